@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "sms/server/bench/bench.h"
+
+extern "C" {
+#include "sms/client/field.h"
+#include "sms/client/sms.h"
+} // extern "C"
+
+namespace bench {
+
+std::atomic<size_t> g_allocations(0);
+extern sms_command_t g_callback;
+
+namespace {
+
+// What sms.c would have made out of the recording: lines without CRLF, each
+// starting a section unless it's a PDU or another +CMGL entry.
+class Recording {
+public:
+    bool Load(const char *filename);
+
+    std::vector<std::string> _texts;
+    std::vector<struct line> _lines;
+    std::vector<struct section> _sections;
+}; // class Recording
+
+bool Recording::Load(const char *filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    std::string text;
+    while (std::getline(file, text)) {
+        if (!text.empty() && text.back() == '\r') {
+            text.pop_back();
+        }
+
+        if (!text.empty()) {
+            _texts.push_back(text);
+        }
+    }
+
+    _lines.resize(_texts.size());
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t i = 0; i < _texts.size(); ++i) {
+        _lines[i].ptr = &_texts[i][0];
+        _lines[i].id = i;
+
+        const std::string &t = _texts[i];
+        const bool named = t[0] == '+' || t[0] == '^' ||
+                           t == "OK" || t == "ERROR";
+
+        const std::string name = t.substr(0, t.find(':'));
+        if (!ranges.empty() && (!named ||
+            (name == "+CMGL" && _sections.back().name == name))) {
+
+            ranges.back().second = i + 1;
+            continue;
+        }
+
+        struct section s;
+        snprintf(s.name, sizeof(s.name), "%s", name.c_str());
+        _sections.push_back(s);
+        ranges.emplace_back(i, i + 1);
+    }
+
+    for (size_t i = 0; i < _sections.size(); ++i) {
+        _sections[i].from = &_lines[ranges[i].first];
+        _sections[i].to = &_lines[ranges[i].second];
+    }
+
+    return !_sections.empty();
+}
+
+bool is_response(const char *name)
+{
+    return strcmp(name, "+CMGR") == 0 || strcmp(name, "+CMGL") == 0;
+}
+
+bool is_urc(const char *name)
+{
+    return (name[0] == '+' || name[0] == '^') && !is_response(name) &&
+           !strstr(name, " ERROR");
+}
+
+// The lookup sms_on_urc did before dispatching on characters.
+const char *const kTable[] = {
+    "^MODE", "^HWNAT", "+CRING", "+CLIP", "^CEND",
+    "^RSSI", "+CMTI", "+CMT", "^NWTIME", "^HCSQ",
+};
+
+const char *lookup(const char *name)
+{
+    for (const char *t : kTable) {
+        if (strcmp(t, name) == 0) {
+            return t;
+        }
+    }
+
+    return nullptr;
+}
+
+void urc(const Recording &r)
+{
+    std::vector<const struct section *> urcs;
+    size_t bytes = 0;
+    for (auto &&s : r._sections) {
+        if (is_urc(s.name)) {
+            urcs.push_back(&s);
+            for (const struct line *l = s.from; l != s.to; ++l) {
+                bytes += strlen(l->ptr) + 2;
+            }
+        }
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "URC/%lu/lookup/table", urcs.size());
+    Measure(name, 0, [&] {
+        for (auto &&s : urcs) {
+            keep(lookup(s->name));
+        }
+    });
+
+    snprintf(name, sizeof(name), "URC/%lu/sms_on_urc", urcs.size());
+    Measure(name, bytes, [&] {
+        for (auto &&s : urcs) {
+            keep(reinterpret_cast<void *>(
+                    static_cast<intptr_t>(sms_on_urc(nullptr, s))));
+        }
+    });
+}
+
+// Replays +CMGR and +CMGL through the callbacks they were read with, OK
+// being the acknowledgement right after.
+void responses(const Recording &r)
+{
+    sms_read_sms(nullptr, 1);
+    const sms_command_t cmgr = g_callback;
+    sms_read_all_sms(nullptr);
+    const sms_command_t cmgl = g_callback;
+
+    std::vector<std::pair<sms_command_t, const struct section *>> replies;
+    size_t bytes = 0;
+    for (size_t i = 0; i + 1 < r._sections.size(); ++i) {
+        const struct section &s = r._sections[i];
+        if (!is_response(s.name) || strcmp(r._sections[i + 1].name, "OK")) {
+            continue;
+        }
+
+        replies.emplace_back(s.name[4] == 'R' ? cmgr : cmgl, &s);
+        for (const struct line *l = s.from; l != s.to; ++l) {
+            bytes += strlen(l->ptr) + 2;
+        }
+    }
+
+    size_t failed = 0;
+    for (auto &&p : replies) {
+        failed += p.first(nullptr, p.second, 2, 1, 0) != 2;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "Responses/%lu/replay", replies.size());
+    Measure(name, bytes, [&] {
+        for (auto &&p : replies) {
+            keep(reinterpret_cast<void *>(
+                    p.first(nullptr, p.second, 2, 1, 0)));
+        }
+    });
+
+    if (failed) {
+        printf("  %lu of the responses were rejected\n", failed);
+    }
+}
+
+// Parameters of the lines handlers parse, with what they're parsed into.
+class Parameters {
+public:
+    int Scan() const;
+    int Split() const;
+
+    std::vector<std::pair<char, const char *>> _values;
+}; // class Parameters
+
+// As the handlers did before.
+int Parameters::Scan() const
+{
+    char number[64];
+    size_t length;
+    int sum = 0;
+    int a, b, c, d;
+
+    for (auto &&v : _values) {
+        const char *p = v.second;
+        switch (v.first) {
+        case 'L':
+            if (sscanf(p, "%d,%d,,%lu", &a, &b, &length) == 3) {
+                sum += a + b + static_cast<int>(length);
+            }
+            break;
+        case 'R':
+            if (sscanf(p, "%d,,%lu", &a, &length) == 2) {
+                sum += a + static_cast<int>(length);
+            }
+            break;
+        case 'I':
+            if (sscanf(p, "\"SM\",%d", &a) == 1) {
+                sum += a;
+            }
+            break;
+        case 'P':
+            if (sscanf(p, "\"%63[^\"]\",%d,,,,%d", number, &a, &b) == 3) {
+                sum += a + b + number[0];
+            }
+            break;
+        case 'E':
+            if (sscanf(p, "%d,%d,%d,%d", &a, &b, &c, &d) == 4) {
+                sum += a + b + c + d;
+            }
+            break;
+        }
+    }
+
+    return sum;
+}
+
+// As the handlers do now.
+int Parameters::Split() const
+{
+    struct field f[6];
+    char number[64];
+    size_t length;
+    int sum = 0;
+    int a, b, c, d;
+
+    for (auto &&v : _values) {
+        const char *p = v.second;
+        switch (v.first) {
+        case 'L':
+            if (field_split(p, f, 4) >= 4 && !field_int(f + 0, &a) &&
+                !field_int(f + 1, &b) && !field_size(f + 3, &length)) {
+                sum += a + b + static_cast<int>(length);
+            }
+            break;
+        case 'R':
+            if (field_split(p, f, 3) >= 3 && !field_int(f + 0, &a) &&
+                !field_size(f + 2, &length)) {
+                sum += a + static_cast<int>(length);
+            }
+            break;
+        case 'I':
+            if (field_split(p, f, 2) >= 2 && field_equals(f + 0, "SM") &&
+                !field_int(f + 1, &a)) {
+                sum += a;
+            }
+            break;
+        case 'P':
+            if (field_split(p, f, 6) >= 6 &&
+                !field_copy(f + 0, number, sizeof(number)) &&
+                !field_int(f + 1, &a) && !field_int(f + 5, &b)) {
+                sum += a + b + number[0];
+            }
+            break;
+        case 'E':
+            if (field_split(p, f, 4) >= 4 && !field_int(f + 0, &a) &&
+                !field_int(f + 1, &b) && !field_int(f + 2, &c) &&
+                !field_int(f + 3, &d)) {
+                sum += a + b + c + d;
+            }
+            break;
+        }
+    }
+
+    return sum;
+}
+
+void fields(const Recording &r)
+{
+    static const struct {
+        const char *prefix;
+        char kind;
+    } kKinds[] = {
+        { "+CMGL:", 'L' }, { "+CMGR:", 'R' }, { "+CMTI:", 'I' },
+        { "+CLIP:", 'P' }, { "^CEND:", 'E' },
+    };
+
+    Parameters parameters;
+    size_t bytes = 0;
+    for (auto &&l : r._lines) {
+        for (auto &&k : kKinds) {
+            if (strncmp(l.ptr, k.prefix, 6) == 0) {
+                const char *p = sms_get_value(l.ptr);
+                parameters._values.emplace_back(k.kind, p);
+                bytes += strlen(p);
+            }
+        }
+    }
+
+    const int scanned = parameters.Scan();
+    const int split = parameters.Split();
+
+    char name[64];
+    snprintf(name, sizeof(name), "Fields/%lu/sscanf",
+             parameters._values.size());
+    Measure(name, bytes, [&] {
+        keep(reinterpret_cast<void *>(
+                static_cast<intptr_t>(parameters.Scan())));
+    });
+
+    snprintf(name, sizeof(name), "Fields/%lu/field_split",
+             parameters._values.size());
+    Measure(name, bytes, [&] {
+        keep(reinterpret_cast<void *>(
+                static_cast<intptr_t>(parameters.Split())));
+    });
+
+    if (scanned != split) {
+        printf("  sscanf and field_split disagree: %d != %d\n",
+               scanned, split);
+    }
+}
+
+} // anonymous namespace
+} // namespace bench
+
+void *operator new(size_t size)
+{
+    bench::g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+// Usage: client-bench recording.txt
+int main(int argc, char *argv[])
+{
+    bench::Recording recording;
+    if (argc < 2 || !recording.Load(argv[1])) {
+        fprintf(stderr, "Usage: %s <recording>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench::urc(recording);
+    bench::responses(recording);
+    bench::fields(recording);
+    return 0;
+}
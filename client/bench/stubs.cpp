@@ -0,0 +1,66 @@
+// Just enough of sms.c and logger.c for huawei.c to run alone: nothing is
+// logged, sent or stored, and the inbox takes whatever it's given.
+
+#include <string.h>
+
+extern "C" {
+#include "sms/client/logger.h"
+#include "sms/client/sms.h"
+} // extern "C"
+
+namespace bench {
+sms_command_t g_callback;
+} // namespace bench
+
+extern "C" {
+
+int logger_fatal(const char *, int, const char *, ...) { return 0; }
+int logger_error(const char *, int, const char *, ...) { return 0; }
+int logger_warn (const char *, int, const char *, ...) { return 0; }
+int logger_info (const char *, int, const char *, ...) { return 0; }
+int logger_trace(const char *, int, const char *, ...) { return 0; }
+int logger_debug(const char *, int, const char *, ...) { return 0; }
+
+char *sms_get_value(const char *s)
+{
+    char *p = const_cast<char *>(strchr(s, ':'));
+    if (!p) {
+        return nullptr;
+    }
+
+    do {
+        ++p;
+    } while (*p == ' ');
+
+    return p;
+}
+
+// Remembers the callback so that responses can be replayed through it.
+int sms_send(struct sms *, enum sms_priority, const char *,
+             sms_command_t callback, int)
+{
+    bench::g_callback = callback;
+    return 0;
+}
+
+int sms_is_waiting(struct sms *, enum sms_priority, const char *)
+{
+    return 0;
+}
+
+int sms_replace(struct sms *, enum sms_priority, const char *, const char *,
+                sms_command_t, int)
+{
+    return 1;
+}
+
+int sms_inbox_prepare(struct sms *, int) { return 0; }
+int sms_inbox_commit(struct sms *, int, const char *) { return 0; }
+int sms_inbox_deliver(struct sms *, const char *) { return 0; }
+int sms_inbox_push(struct sms *, int, const char *, int) { return 0; }
+
+int sms_call_start(struct sms *) { return 0; }
+int sms_call_end(struct sms *, int, int, int, int) { return 0; }
+int sms_call_set_caller(struct sms *, const char *, int, int) { return 0; }
+
+} // extern "C"
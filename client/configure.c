@@ -2,6 +2,7 @@
 
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <flinter/cmdline.h>
@@ -48,17 +49,66 @@ static char *configure_trim(char *s)
     return b;
 }
 
-static int configure_read(FILE *fp, struct configure *c)
+static void configure_free_device(struct configure_device *d)
 {
+    free(d->handshake);
+    free(d->device);
+    free(d->token);
+}
+
+/* A new device inheriting whatever was set before the first one */
+static struct configure_device *configure_add_device(
+        struct configure *c,
+        const struct configure_device *defaults)
+{
+    struct configure_device *devices;
+    struct configure_device *d;
+
+    devices = (struct configure_device *)realloc(
+            c->devices, (c->cdevice + 1) * sizeof(*devices));
+
+    if (!devices) {
+        return NULL;
+    }
+
+    c->devices = devices;
+    d = devices + c->cdevice;
+    memset(d, 0, sizeof(*d));
+    ++c->cdevice;
+
+    d->baudrate = defaults->baudrate;
+    d->direct = defaults->direct;
+    if ((defaults->handshake && !(d->handshake = strdup(defaults->handshake))) ||
+        (defaults->token     && !(d->token     = strdup(defaults->token    )))  ){
+
+        return NULL;
+    }
+
+    return d;
+}
+
+static int configure_set(char **field, const char *value)
+{
+    free(*field);
+    *field = strdup(value);
+    return *field ? 0 : -1;
+}
+
+static int configure_read(
+        FILE *fp,
+        struct configure *c,
+        struct configure_device *defaults)
+{
+    struct configure_device *d;
     char buffer[256];
     unsigned long n;
+    size_t i;
     char *value;
     char *key;
     char *p;
     int ret;
 
-    memset(c, 0, sizeof(*c));
-
+    d = defaults;
     for (;;) {
         ret = configure_read_line(fp, buffer, sizeof(buffer));
         if (ret == -2) {
@@ -80,33 +130,40 @@ static int configure_read(FILE *fp, struct configure *c)
         key = configure_trim(buffer);
         value = configure_trim(p + 1);
 
-        if (strcmp(key, "handshake") == 0) {
-            if (!(c->handshake = strdup(value))) {
+        if (strcmp(key, "device") == 0) {
+            if (!(d = configure_add_device(c, defaults))            ||
+                !(d->device = strdup(value))                        ){
+
                 return -1;
             }
 
-        } else if (strcmp(key, "device") == 0) {
-            if (!(c->device = strdup(value))) {
+        } else if (strcmp(key, "handshake") == 0) {
+            if (configure_set(&d->handshake, value)) {
                 return -1;
             }
 
         } else if (strcmp(key, "token") == 0) {
-            if (!(c->token = strdup(value))) {
+            if (configure_set(&d->token, value)) {
                 return -1;
             }
 
         } else if (strcmp(key, "hostname") == 0) {
-            if (!(c->hostname = strdup(value))) {
+            if (configure_set(&c->hostname, value)) {
                 return -1;
             }
 
         } else if (strcmp(key, "url") == 0) {
-            if (!(c->url = strdup(value))) {
+            if (configure_set(&c->url, value)) {
+                return -1;
+            }
+
+        } else if (strcmp(key, "spool") == 0) {
+            if (configure_set(&c->spool, value)) {
                 return -1;
             }
 
         } else if (strcmp(key, "cainfo") == 0) {
-            if (!(c->cainfo = strdup(value))) {
+            if (configure_set(&c->cainfo, value)) {
                 return -1;
             }
 
@@ -116,29 +173,50 @@ static int configure_read(FILE *fp, struct configure *c)
                 return -1;
             }
 
-            c->baudrate = (int)n;
+            d->baudrate = (int)n;
+
+        } else if (strcmp(key, "delivery") == 0) {
+            if (strcmp(value, "direct") == 0) {
+                d->direct = 1;
+            } else if (strcmp(value, "storage") == 0) {
+                d->direct = 0;
+            } else {
+                return -1;
+            }
         }
     }
 
-    /* hostname and cainfo can be omitted */
-
-    if (!c->baudrate                    ||
-        !c->handshake || !*c->handshake ||
-        !c->device    || !*c->device    ||
-        !c->url       || !*c->url       ||
-        !c->token     || !*c->token     ){
+    /*
+     * hostname and cainfo can be omitted, delivery defaults to storage, and
+     * without spool nothing survives a restart but what's on the SIM. That's
+     * why direct delivery is only honored with a spool.
+     */
 
+    if (!c->cdevice || !c->url || !*c->url) {
         return -1;
     }
 
+    for (i = 0; i < c->cdevice; ++i) {
+        d = c->devices + i;
+        if (!d->baudrate                    ||
+            !d->handshake || !*d->handshake ||
+            !d->device    || !*d->device    ||
+            !d->token     || !*d->token     ){
+
+            return -1;
+        }
+    }
+
     return 0;
 }
 
 struct configure *configure_create(const char *path)
 {
+    struct configure_device defaults;
     struct configure *c;
     char *filename;
     FILE *fp;
+    int ret;
 
     if (!path || !*path) {
         return NULL;
@@ -163,27 +241,35 @@ struct configure *configure_create(const char *path)
     }
 
     memset(c, 0, sizeof(*c));
-    if (configure_read(fp, c)) {
+    memset(&defaults, 0, sizeof(defaults));
+    ret = configure_read(fp, c, &defaults);
+    configure_free_device(&defaults);
+    fclose(fp);
+
+    if (ret) {
         configure_free(c);
-        fclose(fp);
         return NULL;
     }
 
-    fclose(fp);
     return c;
 }
 
 void configure_free(struct configure *c)
 {
+    size_t i;
+
     if (!c) {
         return;
     }
 
-    free(c->handshake);
+    for (i = 0; i < c->cdevice; ++i) {
+        configure_free_device(c->devices + i);
+    }
+
+    free(c->devices);
     free(c->hostname);
-    free(c->device);
     free(c->cainfo);
-    free(c->token);
+    free(c->spool);
     free(c->url);
     free(c);
 }
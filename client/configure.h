@@ -1,15 +1,29 @@
 #ifndef SMS_CONFIGURE_H
 #define SMS_CONFIGURE_H
 
-struct configure {
+#include <stddef.h>
+
+struct configure_device {
     char *handshake;
     char *device;
     int baudrate;
+    int direct;     /* Deliver messages with +CMT rather than +CMTI */
+    char *token;
+};
+
+/*
+ * Each `device` line begins a device, and handshake, baudrate, delivery and
+ * token apply to the last device above them, or to every device below them
+ * if there's none yet. The rest is shared.
+ */
+struct configure {
+    struct configure_device *devices;
+    size_t cdevice;
+    char *spool;    /* Where messages and calls wait to be uploaded */
 
     char *hostname;
     char *url;
     char *cainfo;
-    char *token;
 };
 
 extern struct configure *configure_create(const char *path);
@@ -0,0 +1,115 @@
+#include "field.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+size_t field_split(const char *s, struct field *fields, size_t max)
+{
+    struct field f;
+    const char *p;
+    size_t count;
+
+    for (count = 0;; ++count, ++s) {
+        if (*s == '"') {
+            f.ptr = s + 1;
+            f.quoted = 1;
+            p = strchr(f.ptr, '"');
+            f.length = p ? (size_t)(p - f.ptr) : strlen(f.ptr);
+            s = f.ptr + f.length;
+            for (; *s && *s != ','; ++s);
+
+        } else {
+            f.ptr = s;
+            f.quoted = 0;
+            for (; *s && *s != ','; ++s);
+            f.length = (size_t)(s - f.ptr);
+        }
+
+        if (count < max) {
+            fields[count] = f;
+        }
+
+        if (!*s) {
+            return count + 1;
+        }
+    }
+}
+
+int field_int(const struct field *f, int *value)
+{
+    const char *p;
+    const char *e;
+    long long n;
+    int negative;
+
+    p = f->ptr;
+    e = f->ptr + f->length;
+    negative = 0;
+    if (p < e && (*p == '-' || *p == '+')) {
+        negative = *p++ == '-';
+    }
+
+    if (p == e) {
+        return -1;
+    }
+
+    for (n = 0; p < e; ++p) {
+        if (*p < '0' || *p > '9') {
+            return -1;
+        }
+
+        n = n * 10 + (*p - '0');
+        if (n > (long long)INT_MAX + 1) {
+            return -1;
+        }
+    }
+
+    n = negative ? -n : n;
+    if (n > INT_MAX) {
+        return -1;
+    }
+
+    *value = (int)n;
+    return 0;
+}
+
+int field_size(const struct field *f, size_t *value)
+{
+    const char *p;
+    const char *e;
+    size_t n;
+
+    p = f->ptr;
+    e = f->ptr + f->length;
+    if (p == e) {
+        return -1;
+    }
+
+    for (n = 0; p < e; ++p) {
+        if (*p < '0' || *p > '9' || n > (SIZE_MAX - 9) / 10) {
+            return -1;
+        }
+
+        n = n * 10 + (size_t)(*p - '0');
+    }
+
+    *value = n;
+    return 0;
+}
+
+int field_equals(const struct field *f, const char *s)
+{
+    return strlen(s) == f->length && memcmp(f->ptr, s, f->length) == 0;
+}
+
+int field_copy(const struct field *f, char *buffer, size_t length)
+{
+    if (f->length >= length) {
+        return -1;
+    }
+
+    memcpy(buffer, f->ptr, f->length);
+    buffer[f->length] = '\0';
+    return 0;
+}
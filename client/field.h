@@ -0,0 +1,41 @@
+#ifndef SMS_FIELD_H
+#define SMS_FIELD_H
+
+#include <stddef.h>
+
+/* Points into the line split, quotes excluded, never NUL-terminated */
+struct field {
+    const char *ptr;
+    size_t length;
+    int quoted;
+}; /* struct field */
+
+/*
+ * Splits `s` at commas outside of quotes without copying anything. Returns
+ * how many fields there are, which might be more than `max` filled.
+ */
+extern size_t field_split(
+        const char *s,
+        struct field *fields,
+        size_t max);
+
+/* Decimal with an optional sign, the whole field or -1 */
+extern int field_int(
+        const struct field *f,
+        int *value);
+
+extern int field_size(
+        const struct field *f,
+        size_t *value);
+
+extern int field_equals(
+        const struct field *f,
+        const char *s);
+
+/* NUL-terminated, -1 if it doesn't fit */
+extern int field_copy(
+        const struct field *f,
+        char *buffer,
+        size_t length);
+
+#endif /* SMS_FIELD_H */
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <time.h>
 
+#include "field.h"
 #include "logger.h"
 #include "sms.h"
 
@@ -91,10 +92,12 @@ static ssize_t huawei_on_CMGL(
         struct sms *sms,
         const struct section *sections,
         size_t csection,
-        size_t ack)
+        size_t ack,
+        int argument)
 {
     const struct section *s;
     const struct line *l;
+    struct field f[4];
     char buffer[1024];
     size_t length;
     int index;
@@ -104,6 +107,7 @@ static ssize_t huawei_on_CMGL(
     int n;
 
     (void)csection;
+    (void)argument;
 
     if (ack == 0) {
         return 1; /* Possible */
@@ -129,7 +133,12 @@ static ssize_t huawei_on_CMGL(
 
         LOGI("CMGL: [%s]", p);
 
-        if (sscanf(p, "%d,%d,,%lu", &index, &stat, &length) != 3) {
+        /* <index>,<stat>,[<alpha>],<length> */
+        if (field_split(p, f, 4) < 4        ||
+            field_int(f + 0, &index)        ||
+            field_int(f + 1, &stat)         ||
+            field_size(f + 3, &length)      ){
+
             return -1;
         }
 
@@ -164,10 +173,12 @@ static ssize_t huawei_on_CMGR(
         struct sms *sms,
         const struct section *sections,
         size_t csection,
-        size_t ack)
+        size_t ack,
+        int argument)
 {
     const struct section *s;
     const struct line *l;
+    struct field f[3];
     char buffer[1024];
     size_t length;
     int stat;
@@ -197,7 +208,11 @@ static ssize_t huawei_on_CMGR(
         return -1;
     }
 
-    if (sscanf(p, "%d,,%lu", &stat, &length) != 2) {
+    /* <stat>,[<alpha>],<length> */
+    if (field_split(p, f, 3) < 3        ||
+        field_int(f + 0, &stat)         ||
+        field_size(f + 2, &length)      ){
+
         return -1;
     }
 
@@ -215,10 +230,10 @@ static ssize_t huawei_on_CMGR(
             return -1;
         }
 
-        ret = sms_inbox_commit(sms, buffer);
+        ret = sms_inbox_commit(sms, argument, buffer);
 
     } else {
-        ret = sms_inbox_commit(sms, l->ptr);
+        ret = sms_inbox_commit(sms, argument, l->ptr);
     }
 
     if (ret) {
@@ -234,6 +249,7 @@ static ssize_t huawei_on_CMGR(
 
 static int huawei_on_CMTI(struct sms *sms, const struct section *s)
 {
+    struct field f[2];
     int index;
     char *p;
 
@@ -241,19 +257,67 @@ static int huawei_on_CMTI(struct sms *sms, const struct section *s)
         return -1;
     }
 
-    if (sscanf(p, "\"SM\",%d", &index) != 1) {
+    if (field_split(p, f, 2) < 2        ||
+        !field_equals(f + 0, "SM")      ||
+        field_int(f + 1, &index)        ){
+
         return -1;
     }
 
     LOGI("CMTI: [%s]", p);
 
     if (sms_inbox_prepare(sms, index)) {
-        return 0;
+        return 0; /* Read already, or no room */
     }
 
     return sms_read_sms(sms, index);
 }
 
+/* Not stored, so acknowledged by the inbox once it's been spooled */
+static int huawei_on_CMT(struct sms *sms, const struct section *s)
+{
+    const struct line *l;
+    struct field f[2];
+    char buffer[1024];
+    size_t length;
+    char *p;
+    int ret;
+
+    if (!(p = sms_get_value(s->from->ptr))) {
+        return -1;
+    }
+
+    LOGI("CMT: [%s]", p);
+
+    /* [<alpha>],<length> */
+    if (field_split(p, f, 2) < 2 || field_size(f + 1, &length)) {
+        return -1;
+    }
+
+    l = s->from + 1;
+    if (l == s->to) {
+        return -1;
+    }
+
+    LOGI("CMT: [%s]", l->ptr);
+
+    if (length == strlen(l->ptr) / 2) {
+        buffer[0] = '0';
+        buffer[1] = '0';
+        ret = snprintf(buffer + 2, sizeof(buffer) - 2, "%s", l->ptr);
+        if (ret < 0 || (size_t)ret >= sizeof(buffer) - 2) {
+            return -1;
+        }
+
+        ret = sms_inbox_deliver(sms, buffer);
+
+    } else {
+        ret = sms_inbox_deliver(sms, l->ptr);
+    }
+
+    return ret ? -1 : 0;
+}
+
 static int huawei_on_CRING(struct sms *sms, const struct section *s)
 {
     char *p;
@@ -277,6 +341,7 @@ static int huawei_on_CRING(struct sms *sms, const struct section *s)
 
 static int huawei_on_CLIP(struct sms *sms, const struct section *s)
 {
+    struct field f[6];
     char number[64];
     int validity;
     int type;
@@ -286,19 +351,14 @@ static int huawei_on_CLIP(struct sms *sms, const struct section *s)
         return -1;
     }
 
-    if (p[0] != '\"') {
-        return -1;
-    }
+    /* <number>,<type>,,,,<CLI validity> */
+    if (field_split(p, f, 6) < 6                            ||
+        !f[0].quoted                                        ||
+        field_copy(f + 0, number, sizeof(number))           ||
+        field_int(f + 1, &type)                             ||
+        field_int(f + 5, &validity)                         ){
 
-    if (p[1] == '\"') {
-        number[0] = '\0';
-        if (sscanf(p + 2, ",%d,,,,%d", &type, &validity) != 2) {
-            return -1;
-        }
-    } else {
-        if (sscanf(p, "\"%63[^\"]\",%d,,,,%d", number, &type, &validity) != 3) {
-            return -1;
-        }
+        return -1;
     }
 
     return sms_call_set_caller(sms, number, type, validity);
@@ -306,6 +366,8 @@ static int huawei_on_CLIP(struct sms *sms, const struct section *s)
 
 static int huawei_on_CEND(struct sms *sms, const struct section *s)
 {
+    struct field f[4];
+    size_t n;
     char *p;
 
     int call_x;
@@ -317,80 +379,183 @@ static int huawei_on_CEND(struct sms *sms, const struct section *s)
         return -1;
     }
 
-    if (sscanf(p, "%d,%d,%d,%d", &call_x, &duration, &end_status, &cc_cause) != 4) {
-        if (sscanf(p, "%d,%d,%d", &call_x, &duration, &end_status) != 3) {
-            return -1;
-        }
+    /* <call_x>,<duration>,<end_status>[,<cc_cause>] */
+    n = field_split(p, f, 4);
+    if (n < 3                                   ||
+        field_int(f + 0, &call_x)               ||
+        field_int(f + 1, &duration)             ||
+        field_int(f + 2, &end_status)           ){
+
+        return -1;
+    }
 
+    if (n < 4 || field_int(f + 3, &cc_cause)) {
         cc_cause = 0;
     }
 
     return sms_call_end(sms, call_x, duration, end_status, cc_cause);
 }
 
-static const struct sms_urc_commands {
-    const char *name;
-    sms_urc_command_t command;
-} g_urc_commands[] = {
-    { "^MODE",      NULL                },
-    { "^HWNAT",     NULL                },
-    { "+CRING",     huawei_on_CRING     },
-    { "+CLIP",      huawei_on_CLIP      },
-    { "^CEND",      huawei_on_CEND      },
-    { "^RSSI",      huawei_on_RSSI      },
-    { "+CMTI",      huawei_on_CMTI      },
-    { "^NWTIME",    huawei_on_NWTIME    },
-    { "^HCSQ",      huawei_on_HCSQ      },
-};
+#define URC(n,c) do { name = (n); command = (c); } while (0)
 
+/*
+ * Names are told apart by a character or two at known places, and what's
+ * found is compared once. NULL commands are known but of no interest.
+ */
 int sms_on_urc(struct sms *sms, const struct section *s)
 {
-    const struct sms_urc_commands *handler;
-    const struct sms_urc_commands *p;
+    sms_urc_command_t command;
     const struct line *l;
+    const char *name;
 
-    handler = NULL;
-    for (p = g_urc_commands;
-         p < g_urc_commands + sizeof(g_urc_commands) / sizeof(*g_urc_commands);
-         ++p) {
-
-        if (strcmp(p->name, s->name) == 0) {
-            handler = p;
+    name = NULL;
+    command = NULL;
+    switch (s->name[0]) {
+    case '+':
+        switch (s->name[2]) {
+        case 'R': URC("+CRING",  huawei_on_CRING ); break;
+        case 'L': URC("+CLIP",   huawei_on_CLIP  ); break;
+        case 'M':
+            if (s->name[4] == 'I') {
+                URC("+CMTI",     huawei_on_CMTI  );
+            } else {
+                URC("+CMT",      huawei_on_CMT   );
+            }
             break;
         }
+        break;
+
+    case '^':
+        switch (s->name[1]) {
+        case 'M': URC("^MODE",   NULL            ); break;
+        case 'C': URC("^CEND",   huawei_on_CEND  ); break;
+        case 'R': URC("^RSSI",   huawei_on_RSSI  ); break;
+        case 'N': URC("^NWTIME", huawei_on_NWTIME); break;
+        case 'H':
+            if (s->name[2] == 'W') {
+                URC("^HWNAT",    NULL            );
+            } else {
+                URC("^HCSQ",     huawei_on_HCSQ  );
+            }
+            break;
+        }
+        break;
     }
 
-    if (!handler) {
+    if (!name || strcmp(name, s->name)) {
         LOGT("Unhandled URC:");
         for (l = s->from; l != s->to; ++l) {
             LOGT("%s", l->ptr);
         }
         return 0;
 
-    } else if (!handler->command) {
+    } else if (!command) {
         return 0;
     }
 
-    return handler->command(sms, s);
+    return command(sms, s);
 }
 
+#undef URC
+
 int sms_read_all_sms(struct sms *sms)
 {
     char buffer[32];
     sprintf(buffer, "+CMGL=4");
-    return sms_send(sms, buffer, huawei_on_CMGL);
+    return sms_send(sms, SMS_PRIORITY_HIGH, buffer, huawei_on_CMGL, 0);
+}
+
+static ssize_t huawei_on_CNMI(
+        struct sms *sms,
+        const struct section *sections,
+        size_t csection,
+        size_t ack,
+        int argument)
+{
+    (void)sms;
+    (void)csection;
+
+    if (strcmp(sections[ack].name, "OK")) {
+        LOGW("Delivery not changed: %d: [%s]", argument, sections[ack].name);
+    }
+
+    return 1;
+}
+
+/*
+ * Messages are delivered with +CMT instead of being stored when `direct`,
+ * and +CSMS=1 makes the modem wait for them to be acknowledged.
+ */
+int sms_set_delivery(struct sms *sms, int direct)
+{
+    return sms_send(sms, SMS_PRIORITY_HIGH,
+                    direct ? "+CSMS=1;+CNMI=2,2,0,0,0" : "+CNMI=2,1,0,0,0",
+                    huawei_on_CNMI, direct);
 }
 
+int sms_acknowledge_sms(struct sms *sms)
+{
+    return sms_send(sms, SMS_PRIORITY_URGENT, "+CNMA", NULL, 0);
+}
+
+/*
+ * A message arriving while others are still to be read joins them in one
+ * +CMGL of the unread, instead of a +CMGR each.
+ */
 int sms_read_sms(struct sms *sms, int index)
 {
     char buffer[32];
+    int ret;
+
+    if (sms_is_waiting(sms, SMS_PRIORITY_HIGH, "+CMGL=")) {
+        return 0;
+    }
+
+    ret = sms_replace(sms, SMS_PRIORITY_HIGH, "+CMGR=",
+                      "+CMGL=0", huawei_on_CMGL, 0);
+
+    if (ret <= 0) {
+        return ret;
+    }
+
     sprintf(buffer, "+CMGR=%d", index);
-    return sms_send(sms, buffer, huawei_on_CMGR);
+    return sms_send(sms, SMS_PRIORITY_HIGH, buffer, huawei_on_CMGR, index);
 }
 
-int sms_delete_sms(struct sms *sms, int index)
+/* Chained on as few command lines as possible */
+int sms_delete_sms(
+        struct sms *sms,
+        const int *index,
+        size_t count,
+        size_t *queued)
 {
-    char buffer[32];
-    sprintf(buffer, "+CMGD=%d", index);
-    return sms_send(sms, buffer, NULL);
+    static const size_t kChain = 10;
+    char buffer[128];
+    size_t len;
+    size_t i;
+    size_t j;
+    int ret;
+
+    *queued = 0;
+    for (i = 0; i < count;) {
+        len = 0;
+        for (j = 0; j < kChain && i < count; ++j, ++i) {
+            ret = snprintf(buffer + len, sizeof(buffer) - len,
+                           "%s+CMGD=%d", j ? ";" : "", index[i]);
+
+            if (ret < 0 || (size_t)ret >= sizeof(buffer) - len) {
+                return -1;
+            }
+
+            len += (size_t)ret;
+        }
+
+        if (sms_send(sms, SMS_PRIORITY_LOW, buffer, NULL, 0)) {
+            return -1;
+        }
+
+        *queued = i;
+    }
+
+    return 0;
 }
@@ -2,11 +2,20 @@ extern "C" {
 #include "inbox.h"
 } // extern "C"
 
+#include <sys/eventfd.h>
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <list>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <vector>
 
 #include <flinter/thread/condition.h>
 #include <flinter/thread/fixed_thread_pool.h>
@@ -22,15 +31,19 @@ extern "C" {
 #include "sms.h"
 } // extern "C"
 
+#include "spool.h"
+
 class Call {
 public:
     explicit Call(const struct json_call *call)
             : _ring_start(call->ring_start)
             , _call_start(call->call_start)
             , _call_end(call->call_end)
+            , _token(call->token)
             , _type(call->type)
             , _peer(call->peer)
             , _raw(call->raw)
+            , _sequence(0)
     {
         // Intended left blank
     }
@@ -38,55 +51,220 @@ public:
     const struct timespec _ring_start;
     const struct timespec _call_start;
     const struct timespec _call_end;
+    const std::string _token;
     const std::string _type;
     const std::string _peer;
     const std::string _raw;
+    uint64_t _sequence; // In the spool, or 0
 }; // class Call
 
 class Message {
 public:
-    Message(int index, const struct timespec *when)
-            : _index(index), _when(*when)
+    Message(int device,
+            const std::string &token,
+            int index,
+            const struct timespec *when)
+            : _device(device)
+            , _token(token)
+            , _index(index)
+            , _when(*when)
+            , _sequence(0)
     {
         // Intended left blank
     }
 
+    const int _device; // Attached, or -1 if recovered from the spool
+    const std::string _token;
     const int _index;
     std::string _type;
     std::string _what;
     const struct timespec _when;
+    uint64_t _sequence; // In the spool, or 0 and off the SIM once sent
 
 }; // class Message
 
+namespace {
+
+// Spooled records are either of them, fields laid out as they are in memory.
+const char kMessage = 'M';
+const char kCall = 'C';
+
+// A request is sent once it's this large, whatever is still coming. The
+// server takes up to 1MiB.
+const size_t kBatch = 262144; // 256KiB
+
+// Records arriving less than kBurst apart are a burst, which is waited for
+// until it's quiet for twice as long as they've been apart, and no longer
+// than kLinger since the first one. Lone records and calls never wait.
+const int64_t kBurst = 50000000LL; // 50ms
+const int64_t kQuiet = 1000000LL; // 1ms at least
+const int64_t kLinger = 100000000LL; // 100ms
+
+// Roughly what a record adds to the request, keys and timestamps included.
+size_t cost(const Message &m)
+{
+    return m._token.length() + m._type.length() + m._what.length() + 64;
+}
+
+size_t cost(const Call &c)
+{
+    return c._token.length() + c._type.length() + c._peer.length() +
+           c._raw.length() + 96;
+}
+
+void put(std::string *s, const void *data, size_t length)
+{
+    s->append(static_cast<const char *>(data), length);
+}
+
+void put(std::string *s, const struct timespec &t)
+{
+    const int64_t v[2] = { t.tv_sec, t.tv_nsec };
+    put(s, v, sizeof(v));
+}
+
+void put(std::string *s, const std::string &v)
+{
+    const uint32_t length = static_cast<uint32_t>(v.length());
+    put(s, &length, sizeof(length));
+    s->append(v);
+}
+
+std::string encode(const Message &m)
+{
+    std::string s(1, kMessage);
+    put(&s, m._token);
+    put(&s, m._when);
+    put(&s, m._type);
+    put(&s, m._what);
+    return s;
+}
+
+std::string encode(const Call &c)
+{
+    std::string s(1, kCall);
+    put(&s, c._token);
+    put(&s, c._ring_start);
+    put(&s, c._call_start);
+    put(&s, c._call_end);
+    put(&s, c._type);
+    put(&s, c._peer);
+    put(&s, c._raw);
+    return s;
+}
+
+class Reader {
+public:
+    explicit Reader(const std::string &s) : _s(s), _offset(1) {}
+
+    bool Get(void *data, size_t length)
+    {
+        if (_s.length() - _offset < length) {
+            return false;
+        }
+
+        memcpy(data, _s.data() + _offset, length);
+        _offset += length;
+        return true;
+    }
+
+    bool Get(struct timespec *t)
+    {
+        int64_t v[2];
+        if (!Get(v, sizeof(v))) {
+            return false;
+        }
+
+        t->tv_sec = static_cast<time_t>(v[0]);
+        t->tv_nsec = static_cast<long>(v[1]);
+        return true;
+    }
+
+    bool Get(std::string *v)
+    {
+        uint32_t length;
+        if (!Get(&length, sizeof(length)) || _s.length() - _offset < length) {
+            return false;
+        }
+
+        v->assign(_s, _offset, length);
+        _offset += length;
+        return true;
+    }
+
+private:
+    const std::string &_s;
+    size_t _offset;
+
+}; // class Reader
+
+} // anonymous namespace
+
+// Shared by all devices, with a single thread uploading for them all.
 class Inbox {
 public:
-    Inbox(struct sms *sms, struct http *h);
+    Inbox(struct http *h, const char *spool);
+    ~Inbox();
 
     int HealthCheck();
-    int Commit(const char *what);
-    int Commit(const struct json_call *call);
-    int Prepare(int index, const struct timespec *when);
+    int event() const { return _event; }
+    int Attach(struct sms *sms, const char *token);
+    int Commit(int device, int index, const char *what);
+    int Commit(int device, const struct json_call *call);
+    int Deliver(int device, const char *what, const struct timespec *when);
+    int Prepare(int device, int index, const struct timespec *when);
+    bool available();
 
     bool Initialize();
     void Shutdown();
 
 private:
+    class Device {
+    public:
+        Device(struct sms *sms, const char *token)
+                : _sms(sms), _token(token), _unacknowledged(0)
+        {
+            // Intended left blank
+        }
+
+        struct sms *const _sms;
+        const std::string _token;
+        std::map<int, Message> _incoming; // Notified but not read yet
+        std::set<int> _committed; // Read but not deleted yet
+        std::vector<int> _spooled; // Read and spooled, deleted once synced
+        std::vector<int> _deleting; // Couldn't be queued, tried again
+        size_t _unacknowledged; // Delivered, +CNMA once synced
+
+    }; // class Device
+
     class Worker;
     bool Thread();
+    void Signal();
+    bool Recover(uint64_t sequence, const std::string &record);
+    int Push(Message *message, const char *what);
     bool Send(std::list<Message> *m,
-              std::list<int> *done,
-              std::list<Call> *c) const;
+              std::list<std::pair<int, int>> *done,
+              std::list<Call> *c,
+              std::vector<uint64_t> *spooled,
+              size_t *bytes);
 
-    Message *_incoming;
+    std::vector<Device> _devices; // Main thread only
+    std::unique_ptr<Spool> _spool; // Optional
     struct http *const _h;
-    struct sms *const _sms;
 
-    std::list<int> _done;
+    std::list<std::pair<int, int>> _done; // Device and index
     std::list<Call> _calls;
     std::list<Message> _messages;
+    size_t _bytes; // Cost of _calls and _messages
+    int64_t _arrived; // When the last one of them did
+    int64_t _gap; // After the one before
     flinter::FixedThreadPool _pool;
     flinter::Condition _condition;
     flinter::Mutex _mutex;
+    char *_request; // Worker thread only, grown to fit
+    size_t _capacity;
+    int _event; // Signaled when _done gets more, _available changes or to sync
+    bool _available;
     bool _quit;
 
 }; // class Inbox
@@ -102,79 +280,298 @@ private:
 
 }; // class Inbox::Worker
 
-Inbox::Inbox(struct sms *sms, struct http *h)
-        : _incoming(nullptr), _h(h), _sms(sms), _quit(false)
+Inbox::Inbox(struct http *h, const char *spool)
+        : _spool(spool ? new Spool(spool) : nullptr)
+        , _h(h), _bytes(0), _arrived(0), _gap(kBurst)
+        , _request(nullptr), _capacity(0)
+        , _event(-1), _available(true), _quit(false)
 {
     // Inteneded left blank
 }
 
-int Inbox::Prepare(int index, const struct timespec *when)
+Inbox::~Inbox()
+{
+    free(_request);
+}
+
+int Inbox::Attach(struct sms *sms, const char *token)
+{
+    _devices.emplace_back(sms, token);
+    return static_cast<int>(_devices.size() - 1);
+}
+
+int Inbox::Prepare(int device, int index, const struct timespec *when)
 {
     assert(index > 0);
-    assert(!_incoming);
-    _incoming = new Message(index, when);
+    Device &d = _devices[static_cast<size_t>(device)];
+    if (d._committed.count(index)) {
+        return 1;
+    }
+
+    // Notified again maybe, the first time counts
+    d._incoming.emplace(index, Message(device, d._token, index, when));
     return 0;
 }
 
-int Inbox::Commit(const char *what)
+int Inbox::Commit(int device, int index, const char *what)
+{
+    Device &d = _devices[static_cast<size_t>(device)];
+    auto p = d._incoming.find(index);
+    if (p == d._incoming.end()) {
+        LOGW("Inbox: device=%d index=%d read again, ignored", device, index);
+        return 0;
+    }
+
+    Message m(p->second);
+    d._incoming.erase(p);
+    d._committed.insert(index);
+    return Push(&m, what);
+}
+
+int Inbox::Deliver(int device, const char *what, const struct timespec *when)
 {
-    assert(_incoming);
-    Message &m = *_incoming;
-    _incoming = nullptr;
+    Device &d = _devices[static_cast<size_t>(device)];
+    Message m(device, d._token, 0, when);
+    if (Push(&m, what)) {
+        return -1;
+    }
 
+    // Not acknowledged unless spooled, for the network to deliver it again
+    if (m._sequence) {
+        ++d._unacknowledged;
+    }
+
+    return 0;
+}
+
+int Inbox::Push(Message *message, const char *what)
+{
+    Message &m = *message;
     m._what = what;
     m._type = "Incoming"; // TODO(yiyuanzhong): emmm..
 
-    LOGI("Inbox: time=%ld.%09ld index=%d type=[%s] what=[%s]",
-            m._when.tv_sec, m._when.tv_nsec, m._index,
+    LOGI("Inbox: time=%ld.%09ld device=%d index=%d type=[%s] what=[%s]",
+            m._when.tv_sec, m._when.tv_nsec, m._device, m._index,
             m._type.c_str(), m._what.c_str());
 
+    // Off the SIM once synced, or kept there until sent if it can't be.
+    // Delivered ones are dropped then, as they're never acknowledged.
+    if (_spool) {
+        m._sequence = _spool->Append(encode(m));
+        Signal();
+
+        if (!m._sequence) {
+            LOGW("Inbox: spool is full, index=%d", m._index);
+            if (m._index == 0) {
+                return 0;
+            }
+
+        } else if (m._index > 0) {
+            _devices[static_cast<size_t>(m._device)]._spooled.push_back(m._index);
+        }
+    }
+
+    const int64_t now = get_monotonic_timestamp();
     flinter::MutexLocker locker(&_mutex);
     _messages.push_back(m);
+    _bytes += cost(m);
+    _gap = now - _arrived;
+    _arrived = now;
     _condition.WakeOne();
     return 0;
 }
 
-int Inbox::Commit(const struct json_call *call)
+int Inbox::Commit(int device, const struct json_call *call)
 {
-    Call c(call);
+    struct json_call jc = *call;
+    jc.token = _devices[static_cast<size_t>(device)]._token.c_str();
+
+    Call c(&jc);
+    if (_spool) {
+        c._sequence = _spool->Append(encode(c));
+        if (!c._sequence) {
+            LOGW("Inbox: spool is full, call from [%s]", c._peer.c_str());
+        }
 
+        Signal();
+    }
+
+    const int64_t now = get_monotonic_timestamp();
     flinter::MutexLocker locker(&_mutex);
     _calls.push_back(c);
+    _bytes += cost(c);
+    _gap = now - _arrived;
+    _arrived = now;
     _condition.WakeOne();
     return 0;
 }
 
+// Direct delivery relies on the spool, so it counts as unavailable if full
+bool Inbox::available()
+{
+    flinter::MutexLocker locker(&_mutex);
+    return _available && (!_spool || !_spool->full());
+}
+
 int Inbox::HealthCheck()
 {
-    std::list<int> done;
+    std::list<std::pair<int, int>> done;
+    uint64_t count;
 
-    flinter::MutexLocker locker(&_mutex);
-    if (_done.empty()) {
-        return 0;
+    if (read(_event, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        return -1;
     }
 
+    // Appended by now, durable and safe to delete or acknowledge once synced
+    int ret = 0;
+    if (!_spool || _spool->Sync()) {
+        for (size_t i = 0; i < _devices.size(); ++i) {
+            Device &d = _devices[i];
+            for (auto index : d._spooled) {
+                done.emplace_back(static_cast<int>(i), index);
+            }
+
+            d._spooled.clear();
+            for (; d._unacknowledged; --d._unacknowledged) {
+                if (sms_acknowledge_sms(d._sms)) {
+                    ret = 1;
+                    break;
+                }
+            }
+        }
+
+    } else {
+        ret = 1;
+    }
+
+    flinter::MutexLocker locker(&_mutex);
     done.splice(done.end(), _done);
     locker.Unlock();
 
-    for (auto i : done) {
-        int ret = sms_delete_sms(_sms, i);
-        if (ret) {
-            return ret;
+    std::vector<std::vector<int>> index(_devices.size());
+    for (size_t i = 0; i < _devices.size(); ++i) {
+        index[i].swap(_devices[i]._deleting);
+    }
+
+    for (auto &&p : done) {
+        index[static_cast<size_t>(p.first)].push_back(p.second);
+    }
+
+    // Committed until the delete is queued, so that it's never read again
+    for (size_t i = 0; i < index.size(); ++i) {
+        if (index[i].empty()) {
+            continue;
+        }
+
+        Device &d = _devices[i];
+        size_t queued;
+        sms_delete_sms(d._sms, index[i].data(), index[i].size(), &queued);
+        for (size_t j = 0; j < queued; ++j) {
+            d._committed.erase(index[i][j]);
+        }
+
+        if (queued < index[i].size()) {
+            LOGW("Inbox: device=%d %lu deletes not queued, to be retried",
+                    static_cast<int>(i), index[i].size() - queued);
+
+            d._deleting.assign(index[i].begin() + static_cast<ssize_t>(queued),
+                               index[i].end());
+            ret = 1;
         }
     }
 
-    return 0;
+    return ret;
+}
+
+bool Inbox::Recover(uint64_t sequence, const std::string &record)
+{
+    Reader r(record);
+    std::string token;
+    if (!r.Get(&token)) {
+        return false;
+    }
+
+    if (record[0] == kMessage) {
+        struct timespec when;
+        if (!r.Get(&when)) {
+            return false;
+        }
+
+        Message m(-1, token, 0, &when);
+        if (!r.Get(&m._type) || !r.Get(&m._what)) {
+            return false;
+        }
+
+        m._sequence = sequence;
+        _messages.push_back(m);
+        _bytes += cost(m);
+        return true;
+
+    } else if (record[0] == kCall) {
+        struct json_call jc;
+        std::string type;
+        std::string peer;
+        std::string raw;
+        if (!r.Get(&jc.ring_start)  ||
+            !r.Get(&jc.call_start)  ||
+            !r.Get(&jc.call_end)    ||
+            !r.Get(&type)           ||
+            !r.Get(&peer)           ||
+            !r.Get(&raw)            ){
+
+            return false;
+        }
+
+        jc.token = token.c_str();
+        jc.type = type.c_str();
+        jc.peer = peer.c_str();
+        jc.raw = raw.c_str();
+
+        Call c(&jc);
+        c._sequence = sequence;
+        _calls.push_back(c);
+        _bytes += cost(c);
+        return true;
+    }
+
+    return false;
 }
 
 bool Inbox::Initialize()
 {
+    if (_spool) {
+        std::vector<uint64_t> bad;
+        if (!_spool->Open([this, &bad](uint64_t s, const std::string &r) {
+                if (!Recover(s, r)) {
+                    bad.push_back(s);
+                }
+            })) {
+
+            return false;
+        }
+
+        if (!bad.empty()) {
+            LOGW("Inbox: %lu spooled records not understood", bad.size());
+            _spool->Done(bad);
+        }
+
+        LOGI("Inbox: resuming %lu messages and %lu calls from the spool",
+                _messages.size(), _calls.size());
+    }
+
+    _event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_event < 0) {
+        return false;
+    }
+
     if (!_pool.Initialize(1)) {
+        close(_event);
         return false;
     }
 
     if (!_pool.AppendJob(new Worker(this), true)) {
         _pool.Shutdown();
+        close(_event);
         return false;
     }
 
@@ -189,47 +586,74 @@ void Inbox::Shutdown()
     locker.Unlock();
 
     _pool.Shutdown();
+
+    if (_event >= 0) {
+        close(_event);
+        _event = -1;
+    }
 }
 
+// Calls first, then messages, as many as fit in kBatch but at least one.
 bool Inbox::Send(
         std::list<Message> *m,
-        std::list<int> *done,
-        std::list<Call> *c) const
+        std::list<std::pair<int, int>> *done,
+        std::list<Call> *c,
+        std::vector<uint64_t> *spooled,
+        size_t *bytes)
 {
-    struct json_call jc[20];
-    struct json_sms js[20];
-    size_t i;
-    size_t j;
+    std::vector<struct json_call> jc;
+    std::vector<struct json_sms> js;
+    size_t total = 0;
 
-    auto ps = m->begin();
-    for (i = 0; i < sizeof(js) / sizeof(*js) && ps != m->end(); ++i, ++ps) {
-        memset(js + i, 0, sizeof(*js));
-        js[i].type = ps->_type.c_str();
-        js[i].pdu = ps->_what.c_str();
-        js[i].when = ps->_when;
+    auto pc = c->begin();
+    for (; pc != c->end(); ++pc) {
+        const size_t n = cost(*pc);
+        if (total && total + n > kBatch) {
+            break;
+        }
+
+        struct json_call j;
+        memset(&j, 0, sizeof(j));
+        j.ring_start = pc->_ring_start;
+        j.call_start = pc->_call_start;
+        j.call_end = pc->_call_end;
+        j.token = pc->_token.c_str();
+        j.type = pc->_type.c_str();
+        j.peer = pc->_peer.c_str();
+        j.raw = pc->_raw.c_str();
+        jc.push_back(j);
+        total += n;
     }
 
-    auto pc = c->begin();
-    for (j = 0; j < sizeof(jc) / sizeof(*jc) && pc != c->end(); ++j, ++pc) {
-        memset(jc + j, 0, sizeof(*jc));
-        jc[j].ring_start = pc->_ring_start;
-        jc[j].call_start = pc->_call_start;
-        jc[j].call_end = pc->_call_end;
-        jc[j].type = pc->_type.c_str();
-        jc[j].peer = pc->_peer.c_str();
-        jc[j].raw = pc->_raw.c_str();
+    auto ps = m->begin();
+    for (; ps != m->end(); ++ps) {
+        const size_t n = cost(*ps);
+        if (total && total + n > kBatch) {
+            break;
+        }
+
+        struct json_sms j;
+        memset(&j, 0, sizeof(j));
+        j.token = ps->_token.c_str();
+        j.type = ps->_type.c_str();
+        j.pdu = ps->_what.c_str();
+        j.when = ps->_when;
+        js.push_back(j);
+        total += n;
     }
 
-    LOGI("Inbox: sending %lu messages and %lu calls", i, j);
+    LOGI("Inbox: sending %lu messages and %lu calls, about %lu bytes",
+            js.size(), jc.size(), total);
+
+    if (json_encode(js.data(), js.size(), jc.data(), jc.size(),
+                    &_request, &_capacity)) {
 
-    char request[16384];
-    if (json_encode(js, i, jc, j, request, sizeof(request))) {
         return false;
     }
 
     int status;
     char response[64];
-    if (http_perform(_h, request, &status, response, sizeof(response))) {
+    if (http_perform(_h, _request, &status, response, sizeof(response))) {
         return false;
     }
 
@@ -247,12 +671,23 @@ bool Inbox::Send(
     }
 
     for (auto q = m->begin(); q != ps; ++q) {
-        done->push_back(q->_index);
+        if (q->_sequence) {
+            spooled->push_back(q->_sequence);
+        } else if (q->_index > 0) {
+            done->emplace_back(q->_device, q->_index);
+        }
+    }
+
+    for (auto q = c->begin(); q != pc; ++q) {
+        if (q->_sequence) {
+            spooled->push_back(q->_sequence);
+        }
     }
 
     m->erase(m->begin(), ps);
     c->erase(c->begin(), pc);
-    LOGT("Inbox: sent %lu messages and %lu calls", i, j);
+    *bytes -= std::min(*bytes, total);
+    LOGT("Inbox: sent %lu messages and %lu calls", js.size(), jc.size());
     return true;
 }
 
@@ -260,23 +695,43 @@ bool Inbox::Thread()
 {
     constexpr int64_t kRetry = 15000000000LL; // 15s
 
+    std::list<std::pair<int, int>> done;
+    std::vector<uint64_t> spooled;
     std::list<Message> m;
-    std::list<int> done;
     std::list<Call> c;
 
     size_t tries = 0;
+    size_t bytes = 0;
+    int64_t linger = -1;
     int64_t schedule = -1;
     flinter::MutexLocker locker(&_mutex);
     while (!_quit) {
         c.splice(c.end(), _calls);
         m.splice(m.end(), _messages);
+        bytes += _bytes;
+        _bytes = 0;
 
         const int64_t now = get_monotonic_timestamp();
         if (schedule < 0) {
             if (m.empty() && c.empty()) {
+                linger = -1;
                 _condition.Wait(&_mutex);
                 continue;
             }
+
+            // A burst goes out as one request, a lone one right away
+            if (c.empty() && bytes < kBatch && _gap < kBurst) {
+                if (linger < 0) {
+                    linger = now + kLinger;
+                }
+
+                const int64_t quiet = std::max(_gap * 2, kQuiet);
+                const int64_t until = std::min(_arrived + quiet, linger);
+                if (until > now) {
+                    _condition.Wait(&_mutex, until - now);
+                    continue;
+                }
+            }
         } else {
             const int64_t diff = schedule - now;
             if (diff > 0) {
@@ -287,9 +742,17 @@ bool Inbox::Thread()
 
         locker.Unlock();
 
+        bool reclaimed = false;
+        linger = -1;
         schedule = -1;
-        if (Send(&m, &done, &c)) {
+        if (Send(&m, &done, &c, &spooled, &bytes)) {
             tries = 0;
+            if (!spooled.empty()) {
+                const bool full = _spool->full();
+                _spool->Done(spooled);
+                reclaimed = full && !_spool->full();
+                spooled.clear();
+            }
 
         } else {
             ++tries;
@@ -297,21 +760,34 @@ bool Inbox::Thread()
             schedule = get_monotonic_timestamp() + kRetry;
         }
 
+        const bool available = tries == 0;
         locker.Relock();
-        _done.splice(_done.end(), done);
+        if (!done.empty() || available != _available || reclaimed) {
+            _done.splice(_done.end(), done);
+            _available = available;
+            Signal();
+        }
     }
 
     return true;
 }
 
+void Inbox::Signal()
+{
+    const uint64_t one = 1;
+    if (write(_event, &one, sizeof(one)) < 0) {
+        LOGW("Inbox: failed to signal: %d: %s", errno, strerror(errno));
+    }
+}
+
 bool Inbox::Worker::Run()
 {
     return _inbox->Thread();
 }
 
-struct inbox *inbox_initialize(struct sms *sms, struct http *h)
+struct inbox *inbox_initialize(struct http *h, const char *spool)
 {
-    Inbox *const inbox = new Inbox(sms, h);
+    Inbox *const inbox = new Inbox(h, spool);
     if (!inbox->Initialize()) {
         delete inbox;
         return nullptr;
@@ -327,22 +803,54 @@ void inbox_shutdown(struct inbox *ptr)
     delete inbox;
 }
 
-int inbox_prepare(struct inbox *ptr, int index, const struct timespec *when)
+int inbox_attach(struct inbox *ptr, struct sms *sms, const char *token)
+{
+    Inbox *const inbox = reinterpret_cast<Inbox *>(ptr);
+    return inbox->Attach(sms, token);
+}
+
+int inbox_prepare(
+        struct inbox *ptr,
+        int device,
+        int index,
+        const struct timespec *when)
+{
+    Inbox *const inbox = reinterpret_cast<Inbox *>(ptr);
+    return inbox->Prepare(device, index, when);
+}
+
+int inbox_commit(struct inbox *ptr, int device, int index, const char *what)
+{
+    Inbox *const inbox = reinterpret_cast<Inbox *>(ptr);
+    return inbox->Commit(device, index, what);
+}
+
+int inbox_deliver(
+        struct inbox *ptr,
+        int device,
+        const char *what,
+        const struct timespec *when)
+{
+    Inbox *const inbox = reinterpret_cast<Inbox *>(ptr);
+    return inbox->Deliver(device, what, when);
+}
+
+int inbox_is_available(struct inbox *ptr)
 {
     Inbox *const inbox = reinterpret_cast<Inbox *>(ptr);
-    return inbox->Prepare(index, when);
+    return inbox->available() ? 1 : 0;
 }
 
-int inbox_commit(struct inbox *ptr, const char *what)
+int inbox_call(struct inbox *ptr, int device, const struct json_call *call)
 {
     Inbox *const inbox = reinterpret_cast<Inbox *>(ptr);
-    return inbox->Commit(what);
+    return inbox->Commit(device, call);
 }
 
-int inbox_call(struct inbox *ptr, const struct json_call *call)
+int inbox_get_event(struct inbox *ptr)
 {
     Inbox *const inbox = reinterpret_cast<Inbox *>(ptr);
-    return inbox->Commit(call);
+    return inbox->event();
 }
 
 int inbox_health_check(struct inbox *ptr)
@@ -8,15 +8,34 @@ struct inbox;
 struct json_call;
 struct sms;
 
+/* Shared by devices, each attached with the token to upload with */
 extern void inbox_shutdown(struct inbox *inbox);
-extern int inbox_health_check(struct inbox *inbox);
-extern int inbox_commit(struct inbox *inbox, const char *what);
-extern struct inbox *inbox_initialize(struct sms *sms, struct http *h);
-extern int inbox_call(struct inbox *inbox, const struct json_call *call);
+extern int inbox_health_check(struct inbox *inbox); /* 1 if it's to be retried */
+extern int inbox_get_event(struct inbox *inbox); /* Readable when worth checking */
+extern int inbox_is_available(struct inbox *inbox); /* Uploads and spooling go through */
+extern int inbox_attach(struct inbox *inbox, struct sms *sms, const char *token);
+extern int inbox_commit(struct inbox *inbox, int device, int index, const char *what);
+extern int inbox_call(struct inbox *inbox, int device, const struct json_call *call);
+
+/* Kept in memory only if `spool` is NULL */
+extern struct inbox *inbox_initialize(
+        struct http *h,
+        const char *spool);
 
 extern int inbox_prepare(
         struct inbox *inbox,
+        int device,
         int index,
         const struct timespec *when);
 
+/*
+ * Never stored, nothing to delete but acknowledged with +CNMA once spooled,
+ * or dropped for the network to deliver again if it can't be.
+ */
+extern int inbox_deliver(
+        struct inbox *inbox,
+        int device,
+        const char *what,
+        const struct timespec *when);
+
 #endif /* SMS_INBOX_H */
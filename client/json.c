@@ -1,16 +1,11 @@
 #include "json.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "parson.h"
 
-static const char *g_token;
-
-void json_set_token(const char *token)
-{
-    g_token = token;
-}
-
 int json_decode(const char *result, int *ret)
 {
     JSON_Value *root_value;
@@ -41,8 +36,8 @@ int json_encode(
         size_t sms_count,
         const struct json_call *calls,
         size_t call_count,
-        void *buffer,
-        size_t length)
+        char **buffer,
+        size_t *capacity)
 {
     JSON_Value *root_value;
     JSON_Value *call_value;
@@ -50,9 +45,17 @@ int json_encode(
     JSON_Object *root;
     JSON_Array *call;
     JSON_Array *pdu;
+    const char *token;
+    size_t length;
+    char *p;
 
     size_t i;
 
+    token = sms_count ? sms->token : call_count ? calls->token : NULL;
+    if (!token) {
+        return -1;
+    }
+
     root_value = json_value_init_object();
     root = json_value_get_object(root_value);
 
@@ -73,6 +76,9 @@ int json_encode(
         json_object_set_string(obj, "timestamp", timestamp);
         json_object_set_string(obj, "type", m->type);
         json_object_set_string(obj, "pdu", m->pdu);
+        if (strcmp(m->token, token)) {
+            json_object_set_string(obj, "token", m->token);
+        }
 
         if (!pdu) {
             pdu_value = json_value_init_array();
@@ -107,6 +113,9 @@ int json_encode(
         json_object_set_string(obj, "peer", c->peer);
         json_object_set_string(obj, "type", c->type);
         json_object_set_string(obj, "raw", c->raw);
+        if (strcmp(c->token, token)) {
+            json_object_set_string(obj, "token", c->token);
+        }
 
         if (!call) {
             call_value = json_value_init_array();
@@ -116,7 +125,7 @@ int json_encode(
         json_array_append_value(call, value);
     }
 
-    json_object_set_string(root, "token", g_token);
+    json_object_set_string(root, "token", token);
 
     if (pdu_value) {
         json_object_set_value(root, "pdu", pdu_value);
@@ -126,7 +135,24 @@ int json_encode(
         json_object_set_value(root, "call", call_value);
     }
 
-    if (json_serialize_to_buffer(root_value, buffer, length)) {
+    length = json_serialization_size(root_value);
+    if (!length) {
+        json_value_free(root_value);
+        return -1;
+    }
+
+    if (length > *capacity) {
+        p = (char *)realloc(*buffer, length);
+        if (!p) {
+            json_value_free(root_value);
+            return -1;
+        }
+
+        *buffer = p;
+        *capacity = length;
+    }
+
+    if (json_serialize_to_buffer(root_value, *buffer, *capacity)) {
         json_value_free(root_value);
         return -1;
     }
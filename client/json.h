@@ -6,6 +6,7 @@
 
 struct json_sms {
     struct timespec when;
+    const char *token;  /* Of the device */
     const char *type;
     const char *pdu;
 }; /* struct json_sms */
@@ -14,25 +15,28 @@ struct json_call {
     struct timespec ring_start;
     struct timespec call_start;
     struct timespec call_end;
+    const char *token;  /* Of the device */
     const char *type;
     const char *peer;
     const char *raw;
 }; /* struct json_call */
 
-/* Life span not taken */
-extern void json_set_token(
-        const char *token);
-
 extern int json_decode(
         const char *result,
         int *ret);
 
+/*
+ * Records of devices other than the first one's carry their own token, so
+ * that a batch from one device looks just like it did before. `*buffer` of
+ * `*capacity` bytes is realloc()ed if the request doesn't fit, and can be
+ * kept for the next time.
+ */
 extern int json_encode(
         const struct json_sms *sms,
         size_t sms_count,
         const struct json_call *calls,
         size_t call_count,
-        void *buffer,
-        size_t length);
+        char **buffer,
+        size_t *capacity);
 
 #endif /* SMS_JSON_H */
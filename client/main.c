@@ -14,7 +14,7 @@
 
 #include "configure.h"
 #include "http.h"
-#include "json.h"
+#include "inbox.h"
 #include "logger.h"
 #include "sms.h"
 
@@ -39,8 +39,13 @@ static int initialize_signals(void)
 
 static int callback(int argc, char *argv[])
 {
+    const struct configure_device *d;
     struct configure *c;
+    struct inbox *inbox;
+    struct sms **sms;
     struct http *h;
+    size_t i;
+    int ret;
 
     (void)argc;
     (void)argv;
@@ -58,7 +63,6 @@ static int callback(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    json_set_token(c->token);
     if (initialize_signals()) {
         LOGE("Failed to initialize signals: %d: %s", errno, strerror(errno));
         configure_free(c);
@@ -81,23 +85,51 @@ static int callback(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    struct sms *const sms = sms_open(c->device, c->baudrate, h);
-    if (!sms) {
-        LOGE("Failed to open device [%s] baudrate=%d: %d: %s",
-                c->device, c->baudrate, errno, strerror(errno));
-
+    /* One uploader for all devices */
+    inbox = inbox_initialize(h, c->spool);
+    if (!inbox) {
+        LOGE("Failed to initialize inbox");
         http_close(h);
         configure_free(c);
         logger_shutdown();
         return EXIT_FAILURE;
     }
 
-    LOGI("RUNNING");
+    sms = (struct sms **)calloc(c->cdevice, sizeof(*sms));
+    ret = sms ? 0 : -1;
+    for (i = 0; !ret && i < c->cdevice; ++i) {
+        d = c->devices + i;
+        sms[i] = sms_open(d->device, d->baudrate, inbox, d->token);
+        if (!sms[i]) {
+            LOGE("Failed to open device [%s] baudrate=%d: %d: %s",
+                    d->device, d->baudrate, errno, strerror(errno));
+
+            ret = -1;
+        }
+    }
+
+    /* Acknowledged with +CNMA, direct messages are nowhere but the spool */
+    for (i = 0; !ret && i < c->cdevice; ++i) {
+        d = c->devices + i;
+        if (d->direct && !c->spool) {
+            LOGW("Direct delivery needs a spool, [%s] stays in storage", d->device);
+        }
+
+        ret = sms_start(sms[i], d->handshake, d->direct && c->spool);
+    }
 
-    int ret = sms_run(sms, c->handshake);
+    if (!ret) {
+        LOGI("RUNNING: %lu devices", c->cdevice);
+        ret = sms_run(sms, c->cdevice, inbox);
+    }
 
     LOGI("QUIT");
-    sms_close(sms);
+    inbox_shutdown(inbox);
+    for (i = 0; sms && i < c->cdevice; ++i) {
+        sms_close(sms[i]);
+    }
+
+    free(sms);
     http_close(h);
     http_shutdown();
     configure_free(c);
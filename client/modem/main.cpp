@@ -0,0 +1,389 @@
+#include <dirent.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sms/client/modem/modem.h"
+#include "sms/client/modem/sink.h"
+#include "sms/client/modem/tracker.h"
+
+// Runs the client against a simulated modem and a stand-in smsd, then tells
+// how long it takes from a URC to its upload, and how much CPU the client
+// spends per message. Traffic starts when the client has listed the storage
+// after its handshake, and runs for a while; then what's outstanding is given
+// some time to arrive.
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+class Options {
+public:
+    Options() : port(8081)
+              , seconds(10)
+              , drain(5)
+              , pid(0) {}
+
+    struct sockaddr_in address;
+    uint16_t port;
+    std::string link;
+    int seconds;
+    int drain;          // Seconds to wait for outstanding uploads
+    pid_t pid;          // Client to measure, with its descendants
+    Modem::Options modem;
+}; // class Options
+
+// Nanoseconds on CPU of every thread of `pid`, or from its ticks when there
+// are no scheduler statistics.
+uint64_t process_cpu(pid_t pid, unsigned long long ticks)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+
+    uint64_t total = 0;
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char stat[512];
+        snprintf(stat, sizeof(stat), "%s/%s/schedstat", path, entry->d_name);
+        FILE *fp = fopen(stat, "r");
+        if (!fp) {
+            closedir(dir);
+            return ticks * 1000000000ULL /
+                   static_cast<unsigned long long>(sysconf(_SC_CLK_TCK));
+        }
+
+        unsigned long long ns;
+        if (fscanf(fp, "%llu", &ns) == 1) {
+            total += ns;
+        }
+
+        fclose(fp);
+    }
+
+    closedir(dir);
+    return total;
+}
+
+// Seconds of CPU spent by `root` and every descendant still alive.
+double cpu_seconds(pid_t root)
+{
+    std::map<pid_t, pid_t> parents;
+    std::map<pid_t, unsigned long long> ticks;
+
+    DIR *dir = opendir("/proc");
+    if (!dir) {
+        return 0;
+    }
+
+    while (struct dirent *entry = readdir(dir)) {
+        const pid_t pid = static_cast<pid_t>(atoi(entry->d_name));
+        if (pid <= 0) {
+            continue;
+        }
+
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        FILE *fp = fopen(path, "r");
+        if (!fp) {
+            continue;
+        }
+
+        char buffer[1024];
+        const size_t length = fread(buffer, 1, sizeof(buffer) - 1, fp);
+        fclose(fp);
+        buffer[length] = '\0';
+
+        // The command name can have anything in it, fields follow the last
+        // parenthesis: state, ppid, and utime and stime as 12th and 13th.
+        const char *p = strrchr(buffer, ')');
+        int ppid;
+        unsigned long long utime, stime;
+        if (!p || sscanf(p + 1, " %*c %d %*s %*s %*s %*s %*s %*s %*s %*s %*s "
+                                "%llu %llu", &ppid, &utime, &stime) != 3) {
+            continue;
+        }
+
+        parents[pid] = ppid;
+        ticks[pid] = utime + stime;
+    }
+
+    closedir(dir);
+
+    uint64_t total = 0;
+    for (auto &&t : ticks) {
+        for (pid_t p = t.first; p > 0;) {
+            if (p == root) {
+                total += process_cpu(t.first, t.second);
+                break;
+            }
+
+            auto i = parents.find(p);
+            p = i == parents.end() ? 0 : i->second;
+        }
+    }
+
+    return static_cast<double>(total) / 1000000000.0;
+}
+
+double percentile(const std::vector<int64_t> &l, double p)
+{
+    if (l.empty()) {
+        return 0;
+    }
+
+    const size_t i = std::min(l.size() - 1, static_cast<size_t>(p * l.size()));
+    return static_cast<double>(l[i]) / 1000.0;
+}
+
+void report_latency(const char *name, std::vector<int64_t> l)
+{
+    std::sort(l.begin(), l.end());
+    printf("%-10s %zu, p50 %.3fms p99 %.3fms p999 %.3fms max %.3fms\n",
+           name, l.size(), percentile(l, 0.5), percentile(l, 0.99),
+           percentile(l, 0.999),
+           l.empty() ? 0.0 : static_cast<double>(l.back()) / 1000.0);
+}
+
+void report(const Modem::Stats &m,
+            const Tracker::Summary &t,
+            double seconds,
+            double cpu)
+{
+    printf("generated  %zu messages in %zu PDUs and %zu calls in %.1fs, "
+           "%zu PDUs held for full storage, %zu delivered with +CMT\n",
+           m._messages, m._parts, m._calls, seconds, m._held, m._delivered);
+
+    printf("commands   %zu +CMGR, %zu +CMGL, %zu +CMGD, %zu +CNMA, %zu others, "
+           "%zu of empty slots, in %zu command lines\n",
+           m._cmgr, m._cmgl, m._cmgd, m._cnma, m._others, m._missing,
+           m._lines);
+
+    printf("uploads    %zu, %zu duplicates, %zu unknown, %zu outstanding\n",
+           t._uploads, t._duplicates, t._unknown, t._outstanding);
+
+    report_latency("messages", t._messages);
+    report_latency("calls", t._calls);
+
+    const size_t handled = t._messages.size() + t._calls.size();
+    if (cpu >= 0) {
+        printf("cpu        %.3fs, %.1fus per message\n", cpu,
+               handled ? cpu * 1000000.0 / static_cast<double>(handled) : 0.0);
+    }
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [command...]\n"
+            "\n"
+            "Runs `command`, the client presumably, and measures it. Set up\n"
+            "its configure with the device and url printed, and keep it in\n"
+            "the foreground. Otherwise use -P to measure a running one.\n"
+            "\n"
+            "  -l path     symbolic link to the pty, to name it in sms.conf\n"
+            "  -a ip:port  where to accept uploads, defaults to 127.0.0.1:8081\n"
+            "  -P pid      measure CPU of pid and its descendants\n"
+            "  -r rate     messages per second, defaults to 1\n"
+            "  -B burst    messages arriving at once, defaults to 1\n"
+            "  -c rate     calls per second, defaults to 0\n"
+            "  -g ms       between rings of a call, defaults to 1000\n"
+            "  -n seconds  between ^RSSI/^HCSQ/^NWTIME, defaults to 10, 0 for none\n"
+            "  -L ms[:ms]  response latency and jitter, defaults to 10\n"
+            "  -f bytes    largest write, defaults to 0 for whole responses\n"
+            "  -F us       between fragments, defaults to 1000\n"
+            "  -S slots    message storage, defaults to 100\n"
+            "  -m percent  concatenated messages, defaults to 20\n"
+            "  -u percent  UCS-2 messages, defaults to 30\n"
+            "  -T seconds  how long to generate traffic, defaults to 10\n"
+            "  -W seconds  how long to wait for outstanding uploads, defaults to 5\n"
+            "  -s seed     random seed, defaults to 1\n",
+            argv0);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    std::string ip = "127.0.0.1";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+l:a:P:r:B:c:g:n:L:f:F:S:m:u:T:W:s:h")) != -1) {
+        switch (opt) {
+        case 'l': options.link = optarg;                                 break;
+        case 'P': options.pid = static_cast<pid_t>(atoi(optarg));        break;
+        case 'r': options.modem.rate = atof(optarg);                     break;
+        case 'B': options.modem.burst = strtoul(optarg, nullptr, 10);    break;
+        case 'c': options.modem.calls = atof(optarg);                    break;
+        case 'g': options.modem.ring = atoi(optarg);                     break;
+        case 'n': options.modem.status = atoi(optarg);                   break;
+        case 'f': options.modem.fragment = strtoul(optarg, nullptr, 10); break;
+        case 'F': options.modem.gap = atoi(optarg);                      break;
+        case 'S': options.modem.slots = strtoul(optarg, nullptr, 10);    break;
+        case 'm': options.modem.traffic.multipart = atoi(optarg);        break;
+        case 'u': options.modem.traffic.ucs2 = atoi(optarg);             break;
+        case 'T': options.seconds = atoi(optarg);                        break;
+        case 'W': options.drain = atoi(optarg);                          break;
+        case 's': options.modem.traffic.seed = static_cast<unsigned>(atoi(optarg)); break;
+        case 'a':
+            ip = optarg;
+            if (ip.find(':') != std::string::npos) {
+                options.port = static_cast<uint16_t>(atoi(ip.c_str() + ip.find(':') + 1));
+                ip.resize(ip.find(':'));
+            }
+            break;
+        case 'L': {
+            char *end;
+            options.modem.latency = static_cast<int>(strtol(optarg, &end, 10));
+            options.modem.jitter = *end == ':' ? atoi(end + 1) : 0;
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!options.modem.burst || !options.modem.slots || options.seconds <= 0 ||
+        options.modem.latency < 0 || options.modem.jitter < 0 ||
+        options.modem.ring < 0 || options.modem.gap < 0) {
+
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    memset(&options.address, 0, sizeof(options.address));
+    options.address.sin_family = AF_INET;
+    options.address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, ip.c_str(), &options.address.sin_addr) != 1) {
+        fprintf(stderr, "modem: bad address [%s]\n", ip.c_str());
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    Tracker tracker;
+    Sink sink(options.address, &tracker);
+    if (!sink.Listen()) {
+        perror("modem: listen");
+        return EXIT_FAILURE;
+    }
+
+    Modem modem(options.modem, &tracker);
+    if (!modem.Open(options.link)) {
+        perror("modem: pty");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "modem: device=%s url=http://%s:%u/\n",
+            options.link.empty() ? modem.path().c_str() : options.link.c_str(),
+            ip.c_str(), options.port);
+
+    pid_t child = 0;
+    if (optind < argc) {
+        child = fork();
+        if (child < 0) {
+            perror("modem: fork");
+            return EXIT_FAILURE;
+        } else if (child == 0) {
+            signal(SIGPIPE, SIG_DFL);
+            execvp(argv[optind], argv + optind);
+            perror("modem: exec");
+            _exit(EXIT_FAILURE);
+        }
+
+        options.pid = child;
+    }
+
+    std::atomic<bool> generating(false);
+    std::atomic<bool> quit(false);
+    std::thread sinker([&] { sink.Run(quit); });
+    std::thread modeming([&] { modem.Run(generating, quit); });
+
+    while (!modem.ready()) {
+        if (child && waitpid(child, nullptr, WNOHANG) == child) {
+            fprintf(stderr, "modem: client exited before getting ready\n");
+            child = 0;
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    double seconds = 0;
+    double cpu = -1;
+    if (modem.ready()) {
+        fprintf(stderr, "modem: client ready, generating for %ds\n",
+                options.seconds);
+
+        const double before = options.pid ? cpu_seconds(options.pid) : 0;
+        generating = true;
+
+        const auto start = clock::now();
+        const auto deadline = start + std::chrono::seconds(options.seconds);
+        size_t last = 0;
+        for (auto now = clock::now(); now < deadline; now = clock::now()) {
+            if (child && waitpid(child, nullptr, WNOHANG) == child) {
+                fprintf(stderr, "modem: client exited\n");
+                options.pid = 0;
+                child = 0;
+                break;
+            }
+
+            std::this_thread::sleep_until(std::min(
+                    deadline, now + std::chrono::seconds(1)));
+
+            const size_t uploaded = tracker.uploaded();
+            fprintf(stderr, "modem: %zu uploaded/s, %zu outstanding\n",
+                    uploaded - last, tracker.outstanding());
+
+            last = uploaded;
+        }
+
+        generating = false;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+        const auto drain = clock::now() + std::chrono::seconds(options.drain);
+        while ((tracker.outstanding() || modem.holding()) &&
+               clock::now() < drain) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        if (options.pid) {
+            cpu = cpu_seconds(options.pid) - before;
+        }
+    }
+
+    if (child) {
+        kill(child, SIGTERM);
+        waitpid(child, nullptr, 0);
+    }
+
+    quit = true;
+    modeming.join();
+    sinker.join();
+
+    report(modem.stats(), tracker.Summarize(), seconds, cpu);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,575 @@
+#include "sms/client/modem/modem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "sms/client/modem/tracker.h"
+
+namespace {
+
+// Whatever the client can't tell from a real one.
+const char kRssi[] = "\r\n^RSSI: 20\r\n";
+const char kHcsq[] = "\r\n^HCSQ: \"LTE\",48,40,140,22\r\n";
+
+// Octets of TPDU in a hex PDU starting with the SMSC address, as +CMGR and
+// +CMGL report the length.
+size_t tpdu_length(const std::string &pdu)
+{
+    const size_t smsc = strtoul(pdu.substr(0, 2).c_str(), nullptr, 16);
+    return pdu.length() / 2 - smsc - 1;
+}
+
+} // anonymous namespace
+
+Modem::Modem(const Options &options, Tracker *tracker)
+        : _options(options)
+        , _tracker(tracker)
+        , _traffic(options.traffic)
+        , _random(options.traffic.seed)
+        , _reference(0)
+        , _caller(0)
+        , _master(-1)
+        , _slave(-1)
+        , _ready(false)
+        , _started(false)
+        , _echo(true)
+        , _calling(false)
+        , _slots(options.slots)
+        , _holding(0)
+        , _direct(false)
+        , _acknowledging(false)
+        , _freed(0)
+{
+    // Intended left blank
+}
+
+Modem::~Modem()
+{
+    if (!_link.empty()) {
+        unlink(_link.c_str());
+    }
+
+    if (_slave >= 0) {
+        close(_slave);
+    }
+
+    if (_master >= 0) {
+        close(_master);
+    }
+}
+
+bool Modem::Open(const std::string &link)
+{
+    _master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (_master < 0 || grantpt(_master) || unlockpt(_master)) {
+        return false;
+    }
+
+    const char *path = ptsname(_master);
+    if (!path) {
+        return false;
+    }
+
+    _path = path;
+    _slave = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (_slave < 0) {
+        return false;
+    }
+
+    // Raw until the client sets it up, nothing must be echoed back here.
+    struct termios t;
+    if (tcgetattr(_slave, &t)) {
+        return false;
+    }
+
+    cfmakeraw(&t);
+    if (tcsetattr(_slave, TCSANOW, &t)) {
+        return false;
+    }
+
+    if (!link.empty()) {
+        unlink(link.c_str());
+        if (symlink(path, link.c_str())) {
+            return false;
+        }
+
+        _link = link;
+    }
+
+    return true;
+}
+
+Modem::clock::duration Modem::Latency()
+{
+    int ms = _options.latency;
+    if (_options.jitter > 0) {
+        ms += static_cast<int>(_random() % static_cast<unsigned>(_options.jitter + 1));
+    }
+
+    return std::chrono::milliseconds(ms);
+}
+
+Modem::clock::duration Modem::Interval(double rate)
+{
+    std::exponential_distribution<double> interval(rate);
+    return std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(interval(_random)));
+}
+
+void Modem::Schedule(const clock::time_point &due, std::function<void()> &&f)
+{
+    _timers.emplace(due, std::move(f));
+}
+
+// Output goes out in order, at `delay` from now the soonest, broken into
+// fragments of random sizes up to `fragment` bytes `gap` apart if asked to.
+void Modem::Write(
+        const std::string &data,
+        std::vector<std::string> &&keys,
+        const clock::duration &delay)
+{
+    if (data.empty()) {
+        return;
+    }
+
+    clock::time_point due = clock::now() + delay;
+    if (!_output.empty()) {
+        due = std::max(due, _output.back()._due);
+    }
+
+    const size_t fragment = _options.fragment ? _options.fragment : data.length();
+    for (size_t p = 0; p < data.length();) {
+        const size_t n = std::min(data.length() - p, 1 + _random() % fragment);
+        _output.push_back({ due, data.substr(p, n), 0, {} });
+        due += std::chrono::microseconds(_options.gap);
+        p += n;
+    }
+
+    _output.back()._keys = std::move(keys);
+}
+
+// False if writing must wait for the pty to drain.
+bool Modem::Flush()
+{
+    const auto now = clock::now();
+    while (!_output.empty() && _output.front()._due <= now) {
+        // Stamped before the client can possibly see it, or its upload might
+        // make it to the sink first
+        Chunk &c = _output.front();
+        for (auto &&key : c._keys) {
+            _tracker->Emitted(key);
+        }
+
+        c._keys.clear();
+        const ssize_t ret = write(_master, c._data.data() + c._written,
+                                  c._data.length() - c._written);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        c._written += static_cast<size_t>(ret);
+        if (c._written < c._data.length()) {
+            return false;
+        }
+
+        _output.pop_front();
+    }
+
+    return true;
+}
+
+void Modem::Store(const std::string &pdu)
+{
+    if (_direct) {
+        _deliveries.push_back(pdu);
+        _holding = _held.size() + _deliveries.size();
+        Deliver();
+        return;
+    }
+
+    auto slot = std::find_if(_slots.begin(), _slots.end(),
+                             [](const Slot &s) { return !s._used; });
+
+    if (slot == _slots.end()) {
+        ++_stats._held;
+        _held.push_back(pdu);
+        _holding = _held.size() + _deliveries.size();
+        return;
+    }
+
+    slot->_used = true;
+    slot->_read = false;
+    slot->_pdu = pdu;
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "\r\n+CMTI: \"SM\",%zu\r\n",
+             static_cast<size_t>(slot - _slots.begin()) + 1);
+
+    Write(buffer, { pdu }, clock::duration::zero());
+}
+
+void Modem::Deliver()
+{
+    if (_acknowledging || _deliveries.empty()) {
+        return;
+    }
+
+    const std::string pdu = _deliveries.front();
+    _deliveries.pop_front();
+    _holding = _held.size() + _deliveries.size();
+    _acknowledging = true;
+    ++_stats._delivered;
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "\r\n+CMT: ,%zu\r\n", tpdu_length(pdu));
+    Write(buffer + pdu + "\r\n", { pdu }, clock::duration::zero());
+}
+
+void Modem::Arrive(const std::atomic<bool> &generating)
+{
+    if (!generating) {
+        return;
+    }
+
+    for (size_t i = 0; i < _options.burst; ++i) {
+        ++_stats._messages;
+        for (auto &&pdu : _traffic.Message(&_reference)) {
+            ++_stats._parts;
+            Store(pdu);
+        }
+    }
+
+    Schedule(clock::now() + Interval(_options.rate / _options.burst),
+             [this, &generating] { Arrive(generating); });
+}
+
+// Rings twice and hangs up, then the next call can come.
+void Modem::Call(const std::atomic<bool> &generating)
+{
+    if (!generating) {
+        return;
+    }
+
+    const auto next = clock::now() + Interval(_options.calls);
+    if (_calling) {
+        Schedule(next, [this, &generating] { Call(generating); });
+        return;
+    }
+
+    char number[16];
+    snprintf(number, sizeof(number), "139%08zu", ++_caller);
+
+    char ring[128];
+    snprintf(ring, sizeof(ring),
+             "\r\n+CRING: VOICE\r\n\r\n+CLIP: \"%s\",129,,,,0\r\n", number);
+
+    const std::string caller = number;
+    const auto interval = std::chrono::milliseconds(_options.ring);
+    const auto now = clock::now();
+
+    ++_stats._calls;
+    _calling = true;
+    Write(ring, {}, clock::duration::zero());
+    Schedule(now + interval, [this, ring = std::string(ring)] {
+        Write(ring, {}, clock::duration::zero());
+    });
+
+    Schedule(now + interval * 2, [this, caller] {
+        Write("\r\n^CEND:1,0,104,16\r\n", { caller }, clock::duration::zero());
+        _calling = false;
+    });
+
+    Schedule(std::max(next, now + interval * 2),
+             [this, &generating] { Call(generating); });
+}
+
+void Modem::Status(const std::atomic<bool> &generating)
+{
+    if (!generating) {
+        return;
+    }
+
+    const time_t now = time(nullptr);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+
+    char nwtime[64];
+    snprintf(nwtime, sizeof(nwtime),
+             "\r\n^NWTIME: %02d/%02d/%02d,%02d:%02d:%02d+00,0\r\n",
+             tm.tm_year % 100, tm.tm_mon + 1, tm.tm_mday,
+             tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+    Write(kRssi, {}, clock::duration::zero());
+    Write(kHcsq, {}, clock::duration::zero());
+    Write(nwtime, {}, clock::duration::zero());
+    Schedule(clock::now() + std::chrono::seconds(_options.status),
+             [this, &generating] { Status(generating); });
+}
+
+void Modem::Start(const std::atomic<bool> &generating)
+{
+    const auto now = clock::now();
+    _started = true;
+
+    if (_options.rate > 0) {
+        Schedule(now + Interval(_options.rate / _options.burst),
+                 [this, &generating] { Arrive(generating); });
+    }
+
+    if (_options.calls > 0) {
+        Schedule(now + Interval(_options.calls),
+                 [this, &generating] { Call(generating); });
+    }
+
+    if (_options.status > 0) {
+        Schedule(now, [this, &generating] { Status(generating); });
+    }
+}
+
+// Appends to `response`, false if the command fails.
+bool Modem::Read(const std::string &argument, std::string *response)
+{
+    ++_stats._cmgr;
+    const size_t index = strtoul(argument.c_str(), nullptr, 10);
+    if (index < 1 || index > _slots.size() || !_slots[index - 1]._used) {
+        ++_stats._missing;
+        return false;
+    }
+
+    Slot &slot = _slots[index - 1];
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "\r\n+CMGR: %d,,%zu\r\n",
+             slot._read ? 1 : 0, tpdu_length(slot._pdu));
+
+    slot._read = true;
+    response->append(buffer).append(slot._pdu).append("\r\n");
+    return true;
+}
+
+// Only unread messages for 0, every one for 4, read ones otherwise.
+bool Modem::List(const std::string &argument, std::string *response)
+{
+    ++_stats._cmgl;
+    _ready = true;
+
+    const int stat = atoi(argument.c_str());
+    bool first = true;
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        Slot &slot = _slots[i];
+        if (!slot._used || (stat == 0 && slot._read)
+                        || (stat == 1 && !slot._read)) {
+            continue;
+        }
+
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%s+CMGL: %zu,%d,,%zu\r\n",
+                 first ? "\r\n" : "",
+                 i + 1, slot._read ? 1 : 0, tpdu_length(slot._pdu));
+
+        response->append(buffer).append(slot._pdu).append("\r\n");
+        slot._read = true;
+        first = false;
+    }
+
+    return true;
+}
+
+bool Modem::Delete(const std::string &argument)
+{
+    ++_stats._cmgd;
+    const size_t index = strtoul(argument.c_str(), nullptr, 10);
+    if (index < 1 || index > _slots.size() || !_slots[index - 1]._used) {
+        ++_stats._missing;
+    } else {
+        _slots[index - 1]._used = false;
+        _slots[index - 1]._pdu.clear();
+        ++_freed;
+    }
+
+    return true;
+}
+
+bool Modem::Acknowledge()
+{
+    ++_stats._cnma;
+    if (!_acknowledging) {
+        return false;
+    }
+
+    _acknowledging = false;
+    return true;
+}
+
+// Commands chained with ';' run in order until one fails, with one final
+// result code for all of them.
+void Modem::Execute(const std::string &line)
+{
+    if (_echo) {
+        Write(line + "\r", {}, clock::duration::zero());
+    }
+
+    if (strncasecmp(line.c_str(), "AT", 2)) {
+        return;
+    }
+
+    ++_stats._lines;
+    std::string response;
+    bool ok = true;
+    for (size_t p = 2, q; ok && p <= line.length(); p = q + 1) {
+        q = line.find(';', p);
+        if (q == std::string::npos) {
+            q = line.length();
+        }
+
+        const std::string command = line.substr(p, q - p);
+        if (command.compare(0, 6, "+CMGR=") == 0) {
+            ok = Read(command.substr(6), &response);
+        } else if (command.compare(0, 6, "+CMGL=") == 0) {
+            ok = List(command.substr(6), &response);
+        } else if (command.compare(0, 6, "+CMGD=") == 0) {
+            ok = Delete(command.substr(6));
+        } else if (command.compare(0, 5, "+CNMA") == 0) {
+            ok = Acknowledge();
+        } else {
+            if (command.compare(0, 6, "+CNMI=") == 0) {
+                _direct = command.compare(6, 3, "2,2") == 0;
+            }
+
+            if (command.compare(0, 2, "E0") == 0) {
+                _echo = false;
+            } else if (command.compare(0, 2, "E1") == 0) {
+                _echo = true;
+            }
+
+            ++_stats._others;
+        }
+    }
+
+    response.append(ok ? "\r\nOK\r\n" : "\r\n+CMS ERROR: 321\r\n");
+    Write(response, {}, Latency());
+
+    // Storage freed, what's been held back arrives
+    for (; _freed && !_held.empty(); --_freed) {
+        const std::string pdu = _held.front();
+        _held.pop_front();
+        _holding = _held.size() + _deliveries.size();
+        Store(pdu);
+    }
+
+    _freed = 0;
+
+    // Acknowledged, or back to storage
+    if (!_direct) {
+        while (!_deliveries.empty()) {
+            const std::string pdu = _deliveries.front();
+            _deliveries.pop_front();
+            Store(pdu);
+        }
+
+        _holding = _held.size();
+    }
+
+    Deliver();
+}
+
+// False on errors.
+bool Modem::Receive()
+{
+    char buffer[4096];
+    for (;;) {
+        const ssize_t ret = read(_master, buffer, sizeof(buffer));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return errno == EAGAIN;
+
+        } else if (ret == 0) {
+            return true;
+        }
+
+        _input.append(buffer, static_cast<size_t>(ret));
+        for (size_t p = _input.find('\r'); p != std::string::npos;
+             p = _input.find('\r')) {
+
+            std::string line = _input.substr(0, p);
+            _input.erase(0, p + 1);
+            line.erase(std::remove(line.begin(), line.end(), '\n'), line.end());
+            if (!line.empty()) {
+                Execute(line);
+            }
+        }
+    }
+}
+
+void Modem::Run(const std::atomic<bool> &generating,
+                const std::atomic<bool> &quit)
+{
+    static constexpr auto kTick = std::chrono::milliseconds(100);
+
+    while (!quit) {
+        if (!_started && _ready && generating) {
+            Start(generating);
+        }
+
+        auto now = clock::now();
+        while (!_timers.empty() && _timers.begin()->first <= now) {
+            auto f = std::move(_timers.begin()->second);
+            _timers.erase(_timers.begin());
+            f();
+        }
+
+        const bool blocked = !Flush();
+
+        auto wakeup = clock::now() + kTick;
+        if (!_timers.empty()) {
+            wakeup = std::min(wakeup, _timers.begin()->first);
+        }
+
+        if (!_output.empty() && !blocked) {
+            wakeup = std::min(wakeup, _output.front()._due);
+        }
+
+        now = clock::now();
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::max(wakeup - now, clock::duration::zero())).count();
+
+        const struct timespec timeout = {
+                static_cast<time_t>(ns / 1000000000),
+                static_cast<long>(ns % 1000000000) };
+
+        struct pollfd fd = {
+                _master, static_cast<short>(POLLIN | (blocked ? POLLOUT : 0)), 0 };
+
+        const int ret = ppoll(&fd, 1, &timeout, nullptr);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("modem: ppoll");
+            return;
+        }
+
+        if ((fd.revents & POLLIN) && !Receive()) {
+            perror("modem: read");
+            return;
+        }
+    }
+}
@@ -0,0 +1,186 @@
+#ifndef SMS_CLIENT_MODEM_MODEM_H
+#define SMS_CLIENT_MODEM_MODEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sms/server/load/traffic.h"
+
+class Tracker;
+
+// A Huawei ME909s on the master side of a pty, as much of it as huawei.c
+// talks to: echo, +CMGR, +CMGL, +CMGD, +CMTI, calls reported by +CRING,
+// +CLIP and ^CEND, and ^RSSI, ^HCSQ and ^NWTIME now and then. Every other
+// command is answered with OK, handshakes included. Commands can be chained
+// with ';' on one command line.
+//
+// After +CNMI=2,2 messages are delivered with +CMT instead of being stored,
+// one at a time, each waiting for the +CNMA of the one before.
+//
+// Messages arrive at Poisson times, `burst` of them at once, and are stored
+// in `slots` places like a SIM does. When they're all taken arrivals are
+// held back until the client deletes something.
+class Modem {
+public:
+    using clock = std::chrono::steady_clock;
+
+    class Options {
+    public:
+        Options() : rate(1)
+                  , burst(1)
+                  , calls(0)
+                  , ring(1000)
+                  , status(10)
+                  , latency(10)
+                  , jitter(0)
+                  , fragment(0)
+                  , gap(1000)
+                  , slots(100) {}
+
+        double rate;      // Messages per second
+        size_t burst;     // Messages arriving together
+        double calls;     // Calls per second
+        int ring;         // Milliseconds between rings
+        int status;       // Seconds between status URCs, 0 for none
+        int latency;      // Milliseconds before responding
+        int jitter;       // Milliseconds more at most, uniformly
+        size_t fragment;  // Largest write in bytes, 0 for unlimited
+        int gap;          // Microseconds between fragments
+        size_t slots;
+        Traffic::Options traffic;
+    }; // class Options
+
+    class Stats {
+    public:
+        Stats() : _messages(0), _parts(0), _held(0), _delivered(0), _calls(0)
+                , _lines(0), _cmgr(0), _cmgl(0), _cmgd(0), _cnma(0)
+                , _others(0), _missing(0) {}
+
+        size_t _messages;
+        size_t _parts;    // PDUs of the messages
+        size_t _held;     // Parts arriving while storage was full
+        size_t _delivered;// Parts delivered with +CMT
+        size_t _calls;
+        size_t _lines;    // Round trips, commands can be chained
+        size_t _cmgr;
+        size_t _cmgl;
+        size_t _cmgd;
+        size_t _cnma;
+        size_t _others;
+        size_t _missing;  // +CMGR or +CMGD of empty slots
+    }; // class Stats
+
+    Modem(const Options &options, Tracker *tracker);
+    ~Modem();
+
+    // Creates the pty, and links it to `link` if not empty.
+    bool Open(const std::string &link);
+
+    // Serves the client until `quit`, generating traffic while `generating`
+    // once the client has read the storage for the first time.
+    void Run(const std::atomic<bool> &generating,
+             const std::atomic<bool> &quit);
+
+    const std::string &path() const
+    {
+        return _path;
+    }
+
+    bool ready() const
+    {
+        return _ready;
+    }
+
+    // Messages held back for full storage or an acknowledgement, not
+    // outstanding yet.
+    size_t holding() const
+    {
+        return _holding;
+    }
+
+    // Only valid after Run() returns.
+    const Stats &stats() const
+    {
+        return _stats;
+    }
+
+private:
+    class Chunk {
+    public:
+        clock::time_point _due;
+        std::string _data;
+        size_t _written;
+        std::vector<std::string> _keys; // Tracked as it goes out
+    }; // class Chunk
+
+    class Slot {
+    public:
+        Slot() : _used(false), _read(false) {}
+        bool _used;
+        bool _read;
+        std::string _pdu;
+    }; // class Slot
+
+    void Start(const std::atomic<bool> &generating);
+    void Arrive(const std::atomic<bool> &generating);
+    void Call(const std::atomic<bool> &generating);
+    void Status(const std::atomic<bool> &generating);
+    void Store(const std::string &pdu);
+    void Deliver();
+
+    void Execute(const std::string &line);
+    bool Read(const std::string &argument, std::string *response);
+    bool List(const std::string &argument, std::string *response);
+    bool Delete(const std::string &argument);
+    bool Acknowledge();
+
+    clock::duration Latency();
+    clock::duration Interval(double rate);
+    void Schedule(const clock::time_point &due, std::function<void()> &&f);
+    void Write(const std::string &data,
+               std::vector<std::string> &&keys,
+               const clock::duration &delay);
+
+    bool Receive();
+    bool Flush();
+
+    const Options _options;
+    Tracker *const _tracker;
+    Traffic _traffic;
+    std::mt19937 _random;
+    uint8_t _reference;
+    size_t _caller;
+
+    std::string _path;
+    std::string _link;
+    int _master;
+    int _slave; // Kept open so the master never sees a hangup
+
+    std::atomic<bool> _ready;
+    bool _started;
+    bool _echo;
+    bool _calling;
+    std::string _input;
+    std::deque<Chunk> _output;
+    std::multimap<clock::time_point, std::function<void()>> _timers;
+    std::vector<Slot> _slots;
+    std::deque<std::string> _held;
+    std::deque<std::string> _deliveries; // Waiting to go with +CMT
+    std::atomic<size_t> _holding;
+    bool _direct;
+    bool _acknowledging; // A +CMT is waiting for +CNMA
+    size_t _freed;  // Slots deleted by the command line being executed
+    Stats _stats;
+
+}; // class Modem
+
+#endif // SMS_CLIENT_MODEM_MODEM_H
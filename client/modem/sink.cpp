@@ -0,0 +1,196 @@
+#include "sms/client/modem/sink.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include "sms/client/modem/tracker.h"
+
+namespace {
+
+const char kResponse[] =
+        "HTTP/1.1 202 Accepted\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 9\r\n"
+        "\r\n"
+        "{\"ret\":0}";
+
+// Value of header `name` within `header`, or nullptr.
+const char *find_header(const std::string &header, const char *name)
+{
+    const size_t length = strlen(name);
+    for (size_t p = header.find("\r\n"); p != std::string::npos;
+         p = header.find("\r\n", p + 2)) {
+
+        const char *line = header.c_str() + p + 2;
+        if (strncasecmp(line, name, length) == 0 && line[length] == ':') {
+            line += length + 1;
+            while (*line == ' ') {
+                ++line;
+            }
+
+            return line;
+        }
+    }
+
+    return nullptr;
+}
+
+bool write_all(int fd, const char *buffer, size_t length)
+{
+    for (size_t sent = 0; sent < length;) {
+        const ssize_t ret = send(fd, buffer + sent, length - sent, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN) {
+                struct pollfd p = { fd, POLLOUT, 0 };
+                poll(&p, 1, 1000);
+                continue;
+            }
+
+            return false;
+        }
+
+        sent += static_cast<size_t>(ret);
+    }
+
+    return true;
+}
+
+} // anonymous namespace
+
+Sink::Sink(const struct sockaddr_in &address, Tracker *tracker)
+        : _address(address)
+        , _tracker(tracker)
+        , _fd(-1)
+{
+    // Intended left blank
+}
+
+Sink::~Sink()
+{
+    for (auto &&p : _peers) {
+        close(p._fd);
+    }
+
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool Sink::Listen()
+{
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    const int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))      ||
+        bind(fd, reinterpret_cast<const struct sockaddr *>(&_address),
+             sizeof(_address))                                           ||
+        listen(fd, 16)                                                   ){
+
+        close(fd);
+        return false;
+    }
+
+    _fd = fd;
+    return true;
+}
+
+bool Sink::Accept()
+{
+    const int fd = accept4(_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return errno == EAGAIN || errno == EINTR || errno == ECONNABORTED;
+    }
+
+    _peers.emplace_back(fd);
+    return true;
+}
+
+// Serves every complete request buffered, false if the peer is to be closed.
+bool Sink::Serve(Peer *peer)
+{
+    for (;;) {
+        const size_t end = peer->_buffer.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return true;
+        }
+
+        const std::string header = peer->_buffer.substr(0, end + 2);
+        const char *length = find_header(header, "Content-Length");
+        if (!length) {
+            return false;
+        }
+
+        const size_t total = end + 4 + strtoul(length, nullptr, 10);
+        if (peer->_buffer.length() < total) {
+            return true;
+        }
+
+        _tracker->Uploaded(peer->_buffer.substr(end + 4, total - end - 4));
+        peer->_buffer.erase(0, total);
+
+        if (!write_all(peer->_fd, kResponse, sizeof(kResponse) - 1)) {
+            return false;
+        }
+    }
+}
+
+bool Sink::Receive(Peer *peer)
+{
+    char buffer[16384];
+    for (;;) {
+        const ssize_t ret = recv(peer->_fd, buffer, sizeof(buffer), 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return errno == EAGAIN && Serve(peer);
+
+        } else if (ret == 0) {
+            return false;
+        }
+
+        peer->_buffer.append(buffer, static_cast<size_t>(ret));
+    }
+}
+
+void Sink::Run(const std::atomic<bool> &quit)
+{
+    std::vector<struct pollfd> fds;
+    while (!quit) {
+        fds.clear();
+        fds.push_back({ _fd, POLLIN, 0 });
+        for (auto &&p : _peers) {
+            fds.push_back({ p._fd, POLLIN, 0 });
+        }
+
+        const int ret = poll(fds.data(), fds.size(), 100);
+        if (ret <= 0) {
+            continue;
+        }
+
+        // Peers accepted now are polled next round, `fds` lines up with the
+        // ones there were.
+        for (size_t i = fds.size() - 1; i > 0; --i) {
+            if (fds[i].revents && !Receive(&_peers[i - 1])) {
+                close(_peers[i - 1]._fd);
+                _peers.erase(_peers.begin() + static_cast<ssize_t>(i - 1));
+            }
+        }
+
+        if (fds[0].revents) {
+            Accept();
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef SMS_CLIENT_MODEM_SINK_H
+#define SMS_CLIENT_MODEM_SINK_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+class Tracker;
+
+// Stands in for smsd: accepts every upload with 202 and {"ret":0}, handing
+// the body to the tracker first. Just what the client sends is understood:
+// bodies must carry Content-Length, and no Expect: 100-continue.
+class Sink {
+public:
+    Sink(const struct sockaddr_in &address, Tracker *tracker);
+    ~Sink();
+
+    bool Listen();
+    void Run(const std::atomic<bool> &quit);
+
+private:
+    class Peer {
+    public:
+        explicit Peer(int fd) : _fd(fd) {}
+        std::string _buffer;
+        int _fd;
+    }; // class Peer
+
+    bool Accept();
+    bool Receive(Peer *peer);
+    bool Serve(Peer *peer);
+
+    const struct sockaddr_in _address;
+    Tracker *const _tracker;
+    std::vector<Peer> _peers;
+    int _fd;
+
+}; // class Sink
+
+#endif // SMS_CLIENT_MODEM_SINK_H
@@ -0,0 +1,83 @@
+#include "sms/client/modem/tracker.h"
+
+void Tracker::Emitted(const std::string &key)
+{
+    const auto now = clock::now();
+    std::lock_guard<std::mutex> locker(_mutex);
+    _pending[key] = now;
+}
+
+// json_encode() serializes compactly, so string values of `field` are simply
+// `"field":"value"`. The "pdu" array itself doesn't match, its value isn't a
+// string.
+void Tracker::Match(
+        const std::string &body,
+        const char *field,
+        std::vector<int64_t> *latencies,
+        const clock::time_point &now)
+{
+    const std::string prefix = std::string("\"") + field + "\":\"";
+    for (size_t p = body.find(prefix); p != std::string::npos;
+         p = body.find(prefix, p)) {
+
+        p += prefix.length();
+        const size_t end = body.find('"', p);
+        if (end == std::string::npos) {
+            return;
+        }
+
+        const std::string key = body.substr(p, end - p);
+        p = end;
+
+        auto i = _pending.find(key);
+        if (i == _pending.end()) {
+            if (_done.count(key)) {
+                ++_duplicates;
+            } else {
+                ++_unknown;
+            }
+
+            continue;
+        }
+
+        latencies->push_back(std::chrono::duration_cast<
+                std::chrono::microseconds>(now - i->second).count());
+
+        _pending.erase(i);
+        _done.insert(key);
+    }
+}
+
+void Tracker::Uploaded(const std::string &body)
+{
+    const auto now = clock::now();
+    std::lock_guard<std::mutex> locker(_mutex);
+    ++_uploads;
+    Match(body, "pdu", &_messages, now);
+    Match(body, "peer", &_calls, now);
+}
+
+size_t Tracker::outstanding() const
+{
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _pending.size();
+}
+
+size_t Tracker::uploaded() const
+{
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _messages.size() + _calls.size();
+}
+
+Tracker::Summary Tracker::Summarize() const
+{
+    std::lock_guard<std::mutex> locker(_mutex);
+    Summary s;
+    s._uploads = _uploads;
+    s._duplicates = _duplicates;
+    s._unknown = _unknown;
+    s._outstanding = _pending.size();
+    s._messages = _messages;
+    s._calls = _calls;
+    return s;
+}
@@ -0,0 +1,61 @@
+#ifndef SMS_CLIENT_MODEM_TRACKER_H
+#define SMS_CLIENT_MODEM_TRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Matches what the client uploads against what the modem told it about.
+// Messages are keyed by their hex PDU, calls by the caller's number.
+class Tracker {
+public:
+    using clock = std::chrono::steady_clock;
+
+    class Summary {
+    public:
+        Summary() : _uploads(0), _duplicates(0), _unknown(0), _outstanding(0) {}
+
+        size_t _uploads;
+        size_t _duplicates;  // Uploaded again
+        size_t _unknown;     // Never emitted
+        size_t _outstanding; // Emitted but not uploaded yet
+        std::vector<int64_t> _messages; // Microseconds, URC to upload
+        std::vector<int64_t> _calls;    // Microseconds, ^CEND to upload
+    }; // class Summary
+
+    Tracker() : _uploads(0), _duplicates(0), _unknown(0) {}
+
+    // The URC carrying `key` has just been written to the client.
+    void Emitted(const std::string &key);
+
+    // The client has just uploaded `body`.
+    void Uploaded(const std::string &body);
+
+    size_t outstanding() const;
+    size_t uploaded() const;
+    Summary Summarize() const;
+
+private:
+    void Match(const std::string &body,
+               const char *field,
+               std::vector<int64_t> *latencies,
+               const clock::time_point &now);
+
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, clock::time_point> _pending;
+    std::unordered_set<std::string> _done;
+    std::vector<int64_t> _messages;
+    std::vector<int64_t> _calls;
+    size_t _uploads;
+    size_t _duplicates;
+    size_t _unknown;
+
+}; // class Tracker
+
+#endif // SMS_CLIENT_MODEM_TRACKER_H
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <sys/uio.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -48,26 +50,45 @@ static void HEX(const char *what, const void *buffer, size_t length)
 
 extern volatile sig_atomic_t g_quit;
 
-struct node {
-    struct node *next;
-    char command[256];
+struct request {
+    char command[128];
     sms_command_t callback;
+    int argument;
+    int64_t queued;
+};
+
+/* Preallocated ring, never grows */
+struct queue {
+    struct request requests[256];
+    size_t head;
+    size_t count;
 };
 
 struct sms {
     struct termios original;
-    int64_t delay;
     int fd;
 
     int64_t cooling;
     int64_t requesting;
-    sms_command_t callback;
+    struct request request; /* The one in flight */
+    int cooling_timer;
+    int requesting_timer;
 
-    char buffer[65536];
-    size_t total;
-    int64_t last;
     struct timespec when;
     struct inbox *inbox;
+    int device;         /* As attached to the inbox */
+
+    /* For parsing, see sms_parse() */
+    char buffer[65536];
+    size_t total;       /* Bytes received */
+    size_t scanned;     /* Bytes looked at */
+    size_t begin;       /* Where the incomplete line begins */
+    int opening;        /* An empty line was seen, a section comes next */
+    int open;           /* The last section takes more lines */
+    struct line lines[1024];
+    size_t cline;
+    struct section sections[256];
+    size_t csection;    /* Held until the response completes */
 
     /* For calls */
     int calling;
@@ -78,21 +99,38 @@ struct sms {
     struct timespec ring_started;
     struct timespec call_started;
 
+    /* For delivery */
+    int direct;         /* Configured to */
+    int delivering;     /* Directly right now */
+
     /* For command queue */
-    struct node *head;
-    struct node *tail;
+    struct queue queues[SMS_PRIORITIES];
+    struct sms_stats stats;
 };
 
-static int sms_do_send(
-        struct sms *sms,
-        const char *command,
-        sms_command_t callback)
+/* Fire once after `delay` nanoseconds, or never if negative */
+static int sms_set_timer(int fd, int64_t delay)
 {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (delay >= 0) {
+        delay = delay ? delay : 1;
+        its.it_value.tv_sec = delay / 1000000000LL;
+        its.it_value.tv_nsec = delay % 1000000000LL;
+    }
+
+    return timerfd_settime(fd, 0, &its, NULL);
+}
+
+static int sms_do_send(struct sms *sms, const struct request *request)
+{
+    static const int64_t kRequesting = 10000000000LL; /* 10s */
     char buffer[1600];
     ssize_t ret;
     ssize_t len;
 
-    len = snprintf(buffer, sizeof(buffer), "AT%s\r", command);
+    len = snprintf(buffer, sizeof(buffer), "AT%s\r", request->command);
     if (len < 0 || (size_t)len >= sizeof(buffer)) {
         return -1;
     }
@@ -102,167 +140,144 @@ static int sms_do_send(
         return -1;
     }
 
+    if (sms_set_timer(sms->requesting_timer, kRequesting)) {
+        return -1;
+    }
+
     sms->requesting = get_monotonic_timestamp();
-    LOGT("SEND [%s]", command);
-    sms->callback = callback;
+    LOGT("SEND [%s]", request->command);
+    sms->request = *request;
+    sms->stats.waited += sms->requesting - request->queued;
+    ++sms->stats.sent;
     return 0;
 }
 
-int sms_send(struct sms *sms, const char *command, sms_command_t callback)
+/* Commands are only queued here, sms_run() sends them between events */
+int sms_send(
+        struct sms *sms,
+        enum sms_priority priority,
+        const char *command,
+        sms_command_t callback,
+        int argument)
 {
-    struct node *n;
-
-    if (!sms->requesting && get_monotonic_timestamp() >= sms->cooling) {
-        return sms_do_send(sms, command, callback);
-    }
-
-    LOGT("QUEUE [%s]", command);
-    if (strlen(command) >= sizeof(n->command)) {
+    struct request *request;
+    struct queue *queue;
+    size_t capacity;
+
+    capacity = sizeof(queue->requests) / sizeof(*queue->requests);
+    queue = sms->queues + priority;
+    if (queue->count == capacity) {
+        LOGE("Queue full: [%s]", command);
         return -1;
     }
 
-    n = (struct node *)malloc(sizeof(*n));
-    if (!n) {
+    request = queue->requests + (queue->head + queue->count) % capacity;
+    if (strlen(command) >= sizeof(request->command)) {
         return -1;
     }
 
-    n->next = NULL;
-    n->callback = callback;
-    strcpy(n->command, command);
-
-    if (sms->tail) {
-        sms->tail->next = n;
-        sms->tail = n;
-    } else {
-        sms->head = n;
-        sms->tail = n;
+    LOGT("QUEUE [%s]", command);
+    strcpy(request->command, command);
+    request->callback = callback;
+    request->argument = argument;
+    request->queued = get_monotonic_timestamp();
+    ++queue->count;
+
+    if (++sms->stats.queued > sms->stats.peak) {
+        sms->stats.peak = sms->stats.queued;
     }
 
     return 0;
 }
 
-static void sms_break_lines(
-        char *buffer,
-        size_t total,
-        struct line *lines,
-        size_t *cline)
+static struct request *sms_find(
+        struct sms *sms,
+        enum sms_priority priority,
+        const char *prefix)
 {
-    struct line *pline;
-    size_t max;
-    char *last;
-    char *end;
-    char *p;
-
-    max = *cline;
-    *cline = 0;
-    last = buffer;
-    end = buffer + total;
-    for (p = buffer; p < end; ++p) {
-        if (*p == '\r' && p + 1 < end && *(p + 1) == '\n') {
-            pline = lines + *cline;
-            pline->from = (size_t)(last - buffer);
-            pline->to = (size_t)(p - buffer) + 2;
-            pline->id = *cline;
-            pline->ptr = last;
-            last = p + 2;
-            *p++ = '\0';
-            ++(*cline);
-
-            if (*cline == max) {
-                break;
-            }
+    struct request *request;
+    struct queue *queue;
+    size_t capacity;
+    size_t length;
+    size_t i;
 
-        } else if (!last) {
-            last = p;
+    capacity = sizeof(queue->requests) / sizeof(*queue->requests);
+    queue = sms->queues + priority;
+    length = strlen(prefix);
+    for (i = 0; i < queue->count; ++i) {
+        request = queue->requests + (queue->head + i) % capacity;
+        if (strncmp(request->command, prefix, length) == 0) {
+            return request;
         }
     }
 
-#ifndef NDEBUG
-    for (size_t i = 0; i < *cline; ++i) {
-        LOGD("[%lu:%lu:%lu]: [%s]",
-               i, lines[i].from, lines[i].to, lines[i].ptr);
-    }
-#endif
+    return NULL;
 }
 
-static void sms_break_sections(
-        struct line *lines,
-        size_t cline,
-        struct section *sections,
-        size_t *csection)
+int sms_is_waiting(
+        struct sms *sms,
+        enum sms_priority priority,
+        const char *prefix)
 {
-    struct section *psection;
-    size_t max;
-    size_t i;
-    size_t j;
-    char *p;
-
-    max = *csection;
-    *csection = 0;
-    for (i = 0; i < cline; ++i) {
-        if (!*lines[i].ptr) {
-            if (i + 1 == cline) {
-                break;
-            }
-
-            ++i;
-            for (j = i + 1; j < cline; ++j) {
-                if (!*lines[j].ptr) {
-                    break;
-                }
-            }
+    return sms_find(sms, priority, prefix) != NULL;
+}
 
-            psection = sections + (*csection)++;
-            psection->from = lines + i;
-            psection->to = lines + j;
-            snprintf(psection->name, sizeof(psection->name), "%s", lines[i].ptr);
-            p = strchr(psection->name, ':');
-            if (p) {
-                *p = '\0';
-            }
+int sms_replace(
+        struct sms *sms,
+        enum sms_priority priority,
+        const char *prefix,
+        const char *command,
+        sms_command_t callback,
+        int argument)
+{
+    struct request *request;
 
-            i = j - 1;
-            if (*csection == max) {
-                break;
-            }
-        }
+    request = sms_find(sms, priority, prefix);
+    if (!request) {
+        return 1;
     }
 
-#ifndef NDEBUG
-    for (size_t i = 0; i < *csection; ++i) {
-        psection = sections + i;
-        LOGD("Section: %lu - %lu: %s",
-               psection->from->id,
-               (psection->to - 1)->id,
-               psection->name);
+    if (strlen(command) >= sizeof(request->command)) {
+        return -1;
     }
-#endif
+
+    LOGT("REPLACE [%s] [%s]", request->command, command);
+    strcpy(request->command, command);
+    request->callback = callback;
+    request->argument = argument;
+    return 0;
 }
 
-static size_t sms_on_command(
-        struct sms *sms,
-        const struct section *sections,
-        size_t csection)
+/* Every section is checked, most of them by their first character alone */
+static int sms_is_final(const char *name)
 {
-    static const int64_t kCooling = 100000000LL; /* 100ms */
-    const struct section *s;
-    size_t i;
+    switch (name[0]) {
+    case 'O':
+        return strcmp(name, "OK") == 0;
 
-    for (i = 0; i < csection; ++i) {
-        s = sections + i;
-        if (strcmp(s->name, "OK"        ) == 0 ||
-            strcmp(s->name, "ERROR"     ) == 0 ||
-            strcmp(s->name, "+CME ERROR") == 0 ||
-            strcmp(s->name, "+CMS ERROR") == 0 ){
+    case 'E':
+        return strcmp(name, "ERROR") == 0;
 
-            sms->cooling = get_monotonic_timestamp() + kCooling;
-            sms->requesting = 0;
-            LOGT("ACK");
-            break;
-        }
+    case '+':
+        return name[1] == 'C' && name[2] == 'M'         &&
+               (name[3] == 'E' || name[3] == 'S')       &&
+               strcmp(name + 4, " ERROR") == 0          ;
+
+    default:
+        return 0;
     }
+}
+
+/* URCs in PDU mode with the PDU on a line of its own */
+static int sms_is_complete(const struct section *s)
+{
+    if (s->name[0] != '+'                                       ||
+        (strcmp(s->name, "+CMT") && strcmp(s->name, "+CDS"))    ){
 
-    return i;
+        return 1;
+    }
+
+    return s->to - s->from >= 2;
 }
 
 static void sms_increase_when(struct sms *sms)
@@ -273,75 +288,300 @@ static void sms_increase_when(struct sms *sms)
     sms->when.tv_nsec %= 1000000000;
 }
 
-static int sms_process(struct sms *sms)
+/*
+ * The gap between an ACK and the next command shrinks by 1/8 every time the
+ * modem answers OK in its usual time, and doubles when it errs or stalls.
+ * It starts from the 100ms that used to be fixed.
+ */
+static void sms_adapt(struct sms *sms, const char *name, int64_t elapsed)
 {
-    struct section sections[256];
-    struct line lines[4096];
-    sms_command_t callback;
-    char buffer[65536];
-    size_t csection;
+    static const int64_t kMinimum = 1000000LL;      /* 1ms */
+    static const int64_t kMaximum = 1000000000LL;   /* 1s */
+    static const int64_t kStep = 10000000LL;        /* 10ms */
+    struct sms_stats *stats;
+    int64_t cooling;
+
+    stats = &sms->stats;
+    cooling = stats->cooling;
+    if (strcmp(name, "OK")) {
+        ++stats->errors;
+        cooling = cooling * 2 > kStep ? cooling * 2 : kStep;
+
+    } else if (stats->response && elapsed > stats->response * 4) {
+        cooling = cooling * 2 > kStep ? cooling * 2 : kStep;
+
+    } else {
+        cooling -= cooling / 8;
+        if (cooling < kMinimum) {
+            cooling = 0;
+        }
+    }
+
+    stats->cooling = cooling < kMaximum ? cooling : kMaximum;
+    stats->response += stats->response ? (elapsed - stats->response) / 8
+                                       : elapsed;
+
+    if (elapsed > stats->slowest) {
+        stats->slowest = elapsed;
+    }
+}
+
+static int sms_on_ack(struct sms *sms)
+{
+    struct request request;
     size_t skipf;
     size_t skipt;
-    size_t cline;
+    size_t ack;
     ssize_t ret;
     size_t i;
+    int64_t now;
 
-    memcpy(buffer, sms->buffer, sms->total);
-    HEX("Process", buffer, sms->total);
-
-    cline = sizeof(lines) / sizeof(*lines);
-    sms_break_lines(buffer, sms->total, lines, &cline);
+    ack = sms->csection - 1;
+    now = get_monotonic_timestamp();
+    LOGT("ACK [%s] in %ldus", sms->request.command,
+         (long)((now - sms->requesting) / 1000));
 
-    csection = sizeof(sections) / sizeof(*sections);
-    sms_break_sections(lines, cline, sections, &csection);
+    sms_adapt(sms, sms->sections[ack].name, now - sms->requesting);
+    sms->cooling = now + sms->stats.cooling;
+    sms->requesting = 0;
 
-    if (!csection) {
+    if (sms_set_timer(sms->requesting_timer, -1)) {
         return -1;
     }
 
-    skipf = 0;
-    skipt = 0;
-    if (sms->requesting) {
-        i = sms_on_command(sms, sections, csection);
-        if (i < csection) {
-            callback = sms->callback;
-            sms->callback = NULL;
-
-            ret = 1;
-            if (callback) {
-                ret = callback(sms, sections, csection, i);
-                if (ret < 0) {
-                    return -1;
-                }
-
-                sms_increase_when(sms);
-            }
+    request = sms->request;
+    sms->request.callback = NULL;
 
-            skipf = i + 1 - (size_t)ret;
-            skipt = i + 1;
+    ret = 1;
+    if (request.callback) {
+        ret = request.callback(sms, sms->sections, sms->csection, ack,
+                               request.argument);
+        if (ret < 0) {
+            return -1;
         }
+
+        sms_increase_when(sms);
     }
 
-    for (i = 0; i < csection; ++i) {
+    /* Whatever came along but isn't part of the response */
+    skipf = ack + 1 - (size_t)ret;
+    skipt = ack + 1;
+    for (i = 0; i < sms->csection; ++i) {
         if (i >= skipf && i < skipt) {
             continue;
         }
 
-        if (sms_on_urc(sms, sections + i)) {
+        if (sms_on_urc(sms, sms->sections + i)) {
             return -1;
         }
 
         sms_increase_when(sms);
     }
 
-    sms->total -= (sections[csection - 1].to - 1)->to;
-    if (sms->total) {
-        return 1;
+    return 0;
+}
+
+/* The last section is complete */
+static int sms_on_section(struct sms *sms)
+{
+    const struct section *s;
+
+    s = sms->sections + sms->csection - 1;
+    sms->open = 0;
+
+#ifndef NDEBUG
+    LOGD("Section: %lu - %lu: %s", s->from->id, (s->to - 1)->id, s->name);
+#endif
+
+    if (sms->requesting) {
+        if (!sms_is_final(s->name)) {
+            return 0; /* Held until the response completes */
+        }
+
+        if (sms_on_ack(sms)) {
+            return -1;
+        }
+
+    } else {
+        if (sms_on_urc(sms, s)) {
+            return -1;
+        }
+
+        sms_increase_when(sms);
     }
 
+    sms->csection = 0;
+    sms->cline = 0;
     return 0;
 }
 
+/*
+ * Sections begin after empty lines and run until the next one. Final result
+ * codes and URCs are single lines, so they're complete right away, but for
+ * +CMT and +CDS followed by a PDU. Responses to commands can have more, and
+ * wait for the empty line leading the final result code. Lines outside of
+ * sections, like echoes, are ignored.
+ */
+static int sms_on_line(struct sms *sms, size_t from, size_t to)
+{
+    struct section *psection;
+    struct line *pline;
+    char *p;
+
+    if (from + 2 == to) {
+        if (sms->open && sms_on_section(sms)) {
+            return -1;
+        }
+
+        sms->opening = 1;
+        return 0;
+    }
+
+    if (sms->opening) {
+        if (sms->csection == sizeof(sms->sections) / sizeof(*sms->sections)) {
+            LOGE("Too many sections");
+            return -1;
+        }
+
+        sms->opening = 0;
+        sms->open = 1;
+        psection = sms->sections + sms->csection++;
+        psection->from = sms->lines + sms->cline;
+        psection->to = psection->from;
+        snprintf(psection->name, sizeof(psection->name),
+                 "%s", sms->buffer + from);
+
+        p = strchr(psection->name, ':');
+        if (p) {
+            *p = '\0';
+        }
+
+    } else if (!sms->open) {
+        LOGD("Ignored: [%s]", sms->buffer + from);
+        return 0;
+    }
+
+    if (sms->cline == sizeof(sms->lines) / sizeof(*sms->lines)) {
+        LOGE("Too many lines");
+        return -1;
+    }
+
+    pline = sms->lines + sms->cline;
+    pline->ptr = sms->buffer + from;
+    pline->id = sms->cline++;
+    pline->from = from;
+    pline->to = to;
+
+    psection = sms->sections + sms->csection - 1;
+    psection->to = pline + 1;
+
+#ifndef NDEBUG
+    LOGD("[%lu:%lu:%lu]: [%s]", pline->id, pline->from, pline->to, pline->ptr);
+#endif
+
+    if (sms_is_final(psection->name) ||
+        (!sms->requesting && sms_is_complete(psection))) {
+
+        return sms_on_section(sms);
+    }
+
+    return 0;
+}
+
+/* Look at new bytes only, every complete line is handled immediately */
+static int sms_parse(struct sms *sms)
+{
+    char *end;
+    char *p;
+
+    end = sms->buffer + sms->total;
+    for (p = sms->buffer + sms->scanned; p < end; ++p) {
+        p = (char *)memchr(p, '\n', (size_t)(end - p));
+        if (!p) {
+            break;
+        }
+
+        if (p == sms->buffer + sms->begin || *(p - 1) != '\r') {
+            continue;
+        }
+
+        *(p - 1) = '\0';
+        if (sms_on_line(sms, sms->begin, (size_t)(p - sms->buffer) + 1)) {
+            return -1;
+        }
+
+        sms->begin = (size_t)(p - sms->buffer) + 1;
+    }
+
+    sms->scanned = sms->total;
+    return 0;
+}
+
+/*
+ * The buffer wraps around by moving what's still needed, lines of held
+ * sections and the incomplete one, to the front. Usually nothing is.
+ */
+static void sms_compact(struct sms *sms)
+{
+    size_t live;
+    size_t i;
+
+    live = sms->cline ? sms->lines[0].from : sms->begin;
+    if (!live) {
+        return;
+    }
+
+    memmove(sms->buffer, sms->buffer + live, sms->total - live);
+    for (i = 0; i < sms->cline; ++i) {
+        sms->lines[i].ptr -= live;
+        sms->lines[i].from -= live;
+        sms->lines[i].to -= live;
+    }
+
+    sms->total -= live;
+    sms->scanned -= live;
+    sms->begin -= live;
+}
+
+static int sms_receive(struct sms *sms)
+{
+    ssize_t ret;
+
+    if (sms->begin == sms->total && !sms->cline) {
+        sms->total = 0;
+        sms->scanned = 0;
+        sms->begin = 0;
+
+    } else if (sms->total > sizeof(sms->buffer) / 4 * 3) {
+        sms_compact(sms);
+        if (sms->total == sizeof(sms->buffer)) {
+            LOGE("Buffer overflow");
+            return -1;
+        }
+    }
+
+    ret = read(sms->fd,
+               sms->buffer + sms->total,
+               sizeof(sms->buffer) - sms->total);
+
+    if (ret < 0) {
+        if (errno == EAGAIN) {
+            return 0;
+        }
+        LOGE("read(): %d: %s", errno, strerror(errno));
+        return -1;
+
+    } else if (ret == 0) {
+        LOGE("read(): peer hang");
+        return -1;
+    }
+
+    HEX("Read", sms->buffer + sms->total, (size_t)ret);
+    clock_gettime(CLOCK_REALTIME, &sms->when);
+    sms->total += (size_t)ret;
+    return sms_parse(sms);
+}
+
 static int sms_do_handshake_drain_stale_output(struct sms *sms)
 {
     struct timespec tv;
@@ -504,7 +744,7 @@ static int sms_handshake(struct sms *sms, const char *handshake)
 
     for (i = 0; i < 10; ++i) {
         if (sms_do_handshake(sms, handshake) == 0) {
-            LOGI("HANDSHAKE");
+            LOGI("HANDSHAKE: device=%d", sms->device);
             return 0;
         }
 
@@ -516,13 +756,16 @@ static int sms_handshake(struct sms *sms, const char *handshake)
     return -1;
 }
 
-struct sms *sms_open(const char *path, int baudrate, struct http *h)
+struct sms *sms_open(
+        const char *path,
+        int baudrate,
+        struct inbox *inbox,
+        const char *token)
 {
     static const int kTries = 30;
     struct termios original;
     struct termios t;
     struct sms *sms;
-    int64_t delay;
     speed_t baud;
     int fd;
     int i;
@@ -535,10 +778,6 @@ struct sms *sms_open(const char *path, int baudrate, struct http *h)
     default    : errno = EINVAL; return NULL;
     }
 
-    /* How much nanoseconds to transmit one byte, multiply with 3 */
-    delay = 1000000000LL / (baudrate / 8) * 3;
-    delay = delay >= 1000000LL ? delay : 1000000LL;
-
     memset(&t, 0, sizeof(t));
     t.c_cflag = CS8 | CREAD | CLOCAL | CRTSCTS;
     if (cfsetispeed(&t, baud) || cfsetospeed(&t, baud)) {
@@ -551,7 +790,9 @@ struct sms *sms_open(const char *path, int baudrate, struct http *h)
             break;
         }
 
-        LOGW("Device cannot be opened: %d: %s", errno, strerror(errno));
+        LOGW("Device [%s] cannot be opened: %d: %s",
+                path, errno, strerror(errno));
+
         if (++i >= kTries) {
             return NULL;
         }
@@ -578,60 +819,130 @@ struct sms *sms_open(const char *path, int baudrate, struct http *h)
 
     memset(sms, 0, sizeof(*sms));
     memcpy(&sms->original, &original, sizeof(original));
+    sms->stats.cooling = 100000000LL; /* 100ms */
+    sms->fd = fd;
 
-    sms->inbox = inbox_initialize(sms, h);
-    if (!sms->inbox) {
-        free(sms);
-        tcsetattr(fd, TCSANOW, &original);
-        close(fd);
+    sms->cooling_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    sms->requesting_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    sms->inbox = inbox;
+
+    if (sms->cooling_timer    < 0                                   ||
+        sms->requesting_timer < 0                                   ||
+        (sms->device = inbox_attach(inbox, sms, token)) < 0         ){
+
+        sms_close(sms);
         return NULL;
     }
 
-    sms->delay = delay;
-    sms->fd = fd;
     return sms;
 }
 
-void sms_close(struct sms *sms)
+static void sms_log_stats(const struct sms *sms)
 {
-    struct node *n;
+    const struct sms_stats *s;
+
+    s = &sms->stats;
+    LOGI("Commands: device=%d sent=%lu errors=%lu queued=%lu peak=%lu "
+         "waited=%ldus response=%ldus slowest=%ldus cooling=%ldus",
+         sms->device, s->sent, s->errors, s->queued, s->peak,
+         (long)(s->sent ? s->waited / (int64_t)s->sent / 1000 : 0),
+         (long)(s->response / 1000), (long)(s->slowest / 1000),
+         (long)(s->cooling / 1000));
+}
 
+void sms_close(struct sms *sms)
+{
     if (!sms) {
         return;
     }
 
-    while ((n = sms->head)) {
-        sms->head = sms->head->next;
-        free(n);
+    if (sms->stats.sent) {
+        sms_log_stats(sms);
+    }
+
+    if (sms->requesting_timer >= 0) {
+        close(sms->requesting_timer);
+    }
+
+    if (sms->cooling_timer >= 0) {
+        close(sms->cooling_timer);
     }
 
-    inbox_shutdown(sms->inbox);
     tcsetattr(sms->fd, TCSADRAIN, &sms->original);
     close(sms->fd);
     free(sms);
 }
 
-int sms_run(struct sms *sms, const char *handshake)
+/* Send the next queued command if it's time, or wake up when it is */
+static int sms_dequeue(struct sms *sms)
 {
-    static const int64_t kRequesting = 10000000000LL; /* 10s   */
-    static const int64_t kHeartbeat  = 1000000000LL;  /* 1s    */
-    static const int64_t kTick       = 100000000LL;   /* 100ms */
+    struct queue *queue;
+    size_t capacity;
+    int64_t now;
+    size_t i;
 
-    struct timespec tv;
-    int64_t heartbeat;
-    struct node *n;
-    sigset_t empty;
-    int64_t delay;
-    int64_t diff;
-    fd_set rset;
+    /* Not in the middle of a URC either */
+    if (!sms->stats.queued || sms->requesting || sms->open) {
+        return 0;
+    }
+
+    now = get_monotonic_timestamp();
+    if (now < sms->cooling) {
+        return sms_set_timer(sms->cooling_timer, sms->cooling - now);
+    }
+
+    for (i = 0; !sms->queues[i].count; ++i);
+    queue = sms->queues + i;
+
+    if (sms_do_send(sms, queue->requests + queue->head)) {
+        LOGE("Dequeuing sending item failed");
+        return -1;
+    }
+
+    capacity = sizeof(queue->requests) / sizeof(*queue->requests);
+    queue->head = (queue->head + 1) % capacity;
+    --queue->count;
+    --sms->stats.queued;
+    return 0;
+}
+
+void sms_get_stats(const struct sms *sms, struct sms_stats *stats)
+{
+    *stats = sms->stats;
+}
+
+/* How many times timers fired doesn't matter, only that they did */
+static void sms_drain(int fd)
+{
+    uint64_t count;
     ssize_t ret;
-    int64_t now;
-    int more;
 
-    if (sigemptyset(&empty)) {
+    do {
+        ret = read(fd, &count, sizeof(count));
+    } while (ret < 0 && errno == EINTR);
+}
+
+/* Messages are stored while uploads don't go through or the spool is full */
+static int sms_check_delivery(struct sms *sms)
+{
+    int direct;
+
+    direct = sms->direct && inbox_is_available(sms->inbox);
+    if (direct == sms->delivering) {
+        return 0;
+    }
+
+    LOGI("Delivery: device=%d %s", sms->device, direct ? "direct" : "storage");
+    if (sms_set_delivery(sms, direct)) {
         return -1;
     }
 
+    sms->delivering = direct;
+    return 0;
+}
+
+int sms_start(struct sms *sms, const char *handshake, int direct)
+{
     if (sms_handshake(sms, handshake)) {
         return -1;
     }
@@ -640,110 +951,148 @@ int sms_run(struct sms *sms, const char *handshake)
         return -1;
     }
 
-    heartbeat = get_monotonic_timestamp() + kHeartbeat;
-    memset(&tv, 0, sizeof(tv));
-    sms->last = -1;
+    sms->direct = direct;
+    return sms_check_delivery(sms);
+}
+
+/* Devices are told apart by their index, 4 file descriptors each */
+enum sms_tag {
+    SMS_TAG_TTY,
+    SMS_TAG_REQUESTING,
+    SMS_TAG_COOLING,
+    SMS_TAGS = 4
+};
+
+static int sms_watch(int epoll, int fd, uint64_t tag)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = tag;
+    return epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+}
 
+static int sms_loop(
+        struct sms *const *sms,
+        size_t count,
+        struct inbox *inbox,
+        int epoll)
+{
+    struct epoll_event events[64];
+    struct sms *s;
+    sigset_t empty;
+    uint64_t tag;
+    size_t j;
+    int retry;
+    int ret;
+    int i;
+
+    if (sigemptyset(&empty)) {
+        return -1;
+    }
+
+    /* Nothing wakes us up but the modems, timers and the inbox */
+    retry = 0;
     while (!g_quit) {
-        now = get_monotonic_timestamp();
-
-        delay = kTick;
-        if (sms->last >= 0) {
-            diff = sms->last - now;
-            if (diff <= 0) {
-                do {
-                    more = sms_process(sms);
-                    if (more < 0) {
-                        LOGE("sms_process() returned %d", more);
-                        return -1;
-                    }
-                } while (more);
-                fflush(stdout);
-                sms->last = -1;
+        /* Deletes that didn't fit, the modem has answered something since */
+        if (retry && (retry = inbox_health_check(inbox)) < 0) {
+            return -1;
+        }
 
-            } else if (diff < delay) {
-                delay = diff;
+        for (j = 0; j < count; ++j) {
+            if (sms_dequeue(sms[j])) {
+                return -1;
             }
         }
 
-        if (sms->requesting) {
-            if (now >= sms->requesting + kRequesting) {
-                LOGE("Request timed out");
-                return -1;
+        ret = epoll_pwait(epoll, events,
+                          sizeof(events) / sizeof(*events), -1, &empty);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+
+            LOGE("epoll_pwait(): %d: %s", errno, strerror(errno));
+            return -1;
         }
 
-        if (sms->head) {
-            if (!sms->requesting && now >= sms->cooling) {
-                if (sms_do_send(sms, sms->head->command, sms->head->callback)) {
-                    LOGE("Dequeuing sending item failed");
+        for (i = 0; i < ret; ++i) {
+            tag = events[i].data.u64;
+            if (tag == UINT64_MAX) {
+                if ((retry = inbox_health_check(inbox)) < 0) {
                     return -1;
                 }
 
-                n = sms->head;
-                sms->head = sms->head->next;
-                free(n);
-                if (!sms->head) {
-                    sms->tail = NULL;
+                for (j = 0; j < count; ++j) {
+                    if (sms_check_delivery(sms[j])) {
+                        return -1;
+                    }
                 }
-            }
-        }
-
-        if (now > heartbeat) {
-            heartbeat = now + kHeartbeat;
-            inbox_health_check(sms->inbox);
-        }
 
-        FD_ZERO(&rset);
-        FD_SET(sms->fd, &rset);
-        tv.tv_sec = delay / 1000000000LL;
-        tv.tv_nsec = delay % 1000000000LL;
-        ret = pselect(sms->fd + 1, &rset, NULL, NULL, &tv, &empty);
-        if (ret < 0) {
-            if (errno == EINTR) {
                 continue;
             }
 
-            LOGE("pselect(): %d: %s", errno, strerror(errno));
-            return -1;
+            s = sms[tag / SMS_TAGS];
+            switch (tag % SMS_TAGS) {
+            case SMS_TAG_TTY:
+                if (sms_receive(s)) {
+                    return -1;
+                }
 
-        } else if (ret == 0) {
-            continue;
-        }
+                fflush(stdout);
+                break;
 
-        if (!FD_ISSET(sms->fd, &rset)) {
-            continue;
-        }
+            case SMS_TAG_REQUESTING:
+                sms_drain(s->requesting_timer);
+                if (s->requesting) {
+                    LOGE("Request timed out: device=%d", s->device);
+                    return -1;
+                }
+                break;
 
-        if (sms->total == sizeof(sms->buffer)) {
-            LOGE("Buffer overflow");
-            return -1;
+            case SMS_TAG_COOLING:
+                sms_drain(s->cooling_timer);
+                break;
+            }
         }
+    }
+
+    return 0;
+}
 
-        ret = read(sms->fd,
-                   sms->buffer + sms->total,
-                   sizeof(sms->buffer) - sms->total);
+int sms_run(struct sms *const *sms, size_t count, struct inbox *inbox)
+{
+    uint64_t tag;
+    size_t i;
+    int epoll;
+    int ret;
 
-        if (ret < 0) {
-            if (errno == EAGAIN) {
-                continue;
-            }
-            LOGE("read(): %d: %s", errno, strerror(errno));
-            return -1;
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) {
+        return -1;
+    }
 
-        } else if (ret == 0) {
-            LOGE("read(): peer hang");
-            return -1;
-        }
+    if (sms_watch(epoll, inbox_get_event(inbox), UINT64_MAX)) {
+        close(epoll);
+        return -1;
+    }
 
-        clock_gettime(CLOCK_REALTIME, &sms->when);
-        sms->total += (size_t)ret;
+    for (i = 0; i < count; ++i) {
+        tag = (uint64_t)i * SMS_TAGS;
+        if (sms_watch(epoll, sms[i]->fd, tag + SMS_TAG_TTY)                          ||
+            sms_watch(epoll, sms[i]->requesting_timer, tag + SMS_TAG_REQUESTING)     ||
+            sms_watch(epoll, sms[i]->cooling_timer, tag + SMS_TAG_COOLING)           ){
 
-        /* Don't rely on `now`, let it be precise */
-        sms->last = get_monotonic_timestamp() + sms->delay;
+            close(epoll);
+            return -1;
+        }
     }
 
-    return 0;
+    ret = sms_loop(sms, count, inbox, epoll);
+    close(epoll);
+    return ret;
 }
 
 char *sms_get_value(const char *s)
@@ -764,28 +1113,35 @@ char *sms_get_value(const char *s)
 
 int sms_inbox_prepare(struct sms *sms, int index)
 {
-    return inbox_prepare(sms->inbox, index, &sms->when);
+    return inbox_prepare(sms->inbox, sms->device, index, &sms->when);
 }
 
-int sms_inbox_commit(struct sms *sms, const char *what)
+int sms_inbox_deliver(struct sms *sms, const char *what)
 {
-    return inbox_commit(sms->inbox, what);
+    return inbox_deliver(sms->inbox, sms->device, what, &sms->when);
+}
+
+int sms_inbox_commit(struct sms *sms, int index, const char *what)
+{
+    return inbox_commit(sms->inbox, sms->device, index, what);
 }
 
 int sms_inbox_push(struct sms *sms, int index, const char *what, int offset)
 {
     struct timespec tv;
+    int ret;
 
     tv = sms->when;
     tv.tv_nsec += offset;
     tv.tv_sec += tv.tv_nsec / 1000000000;
     tv.tv_nsec %= 1000000000;
 
-    if (inbox_prepare(sms->inbox, index, &tv)) {
-        return -1;
+    ret = inbox_prepare(sms->inbox, sms->device, index, &tv);
+    if (ret) {
+        return ret < 0 ? -1 : 0; /* Positive if it's been read already */
     }
 
-    return inbox_commit(sms->inbox, what);
+    return inbox_commit(sms->inbox, sms->device, index, what);
 }
 
 int sms_call_start(struct sms *sms)
@@ -870,5 +1226,5 @@ int sms_call_end(
     sms->calling = 0;
     sms->ringing = 0;
 
-    return inbox_call(sms->inbox, &c);
+    return inbox_call(sms->inbox, sms->device, &c);
 }
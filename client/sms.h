@@ -2,10 +2,11 @@
 #define SMS_SMS_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <sys/types.h>
 
-struct http;
+struct inbox;
 struct sms;
 
 struct line {
@@ -25,21 +26,70 @@ typedef ssize_t (*sms_command_t)(
         struct sms * /*sms*/,
         const struct section * /*sections*/,
         size_t /*csection*/,
-        size_t /*ack*/);
+        size_t /*ack*/,
+        int /*argument*/);
 
-extern struct sms *sms_open(const char *device, int baudrate, struct http *h);
-extern int sms_run(struct sms *sms, const char *handshake);
+/* Queued commands go out highest priority first, in order within one */
+enum sms_priority {
+    SMS_PRIORITY_URGENT,    /* Acknowledgements */
+    SMS_PRIORITY_HIGH,      /* Reads */
+    SMS_PRIORITY_LOW,       /* Deletes */
+    SMS_PRIORITIES
+};
+
+struct sms_stats {
+    size_t queued;      /* Waiting right now */
+    size_t peak;        /* Most ever waiting */
+    size_t sent;
+    size_t errors;      /* Final result codes but OK */
+    int64_t waited;     /* Nanoseconds spent queued, all commands */
+    int64_t response;   /* Nanoseconds to the final result code, smoothed */
+    int64_t slowest;
+    int64_t cooling;    /* Nanoseconds between an ACK and the next command */
+};
+
+/* Uploads with `token` through `inbox`, which might be shared */
+extern struct sms *sms_open(
+        const char *device,
+        int baudrate,
+        struct inbox *inbox,
+        const char *token);
+
+/* Handshakes and queues the first commands, sent once running */
+extern int sms_start(struct sms *sms, const char *handshake, int direct);
+
+/* All of them at once, until one fails or it's time to quit */
+extern int sms_run(struct sms *const *sms, size_t count, struct inbox *inbox);
 extern void sms_close(struct sms *sms);
+extern void sms_get_stats(const struct sms *sms, struct sms_stats *stats);
 
 /* Provide to vendor implementations */
 extern char *sms_get_value(const char *s);
 extern int sms_send(
         struct sms *sms,
+        enum sms_priority priority,
         const char *command,
-        sms_command_t callback);
+        sms_command_t callback,
+        int argument);
+
+/* Whether a command beginning with `prefix` is queued and not sent yet */
+extern int sms_is_waiting(
+        struct sms *sms,
+        enum sms_priority priority,
+        const char *prefix);
+
+/* Turn the first such command into this one, 1 if there's none */
+extern int sms_replace(
+        struct sms *sms,
+        enum sms_priority priority,
+        const char *prefix,
+        const char *command,
+        sms_command_t callback,
+        int argument);
 
 extern int sms_inbox_prepare(struct sms *sms, int index);
-extern int sms_inbox_commit(struct sms *sms, const char *what);
+extern int sms_inbox_commit(struct sms *sms, int index, const char *what);
+extern int sms_inbox_deliver(struct sms *sms, const char *what);
 extern int sms_inbox_push(
         struct sms *sms,
         int index,
@@ -68,7 +118,15 @@ extern int sms_on_urc(
         const struct section *s);
 
 extern int sms_read_all_sms(struct sms *sms);
+extern int sms_set_delivery(struct sms *sms, int direct);
+extern int sms_acknowledge_sms(struct sms *sms); /* The oldest +CMT */
 extern int sms_read_sms(struct sms *sms, int index);
-extern int sms_delete_sms(struct sms *sms, int index);
+
+/* Chained as the queue allows, `*queued` of them even if it fails */
+extern int sms_delete_sms(
+        struct sms *sms,
+        const int *index,
+        size_t count,
+        size_t *queued);
 
 #endif /* SMS_SMS_H */
@@ -0,0 +1,442 @@
+#include "spool.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+
+#include <flinter/thread/mutex_locker.h>
+
+extern "C" {
+#include "logger.h"
+} // extern "C"
+
+namespace {
+
+const char kMagic[8] = { 'S', 'M', 'S', 'P', 'O', 'O', 'L', '1' };
+const size_t kInitial = 1048576;    // 1MiB
+const size_t kMaximum = 67108864;   // 64MiB
+const size_t kPage = 4096;
+
+const uint32_t kRecord = 1;
+const uint32_t kDone = 2; // Offsets of records done
+
+size_t align(size_t n, size_t alignment)
+{
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+// FNV-1a, just to tell torn writes apart.
+uint32_t checksum(uint32_t h, const void *data, size_t length)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < length; ++i) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+
+    return h;
+}
+
+} // anonymous namespace
+
+struct Spool::Header {
+    char magic[8];
+    uint32_t generation;
+    uint32_t reserved;
+    uint64_t begin; // Checkpoint, no record before is pending
+}; // struct Spool::Header
+
+// Followed by `length` bytes and padded to 8 bytes.
+struct Spool::Frame {
+    uint32_t length;
+    uint32_t checksum; // Of everything after it
+    uint32_t generation;
+    uint32_t kind;
+}; // struct Spool::Frame
+
+static const size_t kStart = 64; // Where records begin
+
+Spool::Spool(const char *path)
+        : _path(path)
+        , _header(nullptr)
+        , _base(nullptr)
+        , _capacity(0)
+        , _synced(kStart)
+        , _tail(kStart)
+        , _dirty(false)
+        , _full(false)
+        , _fd(-1)
+{
+    // Intended left blank
+}
+
+Spool::~Spool()
+{
+    if (_base) {
+        munmap(_base, _capacity);
+    }
+
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool Spool::Map(size_t capacity)
+{
+    void *const base = _base ? mremap(_base, _capacity, capacity, MREMAP_MAYMOVE)
+                             : mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, _fd, 0);
+
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    _base = static_cast<char *>(base);
+    _header = reinterpret_cast<Header *>(_base);
+    _capacity = capacity;
+    return true;
+}
+
+bool Spool::Create()
+{
+    if (ftruncate(_fd, static_cast<off_t>(kInitial)) || !Map(kInitial)) {
+        return false;
+    }
+
+    memset(_header, 0, kStart);
+    memcpy(_header->magic, kMagic, sizeof(kMagic));
+    _header->generation = 1;
+    _header->begin = kStart;
+    return msync(_base, kPage, MS_SYNC) == 0;
+}
+
+bool Spool::Open(const std::function<void (uint64_t sequence,
+                                            const std::string &record)> &pending)
+{
+    _fd = open(_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (_fd < 0) {
+        LOGE("Spool: failed to open [%s]: %d: %s",
+                _path.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(_fd, &st)) {
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        LOGI("Spool: created [%s]", _path.c_str());
+        return Create();
+    }
+
+    if (size < kInitial || size > kMaximum || size % kPage || !Map(size)) {
+        LOGE("Spool: [%s] is not a spool", _path.c_str());
+        return false;
+    }
+
+    if (memcmp(_header->magic, kMagic, sizeof(kMagic))    ||
+        _header->begin < kStart                           ||
+        _header->begin > _capacity                        ||
+        _header->begin % 8                                ){
+
+        LOGE("Spool: [%s] is corrupted", _path.c_str());
+        return false;
+    }
+
+    std::map<size_t, std::string> records;
+    size_t offset = _header->begin;
+    while (offset + sizeof(Frame) <= _capacity) {
+        const Frame *const f = reinterpret_cast<const Frame *>(_base + offset);
+        const char *const data = reinterpret_cast<const char *>(f + 1);
+        if (f->length == 0                                          ||
+            f->length > _capacity - offset - sizeof(Frame)          ||
+            f->generation != _header->generation                    ||
+            f->checksum != checksum(2166136261u, &f->generation,
+                                    sizeof(*f) - 8 + f->length)     ){
+
+            break;
+        }
+
+        if (f->kind == kRecord) {
+            records.emplace(offset, std::string(data, f->length));
+
+        } else if (f->kind == kDone) {
+            for (size_t i = 0; i + 8 <= f->length; i += 8) {
+                uint64_t done;
+                memcpy(&done, data + i, sizeof(done));
+                records.erase(static_cast<size_t>(done));
+            }
+
+        } else {
+            break;
+        }
+
+        offset += align(sizeof(Frame) + f->length, 8);
+    }
+
+    _tail = offset;
+    _synced = offset;
+    LOGI("Spool: [%s] generation=%u begin=%lu tail=%lu pending=%lu",
+            _path.c_str(), _header->generation,
+            static_cast<unsigned long>(_header->begin),
+            static_cast<unsigned long>(_tail), records.size());
+
+    if (records.empty()) {
+        return Rewind();
+    }
+
+    const uint64_t generation = static_cast<uint64_t>(_header->generation) << 32;
+    for (auto &&r : records) {
+        _pending.insert(r.first);
+        pending(generation | r.first, r.second);
+    }
+
+    return true;
+}
+
+bool Spool::Grow(size_t length)
+{
+    size_t capacity = _capacity;
+    while (capacity < _tail + length) {
+        capacity *= 2;
+    }
+
+    if (capacity > kMaximum) {
+        return false;
+    }
+
+    if (ftruncate(_fd, static_cast<off_t>(capacity)) || !Map(capacity)) {
+        LOGW("Spool: failed to grow to %lu: %d: %s",
+                static_cast<unsigned long>(capacity), errno, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+// Only when nothing is pending. Records of the generation before are left
+// in place, and the new header must be on disk before they're overwritten.
+bool Spool::Rewind()
+{
+    const uint64_t begin = _header->begin;
+    ++_header->generation;
+    _header->begin = kStart;
+    if (msync(_base, kPage, MS_SYNC)) {
+        LOGW("Spool: failed to rewind: %d: %s", errno, strerror(errno));
+        --_header->generation;
+        _header->begin = begin;
+        return false;
+    }
+
+    _tail = kStart;
+    _synced = kStart;
+    _moved.clear();
+    _dirty = false;
+    _full = false;
+    return true;
+}
+
+// Records pending are copied to the start in a new generation, where only
+// records done are as long as the checkpoint on disk is past them. Until
+// the header is switched over, replaying still finds them where they were.
+bool Spool::Compact()
+{
+    Checkpoint();
+    size_t tail = kStart;
+    for (auto offset : _pending) {
+        const Frame *const f = reinterpret_cast<const Frame *>(_base + offset);
+        tail += align(sizeof(Frame) + f->length, 8);
+    }
+
+    if (tail + sizeof(Frame) > _header->begin) {
+        return false;
+    }
+
+    if (msync(_base, kPage, MS_SYNC)) {
+        LOGW("Spool: failed to checkpoint: %d: %s", errno, strerror(errno));
+        return false;
+    }
+
+    _dirty = false;
+    const uint64_t from = static_cast<uint64_t>(_header->generation) << 32;
+    const uint64_t to = from + (1ull << 32);
+    const uint32_t generation = _header->generation + 1;
+
+    std::map<size_t, size_t> offsets;
+    tail = kStart;
+    for (auto offset : _pending) {
+        const Frame *const f = reinterpret_cast<const Frame *>(_base + offset);
+        Frame *const g = reinterpret_cast<Frame *>(_base + tail);
+        g->length = f->length;
+        g->generation = generation;
+        g->kind = kRecord;
+        memcpy(g + 1, f + 1, f->length);
+        g->checksum = checksum(2166136261u, &g->generation, sizeof(*g) - 8 + g->length);
+        offsets.emplace(offset, tail);
+        tail += align(sizeof(Frame) + f->length, 8);
+    }
+
+    memset(_base + tail, 0, sizeof(Frame));
+    if (msync(_base, align(tail + sizeof(Frame), kPage), MS_SYNC)) {
+        LOGW("Spool: failed to compact: %d: %s", errno, strerror(errno));
+        return false;
+    }
+
+    const uint64_t begin = _header->begin;
+    _header->generation = generation;
+    _header->begin = kStart;
+    if (msync(_base, kPage, MS_SYNC)) {
+        LOGW("Spool: failed to compact: %d: %s", errno, strerror(errno));
+        --_header->generation;
+        _header->begin = begin;
+        return false;
+    }
+
+    // Sequences given out still lead to the records, wherever they are now
+    std::set<size_t> moved;
+    for (auto &&m : _moved) {
+        const size_t offset = static_cast<size_t>(m.second & UINT32_MAX);
+        moved.insert(offset);
+        m.second = to | offsets[offset];
+    }
+
+    _pending.clear();
+    for (auto &&o : offsets) {
+        if (!moved.count(o.first)) {
+            _moved.emplace(from | o.first, to | o.second);
+        }
+
+        _pending.insert(o.second);
+    }
+
+    LOGI("Spool: compacted %lu records from %lu bytes into %lu",
+            offsets.size(), static_cast<unsigned long>(_tail),
+            static_cast<unsigned long>(tail));
+
+    _tail = tail;
+    _synced = tail;
+    _full = false;
+    return true;
+}
+
+bool Spool::Reclaim()
+{
+    return _pending.empty() ? Rewind() : Compact();
+}
+
+uint64_t Spool::Write(uint32_t kind, const void *data, size_t length)
+{
+    const size_t total = align(sizeof(Frame) + length, 8);
+    if (length == 0 || length > UINT32_MAX) {
+        return 0;
+    }
+
+    // Leaves room for the empty frame after that ends replaying
+    if (_tail + total + sizeof(Frame) > _capacity && !Grow(total + sizeof(Frame))) {
+        return 0;
+    }
+
+    Frame *const f = reinterpret_cast<Frame *>(_base + _tail);
+    f->length = static_cast<uint32_t>(length);
+    f->generation = _header->generation;
+    f->kind = kind;
+    memcpy(f + 1, data, length);
+    f->checksum = checksum(2166136261u, &f->generation, sizeof(*f) - 8 + length);
+    memset(_base + _tail + total, 0, sizeof(Frame));
+
+    const size_t offset = _tail;
+    _tail += total;
+    return static_cast<uint64_t>(_header->generation) << 32 | offset;
+}
+
+uint64_t Spool::Append(const std::string &record)
+{
+    flinter::MutexLocker locker(&_mutex);
+    uint64_t sequence = Write(kRecord, record.data(), record.length());
+    if (!sequence && Reclaim()) {
+        sequence = Write(kRecord, record.data(), record.length());
+    }
+
+    if (!sequence) {
+        _full = true;
+        return 0;
+    }
+
+    _pending.insert(static_cast<size_t>(sequence & UINT32_MAX));
+    return sequence;
+}
+
+bool Spool::full()
+{
+    flinter::MutexLocker locker(&_mutex);
+    return _full;
+}
+
+void Spool::Checkpoint()
+{
+    const size_t begin = _pending.empty() ? _tail : *_pending.begin();
+    if (_header->begin != begin) {
+        _header->begin = begin;
+        _dirty = true;
+    }
+}
+
+bool Spool::Sync()
+{
+    flinter::MutexLocker locker(&_mutex);
+    const size_t from = _synced / kPage * kPage;
+    if (_tail > _synced && msync(_base + from, _tail - from, MS_SYNC)) {
+        LOGW("Spool: failed to sync: %d: %s", errno, strerror(errno));
+        return false;
+    }
+
+    _synced = _tail;
+    if (_dirty) {
+        _dirty = msync(_base, kPage, MS_ASYNC) != 0;
+    }
+
+    return true;
+}
+
+void Spool::Done(const std::vector<uint64_t> &sequences)
+{
+    flinter::MutexLocker locker(&_mutex);
+    const uint64_t generation = _header->generation;
+
+    std::vector<uint64_t> done;
+    done.reserve(sequences.size());
+    for (auto s : sequences) {
+        auto p = _moved.find(s);
+        if (p != _moved.end()) {
+            s = p->second;
+            _moved.erase(p);
+        }
+
+        const size_t offset = static_cast<size_t>(s & UINT32_MAX);
+        if (s >> 32 == generation && _pending.erase(offset)) {
+            done.push_back(offset);
+        }
+    }
+
+    if (done.empty()) {
+        return;
+    }
+
+    // Reclaiming when the file's half full saves writing this down, or it
+    // would only grow as long as something is always pending
+    if (_tail >= _capacity / 2 && Reclaim()) {
+        return;
+    }
+
+    if (!Write(kDone, done.data(), done.size() * sizeof(*done.data()))) {
+        LOGW("Spool: full, %lu records might be replayed", done.size());
+    }
+
+    Checkpoint();
+}
@@ -0,0 +1,73 @@
+#ifndef SMS_SPOOL_H
+#define SMS_SPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <flinter/thread/mutex.h>
+
+/*
+ * Append-only file mapped into memory, where records stay until they're
+ * done. Each one is checksummed, so that replaying stops at whatever a crash
+ * tore. Records done are written down as well, and the header checkpoints
+ * where the first one not done is, so that replaying starts from there. Once
+ * everything is done the file is rewound, with a new generation telling the
+ * records before apart. Records still pending then are moved to the start
+ * with it, if they fit before the checkpoint, and keep their sequences.
+ */
+class Spool {
+public:
+    explicit Spool(const char *path);
+    ~Spool();
+
+    /* Calls `pending` with every record not done yet, in order */
+    bool Open(const std::function<void (uint64_t sequence,
+                                        const std::string &record)> &pending);
+
+    /* 0 if it can't be, the spool is full */
+    uint64_t Append(const std::string &record);
+
+    /* Records appended so far survive a crash once it returns true */
+    bool Sync();
+
+    /* Not to be replayed again, best effort */
+    void Done(const std::vector<uint64_t> &sequences);
+
+    /* Since Append() returned 0, until space is reclaimed */
+    bool full();
+
+private:
+    struct Header;
+    struct Frame;
+
+    bool Create();
+    bool Map(size_t capacity);
+    bool Grow(size_t length);
+    bool Rewind();
+    bool Compact();
+    bool Reclaim();
+    uint64_t Write(uint32_t kind, const void *data, size_t length);
+    void Checkpoint();
+
+    const std::string _path;
+    std::set<size_t> _pending; // Offsets of records not done
+    std::map<uint64_t, uint64_t> _moved; // Sequences given out to where they are
+    flinter::Mutex _mutex;
+    Header *_header;
+    char *_base;
+    size_t _capacity;
+    size_t _synced;
+    size_t _tail;
+    bool _dirty; // The checkpoint moved since it was synced
+    bool _full;
+    int _fd;
+
+}; // class Spool
+
+#endif /* SMS_SPOOL_H */
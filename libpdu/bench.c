@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pdu.h"
+#include "utf16.h"
+
+/* Throughput of pdu_decode() plus pdu_decode_text() for each coding scheme,
+ * and of the UTF-16 kernels against the scalar code. Run with
+ * `make -C libpdu bench`, numbers are only comparable on the same host. */
+
+struct vector {
+    const char *name;
+    int sending;
+    const char *hex;
+};
+
+static const struct vector VECTORS[] = {
+    { "gsm7 160 septets", 0,
+      "0891683108100005F0040D91683119325476F8000042701180743123A0B0986C46ABD9"
+      "6EB81C2C269BD16AB61B2E078BC966B49AED86CBC162B219AD66BBE172B0986C46ABD9"
+      "6EB81C2C269BD16AB61B2E078BC966B49AED86CBC162B219AD66BBE172B0986C46ABD9"
+      "6EB81C2C269BD16AB61B2E078BC966B49AED86CBC162B219AD66BBE172B0986C46ABD9"
+      "6EB81C2C269BD16AB61B2E078BC966B49AED86CBC162B219AD66BBE172" },
+    { "gsm7 concatenated", 0,
+      "0891683108100005F0440D91683119325476F800004270118074312310050003420201"
+      "E061391DF4769741" },
+    { "gsm7 turkish shifts", 0,
+      "0891683108100005F0440D91683119325476F8000042701180743123150625010124"
+      "0101C7C3E6B8496FE69B32104C00" },
+    { "8 bit", 0,
+      "0891683108100005F0040D91683119325476F80004427011807431232020212223242526"
+      "2728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F" },
+    { "ucs2 70 characters", 0,
+      "0891683108100005F0040D91683119325476F80008427011807431238C77ED4FE177ED"
+      "4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177"
+      "ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE1"
+      "77ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4F"
+      "E177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE177ED4FE1" },
+    { "ucs2 surrogates", 0,
+      "0891683108100005F0040D91683119325476F80008427011807431231A0065006D006F"
+      "006A00690020D83DDE00D83DDC4D0020006F006B" },
+};
+
+#define VECTOR_COUNT (sizeof(VECTORS) / sizeof(*VECTORS))
+
+/* Each measurement runs for about this long. */
+#define BENCH_NANOSECONDS 200000000LL
+
+static volatile size_t sink;
+
+static long long now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static size_t parse_hex(const char *s, unsigned char *output)
+{
+    unsigned int c;
+    size_t i;
+
+    for (i = 0; s[i * 2]; ++i) {
+        sscanf(s + i * 2, "%2X", &c);
+        output[i] = (unsigned char)c;
+    }
+
+    return i;
+}
+
+static void report(const char *name, long long elapsed, size_t iterations, size_t bytes)
+{
+    printf("%-28s %10.1f ns/op %10.1f MB/s\n", name,
+           (double)elapsed / (double)iterations,
+           (double)bytes * 1000.0 / (double)elapsed);
+}
+
+static int bench_decode(const struct vector *v)
+{
+    char text[PDU_MAXIMUM_TEXT];
+    unsigned char pdu[256];
+    long long elapsed;
+    long long start;
+    size_t iterations;
+    size_t length;
+    pdu_message_t m;
+    size_t size;
+    size_t i;
+
+    length = parse_hex(v->hex, pdu);
+    if (pdu_decode(pdu, length, v->sending, 1, &m, NULL) ||
+        pdu_decode_text(&m, text, &size)                 ){
+
+        fprintf(stderr, "%s: failed to decode\n", v->name);
+        return -1;
+    }
+
+    iterations = 0;
+    start = now();
+    do {
+        for (i = 0; i < 1000; ++i) {
+            pdu_decode(pdu, length, v->sending, 1, &m, NULL);
+            pdu_decode_text(&m, text, &size);
+            sink += size;
+        }
+
+        iterations += 1000;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_NANOSECONDS);
+
+    report(v->name, elapsed, iterations, iterations * length);
+    return 0;
+}
+
+typedef ssize_t (*utf16_t)(const void *, size_t, void *, size_t);
+
+static void bench_utf16(const char *name, utf16_t f, const unsigned char *s, size_t length)
+{
+    static char output[UTF16_UTF8_LENGTH(65536) + 64];
+    long long elapsed;
+    long long start;
+    size_t iterations;
+    size_t i;
+
+    iterations = 0;
+    start = now();
+    do {
+        for (i = 0; i < 100; ++i) {
+            sink += (size_t)f(s, length, output, sizeof(output));
+        }
+
+        iterations += 100;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_NANOSECONDS);
+
+    report(name, elapsed, iterations, iterations * length);
+}
+
+/* 64 KiB of `first`..`last` repeated, in UTF-16BE. */
+static void fill(unsigned char *s, unsigned int first, unsigned int last)
+{
+    unsigned int c;
+    size_t i;
+
+    for (i = 0, c = first; i < 65536; i += 2) {
+        s[i] = (unsigned char)(c >> 8);
+        s[i + 1] = (unsigned char)c;
+        c = c == last ? first : c + 1;
+    }
+}
+
+int main(void)
+{
+    static unsigned char utf16[65536];
+    char name[64];
+    size_t i;
+
+    for (i = 0; i < VECTOR_COUNT; ++i) {
+        if (bench_decode(&VECTORS[i])) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    fill(utf16, 0x20, 0x7E);
+    snprintf(name, sizeof(name), "utf16 ascii %s", utf16_kernel());
+    bench_utf16(name, utf16be_to_utf8, utf16, sizeof(utf16));
+    bench_utf16("utf16 ascii scalar", utf16be_to_utf8_scalar, utf16, sizeof(utf16));
+
+    fill(utf16, 0x391, 0x3C9);
+    snprintf(name, sizeof(name), "utf16 greek %s", utf16_kernel());
+    bench_utf16(name, utf16be_to_utf8, utf16, sizeof(utf16));
+    bench_utf16("utf16 greek scalar", utf16be_to_utf8_scalar, utf16, sizeof(utf16));
+
+    fill(utf16, 0x4E00, 0x9FA5);
+    snprintf(name, sizeof(name), "utf16 cjk %s", utf16_kernel());
+    bench_utf16(name, utf16be_to_utf8, utf16, sizeof(utf16));
+    bench_utf16("utf16 cjk scalar", utf16be_to_utf8_scalar, utf16, sizeof(utf16));
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,272 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pdu.h"
+
+/* Runs corpus.txt, which is made of pairs of lines:
+ *
+ *     <d|s>[n] <hex>
+ *     = <dump>
+ *
+ * "d" are received SMS-DELIVER and "s" are sent SMS-SUBMIT, "n" means the
+ * PDU doesn't start with the SMSC address. Lines starting with '#' and empty
+ * lines are ignored. With -u the corpus is written to stdout with every dump
+ * replaced by what the current decoder gives, to review with diff. */
+
+#define LINE_MAX_SIZE 4096
+
+struct dump {
+    char buffer[LINE_MAX_SIZE];
+    size_t length;
+};
+
+static void append(struct dump *d, const char *fmt, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, fmt);
+    ret = vsnprintf(d->buffer + d->length, sizeof(d->buffer) - d->length, fmt, ap);
+    va_end(ap);
+
+    if (ret > 0) {
+        d->length += (size_t)ret;
+        if (d->length >= sizeof(d->buffer)) {
+            d->length = sizeof(d->buffer) - 1;
+        }
+    }
+}
+
+static void append_hex(struct dump *d, const uint8_t *s, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; ++i) {
+        append(d, "%02X", s[i]);
+    }
+}
+
+/* Printable ASCII and UTF-8 as is, the rest escaped. */
+static void append_text(struct dump *d, const char *text, size_t length)
+{
+    unsigned char c;
+    size_t i;
+
+    append(d, "\"");
+    for (i = 0; i < length; ++i) {
+        c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            append(d, "\\%c", c);
+        } else if (c < 0x20 || c == 0x7F) {
+            append(d, "\\x%02X", c);
+        } else {
+            append(d, "%c", c);
+        }
+    }
+
+    append(d, "\"");
+}
+
+static void dump_failure(struct dump *d, pdu_result_t result, const char *why)
+{
+    append(d, "= %s %s",
+           result == PDU_NOT_IMPLEMENTED ? "NOT_IMPLEMENTED" : "FAILED",
+           why ? why : "");
+}
+
+static void dump_message(
+        struct dump *d,
+        const void *pdu,
+        size_t length,
+        int sending,
+        int has_smsc)
+{
+    const pdu_information_element_t *e;
+    char text[PDU_MAXIMUM_TEXT];
+    pdu_result_t result;
+    pdu_message_t m;
+    const char *why;
+    size_t size;
+    size_t i;
+
+    d->length = 0;
+    if ((result = pdu_decode(pdu, length, sending, has_smsc, &m, &why))) {
+        dump_failure(d, result, why);
+        return;
+    }
+
+    if ((result = pdu_decode_text(&m, text, &size))) {
+        dump_failure(d, result, "text");
+        return;
+    }
+
+    append(d, "= OK %s", m.type == PDU_DELIVER ? "DELIVER" : "SUBMIT");
+    if (has_smsc) {
+        append(d, " SMSC=%s", m.SMSC);
+    }
+
+    append(d, " ADDR=%s", m.TPAddress);
+    if (m.type == PDU_DELIVER) {
+        append(d, " SCTS=%ld", (long)m.TPServiceCentreTimeStamp);
+    } else {
+        append(d, " MR=%u VP=%ld", m.TPMessageReference, (long)m.TPValidityPeriod);
+    }
+
+    append(d, " PID=%u DCS=%u UDL=%u",
+           m.TPProtocolIdentifier, m.TPDataCodingScheme, m.TPUserDataLength);
+
+    if (m.TPUserDataHeaderIndicator) {
+        append(d, " UDH=");
+        for (i = 0; i < m.TPUserDataHeader.Count; ++i) {
+            e = &m.TPUserDataHeader.Elements[i];
+            append(d, "%s%02X:", i ? "," : "", e->Identifier);
+            append_hex(d, e->Data.data, e->Data.size);
+        }
+    }
+
+    append(d, " TEXT=");
+    append_text(d, text, size);
+}
+
+static int hex_value(int c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
+
+static ssize_t parse_hex(const char *s, uint8_t *output, size_t outlen)
+{
+    size_t length;
+    size_t i;
+    int h;
+    int l;
+
+    length = strlen(s);
+    if (length % 2 || length / 2 > outlen) {
+        return -1;
+    }
+
+    for (i = 0; i < length / 2; ++i) {
+        h = hex_value(s[i * 2]);
+        l = hex_value(s[i * 2 + 1]);
+        if (h < 0 || l < 0) {
+            return -1;
+        }
+
+        output[i] = (uint8_t)(h << 4 | l);
+    }
+
+    return (ssize_t)(length / 2);
+}
+
+static void chomp(char *line)
+{
+    size_t length;
+
+    length = strlen(line);
+    while (length && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+        line[--length] = '\0';
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char expected[LINE_MAX_SIZE];
+    char line[LINE_MAX_SIZE];
+    uint8_t pdu[LINE_MAX_SIZE / 2];
+    struct dump d;
+    size_t lineno;
+    size_t passed;
+    size_t failed;
+    int has_smsc;
+    int sending;
+    int update;
+    ssize_t ret;
+    FILE *file;
+    char *hex;
+    int opt;
+
+    update = 0;
+    while ((opt = getopt(argc, argv, "u")) != -1) {
+        switch (opt) {
+        case 'u': update = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-u] <corpus>\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        fprintf(stderr, "Usage: %s [-u] <corpus>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!(file = fopen(argv[optind], "r"))) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    lineno = passed = failed = 0;
+    while (fgets(line, sizeof(line), file)) {
+        ++lineno;
+        chomp(line);
+        if (!line[0] || line[0] == '#' || line[0] == '=') {
+            if (update && line[0] != '=') {
+                printf("%s\n", line);
+            }
+
+            continue;
+        }
+
+        sending = line[0] == 's';
+        has_smsc = line[1] != 'n';
+        if ((line[0] != 'd' && line[0] != 's') || !(hex = strchr(line, ' '))) {
+            fprintf(stderr, "%s:%zu: bad vector\n", argv[optind], lineno);
+            fclose(file);
+            return EXIT_FAILURE;
+        }
+
+        if ((ret = parse_hex(hex + 1, pdu, sizeof(pdu))) < 0) {
+            fprintf(stderr, "%s:%zu: bad hex\n", argv[optind], lineno);
+            fclose(file);
+            return EXIT_FAILURE;
+        }
+
+        dump_message(&d, pdu, (size_t)ret, sending, has_smsc);
+        if (update) {
+            printf("%s\n%s\n", line, d.buffer);
+            continue;
+        }
+
+        expected[0] = '\0';
+        if (fgets(expected, sizeof(expected), file)) {
+            ++lineno;
+            chomp(expected);
+        }
+
+        if (strcmp(expected, d.buffer)) {
+            fprintf(stderr, "%s:%zu: mismatch\n  expected %s\n  got      %s\n",
+                    argv[optind], lineno, expected, d.buffer);
+            ++failed;
+        } else {
+            ++passed;
+        }
+    }
+
+    fclose(file);
+    if (!update) {
+        fprintf(stderr, "%zu passed, %zu failed\n", passed, failed);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
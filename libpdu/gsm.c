@@ -0,0 +1,244 @@
+#include "gsm.h"
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <emmintrin.h>
+#define GSM_SSE2 1
+#endif
+
+#define GSM_ESCAPE 0x1B
+
+/* UTF-8, NUL padded. Empty if unassigned. */
+struct glyph {
+    char utf8[4];
+};
+
+/* 6.2.1, escape shows as a space if nothing follows. */
+static const struct glyph default_alphabet[128] = {
+    {"@"}, {"£"}, {"$"}, {"¥"}, {"è"}, {"é"}, {"ù"}, {"ì"},
+    {"ò"}, {"Ç"}, {"\n"}, {"Ø"}, {"ø"}, {"\r"}, {"Å"}, {"å"},
+    {"Δ"}, {"_"}, {"Φ"}, {"Γ"}, {"Λ"}, {"Ω"}, {"Π"}, {"Ψ"},
+    {"Σ"}, {"Θ"}, {"Ξ"}, {" "}, {"Æ"}, {"æ"}, {"ß"}, {"É"},
+    {" "}, {"!"}, {"\""}, {"#"}, {"¤"}, {"%"}, {"&"}, {"'"},
+    {"("}, {")"}, {"*"}, {"+"}, {","}, {"-"}, {"."}, {"/"},
+    {"0"}, {"1"}, {"2"}, {"3"}, {"4"}, {"5"}, {"6"}, {"7"},
+    {"8"}, {"9"}, {":"}, {";"}, {"<"}, {"="}, {">"}, {"?"},
+    {"¡"}, {"A"}, {"B"}, {"C"}, {"D"}, {"E"}, {"F"}, {"G"},
+    {"H"}, {"I"}, {"J"}, {"K"}, {"L"}, {"M"}, {"N"}, {"O"},
+    {"P"}, {"Q"}, {"R"}, {"S"}, {"T"}, {"U"}, {"V"}, {"W"},
+    {"X"}, {"Y"}, {"Z"}, {"Ä"}, {"Ö"}, {"Ñ"}, {"Ü"}, {"§"},
+    {"¿"}, {"a"}, {"b"}, {"c"}, {"d"}, {"e"}, {"f"}, {"g"},
+    {"h"}, {"i"}, {"j"}, {"k"}, {"l"}, {"m"}, {"n"}, {"o"},
+    {"p"}, {"q"}, {"r"}, {"s"}, {"t"}, {"u"}, {"v"}, {"w"},
+    {"x"}, {"y"}, {"z"}, {"ä"}, {"ö"}, {"ñ"}, {"ü"}, {"à"},
+};
+
+/* A.3.1 and A.3.3, Spanish doesn't have its own. */
+static const struct glyph turkish_alphabet[128] = {
+    {"@"}, {"£"}, {"$"}, {"¥"}, {"€"}, {"é"}, {"ù"}, {"ı"},
+    {"ò"}, {"Ç"}, {"\n"}, {"Ğ"}, {"ğ"}, {"\r"}, {"Å"}, {"å"},
+    {"Δ"}, {"_"}, {"Φ"}, {"Γ"}, {"Λ"}, {"Ω"}, {"Π"}, {"Ψ"},
+    {"Σ"}, {"Θ"}, {"Ξ"}, {" "}, {"Ş"}, {"ş"}, {"ß"}, {"É"},
+    {" "}, {"!"}, {"\""}, {"#"}, {"¤"}, {"%"}, {"&"}, {"'"},
+    {"("}, {")"}, {"*"}, {"+"}, {","}, {"-"}, {"."}, {"/"},
+    {"0"}, {"1"}, {"2"}, {"3"}, {"4"}, {"5"}, {"6"}, {"7"},
+    {"8"}, {"9"}, {":"}, {";"}, {"<"}, {"="}, {">"}, {"?"},
+    {"İ"}, {"A"}, {"B"}, {"C"}, {"D"}, {"E"}, {"F"}, {"G"},
+    {"H"}, {"I"}, {"J"}, {"K"}, {"L"}, {"M"}, {"N"}, {"O"},
+    {"P"}, {"Q"}, {"R"}, {"S"}, {"T"}, {"U"}, {"V"}, {"W"},
+    {"X"}, {"Y"}, {"Z"}, {"Ä"}, {"Ö"}, {"Ñ"}, {"Ü"}, {"§"},
+    {"ç"}, {"a"}, {"b"}, {"c"}, {"d"}, {"e"}, {"f"}, {"g"},
+    {"h"}, {"i"}, {"j"}, {"k"}, {"l"}, {"m"}, {"n"}, {"o"},
+    {"p"}, {"q"}, {"r"}, {"s"}, {"t"}, {"u"}, {"v"}, {"w"},
+    {"x"}, {"y"}, {"z"}, {"ä"}, {"ö"}, {"ñ"}, {"ü"}, {"à"},
+};
+
+static const struct glyph portuguese_alphabet[128] = {
+    {"@"}, {"£"}, {"$"}, {"¥"}, {"ê"}, {"é"}, {"ú"}, {"í"},
+    {"ó"}, {"ç"}, {"\n"}, {"Ô"}, {"ô"}, {"\r"}, {"Á"}, {"á"},
+    {"Δ"}, {"_"}, {"ª"}, {"Ç"}, {"À"}, {"∞"}, {"^"}, {"\\"},
+    {"€"}, {"Ó"}, {"|"}, {" "}, {"Â"}, {"â"}, {"Ê"}, {"É"},
+    {" "}, {"!"}, {"\""}, {"#"}, {"º"}, {"%"}, {"&"}, {"'"},
+    {"("}, {")"}, {"*"}, {"+"}, {","}, {"-"}, {"."}, {"/"},
+    {"0"}, {"1"}, {"2"}, {"3"}, {"4"}, {"5"}, {"6"}, {"7"},
+    {"8"}, {"9"}, {":"}, {";"}, {"<"}, {"="}, {">"}, {"?"},
+    {"Í"}, {"A"}, {"B"}, {"C"}, {"D"}, {"E"}, {"F"}, {"G"},
+    {"H"}, {"I"}, {"J"}, {"K"}, {"L"}, {"M"}, {"N"}, {"O"},
+    {"P"}, {"Q"}, {"R"}, {"S"}, {"T"}, {"U"}, {"V"}, {"W"},
+    {"X"}, {"Y"}, {"Z"}, {"Ã"}, {"Õ"}, {"Ú"}, {"Ü"}, {"§"},
+    {"~"}, {"a"}, {"b"}, {"c"}, {"d"}, {"e"}, {"f"}, {"g"},
+    {"h"}, {"i"}, {"j"}, {"k"}, {"l"}, {"m"}, {"n"}, {"o"},
+    {"p"}, {"q"}, {"r"}, {"s"}, {"t"}, {"u"}, {"v"}, {"w"},
+    {"x"}, {"y"}, {"z"}, {"ã"}, {"õ"}, {"`"}, {"ü"}, {"à"},
+};
+
+/* 6.2.1.1, all the single shift tables include it. */
+#define DEFAULT_EXTENSION \
+    [0x0A] = {"\f"}, [0x14] = {"^"}, [0x28] = {"{"}, [0x29] = {"}"}, \
+    [0x2F] = {"\\"}, [0x3C] = {"["}, [0x3D] = {"~"}, [0x3E] = {"]"}, \
+    [0x40] = {"|"},  [0x65] = {"€"}
+
+/* A.2.1 to A.2.3 */
+static const struct glyph default_extension[128] = {
+    DEFAULT_EXTENSION
+};
+
+static const struct glyph turkish_extension[128] = {
+    DEFAULT_EXTENSION,
+    [0x47] = {"Ğ"}, [0x49] = {"İ"}, [0x53] = {"Ş"}, [0x63] = {"ç"}, [0x67] = {"ğ"},
+    [0x69] = {"ı"}, [0x73] = {"ş"},
+};
+
+static const struct glyph spanish_extension[128] = {
+    DEFAULT_EXTENSION,
+    [0x09] = {"ç"}, [0x41] = {"Á"}, [0x49] = {"Í"}, [0x4F] = {"Ó"}, [0x55] = {"Ú"},
+    [0x61] = {"á"}, [0x69] = {"í"}, [0x6F] = {"ó"}, [0x75] = {"ú"},
+};
+
+static const struct glyph portuguese_extension[128] = {
+    DEFAULT_EXTENSION,
+    [0x05] = {"ê"}, [0x09] = {"ç"}, [0x0B] = {"Ô"}, [0x0C] = {"ô"}, [0x0E] = {"Á"},
+    [0x0F] = {"á"}, [0x12] = {"Φ"}, [0x13] = {"Γ"}, [0x15] = {"Ω"}, [0x16] = {"Π"},
+    [0x17] = {"Ψ"}, [0x18] = {"Σ"}, [0x19] = {"Θ"}, [0x1F] = {"Ê"}, [0x41] = {"À"},
+    [0x49] = {"Í"}, [0x4F] = {"Ó"}, [0x55] = {"Ú"}, [0x5B] = {"Ã"}, [0x5C] = {"Õ"},
+    [0x61] = {"Â"}, [0x69] = {"í"}, [0x6F] = {"ó"}, [0x75] = {"ú"}, [0x7B] = {"ã"},
+    [0x7C] = {"õ"}, [0x7F] = {"â"},
+};
+
+
+static const struct glyph *const locking_tables[] = {
+    default_alphabet,
+    turkish_alphabet,
+    default_alphabet,
+    portuguese_alphabet,
+};
+
+static const struct glyph *const single_tables[] = {
+    default_extension,
+    turkish_extension,
+    spanish_extension,
+    portuguese_extension,
+};
+
+#define GSM_LANGUAGES (sizeof(locking_tables) / sizeof(*locking_tables))
+
+#ifdef GSM_SSE2
+static inline __m128i sse2_range(__m128i v, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)(lo - 1))),
+                         _mm_cmpgt_epi8(_mm_set1_epi8((char)(hi + 1)), v));
+}
+
+/* 16 septets that are the same character in ASCII in every locking shift
+ * table, and so are copied as is. */
+static inline int sse2_is_ascii(__m128i v)
+{
+    const __m128i m = _mm_or_si128(
+            _mm_or_si128(
+                    _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(0x24)),
+                                     sse2_range(v, 0x20, 0x3F)),
+                    _mm_or_si128(sse2_range(v, 0x41, 0x5A),
+                                 sse2_range(v, 0x61, 0x7A))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+
+    return _mm_movemask_epi8(m) == 0xFFFF;
+}
+
+/* 8 septets out of the low 7 bytes of `v`. Lane k holds bytes k - 1 and k,
+ * septet k starts at bit 8 - k of it, multiplying by 2^k brings it to the
+ * high byte. */
+static inline __m128i sse2_unpack(__m128i v)
+{
+    const __m128i lanes = _mm_unpacklo_epi8(_mm_slli_si128(v, 1), v);
+    const __m128i shifted = _mm_mullo_epi16(
+            lanes, _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128));
+
+    return _mm_and_si128(_mm_srli_epi16(shifted, 8), _mm_set1_epi16(0x7F));
+}
+#endif /* GSM_SSE2 */
+
+void gsm_unpack(const uint8_t *s, size_t septets, uint8_t *output)
+{
+    unsigned int v;
+    size_t shift;
+    size_t bit;
+    size_t i;
+    size_t j;
+
+    i = 0;
+
+#ifdef GSM_SSE2
+    /* 16 septets from 14 bytes, the second 8 byte load reads one more. */
+    for (; septets - i >= 17; i += 16, s += 14, output += 16) {
+        _mm_storeu_si128((__m128i *)output, _mm_packus_epi16(
+                sse2_unpack(_mm_loadl_epi64((const __m128i *)s)),
+                sse2_unpack(_mm_loadl_epi64((const __m128i *)(s + 7)))));
+    }
+#endif
+
+    for (j = 0; i < septets; ++i, ++j) {
+        bit = j * 7;
+        shift = bit % 8;
+        v = s[bit / 8] >> shift;
+        if (shift > 1) {
+            v |= (unsigned int)s[bit / 8 + 1] << (8 - shift);
+        }
+
+        *output++ = (uint8_t)(v & 0x7F);
+    }
+}
+
+size_t gsm_decode(
+        const uint8_t *septets,
+        size_t count,
+        uint8_t locking,
+        uint8_t single,
+        char *output)
+{
+    const struct glyph *g;
+    const struct glyph *l;
+    const struct glyph *e;
+    size_t end;
+    size_t i;
+    uint8_t c;
+    char *o;
+
+    l = locking_tables[locking < GSM_LANGUAGES ? locking : 0];
+    e = single_tables[single < GSM_LANGUAGES ? single : 0];
+    o = output;
+
+    i = 0;
+    while (i < count) {
+#ifdef GSM_SSE2
+        if (count - i >= 16) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)(septets + i));
+            if (sse2_is_ascii(v)) {
+                _mm_storeu_si128((__m128i *)o, v);
+                i += 16;
+                o += 16;
+                continue;
+            }
+        }
+#endif
+
+        /* Up to the next block, or all the rest */
+        end = count - i >= 16 ? i + 16 : count;
+        while (i < end) {
+            c = septets[i++] & 0x7F;
+            g = &l[c];
+            if (c == GSM_ESCAPE && i < count) {
+                c = septets[i++] & 0x7F;
+
+                /* Unassigned ones show as in the locking shift table */
+                g = e[c].utf8[0] ? &e[c] : &l[c];
+            }
+
+            memcpy(o, g->utf8, 3);
+            o += 1 + !!g->utf8[1] + !!g->utf8[2];
+        }
+    }
+
+    return (size_t)(o - output);
+}
@@ -0,0 +1,42 @@
+#ifndef SMS_LIBPDU_GSM_H
+#define SMS_LIBPDU_GSM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* GSM 7 bit default alphabet of 3GPP TS 23.038 and its national language
+ * shift tables. */
+
+/* National language identifiers as in UDH elements 0x24 and 0x25. Tables
+ * of languages not listed here decode as the default ones. */
+enum gsm_language {
+    GSM_DEFAULT    = 0,
+    GSM_TURKISH    = 1,
+    GSM_SPANISH    = 2,
+    GSM_PORTUGUESE = 3,
+};
+
+/* Bytes gsm_decode() may write for `septets` septets. */
+#define GSM_UTF8_LENGTH(septets) ((septets) * 3)
+
+/* `s` must have `(septets * 7 + 7) / 8` bytes. */
+extern void gsm_unpack(const uint8_t *s, size_t septets, uint8_t *output);
+
+/* Translates septets into UTF-8 through the locking and single shift
+ * tables, returns bytes written. Not NUL terminated. */
+extern size_t gsm_decode(
+        const uint8_t *septets,
+        size_t count,
+        uint8_t locking,
+        uint8_t single,
+        char *output);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* SMS_LIBPDU_GSM_H */
@@ -0,0 +1,765 @@
+#include "pdu.h"
+
+#include <string.h>
+
+#include "gsm.h"
+#include "utf16.h"
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BIT(x, n) (!!((x) & (1 << n)))
+#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define BIT(x, n) (!!((x) & (128 >> n)))
+#else
+#error Unsupported endian
+#endif
+
+#define LEN_7to8(x) ((x) * 7 / 8 + !!((x) * 7 % 8))
+#define LEN_8to7(x) ((x) * 8 / 7 + !!((x) * 8 % 7))
+
+/* Where decoding stopped and why, `why` is always a string literal. */
+struct status {
+    pdu_result_t result;
+    const char *why;
+};
+
+static int fail(struct status *st, pdu_result_t r, const char *why)
+{
+    st->result = r;
+    st->why = why;
+    return -1;
+}
+
+static int decode_numeric(
+        const unsigned char *s,
+        size_t size,
+        char *output,
+        size_t max,
+        struct status *st)
+{
+    size_t i;
+    int c;
+    int n;
+
+    if (size * 2 >= max) {
+        return fail(st, PDU_FAILED, "numeric input too long");
+    }
+
+    for (i = 0; i < size; ++i) {
+        c = s[i];
+        n = c & 0x0F;
+        if (n >= 10) {
+            return fail(st, PDU_FAILED, "bad numeric input");
+        }
+
+        *output++ = (char)(n + '0');
+
+        n = c >> 4;
+        if (n == 0xF) {
+            if (i + 1 == size) {
+                break;
+            } else {
+                return fail(st, PDU_FAILED, "bad numeric terminator");
+            }
+        } else if (n >= 10) {
+            return fail(st, PDU_FAILED, "bad numeric input");
+        }
+
+        *output++ = (char)(n + '0');
+    }
+
+    *output = '\0';
+    return 0;
+}
+
+static int decode_alphanumeric(
+        const unsigned char *s,
+        size_t septets,
+        char *output,
+        size_t max,
+        struct status *st)
+{
+    uint8_t unpacked[16];
+
+    if (GSM_UTF8_LENGTH(septets) >= max) {
+        return fail(st, PDU_FAILED, "alphanumeric input too long");
+    }
+
+    gsm_unpack(s, septets, unpacked);
+    output[gsm_decode(unpacked, septets, 0, 0, output)] = '\0';
+    return 0;
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date, no mktime() here
+ * since glibc serializes it on the time zone lock. */
+static int64_t days_from_civil(int64_t y, int m, int d)
+{
+    int64_t era;
+    int64_t yoe;
+    int64_t doy;
+    int64_t doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static int decode_absolute_timestamp(
+        const unsigned char *s,
+        time_t *t,
+        struct status *st)
+{
+    int year;
+    int v[6];
+    int tz;
+    int lo;
+    int hi;
+    int i;
+
+    for (i = 0; i < 6; ++i) {
+        lo = s[i] & 0x0F;
+        hi = s[i] >> 4;
+        if (lo >= 10 || hi >= 10) {
+            return fail(st, PDU_FAILED, "bad timestamp");
+        }
+
+        v[i] = lo * 10 + hi;
+    }
+
+    /* Quarters of an hour, sign is the highest bit of the first digit */
+    tz = (s[6] & 0x07) * 10 + (s[6] >> 4);
+    if (s[6] & 0x08) {
+        tz = -tz;
+    }
+
+    year = v[0];
+    if (year <= 37) { /* Y2038 */
+        year += 100;
+    }
+
+    if (v[1] < 1 || v[1] > 12 || v[2] < 1 || v[2] > 31 ||
+        v[3] > 23 || v[4] > 59 || v[5] > 60) {
+
+        return fail(st, PDU_FAILED, "invalid timestamp");
+    }
+
+    /* UTC */
+    *t = (time_t)(days_from_civil(1900 + year, v[1], v[2]) * 86400
+                  + v[3] * 3600 + v[4] * 60 + v[5] - tz * 900);
+
+    return 0;
+}
+
+static time_t decode_relative_timestamp(const unsigned char *s)
+{
+    time_t t;
+
+    t = (time_t)(*s);
+    if (t <= 143) {
+        t = (t + 1) * 300;
+    } else if (t <= 167) {
+        t = (t - 143) * 1800 + 43200;
+    } else if (t <= 196) {
+        t = (t - 166) * 86400;
+    } else {
+        t = (t - 192) * 604800;
+    }
+
+    return -t;
+}
+
+/* `digits` is the number of useful semi-octets. */
+static int get_address_any(
+        const unsigned char *s,
+        size_t size,
+        size_t digits,
+        char *output,
+        struct status *st)
+{
+    int numbering_plan_identification;
+    int type_of_address;
+    int type_of_number;
+
+    type_of_address = *s;
+    if (!(type_of_address & 0x80)) {
+        return fail(st, PDU_NOT_IMPLEMENTED, "unsupported type of address");
+    }
+
+    ++s;
+    --size;
+    type_of_number = (type_of_address >> 4) & 0x07;
+    numbering_plan_identification = type_of_address & 0x0F;
+
+    /* International number : ANY */
+    /* Subscriber number : ISDN/telephone numbering plan */
+    if (type_of_number == 1 ||
+        (type_of_number == 4 && numbering_plan_identification == 1)) {
+
+        *output = '+';
+        return decode_numeric(s, size, output + 1, PDU_MAXIMUM_ADDRESS - 1, st);
+
+    /* National number : ANY */
+    /* Subscriber number : National numbering plan */
+    } else if (type_of_number == 2 ||
+               (type_of_number == 4 && numbering_plan_identification == 8)) {
+
+        return decode_numeric(s, size, output, PDU_MAXIMUM_ADDRESS, st);
+
+    /* Alphanumeric */
+    } else if (type_of_number == 5 && numbering_plan_identification == 0) {
+        return decode_alphanumeric(s, digits * 4 / 7, output,
+                                   PDU_MAXIMUM_ADDRESS, st);
+
+    } else {
+        return fail(st, PDU_NOT_IMPLEMENTED, "unsupported number plan");
+    }
+}
+
+static int get_address(
+        const unsigned char *s,
+        size_t max,
+        char *output,
+        size_t *used,
+        struct status *st)
+{
+    size_t length;
+    size_t size;
+
+    if (!max) {
+        return fail(st, PDU_FAILED, "bad address length");
+    }
+
+    length = (size_t)(*s);
+    size = (length + (length % 2)) / 2 + 2;
+    if (size > max) {
+        return fail(st, PDU_FAILED, "bad address length");
+    }
+
+    *used = size;
+    return get_address_any(s + 1, size - 1, length, output, st);
+}
+
+static int get_smsc_number(
+        const unsigned char *s,
+        size_t max,
+        char *output,
+        size_t *used,
+        struct status *st)
+{
+    size_t size;
+
+    if (!max) {
+        return fail(st, PDU_FAILED, "bad smsc length");
+    }
+
+    size = (size_t)*s;
+    if (size == 0) {
+        *output = '\0';
+        *used = 1;
+        return 0;
+    }
+
+    ++s;
+    --max;
+    if (size > max) {
+        return fail(st, PDU_FAILED, "bad smsc length");
+    }
+
+    *used = size + 1;
+    return get_address_any(s, size, (size - 1) * 2, output, st);
+}
+
+static int decode_user_data_header(
+        const unsigned char *p,
+        size_t udhlen,
+        pdu_user_data_header_t *udh,
+        struct status *st)
+{
+    uint8_t InformationElementIdentifier;
+    pdu_information_element_t *ie;
+    uint8_t expected;
+    uint8_t Length;
+
+    udh->Count = 0;
+    while (udhlen) {
+        if (udhlen < 3) {
+            return fail(st, PDU_FAILED, "bad user data header length");
+        }
+
+        InformationElementIdentifier = *p;
+        Length = *(p + 1);
+        udhlen -= 2;
+        p += 2;
+
+        if (udhlen < Length) {
+            return fail(st, PDU_FAILED, "bad user data header length");
+        }
+
+        expected = 0;
+        switch (InformationElementIdentifier) {
+        case 0: expected = 3; break;
+        case 4: expected = 2; break;
+        case 5: expected = 4; break;
+        case 8: expected = 4; break;
+        case 0x24: expected = 1; break;
+        case 0x25: expected = 1; break;
+        };
+
+        if (expected && expected != Length) {
+            return fail(st, PDU_FAILED, "bad user data header");
+        }
+
+        /* TP-UDL caps the header at 140 bytes, but don't count on it */
+        if (udh->Count == PDU_MAXIMUM_ELEMENTS) {
+            return fail(st, PDU_FAILED, "too many elements");
+        }
+
+        ie = &udh->Elements[udh->Count++];
+        ie->Identifier = InformationElementIdentifier;
+        ie->Data.data = p;
+        ie->Data.size = Length;
+
+        udhlen -= Length;
+        p += Length;
+    }
+
+    return 0;
+}
+
+static int decode_user_data(
+        const unsigned char *s,
+        size_t max,
+        pdu_message_t *pdu,
+        struct status *st)
+{
+    uint32_t TPUserDataHeaderLength;
+    uint32_t TPUserDataLength;
+    uint32_t len;
+
+    pdu->TPUserDataHeader.Count = 0;
+    if (!max) {
+        return fail(st, PDU_FAILED, "bad user data length");
+    }
+
+    TPUserDataLength = *s;
+    --max;
+    ++s;
+
+    pdu->TPUserDataLength = (uint8_t)TPUserDataLength;
+    pdu->TPUserData.data = s;
+    pdu->TPUserData.size = max;
+
+    if (pdu->TPDataCodingScheme & 0xE0) {
+        return fail(st, PDU_NOT_IMPLEMENTED, "unsupported data coding scheme");
+    }
+
+    switch ((pdu->TPDataCodingScheme & 0x0C) >> 2) {
+    case 0: /* alphabet */
+        len = LEN_7to8(TPUserDataLength);
+        if (TPUserDataLength > 160 || len != max) {
+            return fail(st, PDU_FAILED, "bad alphabet user data length");
+        }
+
+        if (pdu->TPUserDataHeaderIndicator) {
+            if (!len) {
+                return fail(st, PDU_FAILED, "bad alphabet user data header length");
+            }
+
+            TPUserDataHeaderLength = *s;
+            if (1 + TPUserDataHeaderLength > len) {
+                return fail(st, PDU_FAILED, "bad alphabet user data header length");
+            }
+
+            if (LEN_8to7(1 + TPUserDataHeaderLength) > TPUserDataLength) {
+                return fail(st, PDU_FAILED, "bad alphabet user data header length");
+            }
+
+            return decode_user_data_header(s + 1, TPUserDataHeaderLength,
+                                           &pdu->TPUserDataHeader, st);
+        }
+
+        return 0;
+
+    case 1: /* 8 bit */
+        if (TPUserDataLength > 140 || TPUserDataLength != max) {
+            return fail(st, PDU_FAILED, "bad 8 bit user data length");
+        }
+
+        if (pdu->TPUserDataHeaderIndicator) {
+            if (!max) {
+                return fail(st, PDU_FAILED, "bad 8 bit user data header length");
+            }
+
+            TPUserDataHeaderLength = *s;
+            if (1 + TPUserDataHeaderLength > TPUserDataLength) {
+                return fail(st, PDU_FAILED, "bad 8 bit user data header length");
+            }
+
+            return decode_user_data_header(s + 1, TPUserDataHeaderLength,
+                                           &pdu->TPUserDataHeader, st);
+        }
+
+        return 0;
+
+    case 2: /* UCS-2 */
+        if (TPUserDataLength > 140 || TPUserDataLength != max) {
+            return fail(st, PDU_FAILED, "bad UCS-2 user data length");
+        }
+
+        if (pdu->TPUserDataHeaderIndicator) {
+            if (!max) {
+                return fail(st, PDU_FAILED, "bad UCS-2 user data header length");
+            }
+
+            TPUserDataHeaderLength = *s;
+            if (1 + TPUserDataHeaderLength >= TPUserDataLength) {
+                return fail(st, PDU_FAILED, "bad UCS-2 user data header length");
+            }
+
+            return decode_user_data_header(s + 1, TPUserDataHeaderLength,
+                                           &pdu->TPUserDataHeader, st);
+        }
+
+        return 0;
+
+    case 3:  /* Reserved */
+    default: /* Unreachable */
+        return fail(st, PDU_NOT_IMPLEMENTED, "unsupported data coding scheme");
+    }
+}
+
+static int decode_sms_deliver(
+        const unsigned char *s,
+        size_t max,
+        pdu_message_t *pdu,
+        struct status *st)
+{
+    size_t ret;
+
+    if (!max) {
+        return fail(st, PDU_FAILED, "bad message length");
+    }
+
+    pdu->TPMessageTypeIndicator0   = BIT(*s, 0);
+    pdu->TPMessageTypeIndicator1   = BIT(*s, 1);
+    pdu->TPMoreMessagesToSend      = BIT(*s, 2);
+    pdu->TPStatusReportIndication  = BIT(*s, 5);
+    pdu->TPUserDataHeaderIndicator = BIT(*s, 6);
+    pdu->TPReplyPath               = BIT(*s, 7);
+
+    --max;
+    ++s;
+
+    if (get_address(s, max, pdu->TPAddress, &ret, st)) {
+        return -1;
+    }
+
+    max -= ret;
+    s += ret;
+
+    if (max < 10) {
+        return fail(st, PDU_FAILED, "bad message length");
+    }
+
+    pdu->TPProtocolIdentifier = *s;
+    --max;
+    ++s;
+
+    pdu->TPDataCodingScheme = *s;
+    --max;
+    ++s;
+
+    if (decode_absolute_timestamp(s, &pdu->TPServiceCentreTimeStamp, st)) {
+        return -1;
+    }
+
+    max -= 7;
+    s += 7;
+
+    return decode_user_data(s, max, pdu, st);
+}
+
+static int decode_sms_submit(
+        const unsigned char *s,
+        size_t max,
+        pdu_message_t *pdu,
+        struct status *st)
+{
+    size_t vp;
+    size_t ret;
+
+    if (!max) {
+        return fail(st, PDU_FAILED, "bad message length");
+    }
+
+    pdu->TPMessageTypeIndicator0   = BIT(*s, 0);
+    pdu->TPMessageTypeIndicator1   = BIT(*s, 1);
+    pdu->TPRejectDuplicates        = BIT(*s, 2);
+    pdu->TPValidityPeriodFormat3   = BIT(*s, 3);
+    pdu->TPValidityPeriodFormat4   = BIT(*s, 4);
+    pdu->TPStatusReportRequest     = BIT(*s, 5);
+    pdu->TPUserDataHeaderIndicator = BIT(*s, 6);
+    pdu->TPReplyPath               = BIT(*s, 7);
+    --max;
+    ++s;
+
+    if (!max) {
+        return fail(st, PDU_FAILED, "bad message length");
+    }
+
+    pdu->TPMessageReference = *s;
+    --max;
+    ++s;
+
+    if (get_address(s, max, pdu->TPAddress, &ret, st)) {
+        return -1;
+    }
+
+    max -= ret;
+    s += ret;
+
+    /* TP-PID, TP-DCS and TP-UDL around TP-VP, which might be absent */
+    vp = pdu->TPValidityPeriodFormat4 ? (pdu->TPValidityPeriodFormat3 ? 7 : 1) : 0;
+    if (max < 3 + vp) {
+        return fail(st, PDU_FAILED, "bad message length");
+    }
+
+    pdu->TPProtocolIdentifier = *s;
+    --max;
+    ++s;
+
+    pdu->TPDataCodingScheme = *s;
+    --max;
+    ++s;
+
+    pdu->TPValidityPeriod = 0;
+    if (pdu->TPValidityPeriodFormat4 == 1 && pdu->TPValidityPeriodFormat3 == 0) {
+        pdu->TPValidityPeriod = decode_relative_timestamp(s);
+        --max;
+        ++s;
+
+    } else if (pdu->TPValidityPeriodFormat4 == 0 && pdu->TPValidityPeriodFormat3 == 1) {
+        return fail(st, PDU_NOT_IMPLEMENTED, "unsupported validity period");
+
+    } else if (pdu->TPValidityPeriodFormat4 == 1 && pdu->TPValidityPeriodFormat3 == 1) {
+        if (decode_absolute_timestamp(s, &pdu->TPValidityPeriod, st)) {
+            return -1;
+        }
+
+        max -= 7;
+        s += 7;
+    }
+
+    return decode_user_data(s, max, pdu, st);
+}
+
+static int decode(
+        const unsigned char *s,
+        size_t max,
+        int sending,
+        int has_smsc,
+        pdu_message_t *m,
+        struct status *st)
+{
+    uint8_t TPMessageTypeIndicator0;
+    uint8_t TPMessageTypeIndicator1;
+    size_t ret;
+
+    m->SMSC[0] = '\0';
+    if (has_smsc) {
+        if (get_smsc_number(s, max, m->SMSC, &ret, st)) {
+            return -1;
+        }
+
+        max -= ret;
+        s += ret;
+    }
+
+    if (!max) {
+        return fail(st, PDU_FAILED, "bad message length");
+    }
+
+    TPMessageTypeIndicator0 = BIT(*s, 0);
+    TPMessageTypeIndicator1 = BIT(*s, 1);
+
+    if (sending) {
+        if (TPMessageTypeIndicator1 == 0 && TPMessageTypeIndicator0 == 0) {
+            return fail(st, PDU_NOT_IMPLEMENTED, "SMS Deliver Report");
+
+        } else if (TPMessageTypeIndicator1 == 1 && TPMessageTypeIndicator0 == 0) {
+            return fail(st, PDU_NOT_IMPLEMENTED, "SMS Command");
+
+        } else if (TPMessageTypeIndicator1 == 0 && TPMessageTypeIndicator0 == 1) {
+            m->type = PDU_SUBMIT;
+            return decode_sms_submit(s, max, m, st);
+
+        } else {
+            return fail(st, PDU_NOT_IMPLEMENTED, "unsupported outgoing message type");
+        }
+
+    } else {
+        if (TPMessageTypeIndicator1 == 0 && TPMessageTypeIndicator0 == 0) {
+            m->type = PDU_DELIVER;
+            return decode_sms_deliver(s, max, m, st);
+
+        } else if (TPMessageTypeIndicator1 == 1 && TPMessageTypeIndicator0 == 0) {
+            return fail(st, PDU_NOT_IMPLEMENTED, "SMS Status Report");
+
+        } else if (TPMessageTypeIndicator1 == 0 && TPMessageTypeIndicator0 == 1) {
+            return fail(st, PDU_NOT_IMPLEMENTED, "SMS Submit Report");
+
+        } else {
+            return fail(st, PDU_NOT_IMPLEMENTED, "unsupported incoming message type");
+        }
+    }
+}
+
+pdu_result_t pdu_decode(
+        const void *buffer,
+        size_t length,
+        int sending,
+        int has_smsc,
+        pdu_message_t *message,
+        const char **why)
+{
+    struct status st;
+
+    st.result = PDU_OK;
+    st.why = NULL;
+    memset(message, 0, sizeof(*message));
+    decode((const unsigned char *)buffer, length,
+           sending, has_smsc, message, &st);
+
+    if (why) {
+        *why = st.why;
+    }
+
+    return st.result;
+}
+
+pdu_result_t pdu_decode_text(
+        const pdu_message_t *message,
+        char *buffer,
+        size_t *length)
+{
+    const pdu_information_element_t *locking;
+    const pdu_information_element_t *single;
+    const unsigned char *s;
+    uint8_t septets[256];
+    size_t size;
+    size_t skip;
+    ssize_t ret;
+
+    s = message->TPUserData.data;
+    size = message->TPUserData.size;
+    skip = 0;
+
+    *length = 0;
+    if (message->TPUserDataHeaderIndicator) {
+        skip = 1 + (size_t)(*s);
+    }
+
+    switch ((message->TPDataCodingScheme & 0x0C) >> 2) {
+    case 0: /* alphabet */
+        /* Header is padded to septet boundary */
+        skip = LEN_8to7(skip);
+        if (skip < message->TPUserDataLength) {
+            locking = pdu_find_information_element(&message->TPUserDataHeader, 0x25);
+            single = pdu_find_information_element(&message->TPUserDataHeader, 0x24);
+
+            gsm_unpack(s, message->TPUserDataLength, septets);
+            *length = gsm_decode(septets + skip,
+                                 message->TPUserDataLength - skip,
+                                 locking ? locking->Data.data[0] : 0,
+                                 single ? single->Data.data[0] : 0,
+                                 buffer);
+        }
+
+        return PDU_OK;
+
+    case 1: /* 8 bit */
+        *length = size - skip;
+        memcpy(buffer, s + skip, *length);
+        return PDU_OK;
+
+    case 2: /* UCS-2 */
+        if ((ret = utf16be_to_utf8(s + skip, size - skip,
+                                   buffer, PDU_MAXIMUM_TEXT)) < 0) {
+
+            return PDU_FAILED;
+        }
+
+        *length = (size_t)ret;
+        return PDU_OK;
+
+    default:
+        return PDU_NOT_IMPLEMENTED;
+    }
+}
+
+const pdu_information_element_t *pdu_find_information_element(
+        const pdu_user_data_header_t *udh,
+        uint8_t identifier)
+{
+    size_t i;
+
+    for (i = 0; i < udh->Count; ++i) {
+        if (udh->Elements[i].Identifier == identifier) {
+            return &udh->Elements[i];
+        }
+    }
+
+    return NULL;
+}
+
+int pdu_get_application_port_addressing_scheme(
+        const pdu_user_data_header_t *udh,
+        pdu_application_port_addressing_scheme_t *a)
+{
+    const pdu_information_element_t *ie;
+    const uint8_t *p;
+
+    if ((ie = pdu_find_information_element(udh, 4))) {
+        p = ie->Data.data;
+        a->DestinationPort = p[0];
+        a->OriginatorPort  = p[1];
+        return 1;
+    }
+
+    if ((ie = pdu_find_information_element(udh, 5))) {
+        p = ie->Data.data;
+        a->DestinationPort = (uint16_t)(p[0] << 8 | p[1]);
+        a->OriginatorPort  = (uint16_t)(p[2] << 8 | p[3]);
+        return 1;
+    }
+
+    return 0;
+}
+
+int pdu_get_concatenated_short_messages(
+        const pdu_user_data_header_t *udh,
+        pdu_concatenated_short_messages_t *c)
+{
+    const pdu_information_element_t *ie;
+    const uint8_t *p;
+
+    if ((ie = pdu_find_information_element(udh, 0))) {
+        p = ie->Data.data;
+        c->ReferenceNumber = p[0];
+        c->Maximum         = p[1];
+        c->Sequence        = p[2];
+        return 1;
+    }
+
+    if ((ie = pdu_find_information_element(udh, 8))) {
+        p = ie->Data.data;
+        c->ReferenceNumber = (uint16_t)(p[0] << 8 | p[1]);
+        c->Maximum         = p[2];
+        c->Sequence        = p[3];
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+#ifndef SMS_LIBPDU_PDU_H
+#define SMS_LIBPDU_PDU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* SMS-DELIVER and SMS-SUBMIT of 3GPP TS 23.040 in plain C, shared by smsd
+ * and the pdu tool. Nothing here allocates, takes locks or keeps state, so
+ * it can be called from any thread. */
+
+typedef enum pdu_result {
+    PDU_OK              = 0,
+    PDU_FAILED          = 1,
+    PDU_NOT_IMPLEMENTED = 2,
+} pdu_result_t;
+
+typedef enum pdu_type {
+    PDU_SUBMIT,
+    PDU_DELIVER,
+} pdu_type_t;
+
+/* Bytes inside the decoded input, not owned. */
+typedef struct pdu_view {
+    const uint8_t *data;
+    size_t         size;
+} pdu_view_t;
+
+typedef struct pdu_application_port_addressing_scheme {
+    uint16_t DestinationPort;
+    uint16_t OriginatorPort;
+} pdu_application_port_addressing_scheme_t;
+
+typedef struct pdu_concatenated_short_messages {
+    uint16_t ReferenceNumber;
+    uint8_t  Maximum;
+    uint8_t  Sequence;
+} pdu_concatenated_short_messages_t;
+
+typedef struct pdu_information_element {
+    uint8_t    Identifier;
+    pdu_view_t Data;
+} pdu_information_element_t;
+
+/* A header of at most 140 bytes can't hold more than this. */
+#define PDU_MAXIMUM_ELEMENTS 70
+
+typedef struct pdu_user_data_header {
+    size_t                    Count;
+    pdu_information_element_t Elements[PDU_MAXIMUM_ELEMENTS];
+} pdu_user_data_header_t;
+
+/* Semi-octets or septets, NUL terminated. Alphanumeric addresses are at
+ * most 11 septets of up to 3 bytes each once in UTF-8. */
+#define PDU_MAXIMUM_ADDRESS 40
+
+/* Longest text of a single PDU in UTF-8. */
+#define PDU_MAXIMUM_TEXT 1024
+
+/* Views point into the input so it must outlive the message. */
+typedef struct pdu_message {
+    pdu_type_t type;
+
+    uint8_t TPMessageTypeIndicator0  :1;
+    uint8_t TPMessageTypeIndicator1  :1;
+    uint8_t TPMoreMessagesToSend     :1; /* Deliver only */
+    uint8_t TPStatusReportIndication :1; /* Deliver only */
+    uint8_t TPRejectDuplicates       :1; /* Submit only */
+    uint8_t TPValidityPeriodFormat3  :1; /* Submit only */
+    uint8_t TPValidityPeriodFormat4  :1; /* Submit only */
+    uint8_t TPStatusReportRequest    :1; /* Submit only */
+    uint8_t TPUserDataHeaderIndicator:1;
+    uint8_t TPReplyPath              :1;
+
+    char                   SMSC[PDU_MAXIMUM_ADDRESS];
+    char                   TPAddress[PDU_MAXIMUM_ADDRESS]; /* Originating or destination */
+    uint8_t                TPMessageReference;             /* Submit only */
+    uint8_t                TPProtocolIdentifier;
+    uint8_t                TPDataCodingScheme;
+    time_t                 TPServiceCentreTimeStamp;       /* Deliver only */
+    time_t                 TPValidityPeriod;               /* Submit only, negative if relative */
+    pdu_user_data_header_t TPUserDataHeader;
+
+    /* TP-UD as is, header included. `TPUserDataLength` counts septets for
+     * GSM 7 bit alphabet and octets otherwise. */
+    uint8_t                TPUserDataLength;
+    pdu_view_t             TPUserData;
+} pdu_message_t;
+
+/* `why` is set to a static string if not NULL. */
+extern pdu_result_t pdu_decode(
+        const void *buffer,
+        size_t length,
+        int sending,
+        int has_smsc,
+        pdu_message_t *message,
+        const char **why);
+
+/* Text of the user data without the header into `buffer` of at least
+ * PDU_MAXIMUM_TEXT bytes, `length` is set to bytes written. Not NUL
+ * terminated. */
+extern pdu_result_t pdu_decode_text(
+        const pdu_message_t *message,
+        char *buffer,
+        size_t *length);
+
+/* First element of `identifier`, or NULL. */
+extern const pdu_information_element_t *pdu_find_information_element(
+        const pdu_user_data_header_t *udh,
+        uint8_t identifier);
+
+/* Non-zero if the header has either the 8 bit or the 16 bit form. */
+extern int pdu_get_concatenated_short_messages(
+        const pdu_user_data_header_t *udh,
+        pdu_concatenated_short_messages_t *c);
+
+extern int pdu_get_application_port_addressing_scheme(
+        const pdu_user_data_header_t *udh,
+        pdu_application_port_addressing_scheme_t *a);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* SMS_LIBPDU_PDU_H */
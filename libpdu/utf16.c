@@ -0,0 +1,355 @@
+#include "utf16.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UTF16_X86 1
+#define UTF16_AVX2 __attribute__((target("avx2")))
+#endif
+
+/* Decodes at least `units` code units, or all there are, one more if a
+ * surrogate pair crosses the boundary. */
+static int utf16be_units(
+        const unsigned char **input,
+        const unsigned char *end,
+        size_t units,
+        unsigned char **output,
+        const unsigned char *oend)
+{
+    const unsigned char *s;
+    const unsigned char *stop;
+    unsigned char *o;
+    uint32_t c;
+    uint32_t l;
+
+    s = *input;
+    o = *output;
+    stop = (size_t)(end - s) > units * 2 ? s + units * 2 : end;
+
+    while (s < stop) {
+        c = (uint32_t)(s[0] << 8 | s[1]);
+        s += 2;
+
+        if (c >= 0xDC00 && c <= 0xDFFF) {
+            return -1;
+
+        } else if (c >= 0xD800 && c <= 0xDBFF) {
+            if (end - s < 2) {
+                return -1;
+            }
+
+            l = (uint32_t)(s[0] << 8 | s[1]);
+            if (l < 0xDC00 || l > 0xDFFF) {
+                return -1;
+            }
+
+            c = 0x10000 + ((c - 0xD800) << 10) + (l - 0xDC00);
+            s += 2;
+        }
+
+        if (c < 0x80) {
+            if (oend - o < 1) {
+                return -1;
+            }
+
+            *o++ = (unsigned char)c;
+
+        } else if (c < 0x800) {
+            if (oend - o < 2) {
+                return -1;
+            }
+
+            *o++ = (unsigned char)(0xC0 | (c >> 6));
+            *o++ = (unsigned char)(0x80 | (c & 0x3F));
+
+        } else if (c < 0x10000) {
+            if (oend - o < 3) {
+                return -1;
+            }
+
+            *o++ = (unsigned char)(0xE0 | (c >> 12));
+            *o++ = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+            *o++ = (unsigned char)(0x80 | (c & 0x3F));
+
+        } else {
+            if (oend - o < 4) {
+                return -1;
+            }
+
+            *o++ = (unsigned char)(0xF0 | (c >> 18));
+            *o++ = (unsigned char)(0x80 | ((c >> 12) & 0x3F));
+            *o++ = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+            *o++ = (unsigned char)(0x80 | (c & 0x3F));
+        }
+    }
+
+    *input = s;
+    *output = o;
+    return 0;
+}
+
+#ifdef UTF16_X86
+#ifdef __SSE2__
+/* Blocks of 8 code units that are all ASCII or all 2 bytes in UTF-8 are
+ * done in registers, anything else in scalar code. Without byte shuffles
+ * there's no compacting 3 byte sequences. */
+static int sse2_units(
+        const unsigned char **input,
+        const unsigned char *end,
+        unsigned char **output,
+        const unsigned char *oend)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const unsigned char *s;
+    unsigned char *o;
+    __m128i v;
+    __m128i c;
+    int ascii;
+    int two;
+
+    s = *input;
+    o = *output;
+    while (end - s >= 16 && oend - o >= 16) {
+        v = _mm_loadu_si128((const __m128i *)s);
+        c = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+        ascii = _mm_movemask_epi8(_mm_cmpeq_epi16(
+                _mm_subs_epu16(c, _mm_set1_epi16(0x7F)), zero));
+
+        if (ascii == 0xFFFF) {
+            _mm_storel_epi64((__m128i *)o, _mm_packus_epi16(c, c));
+            s += 16;
+            o += 8;
+            continue;
+        }
+
+        two = _mm_movemask_epi8(_mm_cmpeq_epi16(
+                _mm_subs_epu16(c, _mm_set1_epi16(0x7FF)), zero));
+
+        if (ascii == 0 && two == 0xFFFF) {
+            v = _mm_or_si128(
+                    _mm_or_si128(_mm_srli_epi16(c, 6), _mm_set1_epi16(0xC0)),
+                    _mm_slli_epi16(_mm_or_si128(
+                            _mm_and_si128(c, _mm_set1_epi16(0x3F)),
+                            _mm_set1_epi16(0x80)), 8));
+
+            _mm_storeu_si128((__m128i *)o, v);
+            s += 16;
+            o += 16;
+            continue;
+        }
+
+        if (utf16be_units(&s, end, 8, &o, oend)) {
+            return -1;
+        }
+    }
+
+    *input = s;
+    *output = o;
+    return 0;
+}
+#endif /* __SSE2__ */
+
+/* 16 code units at a time, 3 byte sequences are built in 32 bit lanes and
+ * compacted by shuffles. */
+UTF16_AVX2 static int avx2_units(
+        const unsigned char **input,
+        const unsigned char *end,
+        unsigned char **output,
+        const unsigned char *oend)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i compact = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    const unsigned char *s;
+    unsigned char *o;
+    unsigned int surrogate;
+    unsigned int ascii;
+    unsigned int two;
+    __m256i bytes[2];
+    __m256i b0;
+    __m256i b1;
+    __m256i b2;
+    __m256i x;
+    __m256i v;
+    __m256i c;
+    __m128i last;
+    uint32_t tail;
+    int i;
+
+    s = *input;
+    o = *output;
+
+    /* The widest block writes 48 bytes */
+    while (end - s >= 32 && oend - o >= 48) {
+        v = _mm256_loadu_si256((const __m256i *)s);
+        c = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+
+        ascii = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi16(
+                _mm256_subs_epu16(c, _mm256_set1_epi16(0x7F)), zero));
+
+        if (ascii == 0xFFFFFFFFu) {
+            _mm_storeu_si128((__m128i *)o, _mm256_castsi256_si128(
+                    _mm256_permute4x64_epi64(_mm256_packus_epi16(c, c), 0x08)));
+            s += 32;
+            o += 16;
+            continue;
+        }
+
+        two = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi16(
+                _mm256_subs_epu16(c, _mm256_set1_epi16(0x7FF)), zero));
+
+        if (ascii == 0 && two == 0xFFFFFFFFu) {
+            b0 = _mm256_or_si256(_mm256_srli_epi16(c, 6),
+                                 _mm256_set1_epi16(0xC0));
+            b1 = _mm256_or_si256(_mm256_and_si256(c, _mm256_set1_epi16(0x3F)),
+                                 _mm256_set1_epi16(0x80));
+
+            _mm256_storeu_si256((__m256i *)o,
+                                _mm256_or_si256(b0, _mm256_slli_epi16(b1, 8)));
+            s += 32;
+            o += 32;
+            continue;
+        }
+
+        surrogate = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi16(
+                _mm256_and_si256(c, _mm256_set1_epi16((short)0xF800)),
+                _mm256_set1_epi16((short)0xD800)));
+
+        if (two == 0 && surrogate == 0) {
+            for (i = 0; i < 2; ++i) {
+                x = _mm256_cvtepu16_epi32(i == 0
+                        ? _mm256_castsi256_si128(c)
+                        : _mm256_extracti128_si256(c, 1));
+
+                b0 = _mm256_or_si256(_mm256_srli_epi32(x, 12),
+                                     _mm256_set1_epi32(0xE0));
+                b1 = _mm256_or_si256(_mm256_and_si256(
+                        _mm256_srli_epi32(x, 6), _mm256_set1_epi32(0x3F)),
+                        _mm256_set1_epi32(0x80));
+                b2 = _mm256_or_si256(_mm256_and_si256(
+                        x, _mm256_set1_epi32(0x3F)),
+                        _mm256_set1_epi32(0x80));
+
+                bytes[i] = _mm256_shuffle_epi8(_mm256_or_si256(
+                        _mm256_or_si256(b0, _mm256_slli_epi32(b1, 8)),
+                        _mm256_slli_epi32(b2, 16)), compact);
+            }
+
+            /* 12 bytes in each lane, every store but the last runs 4 bytes
+             * over into where the next one goes. */
+            last = _mm256_extracti128_si256(bytes[1], 1);
+            tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(last, 8));
+
+            _mm_storeu_si128((__m128i *)o, _mm256_castsi256_si128(bytes[0]));
+            _mm_storeu_si128((__m128i *)(o + 12),
+                             _mm256_extracti128_si256(bytes[0], 1));
+            _mm_storeu_si128((__m128i *)(o + 24),
+                             _mm256_castsi256_si128(bytes[1]));
+            _mm_storel_epi64((__m128i *)(o + 36), last);
+            memcpy(o + 44, &tail, 4);
+
+            s += 32;
+            o += 48;
+            continue;
+        }
+
+        if (utf16be_units(&s, end, 16, &o, oend)) {
+            return -1;
+        }
+    }
+
+    *input = s;
+    *output = o;
+    return 0;
+}
+#endif /* UTF16_X86 */
+
+static int has_avx2(void)
+{
+#ifdef UTF16_X86
+    return __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+}
+
+ssize_t utf16be_to_utf8_scalar(
+        const void *input,
+        size_t inlen,
+        void *output,
+        size_t outlen)
+{
+    const unsigned char *s;
+    unsigned char *o;
+
+    if (inlen % 2) {
+        return -1;
+    }
+
+    s = (const unsigned char *)input;
+    o = (unsigned char *)output;
+    if (utf16be_units(&s, s + inlen, inlen, &o, o + outlen)) {
+        return -1;
+    }
+
+    return (ssize_t)(o - (unsigned char *)output);
+}
+
+ssize_t utf16be_to_utf8(
+        const void *input,
+        size_t inlen,
+        void *output,
+        size_t outlen)
+{
+    const unsigned char *s;
+    const unsigned char *end;
+    const unsigned char *oend;
+    unsigned char *o;
+
+    if (inlen % 2) {
+        return -1;
+    }
+
+    s = (const unsigned char *)input;
+    end = s + inlen;
+    o = (unsigned char *)output;
+    oend = o + outlen;
+
+#ifdef UTF16_X86
+    if (has_avx2()) {
+        if (avx2_units(&s, end, &o, oend)) {
+            return -1;
+        }
+    }
+
+#ifdef __SSE2__
+    if (sse2_units(&s, end, &o, oend)) {
+        return -1;
+    }
+#endif
+#endif
+
+    if (utf16be_units(&s, end, inlen, &o, oend)) {
+        return -1;
+    }
+
+    return (ssize_t)(o - (unsigned char *)output);
+}
+
+const char *utf16_kernel(void)
+{
+    if (has_avx2()) {
+        return "avx2";
+    }
+
+#if defined(UTF16_X86) && defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,39 @@
+#ifndef SMS_LIBPDU_UTF16_H
+#define SMS_LIBPDU_UTF16_H
+
+#include <stddef.h>
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest UTF-8 of `length` bytes of UTF-16, surrogate pairs take 4 bytes
+ * either way. */
+#define UTF16_UTF8_LENGTH(length) ((length) / 2 * 3)
+
+/* Returns bytes written, or -1 if the input is odd sized, has unpaired
+ * surrogates or doesn't fit in `outlen`. Picks AVX2 or SSE2 code by CPUID
+ * where there is any. */
+extern ssize_t utf16be_to_utf8(
+        const void *input,
+        size_t inlen,
+        void *output,
+        size_t outlen);
+
+/* Same as above, but always scalar, for comparison. */
+extern ssize_t utf16be_to_utf8_scalar(
+        const void *input,
+        size_t inlen,
+        void *output,
+        size_t outlen);
+
+/* "avx2", "sse2" or "scalar", whichever utf16be_to_utf8() runs. */
+extern const char *utf16_kernel(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* SMS_LIBPDU_UTF16_H */
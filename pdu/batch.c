@@ -0,0 +1,502 @@
+#include "batch.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hex.h"
+
+#define CHUNK_SIZE  (1024 * 1024)   /* Input bytes a worker takes at once */
+#define PDU_MAX     1024
+#define JSON_MAX    4096
+
+/* Chunks go round a ring, FREE -> READY -> BUSY -> DONE -> FREE. The reader
+ * and the writer walk it in order, workers take whatever is READY. */
+enum chunk_state {
+    CHUNK_FREE,
+    CHUNK_READY,
+    CHUNK_BUSY,
+    CHUNK_DONE,
+};
+
+struct chunk {
+    enum chunk_state state;
+    char   *input;
+    size_t  inlen;
+    char   *output;
+    size_t  outlen;
+    size_t  outcap;
+    size_t  records;
+    size_t  failed;
+};
+
+struct batch {
+    const struct batch_options *options;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    struct chunk   *chunks;
+    size_t          count;
+
+    /* Chunks filled, taken by workers and written so far */
+    size_t          filled;
+    size_t          taken;
+    size_t          written;
+    int             eof;
+    int             error;
+
+    size_t          records;
+    size_t          failed;
+    size_t          bytes;
+};
+
+struct reader {
+    FILE   *file;
+    int     raw;
+    char   *carry;      /* Partial record left by the last read */
+    size_t  carried;
+};
+
+static int chunk_reserve(struct chunk *c, size_t size)
+{
+    size_t capacity;
+    char *output;
+
+    if (c->outcap - c->outlen >= size) {
+        return 0;
+    }
+
+    capacity = c->outcap ? c->outcap : CHUNK_SIZE;
+    while (capacity - c->outlen < size) {
+        capacity *= 2;
+    }
+
+    if (!(output = (char *)realloc(c->output, capacity))) {
+        return -1;
+    }
+
+    c->output = output;
+    c->outcap = capacity;
+    return 0;
+}
+
+static int chunk_append(struct chunk *c, const char *s, size_t length)
+{
+    if (chunk_reserve(c, length)) {
+        return -1;
+    }
+
+    memcpy(c->output + c->outlen, s, length);
+    c->outlen += length;
+    return 0;
+}
+
+static int chunk_append_error(struct chunk *c, const unsigned char *pdu, size_t length)
+{
+    static const char NUL[] = "{\"ERROR\":null}\n";
+    static const char HEAD[] = "{\"ERROR\":\"";
+    static const char TAIL[] = "\"}\n";
+
+    if (!pdu) {
+        return chunk_append(c, NUL, sizeof(NUL) - 1);
+    }
+
+    if (chunk_reserve(c, sizeof(HEAD) - 1 + length * 2 + sizeof(TAIL) - 1)) {
+        return -1;
+    }
+
+    chunk_append(c, HEAD, sizeof(HEAD) - 1);
+    hex_encode(pdu, length, c->output + c->outlen);
+    c->outlen += length * 2;
+    chunk_append(c, TAIL, sizeof(TAIL) - 1);
+    return 0;
+}
+
+static int decode_chunk(const struct batch_options *options, struct chunk *c)
+{
+    unsigned char buffer[PDU_MAX];
+    const unsigned char *pdu;
+    const char *line;
+    const char *eol;
+    const char *end;
+    const char *p;
+    char json[JSON_MAX];
+    size_t length;
+    ssize_t ret;
+
+    c->outlen = 0;
+    c->records = 0;
+    c->failed = 0;
+
+    p = c->input;
+    end = p + c->inlen;
+    while (p < end) {
+        if (options->raw) {
+            pdu = NULL;
+            length = 0;
+            if (end - p >= 2) {
+                length = (size_t)((uint8_t)p[0] << 8 | (uint8_t)p[1]);
+            }
+
+            /* Truncated at the end of a file */
+            if (end - p < 2 || length > (size_t)(end - p - 2)) {
+                p = end;
+            } else {
+                pdu = (const unsigned char *)p + 2;
+                p += length + 2;
+            }
+
+        } else {
+            line = p;
+            if ((eol = (const char *)memchr(p, '\n', (size_t)(end - p)))) {
+                p = eol + 1;
+            } else {
+                p = eol = end;
+            }
+
+            while (line < eol && isspace((unsigned char)*line)) {
+                ++line;
+            }
+
+            while (eol > line && isspace((unsigned char)eol[-1])) {
+                --eol;
+            }
+
+            if (line == eol) {
+                continue;
+            }
+
+            pdu = NULL;
+            length = 0;
+            if ((ret = hex_decode(line, (size_t)(eol - line), buffer, sizeof(buffer))) >= 0) {
+                pdu = buffer;
+                length = (size_t)ret;
+            }
+        }
+
+        ++c->records;
+        if (pdu && !options->decode(pdu, length, options, json, sizeof(json))) {
+            length = strlen(json);
+            json[length++] = '\n';
+            if (chunk_append(c, json, length)) {
+                return -1;
+            }
+
+            continue;
+        }
+
+        ++c->failed;
+        if (chunk_append_error(c, pdu, length)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void *worker(void *arg)
+{
+    struct batch *b;
+    struct chunk *c;
+    int ret;
+
+    b = (struct batch *)arg;
+    pthread_mutex_lock(&b->mutex);
+    for (;;) {
+        while (b->taken == b->filled && !b->eof) {
+            pthread_cond_wait(&b->cond, &b->mutex);
+        }
+
+        if (b->taken == b->filled) {
+            break;
+        }
+
+        c = &b->chunks[b->taken++ % b->count];
+        c->state = CHUNK_BUSY;
+        pthread_mutex_unlock(&b->mutex);
+
+        ret = decode_chunk(b->options, c);
+
+        pthread_mutex_lock(&b->mutex);
+        if (ret) {
+            b->error = 1;
+        }
+
+        c->state = CHUNK_DONE;
+        pthread_cond_broadcast(&b->cond);
+    }
+
+    pthread_mutex_unlock(&b->mutex);
+    return NULL;
+}
+
+static void *writer(void *arg)
+{
+    struct batch *b;
+    struct chunk *c;
+    int error;
+
+    b = (struct batch *)arg;
+    pthread_mutex_lock(&b->mutex);
+    for (;;) {
+        c = &b->chunks[b->written % b->count];
+        while (!(b->written < b->filled && c->state == CHUNK_DONE)
+               && !(b->written == b->filled && b->eof)) {
+
+            pthread_cond_wait(&b->cond, &b->mutex);
+        }
+
+        if (b->written == b->filled) {
+            break;
+        }
+
+        error = b->error;
+        pthread_mutex_unlock(&b->mutex);
+
+        if (!error && fwrite(c->output, 1, c->outlen, stdout) != c->outlen) {
+            error = 1;
+        }
+
+        pthread_mutex_lock(&b->mutex);
+        if (error) {
+            b->error = 1;
+        }
+
+        b->records += c->records;
+        b->failed += c->failed;
+        b->bytes += c->inlen;
+        c->state = CHUNK_FREE;
+        ++b->written;
+        pthread_cond_broadcast(&b->cond);
+    }
+
+    pthread_mutex_unlock(&b->mutex);
+    return NULL;
+}
+
+/* Where the last whole record of `buffer` ends. */
+static size_t find_boundary(const char *buffer, size_t length, int raw)
+{
+    size_t record;
+    size_t i;
+
+    if (!raw) {
+        for (i = length; i; --i) {
+            if (buffer[i - 1] == '\n') {
+                break;
+            }
+        }
+
+        return i;
+    }
+
+    for (i = 0; length - i >= 2; i += record) {
+        record = (size_t)((uint8_t)buffer[i] << 8 | (uint8_t)buffer[i + 1]) + 2;
+        if (record > length - i) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* Fills `buffer` with whole records, returns its length, 0 at the end of
+ * the file or -1 on errors. */
+static ssize_t reader_fill(struct reader *r, char *buffer)
+{
+    size_t boundary;
+    size_t length;
+    size_t ret;
+
+    memcpy(buffer, r->carry, r->carried);
+    length = r->carried;
+    r->carried = 0;
+
+    ret = fread(buffer + length, 1, CHUNK_SIZE - length, r->file);
+    length += ret;
+    if (length < CHUNK_SIZE) {
+        if (ferror(r->file)) {
+            return -1;
+        }
+
+        /* Whatever is left at the end of the file is the last record */
+        return (ssize_t)length;
+    }
+
+    if (!(boundary = find_boundary(buffer, length, r->raw))) {
+        fprintf(stderr, "pdu: record longer than %d bytes\n", CHUNK_SIZE);
+        return -1;
+    }
+
+    r->carried = length - boundary;
+    memcpy(r->carry, buffer + boundary, r->carried);
+    return (ssize_t)boundary;
+}
+
+static int read_file(struct batch *b, struct reader *r)
+{
+    struct chunk *c;
+    ssize_t ret;
+
+    for (;;) {
+        pthread_mutex_lock(&b->mutex);
+        c = &b->chunks[b->filled % b->count];
+        while (c->state != CHUNK_FREE) {
+            pthread_cond_wait(&b->cond, &b->mutex);
+        }
+
+        ret = b->error ? -1 : 0;
+        pthread_mutex_unlock(&b->mutex);
+        if (ret) {
+            return -1;
+        }
+
+        if ((ret = reader_fill(r, c->input)) <= 0) {
+            return (int)ret;
+        }
+
+        c->inlen = (size_t)ret;
+
+        pthread_mutex_lock(&b->mutex);
+        c->state = CHUNK_READY;
+        ++b->filled;
+        pthread_cond_broadcast(&b->cond);
+        pthread_mutex_unlock(&b->mutex);
+    }
+}
+
+static int read_files(struct batch *b, char *const *files, size_t count)
+{
+    struct reader r;
+    size_t i;
+    int ret;
+
+    memset(&r, 0, sizeof(r));
+    r.raw = b->options->raw;
+    if (!(r.carry = (char *)malloc(CHUNK_SIZE))) {
+        return -1;
+    }
+
+    ret = 0;
+    if (!count) {
+        r.file = stdin;
+        ret = read_file(b, &r);
+    }
+
+    for (i = 0; i < count && !ret; ++i) {
+        if (strcmp(files[i], "-") == 0) {
+            r.file = stdin;
+        } else if (!(r.file = fopen(files[i], "rb"))) {
+            fprintf(stderr, "pdu: %s: %s\n", files[i], strerror(errno));
+            ret = -1;
+            break;
+        }
+
+        r.carried = 0;
+        ret = read_file(b, &r);
+        if (r.file != stdin) {
+            fclose(r.file);
+        }
+    }
+
+    free(r.carry);
+    return ret;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int batch_run(
+        const struct batch_options *options,
+        char *const *files,
+        size_t count)
+{
+    pthread_t *workers;
+    pthread_t output;
+    struct batch b;
+    double elapsed;
+    double start;
+    size_t started;
+    size_t i;
+    int ret;
+
+    memset(&b, 0, sizeof(b));
+    b.options = options;
+    b.count = (size_t)options->threads * 2 + 2;
+    pthread_mutex_init(&b.mutex, NULL);
+    pthread_cond_init(&b.cond, NULL);
+
+    ret = -1;
+    started = 0;
+    workers = (pthread_t *)calloc((size_t)options->threads, sizeof(*workers));
+    b.chunks = (struct chunk *)calloc(b.count, sizeof(*b.chunks));
+    if (!workers || !b.chunks) {
+        goto out;
+    }
+
+    for (i = 0; i < b.count; ++i) {
+        if (!(b.chunks[i].input = (char *)malloc(CHUNK_SIZE))) {
+            goto out;
+        }
+    }
+
+    start = now();
+    if (pthread_create(&output, NULL, writer, &b)) {
+        goto out;
+    }
+
+    for (; started < (size_t)options->threads; ++started) {
+        if (pthread_create(&workers[started], NULL, worker, &b)) {
+            break;
+        }
+    }
+
+    ret = started ? read_files(&b, files, count) : -1;
+
+    pthread_mutex_lock(&b.mutex);
+    b.eof = 1;
+    pthread_cond_broadcast(&b.cond);
+    pthread_mutex_unlock(&b.mutex);
+
+    for (i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_join(output, NULL);
+    if (fflush(stdout) || b.error) {
+        ret = -1;
+    }
+
+    elapsed = now() - start;
+    fprintf(stderr,
+            "pdu: %zu records, %zu decoded, %zu failed, %.1f MiB "
+            "in %.3fs with %zu threads, %.0f records/s, %.1f MiB/s%s\n",
+            b.records, b.records - b.failed, b.failed,
+            (double)b.bytes / 1048576, elapsed, started,
+            elapsed > 0 ? (double)b.records / elapsed : 0,
+            elapsed > 0 ? (double)b.bytes / 1048576 / elapsed : 0,
+            ret ? ", incomplete" : "");
+
+out:
+    if (b.chunks) {
+        for (i = 0; i < b.count; ++i) {
+            free(b.chunks[i].input);
+            free(b.chunks[i].output);
+        }
+    }
+
+    free(b.chunks);
+    free(workers);
+    pthread_cond_destroy(&b.cond);
+    pthread_mutex_destroy(&b.mutex);
+    return ret;
+}
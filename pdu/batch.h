@@ -0,0 +1,34 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+struct batch_options;
+
+/* Writes a NUL terminated JSON object into `json`, returns 0 or -1. Called
+ * from several threads at once. */
+typedef int (*batch_decode_t)(
+        const unsigned char *pdu,
+        size_t length,
+        const struct batch_options *options,
+        char *json,
+        size_t jsonlen);
+
+struct batch_options {
+    int sending;
+    int has_smsc;
+    int raw;
+    int threads;
+    batch_decode_t decode;
+};
+
+/* Decodes every PDU in `files`, or stdin if there's none, into a JSON object
+ * per line on stdout, in input order. PDUs that fail show as
+ * {"ERROR":"<hex>"}, or {"ERROR":null} if not even hex. Statistics go to
+ * stderr at the end. Returns -1 on I/O errors. */
+extern int batch_run(
+        const struct batch_options *options,
+        char *const *files,
+        size_t count);
+
+#endif /* BATCH_H */
@@ -1,38 +1,64 @@
 #include "charset.h"
 
-#include <iconv.h>
-
-ssize_t charset(const void *input,
-                size_t inlen,
-                void *output,
-                size_t outlen,
-                const char *from,
-                const char *to)
+ssize_t charset_utf8_to_ucs4(
+        const void *input,
+        size_t inlen,
+        uint32_t *output,
+        size_t outlen)
 {
-    size_t olen;
-    iconv_t cd;
-    size_t ret;
-    char *optr;
-    char *iptr;
-
-    if (inlen == 0) {
-        return 0;
-    }
+    const unsigned char *s;
+    const unsigned char *end;
+    uint32_t c;
+    size_t count;
+    size_t n;
+    size_t i;
 
-    cd = iconv_open(to, from);
-    if (cd == (iconv_t)-1) {
-        return -1;
-    }
+    s = (const unsigned char *)input;
+    end = s + inlen;
+    for (count = 0; s < end; ++count) {
+        if (count == outlen) {
+            return -1;
+        }
+
+        c = *s++;
+        if (c < 0x80) {
+            output[count] = c;
+            continue;
+        } else if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+            c &= 0x1F;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            c &= 0x0F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            c &= 0x07;
+        } else {
+            return -1;
+        }
+
+        if ((size_t)(end - s) < n) {
+            return -1;
+        }
+
+        for (i = 0; i < n; ++i) {
+            if ((s[i] & 0xC0) != 0x80) {
+                return -1;
+            }
+
+            c = (c << 6) | (s[i] & 0x3F);
+        }
 
-    olen = outlen;
-    iptr = (char *)input;
-    optr = (char *)output;
-    ret = iconv(cd, &iptr, &inlen, &optr, &outlen);
-    iconv_close(cd);
+        /* Overlong, surrogates or beyond U+10FFFF */
+        if ((n == 2 && c < 0x800)   ||
+            (n == 3 && c < 0x10000) ||
+            (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+            return -1;
+        }
 
-    if (ret == (size_t)-1) {
-        return -1;
+        output[count] = c;
+        s += n;
     }
 
-    return (ssize_t)(olen - outlen);
+    return (ssize_t)count;
 }
@@ -2,15 +2,16 @@
 #define CHARSET_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <sys/types.h>
 
-extern ssize_t charset(
+/* Returns code points written, or -1 if the input is malformed or doesn't
+ * fit in `outlen` code points. */
+extern ssize_t charset_utf8_to_ucs4(
         const void *input,
         size_t inlen,
-        void *output,
-        size_t outlen,
-        const char *from,
-        const char *to);
+        uint32_t *output,
+        size_t outlen);
 
 #endif /* CHARSET_H */
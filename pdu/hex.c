@@ -0,0 +1,61 @@
+#include "hex.h"
+
+#include <stdint.h>
+
+/* Digit values plus one, so that anything else is zero. */
+static const uint8_t hex_value[256] = {
+    ['0'] = 0x01, ['1'] = 0x02, ['2'] = 0x03, ['3'] = 0x04, ['4'] = 0x05,
+    ['5'] = 0x06, ['6'] = 0x07, ['7'] = 0x08, ['8'] = 0x09, ['9'] = 0x0A,
+    ['A'] = 0x0B, ['B'] = 0x0C, ['C'] = 0x0D, ['D'] = 0x0E, ['E'] = 0x0F,
+    ['F'] = 0x10, ['a'] = 0x0B, ['b'] = 0x0C, ['c'] = 0x0D, ['d'] = 0x0E,
+    ['e'] = 0x0F, ['f'] = 0x10,
+};
+
+ssize_t hex_decode(
+        const char *input,
+        size_t inlen,
+        unsigned char *output,
+        size_t outlen)
+{
+    const uint8_t *s;
+    unsigned int h;
+    unsigned int l;
+    size_t max;
+    size_t i;
+
+    if (inlen % 2) {
+        return -1;
+    }
+
+    max = inlen / 2;
+    if (max > outlen) {
+        return -1;
+    }
+
+    s = (const uint8_t *)input;
+    for (i = 0; i < max; ++i) {
+        h = hex_value[s[i * 2]] - 1u;
+        l = hex_value[s[i * 2 + 1]] - 1u;
+        if ((h | l) > 0x0F) {
+            return -1;
+        }
+
+        output[i] = (unsigned char)(h << 4 | l);
+    }
+
+    return (ssize_t)max;
+}
+
+void hex_encode(
+        const unsigned char *input,
+        size_t inlen,
+        char *output)
+{
+    static const char H[] = "0123456789ABCDEF";
+    size_t i;
+
+    for (i = 0; i < inlen; ++i) {
+        *output++ = H[input[i] >> 4];
+        *output++ = H[input[i] & 0x0F];
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef HEX_H
+#define HEX_H
+
+#include <stddef.h>
+
+#include <sys/types.h>
+
+/* Returns bytes written, or -1 if the input is odd sized, has non hex
+ * digits or doesn't fit in `outlen`. */
+extern ssize_t hex_decode(
+        const char *input,
+        size_t inlen,
+        unsigned char *output,
+        size_t outlen);
+
+/* Upper case, `output` gets `inlen * 2` characters, not NUL terminated. */
+extern void hex_encode(
+        const unsigned char *input,
+        size_t inlen,
+        char *output);
+
+#endif /* HEX_H */
@@ -4,17 +4,9 @@
 #include <stdio.h>
 #include <string.h>
 
-#include "charset.h"
-#include "pdu.h"
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-#define UCS4 "UCS-4LE"
-#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-#define UCS4 "UCS-4BE"
-#else
-#error Unsupported endian
-#endif
+#include "sms/libpdu/pdu.h"
 
+#include "charset.h"
 
 static int json_encode_string(
         const char *input,
@@ -28,15 +20,15 @@ static int json_encode_string(
     int ret;
 
     assert(outlen);
-    inlen = charset(input, strlen(input), ucs, sizeof(ucs), "UTF-8", UCS4);
+    inlen = charset_utf8_to_ucs4(input, strlen(input),
+                                 ucs, sizeof(ucs) / sizeof(*ucs));
     if (inlen < 0) {
         return -1;
     }
 
-    inlen /= (ssize_t)sizeof(*ucs);
     for (p = ucs, q = output; inlen; ++p, --inlen) {
         /* TODO(yiyuanzhong): too lazy to calculate buffer precisely */
-        if (outlen < 10) {
+        if (outlen < 16) {
             return -1;
         }
 
@@ -57,6 +49,18 @@ static int json_encode_string(
             *q++ = (char)*p;
             --outlen;
 
+        } else if (*p > 0xFFFF) { /* Surrogate pair */
+            ret = snprintf(q, outlen, "\\u%04X\\u%04X",
+                           0xD800 + ((*p - 0x10000) >> 10),
+                           0xDC00 + ((*p - 0x10000) & 0x3FF));
+
+            if (ret < 0 || (size_t)ret >= outlen) {
+                return -1;
+            }
+
+            outlen -= (size_t)ret;
+            q += ret;
+
         } else {
             ret = snprintf(q, outlen, "\\u%04X", *p);
             if (ret < 0 || (size_t)ret >= outlen) {
@@ -148,7 +152,8 @@ static int json_set_time(
 
 static int json_do_encode_sms_deliver(
         const char *smsc,
-        const struct sms_deliver *pdu,
+        const pdu_message_t *pdu,
+        const char *text,
         char **p,
         size_t *length)
 {
@@ -158,9 +163,32 @@ static int json_do_encode_sms_deliver(
         }
     }
 
-    if (json_set_string("TP-OA",   pdu->TPOriginatingAddress,     p, length) ||
+    if (json_set_string("TP-OA",   pdu->TPAddress,                p, length) ||
         json_set_time  ("TP-SCTS", pdu->TPServiceCentreTimeStamp, p, length) ||
-        json_set_string("TP-UD",   pdu->TPUserData,               p, length) ){
+        json_set_string("TP-UD",   text,                          p, length) ){
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int json_do_encode_sms_submit(
+        const char *smsc,
+        const pdu_message_t *pdu,
+        const char *text,
+        char **p,
+        size_t *length)
+{
+    if (smsc) {
+        if (json_set_string("RP-DA", smsc, p, length)) {
+            return -1;
+        }
+    }
+
+    if (json_set_string("TP-DA", pdu->TPAddress,        p, length) ||
+        json_set_time  ("TP-VP", pdu->TPValidityPeriod, p, length) ||
+        json_set_string("TP-UD", text,                  p, length) ){
 
         return -1;
     }
@@ -168,13 +196,15 @@ static int json_do_encode_sms_deliver(
     return 0;
 }
 
-int json_encode_sms_deliver(
+int json_encode_message(
         const char *smsc,
-        const struct sms_deliver *pdu,
+        const pdu_message_t *pdu,
+        const char *text,
         void *buffer,
         size_t length)
 {
     char *p;
+    int ret;
 
     if (length < 3) {
         return -1;
@@ -184,7 +214,13 @@ int json_encode_sms_deliver(
     *p++ = '{';
     --length;
 
-    if (json_do_encode_sms_deliver(smsc, pdu, &p, &length)) {
+    if (pdu->type == PDU_DELIVER) {
+        ret = json_do_encode_sms_deliver(smsc, pdu, text, &p, &length);
+    } else {
+        ret = json_do_encode_sms_submit(smsc, pdu, text, &p, &length);
+    }
+
+    if (ret) {
         return -1;
     }
 
@@ -192,16 +228,3 @@ int json_encode_sms_deliver(
     *p = '\0';
     return 0;
 }
-
-int json_encode_sms_submit(
-        const char *smsc,
-        const struct sms_submit *pdu,
-        void *buffer,
-        size_t length)
-{
-    (void)smsc;
-    (void)pdu;
-    (void)buffer;
-    (void)length;
-    return -1;
-}
@@ -3,18 +3,13 @@
 
 #include <stddef.h>
 
-struct sms_deliver;
-struct sms_submit;
+struct pdu_message;
 
-extern int json_encode_sms_deliver(
+/* `text` is the NUL terminated user data, `smsc` can be NULL. */
+extern int json_encode_message(
         const char *smsc,
-        const struct sms_deliver *pdu,
-        void *buffer,
-        size_t length);
-
-extern int json_encode_sms_submit(
-        const char *smsc,
-        const struct sms_submit *pdu,
+        const struct pdu_message *pdu,
+        const char *text,
         void *buffer,
         size_t length);
 
@@ -1,23 +1,20 @@
-#include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
-#include <arpa/inet.h>
+#include "sms/libpdu/pdu.h"
 
-#include "charset.h"
+#include "batch.h"
+#include "hex.h"
 #include "json.h"
-#include "pdu.h"
 
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-#define BIT(x, n) (!!((x) & (1 << n)))
-#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-#define BIT(x, n) (!!((x) & (128 >> n)))
-#else
-#error Unsupported endian
-#endif
+/* Batch mode turns it off before starting any thread. */
+static int verbose = 1;
+
+#define DEBUG(...) do { if (verbose) { printf(__VA_ARGS__); } } while (0)
 
 static void HEX(const char *what, const void *b, size_t l)
 {
@@ -33,324 +30,31 @@ static void HEX(const char *what, const void *b, size_t l)
     printf("\n");
 }
 
-static int get_one(char c)
-{
-    if (c >= '0' && c <= '9') {
-        return c - '0';
-    } else if (c >= 'A' && c <= 'F') {
-        return c - 'A' + 10;
-    } else if (c >= 'a' && c <= 'f') {
-        return c - 'a' + 10;
-    } else {
-        return -1;
-    }
-}
-
-static int get(const char *s)
-{
-    int h;
-    int l;
-
-    h = get_one(*s);
-    if (h < 0) {
-        return -1;
-    }
-
-    l = get_one(*(s + 1));
-    if (l < 0) {
-        return -1;
-    }
-
-    return (h << 4) | l;
-}
-
-static int decode_numeric(const unsigned char *s, size_t size, char *output, size_t outlen)
-{
-    size_t i;
-    int c;
-    int n;
-
-    for (i = 0; i < size; ++i) {
-        c = s[i];
-        n = c & 0x0F;
-        if (n >= 10) {
-            return -1;
-        }
-
-        if (outlen-- < 2) { /* This char, and trailing zero */
-            return -1;
-        }
-
-        *output++ = (char)(n + '0');
-
-        n = c >> 4;
-        if (n == 0xF) {
-            if (i + 1 == size) {
-                break;
-            } else {
-                return -1;
-            }
-        } else if (n >= 10) {
-            return -1;
-        }
-
-        if (outlen-- < 2) { /* This char, and trailing zero */
-            return -1;
-        }
-
-        *output++ = (char)(n + '0');
-    }
-
-    *output = '\0';
-    return 0;
-}
-
-static int decode_alphanumeric(const unsigned char *s, size_t length, char *output, size_t outlen)
+static void print_user_data_header(const pdu_user_data_header_t *udh)
 {
-    uint64_t n;
-    size_t max;
+    pdu_application_port_addressing_scheme_t a;
+    pdu_concatenated_short_messages_t c;
+    const pdu_information_element_t *e;
+    char buffer[32];
     size_t i;
-    size_t j;
-
-    if (outlen < length + 1) {
-        return -1;
-    }
-
-    max = length * 7 / 8 + !!(length * 7 % 8);
-    for (i = 0, j = 0, n = 0; i < max; ++i) {
-        n >>= 8;
-        n |= (uint64_t)s[i] << 48;
-        if (i % 7 == 6) {
-            output[j++] = (char)(n & 0x7F); n >>= 7;
-            output[j++] = (char)(n & 0x7F); n >>= 7;
-            output[j++] = (char)(n & 0x7F); n >>= 7;
-            output[j++] = (char)(n & 0x7F); n >>= 7;
-            output[j++] = (char)(n & 0x7F); n >>= 7;
-            output[j++] = (char)(n & 0x7F); n >>= 7;
-            output[j++] = (char)(n & 0x7F); n >>= 7;
-            output[j++] = (char)(n & 0x7F); n >>= 7;
-        }
-    }
-
-    if (n) {
-        n >>= (7 - i % 7) * 8;
-        for (; i % 7 != 1; ++i) {
-            output[j++] = (char)(n & 0x7F); n >>= 7;
-        }
-    }
-
-    output[j++] = '\0';
-    return 0;
-}
-
-static time_t decode_absolute_timestamp(const unsigned char *s)
-{
-    struct tm tm;
-    time_t ret;
-    char b[16];
-    int tz;
-
-    if (decode_numeric(s, 7, b, sizeof(b))) {
-        return -1;
-    }
-
-    memset(&tm, 0, sizeof(tm));
-    tm.tm_year = (b[ 0] - '0') * 10 + (b[ 1] - '0');
-    tm.tm_mon  = (b[ 2] - '0') * 10 + (b[ 3] - '0') - 1;
-    tm.tm_mday = (b[ 4] - '0') * 10 + (b[ 5] - '0');
-    tm.tm_hour = (b[ 6] - '0') * 10 + (b[ 7] - '0');
-    tm.tm_min  = (b[ 8] - '0') * 10 + (b[ 9] - '0');
-    tm.tm_sec  = (b[10] - '0') * 10 + (b[11] - '0');
-    tz         = (b[12] - '0') * 10 + (b[13] - '0');
-
-    if (tm.tm_year <= 37) { /* Y2038 */
-        tm.tm_year += 100;
-    }
-
-    if (tz & 0x80) {
-        tz = -tz & 0x7F;
-    }
-
-    ret = mktime(&tm);
-    if (ret < 0) {
-        return -1;
-    }
-
-    ret -= timezone; /* UTC */
-    ret -= tz * 900;
-    return ret;
-}
-
-static time_t decode_relative_timestamp(const unsigned char *s)
-{
-    time_t t;
-
-    t = (time_t)(*s);
-    if (t <= 143) {
-        t = (t + 1) * 300;
-    } else if (t <= 167) {
-        t = (t - 143) * 1800 + 43200;
-    } else if (t <= 196) {
-        t = (t - 166) * 86400;
-    } else {
-        t = (t - 192) * 604800;
-    }
-
-    return -t;
-}
-
-static int get_address_any(const unsigned char *s, size_t size, char *output, size_t outlen)
-{
-    int numbering_plan_identification;
-    int type_of_address;
-    int type_of_number;
-
-    type_of_address = *s;
-    if (!(type_of_address & 0x80)) {
-        return -1;
-    }
-
-    ++s;
-    --size;
-    type_of_number = (type_of_address >> 4) & 0x07;
-    numbering_plan_identification = type_of_address & 0x0F;
-
-    /* International number : ANY */
-    /* Subscriber number : ISDN/telephone numbering plan */
-    if (type_of_number == 1 ||
-        (type_of_number == 4 && numbering_plan_identification == 1)) {
-
-        *output = '+';
-        if (decode_numeric(s, size, output + 1, outlen - 1)) {
-            return -1;
-        }
-
-    /* National number : ANY */
-    /* Subscriber number : National numbering plan */
-    } else if (type_of_number == 2 ||
-               (type_of_number == 4 && numbering_plan_identification == 8)) {
-
-        if (decode_numeric(s, size, output, outlen)) {
-            return -1;
-        }
-
-    /* Alphanumeric */
-    } else if (type_of_number == 5 && numbering_plan_identification == 0) {
-        if (decode_alphanumeric(s, size, output, outlen)) {
-            return -1;
-        }
-
-    } else {
-        return -1;
-    }
-
-    return 0;
-}
 
-static ssize_t get_address(const unsigned char *s, size_t max, char *output, size_t outlen)
-{
-    size_t length;
-    size_t size;
-
-    if (!max) {
-        return -1;
-    }
+    for (i = 0; i < udh->Count; ++i) {
+        e = &udh->Elements[i];
+        sprintf(buffer, "IEI=%u LEN=%u",
+                e->Identifier, (unsigned int)e->Data.size);
 
-    length = (size_t)(*s);
-    size = (length + (length % 2)) / 2 + 2;
-    if (size > max) {
-        return -1;
+        HEX(buffer, e->Data.data, e->Data.size);
     }
 
-    if (get_address_any(s + 1, size - 1, output, outlen)) {
-        return -1;
+    if (pdu_get_concatenated_short_messages(udh, &c)) {
+        printf("Concatenated short messages: REF=%u TOTAL=%u SEQ=%u\n",
+               c.ReferenceNumber, c.Maximum, c.Sequence);
     }
 
-    return (ssize_t)size;
-}
-
-static ssize_t get_smsc_number(const unsigned char *s, size_t max, char *output, size_t outlen)
-{
-    size_t size;
-
-    if (!max) {
-        return -1;
-    }
-
-    size = (size_t)*s;
-    if (size == 0) {
-        *output = '\0';
-        return 1;
-    }
-
-    ++s;
-    --max;
-    if (size > max) {
-        return -1;
-    }
-
-    if (get_address_any(s, size, output, outlen)) {
-        return -1;
-    }
-
-    return (ssize_t)(size + 1);
-}
-
-static int print_user_data_header(const void *udh, size_t udhlen)
-{
-    uint8_t InformationElementIdentifier;
-    const uint8_t *p;
-    char buffer[32];
-    uint8_t Length;
-
-    p = (const uint8_t *)udh;
-    while (udhlen) {
-        if (udhlen < 3) {
-            return -1;
-        }
-
-        InformationElementIdentifier = *p;
-        Length = *(p + 1);
-        udhlen -= 2;
-        p += 2;
-
-        if (udhlen < Length) {
-            return -1;
-        }
-
-        sprintf(buffer, "IEI=%u LEN=%u", InformationElementIdentifier, Length);
-        HEX(buffer, p, Length);
-
-        switch (InformationElementIdentifier) {
-        case 0x00:
-            if (Length != 3) {
-                return -1;
-            }
-
-            printf("Concatenated short messages, 8-bit reference number: "
-                   "REF=%u TOTAL=%u SEQ=%u\n", *p, *(p + 1), *(p + 2));
-            break;
-
-        case 0x05:
-            if (Length != 4) {
-                return -1;
-            }
-
-            printf("Application port addressing scheme, 16 bit address: "
-                   "SRC=%u DST=%u\n",
-                   ntohs(*(const uint16_t *)(p + 2)),
-                   ntohs(*(const uint16_t *)p));
-            break;
-
-        default:
-            break;
-        }
-
-        udhlen -= Length;
-        p += Length;
+    if (pdu_get_application_port_addressing_scheme(udh, &a)) {
+        printf("Application port addressing scheme: SRC=%u DST=%u\n",
+               a.OriginatorPort, a.DestinationPort);
     }
-
-    return 0;
 }
 
 static int print_timestamp(const char *what, time_t t)
@@ -391,420 +95,165 @@ static int print_timestamp(const char *what, time_t t)
     return 0;
 }
 
-#define DECODE_USER_DATA(s, max, pdu) decode_user_data( \
-        (s), (max), \
-        (pdu)->TPUserDataHeaderIndicator, \
-        (pdu)->TPDataCodingScheme, \
-        (pdu)->TPUserDataHeader, \
-        sizeof((pdu)->TPUserDataHeader), \
-        &(pdu)->TPUserDataHeaderLength, \
-        (pdu)->TPUserData, \
-        sizeof((pdu)->TPUserData), \
-        &(pdu)->TPUserDataLength)
-
-static int decode_user_data(
-        const unsigned char *s,
-        size_t               max,
-        uint8_t              TPUserDataHeaderIndicator,
-        uint8_t              TPDataCodingScheme,
-        void                *TPUserDataHeader,
-        size_t               udhmax,
-        uint8_t             *udhlen,
-        char                *TPUserData,
-        size_t               udmax,
-        uint8_t             *udlen)
+static void print_message(const pdu_message_t *pdu, const char *text)
 {
-    uint32_t TPUserDataHeaderLength;
-    uint32_t TPUserDataLength;
-    uint32_t len;
-    ssize_t  ret;
-
-    if (!max) {
-        return -1;
+    if (pdu->SMSC[0]) {
+        printf("SMSC: [%s]\n", pdu->SMSC);
     }
 
-    TPUserDataLength = *s;
-    --max;
-    ++s;
+    printf("TP-MTI: %u %u\n",
+           pdu->TPMessageTypeIndicator1, pdu->TPMessageTypeIndicator0);
 
-    if (TPDataCodingScheme & 0xE0) {
-        return -1;
+    if (pdu->type == PDU_DELIVER) {
+        printf("Type: SMS-DELIVER\n");
+        printf("From: [%s]\n", pdu->TPAddress);
+    } else {
+        printf("Type: SMS-SUBMIT\n");
+        printf("To: [%s]\n", pdu->TPAddress);
+        printf("TP-MR: %d\n", pdu->TPMessageReference);
     }
 
-    switch ((TPDataCodingScheme & 0x0C) >> 2) {
-    case 0: /* alphabet */
-        len = (uint32_t)TPUserDataLength * 7 / 8 + !!((uint32_t)TPUserDataLength * 7 % 8);
-        if (len > max) {
-            return -1;
-        }
-
-        if (decode_alphanumeric(s, TPUserDataLength, TPUserData, udmax)) {
-            return -1;
-        }
-
-        *udlen = (uint8_t)TPUserDataLength;
-        if (TPUserDataHeaderIndicator) {
-            TPUserDataHeaderLength = (unsigned int)(*s) + 1;
-            if (TPUserDataHeaderLength > max) {
-                return -1;
-            }
-
-            len = TPUserDataHeaderLength * 8 / 7 + !!(TPUserDataHeaderLength * 8 % 7);
-            if (udhmax < len) {
-                return -1;
-            }
-
-            *udhlen = *s;
-            memcpy(TPUserDataHeader, s + 1, *s);
-            *udlen = (uint8_t)(TPUserDataLength - len);
-            memmove(TPUserData, TPUserData + len, TPUserDataLength - len + 1);
-        }
-
-        return 0;
-
-    case 1: /* 8 bit */
-        if (TPUserDataLength > max) {
-            return -1;
-        }
-
-        if (TPUserDataHeaderIndicator) {
-            TPUserDataHeaderLength = (unsigned int)(*s);
-            if (TPUserDataHeaderLength > max) {
-                return -1;
-            }
-
-            if (udhmax < TPUserDataHeaderLength) {
-                return -1;
-            }
-
-            *udhlen = (uint8_t)TPUserDataHeaderLength;
-            *udlen = (uint8_t)(TPUserDataLength - 1 - TPUserDataHeaderLength);
-            if (udmax < *udlen) {
-                return -1;
-            }
-
-            memcpy(TPUserDataHeader, s + 1, TPUserDataHeaderLength);
-            memcpy(TPUserData,
-                   s + TPUserDataHeaderLength + 1,
-                   TPUserDataLength - TPUserDataHeaderLength - 1);
-
-        } else {
-            *udlen = (uint8_t)TPUserDataLength;
-            if (udmax < *udlen) {
-                return -1;
-            }
-
-            memcpy(TPUserData, s, TPUserDataLength);
-        }
-
-        return 0;
-
-    case 2: /* UCS-2 */
-        if (TPUserDataLength > max) {
-            return -1;
-        }
-
-        TPUserDataHeaderLength = 0;
-        if (TPUserDataHeaderIndicator) {
-            TPUserDataHeaderLength = (unsigned int)(*s) + 1;
-            if (TPUserDataHeaderLength >= max) {
-                return -1;
-            }
-
-            if (udhmax < TPUserDataHeaderLength) {
-                return -1;
-            }
-
-            *udhlen = (uint8_t)(TPUserDataHeaderLength - 1);
-            memcpy(TPUserDataHeader, s + 1, TPUserDataHeaderLength - 1);
-        }
-
-        if ((ret = charset(s + TPUserDataHeaderLength,
-                           TPUserDataLength - TPUserDataHeaderLength,
-                           TPUserData, udmax,
-                           "UCS-2BE", "UTF-8")) < 0) {
-
-            return -1;
-        }
-
-        *udlen = (uint8_t)ret;
-        return 0;
+    printf("TP-PID: %d\n", pdu->TPProtocolIdentifier);
+    printf("TP-DCS: %d\n", pdu->TPDataCodingScheme);
+    if (pdu->type == PDU_DELIVER) {
+        print_timestamp("TP-SCTS", pdu->TPServiceCentreTimeStamp);
+    } else {
+        print_timestamp("TP-VP", pdu->TPValidityPeriod);
+    }
 
-    case 3:  /* Reserved */
-    default: /* Unreachable */
-        return -1;
+    if (pdu->TPUserDataHeaderIndicator) {
+        print_user_data_header(&pdu->TPUserDataHeader);
     }
+
+    printf("UDL: [%u]\n", pdu->TPUserDataLength);
+    printf("Text: [%s]\n", text);
+    HEX("UD", pdu->TPUserData.data, pdu->TPUserData.size);
 }
 
-static int decode_sms_deliver(
+/* Types without a decoder yet fail. */
+static int decode(
         const unsigned char *s,
         size_t max,
-        struct sms_deliver *pdu)
+        int sending,
+        int has_smsc,
+        char *json,
+        size_t length)
 {
-    ssize_t ret;
-
-    printf("Type: SMS-DELIVER\n");
-    memset(pdu, 0, sizeof(*pdu));
-    if (!max) {
-        return -1;
-    }
-
-    pdu->TPMessageTypeIndicator0   = BIT(*s, 0);
-    pdu->TPMessageTypeIndicator1   = BIT(*s, 1);
-    pdu->TPMoreMessagesToSend      = BIT(*s, 2);
-    pdu->TPStatusReportIndication  = BIT(*s, 5);
-    pdu->TPUserDataHeaderIndicator = BIT(*s, 6);
-    pdu->TPReplyPath               = BIT(*s, 7);
-
-    --max;
-    ++s;
-
-    if ((ret = get_address(s, max,
-                           pdu->TPOriginatingAddress,
-                           sizeof(pdu->TPOriginatingAddress))) < 0) {
+    char text[PDU_MAXIMUM_TEXT + 1];
+    pdu_message_t pdu;
+    const char *why;
+    size_t size;
 
-        printf("FAILED %d\n", __LINE__);
+    if (pdu_decode(s, max, sending, has_smsc, &pdu, &why)) {
+        DEBUG("FAILED: %s\n", why ? why : "unknown");
         return -1;
     }
 
-    max -= (size_t)ret;
-    s += ret;
-
-    if (max < 10) {
-        printf("FAILED %d\n", __LINE__);
+    if (pdu_decode_text(&pdu, text, &size)) {
+        DEBUG("FAILED: TP-UD\n");
         return -1;
     }
 
-    pdu->TPProtocolIdentifier = *s;
-    --max;
-    ++s;
-
-    pdu->TPDataCodingScheme = *s;
-    --max;
-    ++s;
-
-    if ((pdu->TPServiceCentreTimeStamp = decode_absolute_timestamp(s)) < 0) {
-        printf("FAILED %d\n", __LINE__);
-        return -1;
+    text[size] = '\0';
+    if (verbose) {
+        print_message(&pdu, text);
     }
 
-    max -= 7;
-    s += 7;
-
-    pdu->TPUserDataLength = *s;
-    if (DECODE_USER_DATA(s, max, pdu)) {
-        printf("FAILED %d\n", __LINE__);
-        return -1;
-    }
+    return json_encode_message(has_smsc ? pdu.SMSC : NULL,
+                               &pdu, text, json, length);
+}
 
-    printf("From: [%s]\n", pdu->TPOriginatingAddress);
-    printf("TP-PID: %d\n", pdu->TPProtocolIdentifier);
-    printf("TP-DCS: %d\n", pdu->TPDataCodingScheme);
-    print_timestamp("TP-SCTS", pdu->TPServiceCentreTimeStamp);
-    if (pdu->TPUserDataHeaderIndicator) {
-        HEX("UDH", pdu->TPUserDataHeader, pdu->TPUserDataHeaderLength);
-        print_user_data_header(pdu->TPUserDataHeader, pdu->TPUserDataHeaderLength);
-    }
-    printf("UDL: [%u]\n", pdu->TPUserDataLength);
-    printf("Text: [%.*s]\n", pdu->TPUserDataLength, pdu->TPUserData);
-    HEX("UD", pdu->TPUserData, pdu->TPUserDataLength);
-    return 0;
+static int batch_decode(
+        const unsigned char *pdu,
+        size_t length,
+        const struct batch_options *options,
+        char *json,
+        size_t jsonlen)
+{
+    return decode(pdu, length,
+                  options->sending, options->has_smsc,
+                  json, jsonlen);
 }
 
-static int decode_sms_submit(const unsigned char *s, size_t max, struct sms_submit *pdu)
+static int process(const char *input, int sending, int has_smsc)
 {
+    unsigned char buffer[1024];
+    char json[1024];
     ssize_t ret;
 
-    printf("Type: SMS-SUBMIT\n");
-    memset(pdu, 0, sizeof(*pdu));
-    if (max < 2) {
-        return -1;
-    }
-
-    pdu->TPMessageTypeIndicator0   = BIT(*s, 0);
-    pdu->TPMessageTypeIndicator1   = BIT(*s, 1);
-    pdu->TPRejectDuplicates        = BIT(*s, 2);
-    pdu->TPValidityPeriodFormat3   = BIT(*s, 3);
-    pdu->TPValidityPeriodFormat4   = BIT(*s, 4);
-    pdu->TPStatusReportRequest     = BIT(*s, 5);
-    pdu->TPUserDataHeaderIndicator = BIT(*s, 6);
-    pdu->TPReplyPath               = BIT(*s, 7);
-    --max;
-    ++s;
-
-    pdu->TPMessageReference = *s;
-    --max;
-    ++s;
-
-    if ((ret = get_address(s, max,
-                           pdu->TPDestinationAddress,
-                           sizeof(pdu->TPDestinationAddress))) < 0) {
-
-        return -1;
-    }
-
-    max -= (size_t)ret;
-    s += ret;
-
-    if (max < 4) {
-        return -1;
-    }
-
-    pdu->TPProtocolIdentifier = *s;
-    --max;
-    ++s;
-
-    pdu->TPDataCodingScheme = *s;
-    --max;
-    ++s;
-
-    pdu->TPValidityPeriod = 0;
-    if (pdu->TPValidityPeriodFormat4 == 1 && pdu->TPValidityPeriodFormat3 == 0) {
-        pdu->TPValidityPeriod = decode_relative_timestamp(s);
-        --max;
-        ++s;
-
-    } else if (pdu->TPValidityPeriodFormat4 == 0 && pdu->TPValidityPeriodFormat3 == 1) {
+    if ((ret = hex_decode(input, strlen(input), buffer, sizeof(buffer))) < 0) {
         return -1;
-    } else if (pdu->TPValidityPeriodFormat4 == 1 && pdu->TPValidityPeriodFormat3 == 1) {
-        if ((pdu->TPValidityPeriod = decode_absolute_timestamp(s)) < 0) {
-            return -1;
-        }
-
-        max -= 7;
-        s += 7;
     }
 
-    pdu->TPUserDataLength = *s;
-    if (DECODE_USER_DATA(s, max, pdu)) {
+    if (decode(buffer, (size_t)ret, sending, has_smsc, json, sizeof(json))) {
         return -1;
     }
 
-    printf("To: [%s]\n", pdu->TPDestinationAddress);
-    printf("TP-MR: %d\n", pdu->TPMessageReference);
-    printf("TP-PID: %d\n", pdu->TPProtocolIdentifier);
-    printf("TP-DCS: %d\n", pdu->TPDataCodingScheme);
-    print_timestamp("TP-VP", pdu->TPValidityPeriod);
-    if (pdu->TPUserDataHeaderIndicator) {
-        HEX("UDH", pdu->TPUserDataHeader, pdu->TPUserDataHeaderLength);
-        print_user_data_header(pdu->TPUserDataHeader, pdu->TPUserDataHeaderLength);
-    }
-    printf("UDL: [%u]\n", pdu->TPUserDataLength);
-    printf("Text: [%.*s]\n", pdu->TPUserDataLength, pdu->TPUserData);
-    HEX("UD", pdu->TPUserData, pdu->TPUserDataLength);
+    printf("JSON: %s\n", json);
     return 0;
 }
 
-static ssize_t unhex(const char *input, unsigned char *output, size_t outlen)
+static void usage(const char *argv0)
 {
-    ssize_t ret;
-    size_t max;
-    size_t i;
-
-    max = strlen(input);
-    if (max % 2) {
-        return -1;
-    }
-
-    max /= 2;
-    if (max > outlen) {
-        return -1;
-    }
-
-    for (i = 0; i < max; ++i) {
-        if ((ret = get(input + i * 2)) < 0) {
-            return -1;
-        }
-
-        output[i] = (unsigned char)ret;
-    }
-
-    return (ssize_t)max;
+    fprintf(stderr,
+            "Usage: %s <hex> [sending]\n"
+            "       %s -b [-s] [-n] [-r] [-j threads] [file...]\n"
+            "\n"
+            "  -b  batch mode, decode files or stdin into NDJSON on stdout\n"
+            "  -s  PDUs are SMS-SUBMIT rather than SMS-DELIVER\n"
+            "  -n  PDUs don't start with the SMSC address\n"
+            "  -r  raw records, each a 16 bit big endian length and the PDU,\n"
+            "      rather than a hex PDU per line\n"
+            "  -j  decoding threads, defaults to the number of CPUs\n",
+            argv0, argv0);
 }
 
-static int process(const char *input, int sending, int has_smsc)
+int main(int argc, char *argv[])
 {
-    struct sms_deliver deliver;
-    unsigned char buffer[1024];
-    unsigned char json[1024];
-    struct sms_submit submit;
-    const char *psmsc;
-    unsigned char *s;
-    char smsc[32];
-    size_t max;
-
-    ssize_t ret;
-    uint8_t TPMessageTypeIndicator0;
-    uint8_t TPMessageTypeIndicator1;
-
-    if ((ret = unhex(input, buffer, sizeof(buffer))) < 0) {
-        return -1;
-    }
-
-    max = (size_t)ret;
-    s = buffer;
-
-    psmsc = NULL;
-    if (has_smsc) {
-        if ((ret = get_smsc_number(s, max, smsc, sizeof(smsc))) < 0) {
-            return -1;
+    struct batch_options options;
+    int batch = 0;
+    long cpus;
+    int opt;
+
+    memset(&options, 0, sizeof(options));
+    options.has_smsc = 1;
+    options.decode = batch_decode;
+
+    while ((opt = getopt(argc, argv, "bsnrj:h")) != -1) {
+        switch (opt) {
+        case 'b': batch = 1;                        break;
+        case 's': options.sending = 1;              break;
+        case 'n': options.has_smsc = 0;             break;
+        case 'r': options.raw = 1;                  break;
+        case 'j': options.threads = atoi(optarg);   break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
         }
-        printf("SMSC: [%s]\n", smsc);
-        psmsc = smsc;
-
-        s += ret;
-        max -= (size_t)ret;
     }
 
-    printf("Head: %d\n", (int)(*s));
-
-    TPMessageTypeIndicator0 = BIT(*s, 0);
-    TPMessageTypeIndicator1 = BIT(*s, 1);
-    printf("TP-MTI: %u %u\n", TPMessageTypeIndicator1, TPMessageTypeIndicator0);
-
-    if (sending) {
-        if (TPMessageTypeIndicator1 == 0 && TPMessageTypeIndicator0 == 0) {
-            //return decode_sms_deliver_report(s, max, &deliver);
-        } else if (TPMessageTypeIndicator1 == 1 && TPMessageTypeIndicator0 == 0) {
-            //return decode_sms_command(s, max, &deliver);
-        } else if (TPMessageTypeIndicator1 == 0 && TPMessageTypeIndicator0 == 1) {
-            if (decode_sms_submit(s, max, &submit)                        ||
-                json_encode_sms_submit(psmsc, &submit, json, sizeof(json)) ){
-
-                return -1;
-            }
+    if (batch) {
+        if (options.threads <= 0) {
+            cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            options.threads = cpus > 0 ? (int)cpus : 1;
         }
-    } else {
-        if (TPMessageTypeIndicator1 == 0 && TPMessageTypeIndicator0 == 0) {
-            if (decode_sms_deliver(s, max, &deliver)                        ||
-                json_encode_sms_deliver(psmsc, &deliver, json, sizeof(json)) ){
 
-                return -1;
-            }
-
-        } else if (TPMessageTypeIndicator1 == 1 && TPMessageTypeIndicator0 == 0) {
-            //return decode_sms_status_report(s, max, &deliver);
-        } else if (TPMessageTypeIndicator1 == 0 && TPMessageTypeIndicator0 == 1) {
-            //return decode_sms_submit_report(s, max, &submit);
+        verbose = 0;
+        if (batch_run(&options, argv + optind, (size_t)(argc - optind))) {
+            return EXIT_FAILURE;
         }
-    }
 
-    printf("JSON: %s\n", json);
-    return 0;
-}
-
-int main(int argc, char *argv[])
-{
-    int sending = 0;
-    int smsc = 1;
+        return EXIT_SUCCESS;
+    }
 
-    if (argc < 2) {
+    if (optind >= argc) {
+        usage(argv[0]);
         return EXIT_FAILURE;
-    } else if (argc >= 3) {
-        sending = 1;
+    } else if (optind + 1 < argc) {
+        options.sending = 1;
     }
 
-    if (process(argv[1], sending, smsc)) {
+    if (process(argv[optind], options.sending, options.has_smsc)) {
         printf("ERROR\n");
         return EXIT_FAILURE;
     }
@@ -0,0 +1,124 @@
+#ifndef SMS_SERVER_BENCH_BENCH_H
+#define SMS_SERVER_BENCH_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// Calls to operator new so far, counted by main.cpp.
+extern std::atomic<size_t> g_allocations;
+
+// Keeps the compiler from optimizing `p` and whatever it points to away.
+inline void keep(const void *p)
+{
+    asm volatile("" : : "g"(p) : "memory");
+}
+
+// Calls `f` in batches of about a millisecond for a while, prints the median
+// time per call with the 90th and 99th percentiles of the batches to show
+// the variance, allocations per call, and throughput if each call processes
+// `bytes`.
+template <class F>
+void Measure(const char *name, size_t bytes, F &&f)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr auto kDuration = std::chrono::milliseconds(200);
+    constexpr auto kSample = std::chrono::milliseconds(1);
+    constexpr size_t kMinimumSamples = 20;
+
+    for (int i = 0; i < 100; ++i) {
+        f();
+    }
+
+    size_t batch = 1;
+    for (;;) {
+        const auto start = clock::now();
+        for (size_t i = 0; i < batch; ++i) {
+            f();
+        }
+
+        if (clock::now() - start >= kSample || batch >= (1u << 24)) {
+            break;
+        }
+
+        batch *= 2;
+    }
+
+    std::vector<double> samples;
+    samples.reserve(1024);
+
+    size_t iterations = 0;
+    size_t allocations = 0;
+    const auto start = clock::now();
+    auto now = start;
+    while (now - start < kDuration || samples.size() < kMinimumSamples) {
+        const size_t before = g_allocations.load(std::memory_order_relaxed);
+        const auto begin = clock::now();
+        for (size_t i = 0; i < batch; ++i) {
+            f();
+        }
+
+        now = clock::now();
+        allocations += g_allocations.load(std::memory_order_relaxed) - before;
+        iterations += batch;
+
+        samples.push_back(static_cast<double>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        now - begin).count()) / static_cast<double>(batch));
+    }
+
+    std::sort(samples.begin(), samples.end());
+    const double p50 = samples[samples.size() / 2];
+    const double p90 = samples[samples.size() * 9 / 10];
+    const double p99 = samples[samples.size() * 99 / 100];
+    const double allocs = static_cast<double>(allocations)
+                        / static_cast<double>(iterations);
+
+    if (bytes) {
+        printf("%-40s %12.1f ns/op p90 %12.1f p99 %12.1f %8.2f allocs/op %10.1f MB/s\n",
+               name, p50, p90, p99, allocs,
+               static_cast<double>(bytes) * 1000.0 / p50);
+    } else {
+        printf("%-40s %12.1f ns/op p90 %12.1f p99 %12.1f %8.2f allocs/op\n",
+               name, p50, p90, p99, allocs);
+    }
+}
+
+// Coding schemes of synthetic PDUs.
+enum Scheme {
+    kGsm7,
+    kOctet,
+    kUcs2,
+};
+
+// Installs a configuration with device 1 whose token is "bench", and SMTP
+// settings good for building mails but not for sending them.
+void Configure();
+
+// A binary SMS-DELIVER with the SMSC address of `characters` random ones,
+// part `sequence` of `maximum` under `reference` if `maximum` isn't 0.
+std::string MakeDeliver(Scheme scheme,
+                        const std::string &peer,
+                        size_t characters,
+                        uint8_t reference = 0,
+                        uint8_t maximum = 0,
+                        uint8_t sequence = 0);
+
+void Codec();
+void Decode(const char *corpus);
+void Split();
+void Handle();
+void Render();
+void Mail();
+
+} // namespace bench
+
+#endif // SMS_SERVER_BENCH_BENCH_H
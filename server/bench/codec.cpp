@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include <flinter/charset.h>
+#include <flinter/encode.h>
+
+#include "sms/libpdu/utf16.h"
+#include "sms/server/bench/bench.h"
+#include "sms/server/codec.h"
+
+namespace bench {
+namespace {
+
+std::string random_bytes(size_t length)
+{
+    std::string s(length, '\0');
+    for (size_t i = 0; i < length; ++i) {
+        s[i] = static_cast<char>(rand());
+    }
+
+    return s;
+}
+
+// Mostly plain text with the occasional character to escape.
+std::string random_text(size_t length)
+{
+    static const char kSpecial[] = "&<>\"'";
+    std::string s(length, '\0');
+    for (size_t i = 0; i < length; ++i) {
+        const int r = rand() % 256;
+        s[i] = r < 5 ? kSpecial[r] : static_cast<char>('a' + r % 26);
+    }
+
+    return s;
+}
+
+void hex(size_t length)
+{
+    const std::string bytes = random_bytes(length);
+    const std::string text = codec::EncodeHex(bytes);
+    std::string out(text.length(), '\0');
+    std::string decoded;
+    char name[64];
+
+    snprintf(name, sizeof(name), "DecodeHex/%lu/flinter", text.length());
+    Measure(name, text.length(), [&] {
+        flinter::DecodeHex(text, &decoded);
+        keep(decoded.data());
+    });
+
+    snprintf(name, sizeof(name), "DecodeHex/%lu/scalar", text.length());
+    Measure(name, text.length(), [&] {
+        codec::scalar::DecodeHex(text.data(), text.length(),
+                reinterpret_cast<unsigned char *>(&out[0]));
+        keep(out.data());
+    });
+
+    snprintf(name, sizeof(name), "DecodeHex/%lu/%s",
+             text.length(), codec::kernel());
+    Measure(name, text.length(), [&] {
+        codec::DecodeHex(text.data(), text.length(),
+                reinterpret_cast<unsigned char *>(&out[0]));
+        keep(out.data());
+    });
+
+    const unsigned char *in =
+            reinterpret_cast<const unsigned char *>(bytes.data());
+
+    snprintf(name, sizeof(name), "EncodeHex/%lu/flinter", length);
+    Measure(name, length, [&] {
+        keep(flinter::EncodeHex(bytes).data());
+    });
+
+    snprintf(name, sizeof(name), "EncodeHex/%lu/scalar", length);
+    Measure(name, length, [&] {
+        codec::scalar::EncodeHex(in, length, &out[0]);
+        keep(out.data());
+    });
+
+    snprintf(name, sizeof(name), "EncodeHex/%lu/%s",
+             length, codec::kernel());
+    Measure(name, length, [&] {
+        codec::EncodeHex(in, length, &out[0]);
+        keep(out.data());
+    });
+}
+
+void base64(size_t length)
+{
+    const std::string bytes = random_bytes(length);
+    const unsigned char *in =
+            reinterpret_cast<const unsigned char *>(bytes.data());
+
+    std::string out(codec::base64_length(length), '\0');
+    std::string encoded;
+    char name[64];
+
+    snprintf(name, sizeof(name), "EncodeBase64/%lu/flinter", length);
+    Measure(name, length, [&] {
+        flinter::EncodeBase64(bytes, &encoded);
+        keep(encoded.data());
+    });
+
+    snprintf(name, sizeof(name), "EncodeBase64/%lu/scalar", length);
+    Measure(name, length, [&] {
+        codec::scalar::EncodeBase64(in, length, &out[0]);
+        keep(out.data());
+    });
+
+    snprintf(name, sizeof(name), "EncodeBase64/%lu/%s",
+             length, codec::kernel());
+    Measure(name, length, [&] {
+        codec::EncodeBase64(in, length, &out[0]);
+        keep(out.data());
+    });
+}
+
+// `units` code units picked from [lo, hi).
+void utf16(const char *kind, size_t units, unsigned lo, unsigned hi)
+{
+    std::string text(units * 2, '\0');
+    for (size_t i = 0; i < units; ++i) {
+        const unsigned c = lo + static_cast<unsigned>(rand()) % (hi - lo);
+        text[i * 2] = static_cast<char>(c >> 8);
+        text[i * 2 + 1] = static_cast<char>(c);
+    }
+
+    const unsigned char *in =
+            reinterpret_cast<const unsigned char *>(text.data());
+
+    std::string out(UTF16_UTF8_LENGTH(text.length()), '\0');
+    std::string converted;
+    char name[64];
+
+    snprintf(name, sizeof(name), "utf16be_to_utf8/%s/flinter", kind);
+    Measure(name, text.length(), [&] {
+        flinter::charset_utf16be_to_utf8(text, &converted);
+        keep(converted.data());
+    });
+
+    snprintf(name, sizeof(name), "utf16be_to_utf8/%s/scalar", kind);
+    Measure(name, text.length(), [&] {
+        utf16be_to_utf8_scalar(in, text.length(), &out[0], out.length());
+        keep(out.data());
+    });
+
+    snprintf(name, sizeof(name), "utf16be_to_utf8/%s/%s",
+             kind, utf16_kernel());
+    Measure(name, text.length(), [&] {
+        utf16be_to_utf8(in, text.length(), &out[0], out.length());
+        keep(out.data());
+    });
+}
+
+void html(size_t length)
+{
+    const std::string text = random_text(length);
+    std::string out;
+    char name[64];
+
+    snprintf(name, sizeof(name), "EscapeHtml/%lu/flinter", length);
+    Measure(name, length, [&] {
+        keep(flinter::EscapeHtml(text).data());
+    });
+
+    snprintf(name, sizeof(name), "EscapeHtml/%lu/%s",
+             length, codec::kernel());
+    Measure(name, length, [&] {
+        out.clear();
+        codec::AppendHtml(&out, text);
+        keep(out.data());
+    });
+}
+
+} // anonymous namespace
+
+void Codec()
+{
+    srand(1);
+
+    // A long PDU, a mail of a few dozen messages, an SMS and a long one.
+    hex(176);
+    base64(32768);
+    html(160);
+    html(4096);
+
+    // A full UCS-2 message each
+    utf16("ascii", 70, 0x20, 0x7F);
+    utf16("cyrillic", 70, 0x410, 0x450);
+    utf16("cjk", 70, 0x4E00, 0x9FA6);
+}
+
+} // namespace bench
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "sms/libpdu/pdu.h"
+#include "sms/server/bench/bench.h"
+#include "sms/server/codec.h"
+
+namespace bench {
+namespace {
+
+class Vector {
+public:
+    std::string _pdu;
+    bool _sending;
+    bool _has_smsc;
+}; // class Vector
+
+void decode(const char *name, const std::vector<Vector> &vectors)
+{
+    char text[PDU_MAXIMUM_TEXT];
+    pdu_message_t m;
+    size_t length;
+
+    size_t bytes = 0;
+    for (auto &&v : vectors) {
+        bytes += v._pdu.length();
+    }
+
+    Measure(name, bytes, [&] {
+        for (auto &&v : vectors) {
+            if (pdu_decode(v._pdu.data(), v._pdu.length(),
+                           v._sending, v._has_smsc, &m, nullptr) == PDU_OK) {
+
+                pdu_decode_text(&m, text, &length);
+                keep(text);
+            }
+        }
+    });
+}
+
+void synthetic(const char *name, Scheme scheme, size_t characters, bool udh)
+{
+    std::vector<Vector> vectors(1);
+    vectors[0]._pdu = MakeDeliver(scheme, "+8613912345678", characters,
+                                  0x42, udh ? 2 : 0, udh ? 1 : 0);
+    vectors[0]._sending = false;
+    vectors[0]._has_smsc = true;
+    decode(name, vectors);
+}
+
+// PDUs of libpdu/corpus.txt that decode, by coding scheme.
+void recorded(const char *corpus)
+{
+    std::ifstream file(corpus);
+    if (!file) {
+        fprintf(stderr, "bench: failed to open [%s]\n", corpus);
+        return;
+    }
+
+    std::vector<Vector> schemes[3];
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || (line[0] != 'd' && line[0] != 's')) {
+            continue;
+        }
+
+        const size_t space = line.find(' ');
+        if (space == std::string::npos) {
+            continue;
+        }
+
+        Vector v;
+        v._sending = line[0] == 's';
+        v._has_smsc = line[1] != 'n';
+        if (!codec::DecodeHex(line.substr(space + 1), &v._pdu)) {
+            continue;
+        }
+
+        pdu_message_t m;
+        if (pdu_decode(v._pdu.data(), v._pdu.length(),
+                       v._sending, v._has_smsc, &m, nullptr) != PDU_OK) {
+            continue;
+        }
+
+        const size_t scheme = (m.TPDataCodingScheme & 0x0C) >> 2;
+        if (scheme < 3) {
+            schemes[scheme].push_back(v);
+        }
+    }
+
+    decode("pdu_decode/corpus/gsm7", schemes[kGsm7]);
+    decode("pdu_decode/corpus/8bit", schemes[kOctet]);
+    decode("pdu_decode/corpus/ucs2", schemes[kUcs2]);
+}
+
+} // anonymous namespace
+
+void Decode(const char *corpus)
+{
+    srand(1);
+
+    synthetic("pdu_decode/gsm7/160", kGsm7, 160, false);
+    synthetic("pdu_decode/gsm7/153+udh", kGsm7, 153, true);
+    synthetic("pdu_decode/8bit/140", kOctet, 140, false);
+    synthetic("pdu_decode/ucs2/70", kUcs2, 70, false);
+    synthetic("pdu_decode/ucs2/67+udh", kUcs2, 67, true);
+
+    if (corpus) {
+        recorded(corpus);
+    }
+}
+
+} // namespace bench
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+
+#include <flinter/types/tree.h>
+
+#include "sms/server/bench/bench.h"
+#include "sms/server/configure.h"
+
+namespace bench {
+namespace {
+
+const char kConfigure[] =
+        "device {\n"
+        "  1 {\n"
+        "    token = bench\n"
+        "    has_smsc = 1\n"
+        "    to = bench@example.com\n"
+        "    receiver = Bench\n"
+        "  }\n"
+        "}\n"
+        "smtp {\n"
+        "  from = smsd@example.com\n"
+        "  sender = SMS\n"
+        "  subject = SMS\n"
+        "  disabled = 1\n"
+        "}\n";
+
+// Packs bytes and septets LSB first, as TP-UD with a header is.
+class Bits {
+public:
+    Bits() : _bits(0) {}
+
+    void Put(unsigned value, size_t width)
+    {
+        for (size_t i = 0; i < width; ++i, ++_bits) {
+            if (_bits % 8 == 0) {
+                _out.push_back('\0');
+            }
+
+            if (value & (1u << i)) {
+                _out.back() = static_cast<char>(
+                        _out.back() | (1 << (_bits % 8)));
+            }
+        }
+    }
+
+    // Fill bits up to the next septet boundary.
+    void Align()
+    {
+        while (_bits % 7) {
+            Put(0, 1);
+        }
+    }
+
+    const std::string &str() const
+    {
+        return _out;
+    }
+
+private:
+    std::string _out;
+    size_t _bits;
+
+}; // class Bits
+
+void put_number(std::string *out, const std::string &number)
+{
+    const bool international = !number.empty() && number[0] == '+';
+    const std::string digits = number.substr(international ? 1 : 0);
+
+    out->push_back(static_cast<char>(digits.length()));
+    out->push_back(static_cast<char>(international ? 0x91 : 0xA1));
+    for (size_t i = 0; i < digits.length(); i += 2) {
+        const int l = digits[i] - '0';
+        const int h = i + 1 < digits.length() ? digits[i + 1] - '0' : 0xF;
+        out->push_back(static_cast<char>(h << 4 | l));
+    }
+}
+
+} // anonymous namespace
+
+void Configure()
+{
+    static flinter::Tree configure;
+    if (!configure.ParseFromHdfString(kConfigure)) {
+        fprintf(stderr, "bench: failed to parse configure\n");
+        exit(EXIT_FAILURE);
+    }
+
+    g_configure = &configure;
+}
+
+std::string MakeDeliver(
+        Scheme scheme,
+        const std::string &peer,
+        size_t characters,
+        uint8_t reference,
+        uint8_t maximum,
+        uint8_t sequence)
+{
+    // Alphanumerics are the same in the GSM 7 bit default alphabet.
+    static const char kAlphabet[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789 ";
+
+    std::string udh;
+    if (maximum) {
+        const char element[] = {
+                0x05, 0x00, 0x03,
+                static_cast<char>(reference),
+                static_cast<char>(maximum),
+                static_cast<char>(sequence),
+        };
+
+        udh.assign(element, sizeof(element));
+    }
+
+    std::string pdu("\x08\x91\x68\x31\x08\x10\x00\x05\xF0", 9);
+    pdu.push_back(static_cast<char>(udh.empty() ? 0x04 : 0x44));
+    put_number(&pdu, peer);
+    pdu.push_back('\0');
+    pdu.push_back(static_cast<char>(scheme == kGsm7 ? 0x00 :
+                                    scheme == kOctet ? 0x04 : 0x08));
+
+    pdu.append("\x42\x70\x11\x80\x74\x31\x23", 7);
+
+    if (scheme == kGsm7) {
+        Bits bits;
+        for (auto &&c : udh) {
+            bits.Put(static_cast<unsigned char>(c), 8);
+        }
+
+        bits.Align();
+        const size_t septets = udh.length() * 8 / 7 + !!(udh.length() * 8 % 7);
+        for (size_t i = 0; i < characters; ++i) {
+            bits.Put(static_cast<unsigned char>(
+                    kAlphabet[rand() % (sizeof(kAlphabet) - 1)]), 7);
+        }
+
+        pdu.push_back(static_cast<char>(septets + characters));
+        pdu.append(bits.str());
+
+    } else if (scheme == kOctet) {
+        pdu.push_back(static_cast<char>(udh.length() + characters));
+        pdu.append(udh);
+        for (size_t i = 0; i < characters; ++i) {
+            pdu.push_back(static_cast<char>(rand()));
+        }
+
+    } else {
+        pdu.push_back(static_cast<char>(udh.length() + characters * 2));
+        pdu.append(udh);
+        for (size_t i = 0; i < characters; ++i) {
+            const unsigned c = 0x4E00 + static_cast<unsigned>(rand()) % 0x51A6;
+            pdu.push_back(static_cast<char>(c >> 8));
+            pdu.push_back(static_cast<char>(c));
+        }
+    }
+
+    return pdu;
+}
+
+} // namespace bench
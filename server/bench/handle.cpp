@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "sms/server/bench/bench.h"
+#include "sms/server/codec.h"
+#include "sms/server/handler.h"
+#include "sms/server/processor.h"
+
+namespace bench {
+namespace {
+
+// Takes records and drops them, handle() is measured on its own.
+class Sink : public ::Processor {
+public:
+    int Received(std::unique_ptr<db::Call> r) override
+    {
+        keep(r.get());
+        return 0;
+    }
+
+    int Received(std::unique_ptr<db::PDU> r) override
+    {
+        keep(r.get());
+        return 0;
+    }
+
+    int Received(std::unique_ptr<db::SMS> r) override
+    {
+        keep(r.get());
+        return 0;
+    }
+
+}; // class Sink
+
+// What the client uploads: `pdus` PDUs of mixed coding schemes, some of them
+// concatenated, and `calls` calls.
+std::string make_payload(size_t pdus, size_t calls)
+{
+    std::string payload = "{\"token\":\"bench\"";
+    int64_t timestamp = 1720658833000000000LL;
+
+    for (size_t i = 0; i < pdus; ++i, timestamp += 1000000) {
+        const Scheme scheme = static_cast<Scheme>(i % 3);
+        const uint8_t sequence = static_cast<uint8_t>(i % 4 == 3 ? 0 : i % 4 + 1);
+        const std::string pdu = MakeDeliver(
+                scheme, "+8613912345678",
+                scheme == kGsm7 ? 153 : scheme == kOctet ? 134 : 67,
+                static_cast<uint8_t>(i / 4), sequence ? 3 : 0, sequence);
+
+        payload.append(i ? "," : ",\"pdu\":[");
+        payload.append("{\"timestamp\":\"").append(std::to_string(timestamp))
+               .append("\",\"type\":\"Incoming\",\"pdu\":\"")
+               .append(codec::EncodeHex(pdu)).append("\"}");
+    }
+
+    if (pdus) {
+        payload.append("]");
+    }
+
+    for (size_t i = 0; i < calls; ++i, timestamp += 1000000) {
+        payload.append(i ? "," : ",\"call\":[");
+        payload.append("{\"timestamp\":\"").append(std::to_string(timestamp))
+               .append("\",\"duration\":\"15000000000\"")
+               .append(",\"peer\":\"+8613912345678\",\"type\":\"Incoming\"")
+               .append(",\"raw\":\"+CLIP: \\\"13912345678\\\",161,,,,0\"}");
+    }
+
+    if (calls) {
+        payload.append("]");
+    }
+
+    payload.append("}");
+    return payload;
+}
+
+void handle(Sink *sink, size_t pdus, size_t calls)
+{
+    const std::string payload = make_payload(pdus, calls);
+    std::string response;
+    char name[64];
+
+    snprintf(name, sizeof(name), "handle/%lu+%lu", pdus, calls);
+    Measure(name, payload.length(), [&] {
+        response.clear();
+        if (::handle(payload, &response, sink) != 202) {
+            fprintf(stderr, "bench: payload rejected\n");
+            exit(EXIT_FAILURE);
+        }
+
+        keep(response.data());
+    });
+}
+
+} // anonymous namespace
+
+void Handle()
+{
+    srand(1);
+
+    Sink sink;
+    handle(&sink, 1, 0);
+    handle(&sink, 0, 1);
+    handle(&sink, 10, 2);
+    handle(&sink, 100, 10);
+}
+
+} // namespace bench
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "sms/server/bench/bench.h"
+#include "sms/server/smtp.h"
+
+namespace bench {
+namespace {
+
+// Builds mails the way curl pulls them, never connects.
+class Builder : public ::SMTP {
+public:
+    size_t Build(const std::string &body)
+    {
+        // curl's default upload buffer
+        static char buffer[65536];
+
+        Prepare("bench@example.com", "Bench", body,
+                "text/html; charset=UTF-8", 1720658833);
+
+        size_t total = 0;
+        while (size_t length = read(buffer, 1, sizeof(buffer))) {
+            keep(buffer);
+            total += length;
+        }
+
+        return total;
+    }
+
+}; // class Builder
+
+void mail(size_t length)
+{
+    std::string body(length, '\0');
+    for (size_t i = 0; i < length; ++i) {
+        body[i] = static_cast<char>(' ' + rand() % 95);
+    }
+
+    Builder builder;
+    size_t total;
+    char name[64];
+    snprintf(name, sizeof(name), "SMTP/%lu", length);
+    Measure(name, length, [&] {
+        total = builder.Build(body);
+        keep(&total);
+    });
+}
+
+} // anonymous namespace
+
+void Mail()
+{
+    srand(1);
+
+    // A single SMS, a few dozen of them
+    mail(1024);
+    mail(32768);
+}
+
+} // namespace bench
@@ -0,0 +1,42 @@
+#include <stdlib.h>
+
+#include <new>
+
+#include "sms/server/bench/bench.h"
+
+namespace bench {
+std::atomic<size_t> g_allocations(0);
+} // namespace bench
+
+void *operator new(size_t size)
+{
+    bench::g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+// Usage: bench [corpus], where the corpus is libpdu/corpus.txt.
+int main(int argc, char *argv[])
+{
+    bench::Configure();
+    bench::Codec();
+    bench::Decode(argc > 1 ? argv[1] : nullptr);
+    bench::Split();
+    bench::Handle();
+    bench::Render();
+    bench::Mail();
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "sms/server/bench/bench.h"
+#include "sms/server/processor.h"
+
+namespace bench {
+namespace {
+
+// Renders mails with the built-in templates.
+class Renderer : public ::Processor {
+public:
+    bool Prepare()
+    {
+        return InitializeTemplates();
+    }
+
+    void Run(size_t calls, size_t sms)
+    {
+        static const std::string kBody =
+                "Your verification code is 123456, valid for 5 minutes. "
+                "Don't share it with anyone <including us> & stay safe.";
+
+        Mail mail;
+        mail._to = "bench@example.com";
+        mail._receiver = "Bench";
+
+        const int64_t timestamp = 1720658833000000000LL;
+        for (size_t i = 0; i < calls; ++i) {
+            mail._call.emplace_back();
+            auto &c = mail._call.back()._call;
+            c.reset(new db::Call);
+            c->device = 1;
+            c->timestamp = timestamp;
+            c->peer = "+8613912345678";
+            c->duration = 75000000000LL;
+            c->type = "Incoming";
+        }
+
+        for (size_t i = 0; i < sms; ++i) {
+            mail._sms.emplace_back();
+            auto &s = mail._sms.back()._sms;
+            s.reset(new db::SMS);
+            s->device = 1;
+            s->type = "Incoming";
+            s->sent = timestamp;
+            s->received = timestamp + 3000000000LL;
+            s->peer = "+8613912345678";
+            s->body = kBody;
+        }
+
+        std::string out;
+        char name[64];
+        snprintf(name, sizeof(name), "Processor::Render/%lu+%lu", calls, sms);
+        Measure(name, 0, [&] {
+            Render(mail, &out);
+            keep(out.data());
+        });
+    }
+
+}; // class Renderer
+
+} // anonymous namespace
+
+void Render()
+{
+    Renderer renderer;
+    if (!renderer.Prepare()) {
+        fprintf(stderr, "bench: failed to compile templates\n");
+        exit(EXIT_FAILURE);
+    }
+
+    renderer.Run(0, 1);
+    renderer.Run(1, 0);
+    renderer.Run(2, 10);
+    renderer.Run(10, 100);
+}
+
+} // namespace bench
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "sms/server/bench/bench.h"
+#include "sms/server/splitter.h"
+
+namespace bench {
+namespace {
+
+db::PDU make_pdu(const std::string &pdu, int64_t timestamp)
+{
+    db::PDU r;
+    r.device = 1;
+    r.timestamp = timestamp;
+    r.uploaded = timestamp;
+    r.type = "Incoming";
+    r.pdu = pdu;
+    return r;
+}
+
+// Adds and splits a message of 3 parts with `pending` groups that are
+// still missing parts, as it would be when uploads come in bursts.
+void split(size_t pending)
+{
+    ::Splitter splitter;
+    for (size_t i = 0; i < pending; ++i) {
+        char peer[32];
+        snprintf(peer, sizeof(peer), "+86139%08lu", i);
+        splitter.Add(make_pdu(MakeDeliver(
+                kGsm7, peer, 153, static_cast<uint8_t>(i), 3, 1), 0));
+    }
+
+    std::vector<db::PDU> parts;
+    for (uint8_t i = 1; i <= 3; ++i) {
+        parts.push_back(make_pdu(MakeDeliver(
+                kGsm7, "+8613912345678", 153, 0xFF, 3, i), i));
+    }
+
+    const db::PDU single = make_pdu(
+            MakeDeliver(kGsm7, "+8613912345678", 160), 0);
+
+    size_t bytes = 0;
+    for (auto &&p : parts) {
+        bytes += p.pdu.length();
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "Splitter/single/%lu", pending);
+    Measure(name, single.pdu.length(), [&] {
+        splitter.Add(single);
+        splitter.Split();
+        splitter.Process([](const db::SMS &sms,
+                            const std::list<db::PDU> &,
+                            const std::list<db::PDU> &) {
+            keep(sms.body.data());
+            return true;
+        });
+    });
+
+    snprintf(name, sizeof(name), "Splitter/concatenated/%lu", pending);
+    Measure(name, bytes, [&] {
+        for (auto &&p : parts) {
+            splitter.Add(p);
+        }
+
+        splitter.Split();
+        splitter.Process([](const db::SMS &sms,
+                            const std::list<db::PDU> &,
+                            const std::list<db::PDU> &) {
+            keep(sms.body.data());
+            return true;
+        });
+    });
+}
+
+} // anonymous namespace
+
+void Split()
+{
+    srand(1);
+
+    split(0);
+    split(16);
+    split(250);
+}
+
+} // namespace bench
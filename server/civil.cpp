@@ -0,0 +1,123 @@
+#include "sms/server/civil.h"
+
+#include <time.h>
+
+#include <algorithm>
+
+namespace civil {
+namespace {
+
+long probe(int64_t t)
+{
+    const time_t s = static_cast<time_t>(t);
+    struct tm tm;
+    if (!localtime_r(&s, &tm)) {
+        return 0;
+    }
+
+    return tm.tm_gmtoff;
+}
+
+void put2(char *out, int v)
+{
+    out[0] = static_cast<char>('0' + v / 10);
+    out[1] = static_cast<char>('0' + v % 10);
+}
+
+} // anonymous namespace
+
+const Zone &Zone::Local()
+{
+    static const Zone zone;
+    return zone;
+}
+
+Zone::Zone()
+{
+    // Messages come and go within years, beyond that the nearest offset
+    // is good enough.
+    constexpr int64_t kRange = 20 * 366 * 86400LL;
+    constexpr int64_t kStep = 86400;
+
+    const int64_t now = time(nullptr);
+    int64_t t = now - kRange;
+    long offset = probe(t);
+
+    _since.push_back(INT64_MIN);
+    _offset.push_back(offset);
+
+    for (; t < now + kRange; t += kStep) {
+        const long next = probe(t + kStep);
+        if (next == offset) {
+            continue;
+        }
+
+        // Changed in (t, t + kStep], find out exactly when
+        int64_t lo = t;
+        int64_t hi = t + kStep;
+        while (hi - lo > 1) {
+            const int64_t mid = lo + (hi - lo) / 2;
+            if (probe(mid) == offset) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+
+        _since.push_back(hi);
+        _offset.push_back(next);
+        offset = next;
+    }
+}
+
+long Zone::offset(int64_t t) const
+{
+    const auto p = std::upper_bound(_since.begin(), _since.end(), t);
+    return _offset[static_cast<size_t>(p - _since.begin()) - 1];
+}
+
+Time to_time(int64_t t, long offset)
+{
+    const int64_t s = t + offset;
+    int64_t z = s >= 0 ? s / 86400 : (s - 86399) / 86400;
+    const int64_t sod = s - z * 86400;
+
+    Time r;
+    r.offset = offset;
+    r.hour = static_cast<int>(sod / 3600);
+    r.minute = static_cast<int>(sod / 60 % 60);
+    r.second = static_cast<int>(sod % 60);
+    r.weekday = static_cast<int>(((z + 4) % 7 + 7) % 7);
+
+    // Inverse of days_from_civil()
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const int64_t doe = z - era * 146097;
+    const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int64_t mp = (5 * doy + 2) / 153;
+
+    r.day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    r.month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    r.year = yoe + era * 400 + (r.month <= 2);
+    return r;
+}
+
+void format_date_time(const Time &t, char *out)
+{
+    const int y = static_cast<int>(t.year % 10000);
+    put2(out +  0, y / 100);
+    put2(out +  2, y % 100);
+    out[4] = '-';
+    put2(out +  5, t.month);
+    out[7] = '-';
+    put2(out +  8, t.day);
+    out[10] = ' ';
+    put2(out + 11, t.hour);
+    out[13] = ':';
+    put2(out + 14, t.minute);
+    out[16] = ':';
+    put2(out + 17, t.second);
+}
+
+} // namespace civil
@@ -0,0 +1,78 @@
+#ifndef SMS_SERVER_CIVIL_H
+#define SMS_SERVER_CIVIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Calendar arithmetic that never takes the libc timezone lock.
+namespace civil {
+
+class Time {
+public:
+    int64_t year;
+    int month;   // [1, 12]
+    int day;     // [1, 31]
+    int hour;
+    int minute;
+    int second;
+    int weekday; // [0, 6], Sunday is 0
+    long offset; // Seconds east of UTC
+}; // class Time
+
+// Days since 1970-01-01 of a proleptic Gregorian date.
+constexpr int64_t days_from_civil(int64_t y, int m, int d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const int64_t yoe = y - era * 400;
+    const int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Seconds since epoch of a UTC date and time, like timegm().
+constexpr int64_t from_utc(int64_t y, int m, int d, int hh, int mm, int ss)
+{
+    return days_from_civil(y, m, d) * 86400 + hh * 3600 + mm * 60 + ss;
+}
+
+static_assert(days_from_civil(1970, 1, 1) == 0, "epoch");
+static_assert(days_from_civil(2000, 3, 1) == 11017, "leap year");
+
+// UTC offsets of the local zone, probed once around the time it's first
+// used and looked up by binary search afterwards.
+class Zone {
+public:
+    static const Zone &Local();
+
+    long offset(int64_t t) const;
+
+private:
+    Zone();
+
+    std::vector<int64_t> _since;
+    std::vector<long> _offset;
+
+}; // class Zone
+
+Time to_time(int64_t t, long offset);
+
+inline Time to_utc(int64_t t)
+{
+    return to_time(t, 0);
+}
+
+inline Time to_local(int64_t t)
+{
+    return to_time(t, Zone::Local().offset(t));
+}
+
+// "YYYY-MM-DD HH:MM:SS", date and time can be taken apart at 10 and 11.
+constexpr size_t kDateTime = 19;
+void format_date_time(const Time &t, char *out);
+
+} // namespace civil
+
+#endif // SMS_SERVER_CIVIL_H
@@ -0,0 +1,488 @@
+#include "sms/server/codec.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CODEC_X86 1
+#endif
+
+namespace codec {
+namespace {
+
+const char kHex[] = "0123456789ABCDEF";
+const char kBase64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+class Kernels {
+public:
+    const char *name;
+    bool (*decode_hex)(const char *, size_t, unsigned char *);
+    void (*encode_hex)(const unsigned char *, size_t, char *);
+    void (*encode_base64)(const unsigned char *, size_t, char *);
+    size_t (*find_html)(const char *, size_t, bool);
+}; // class Kernels
+
+int hex_value(unsigned char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
+
+#ifdef CODEC_X86
+#ifdef __SSE2__
+// Nibble values of 16 hex digits, `valid` is all ones where they are digits.
+inline __m128i sse2_nibbles(__m128i v, __m128i *valid)
+{
+    const __m128i digit = _mm_and_si128(
+            _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+            _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+
+    const __m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    const __m128i alpha = _mm_and_si128(
+            _mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+            _mm_cmpgt_epi8(_mm_set1_epi8('f' + 1), l));
+
+    *valid = _mm_or_si128(digit, alpha);
+    return _mm_or_si128(
+            _mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+            _mm_and_si128(alpha, _mm_sub_epi8(l, _mm_set1_epi8('a' - 10))));
+}
+
+// Each 16 bit lane holds two nibbles, high one first in memory.
+inline __m128i sse2_join(__m128i n)
+{
+    return _mm_or_si128(
+            _mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0x00FF)), 4),
+            _mm_srli_epi16(n, 8));
+}
+
+bool sse2_decode_hex(const char *input, size_t length, unsigned char *output)
+{
+    for (; length >= 32; length -= 32, input += 32, output += 16) {
+        __m128i v0;
+        __m128i v1;
+        const __m128i n0 = sse2_nibbles(_mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(input)), &v0);
+        const __m128i n1 = sse2_nibbles(_mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(input + 16)), &v1);
+
+        if (_mm_movemask_epi8(_mm_and_si128(v0, v1)) != 0xFFFF) {
+            return false;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output),
+                         _mm_packus_epi16(sse2_join(n0), sse2_join(n1)));
+    }
+
+    return scalar::DecodeHex(input, length, output);
+}
+
+inline __m128i sse2_hex_digits(__m128i n)
+{
+    const __m128i alpha = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')),
+                        _mm_and_si128(alpha, _mm_set1_epi8('A' - '9' - 1)));
+}
+
+void sse2_encode_hex(const unsigned char *input, size_t length, char *output)
+{
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    for (; length >= 16; length -= 16, input += 16, output += 32) {
+        const __m128i v = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(input));
+
+        const __m128i hi = sse2_hex_digits(
+                _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+        const __m128i lo = sse2_hex_digits(_mm_and_si128(v, mask));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output),
+                         _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + 16),
+                         _mm_unpackhi_epi8(hi, lo));
+    }
+
+    scalar::EncodeHex(input, length, output);
+}
+
+size_t sse2_find_html(const char *input, size_t length, bool apos)
+{
+    const __m128i quote = apos ? _mm_set1_epi8('\'') : _mm_set1_epi8('"');
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i v = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(input + i));
+
+        const __m128i m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('&')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('<'))),
+                _mm_or_si128(_mm_or_si128(
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('>')),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))),
+                        _mm_cmpeq_epi8(v, quote)));
+
+        const int bits = _mm_movemask_epi8(m);
+        if (bits) {
+            return i + static_cast<size_t>(__builtin_ctz(bits));
+        }
+    }
+
+    return i + scalar::FindHtml(input + i, length - i, apos);
+}
+#endif // __SSE2__
+
+#define CODEC_AVX2 __attribute__((target("avx2")))
+
+CODEC_AVX2 inline __m256i avx2_nibbles(__m256i v, __m256i *valid)
+{
+    const __m256i digit = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+
+    const __m256i l = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    const __m256i alpha = _mm256_and_si256(
+            _mm256_cmpgt_epi8(l, _mm256_set1_epi8('a' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), l));
+
+    *valid = _mm256_or_si256(digit, alpha);
+    return _mm256_or_si256(
+            _mm256_and_si256(digit, _mm256_sub_epi8(v, _mm256_set1_epi8('0'))),
+            _mm256_and_si256(alpha, _mm256_sub_epi8(
+                    l, _mm256_set1_epi8('a' - 10))));
+}
+
+CODEC_AVX2 inline __m256i avx2_join(__m256i n)
+{
+    return _mm256_or_si256(
+            _mm256_slli_epi16(_mm256_and_si256(
+                    n, _mm256_set1_epi16(0x00FF)), 4),
+            _mm256_srli_epi16(n, 8));
+}
+
+CODEC_AVX2 bool avx2_decode_hex(
+        const char *input, size_t length, unsigned char *output)
+{
+    for (; length >= 64; length -= 64, input += 64, output += 32) {
+        __m256i v0;
+        __m256i v1;
+        const __m256i n0 = avx2_nibbles(_mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(input)), &v0);
+        const __m256i n1 = avx2_nibbles(_mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(input + 32)), &v1);
+
+        if (~_mm256_movemask_epi8(_mm256_and_si256(v0, v1))) {
+            return false;
+        }
+
+        // Packing works within 128 bit lanes, put quarters back in order.
+        const __m256i packed = _mm256_packus_epi16(avx2_join(n0),
+                                                   avx2_join(n1));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output),
+                            _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+
+    return scalar::DecodeHex(input, length, output);
+}
+
+CODEC_AVX2 inline __m256i avx2_hex_digits(__m256i n)
+{
+    const __m256i alpha = _mm256_cmpgt_epi8(n, _mm256_set1_epi8(9));
+    return _mm256_add_epi8(
+            _mm256_add_epi8(n, _mm256_set1_epi8('0')),
+            _mm256_and_si256(alpha, _mm256_set1_epi8('A' - '9' - 1)));
+}
+
+CODEC_AVX2 void avx2_encode_hex(
+        const unsigned char *input, size_t length, char *output)
+{
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    for (; length >= 32; length -= 32, input += 32, output += 64) {
+        const __m256i v = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(input));
+
+        const __m256i hi = avx2_hex_digits(
+                _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+        const __m256i lo = avx2_hex_digits(_mm256_and_si256(v, mask));
+
+        // Unpacking works within 128 bit lanes as well.
+        const __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        const __m256i b = _mm256_unpackhi_epi8(hi, lo);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output),
+                            _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + 32),
+                            _mm256_permute2x128_si256(a, b, 0x31));
+    }
+
+    scalar::EncodeHex(input, length, output);
+}
+
+// Wojciech Muła's and Daniel Lemire's method: spread 12 bytes of each lane
+// into 16 sextets by shuffles and multiplications, then map sextets to
+// the alphabet by adding offsets looked up per range.
+CODEC_AVX2 void avx2_encode_base64(
+        const unsigned char *input, size_t length, char *output)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+
+    const __m256i offsets = _mm256_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A', 0, 0,
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A', 0, 0);
+
+    // Two 16 byte loads for 24 bytes, keep 4 bytes of slack for the last.
+    for (; length >= 28; length -= 24, input += 24, output += 32) {
+        const __m256i v = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(
+                        reinterpret_cast<const __m128i *>(input))),
+                _mm_loadu_si128(
+                        reinterpret_cast<const __m128i *>(input + 12)), 1);
+
+        const __m256i in = _mm256_shuffle_epi8(v, shuffle);
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i sextets = _mm256_or_si256(t1, t3);
+
+        // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+        __m256i index = _mm256_subs_epu8(sextets, _mm256_set1_epi8(51));
+        const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), sextets);
+        index = _mm256_or_si256(
+                _mm256_andnot_si256(upper, index),
+                _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output),
+                            _mm256_add_epi8(sextets, _mm256_shuffle_epi8(
+                                    offsets, index)));
+    }
+
+    scalar::EncodeBase64(input, length, output);
+}
+
+CODEC_AVX2 size_t avx2_find_html(const char *input, size_t length, bool apos)
+{
+    const __m256i quote = apos ? _mm256_set1_epi8('\'')
+                               : _mm256_set1_epi8('"');
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i v = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(input + i));
+
+        const __m256i m = _mm256_or_si256(
+                _mm256_or_si256(
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<'))),
+                _mm256_or_si256(_mm256_or_si256(
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))),
+                        _mm256_cmpeq_epi8(v, quote)));
+
+        const unsigned bits = static_cast<unsigned>(_mm256_movemask_epi8(m));
+        if (bits) {
+            return i + static_cast<size_t>(__builtin_ctz(bits));
+        }
+    }
+
+    return i + scalar::FindHtml(input + i, length - i, apos);
+}
+#endif // CODEC_X86
+
+Kernels select()
+{
+    Kernels k;
+    k.name = "scalar";
+    k.decode_hex = scalar::DecodeHex;
+    k.encode_hex = scalar::EncodeHex;
+    k.encode_base64 = scalar::EncodeBase64;
+    k.find_html = scalar::FindHtml;
+
+#ifdef CODEC_X86
+#ifdef __SSE2__
+    // Base64 needs byte shuffles, which SSE2 doesn't have.
+    k.name = "sse2";
+    k.decode_hex = sse2_decode_hex;
+    k.encode_hex = sse2_encode_hex;
+    k.find_html = sse2_find_html;
+#endif
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        k.name = "avx2";
+        k.decode_hex = avx2_decode_hex;
+        k.encode_hex = avx2_encode_hex;
+        k.encode_base64 = avx2_encode_base64;
+        k.find_html = avx2_find_html;
+    }
+#endif
+
+    return k;
+}
+
+const Kernels &kernels()
+{
+    static const Kernels k = select();
+    return k;
+}
+
+} // anonymous namespace
+
+namespace scalar {
+
+bool DecodeHex(const char *input, size_t length, unsigned char *output)
+{
+    if (length % 2) {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i += 2) {
+        const int hi = hex_value(static_cast<unsigned char>(input[i]));
+        const int lo = hex_value(static_cast<unsigned char>(input[i + 1]));
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+
+        *output++ = static_cast<unsigned char>((hi << 4) | lo);
+    }
+
+    return true;
+}
+
+void EncodeHex(const unsigned char *input, size_t length, char *output)
+{
+    for (size_t i = 0; i < length; ++i) {
+        *output++ = kHex[input[i] >> 4];
+        *output++ = kHex[input[i] & 0x0F];
+    }
+}
+
+void EncodeBase64(const unsigned char *input, size_t length, char *output)
+{
+    size_t i = 0;
+    for (; i + 3 <= length; i += 3) {
+        const uint32_t v = (input[i] << 16) | (input[i + 1] << 8)
+                         | input[i + 2];
+
+        *output++ = kBase64[(v >> 18) & 0x3F];
+        *output++ = kBase64[(v >> 12) & 0x3F];
+        *output++ = kBase64[(v >>  6) & 0x3F];
+        *output++ = kBase64[ v        & 0x3F];
+    }
+
+    if (i < length) {
+        uint32_t v = input[i] << 16;
+        if (i + 1 < length) {
+            v |= input[i + 1] << 8;
+        }
+
+        *output++ = kBase64[(v >> 18) & 0x3F];
+        *output++ = kBase64[(v >> 12) & 0x3F];
+        *output++ = i + 1 < length ? kBase64[(v >> 6) & 0x3F] : '=';
+        *output++ = '=';
+    }
+}
+
+size_t FindHtml(const char *input, size_t length, bool apos)
+{
+    for (size_t i = 0; i < length; ++i) {
+        switch (input[i]) {
+        case '&':
+        case '<':
+        case '>':
+        case '"':
+            return i;
+        case '\'':
+            if (apos) {
+                return i;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return length;
+}
+
+} // namespace scalar
+
+const char *kernel()
+{
+    return kernels().name;
+}
+
+bool DecodeHex(const char *input, size_t length, unsigned char *output)
+{
+    return length % 2 == 0 && kernels().decode_hex(input, length, output);
+}
+
+bool DecodeHex(const std::string &input, std::string *output)
+{
+    output->resize(input.length() / 2);
+    return DecodeHex(input.data(), input.length(),
+                     reinterpret_cast<unsigned char *>(&(*output)[0]));
+}
+
+void EncodeHex(const unsigned char *input, size_t length, char *output)
+{
+    kernels().encode_hex(input, length, output);
+}
+
+std::string EncodeHex(const std::string &input)
+{
+    std::string result(input.length() * 2, '\0');
+    EncodeHex(reinterpret_cast<const unsigned char *>(input.data()),
+              input.length(), &result[0]);
+
+    return result;
+}
+
+void EncodeBase64(const unsigned char *input, size_t length, char *output)
+{
+    kernels().encode_base64(input, length, output);
+}
+
+void AppendHtml(std::string *output,
+                const char *input,
+                size_t length,
+                bool apos)
+{
+    const Kernels &k = kernels();
+    output->reserve(output->length() + length);
+
+    while (true) {
+        const size_t n = k.find_html(input, length, apos);
+        output->append(input, n);
+        if (n == length) {
+            break;
+        }
+
+        switch (input[n]) {
+        case '&':  output->append("&amp;",  5); break;
+        case '<':  output->append("&lt;",   4); break;
+        case '>':  output->append("&gt;",   4); break;
+        case '"':  output->append("&quot;", 6); break;
+        default:   output->append("&#39;",  5); break;
+        }
+
+        input += n + 1;
+        length -= n + 1;
+    }
+}
+
+} // namespace codec
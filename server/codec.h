@@ -0,0 +1,53 @@
+#ifndef SMS_SERVER_CODEC_H
+#define SMS_SERVER_CODEC_H
+
+#include <stddef.h>
+
+#include <string>
+
+// Hex, base64 and HTML escaping. x86 builds pick SSE2 or AVX2 kernels once
+// at startup by CPUID, everything else runs the scalar ones.
+namespace codec {
+
+// "avx2", "sse2" or "scalar".
+const char *kernel();
+
+// `output` gets `length / 2` bytes, false on odd length or non hex digits.
+bool DecodeHex(const char *input, size_t length, unsigned char *output);
+bool DecodeHex(const std::string &input, std::string *output);
+
+// Upper case, `output` gets `length * 2` characters.
+void EncodeHex(const unsigned char *input, size_t length, char *output);
+std::string EncodeHex(const std::string &input);
+
+// Standard alphabet with padding, `output` gets `base64_length(length)`
+// characters.
+constexpr size_t base64_length(size_t length)
+{
+    return (length + 2) / 3 * 4;
+}
+
+void EncodeBase64(const unsigned char *input, size_t length, char *output);
+
+// Escapes & < > " and, if `apos` is set, '.
+void AppendHtml(std::string *output,
+                const char *input,
+                size_t length,
+                bool apos = true);
+
+inline void AppendHtml(std::string *output, const std::string &input)
+{
+    AppendHtml(output, input.data(), input.length());
+}
+
+// Same as above, but always scalar, for comparison.
+namespace scalar {
+bool DecodeHex(const char *input, size_t length, unsigned char *output);
+void EncodeHex(const unsigned char *input, size_t length, char *output);
+void EncodeBase64(const unsigned char *input, size_t length, char *output);
+size_t FindHtml(const char *input, size_t length, bool apos);
+} // namespace scalar
+
+} // namespace codec
+
+#endif // SMS_SERVER_CODEC_H
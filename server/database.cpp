@@ -6,9 +6,9 @@
 #include <mysql/mysql.h>
 
 #include <flinter/types/tree.h>
-#include <flinter/encode.h>
 #include <flinter/logger.h>
 
+#include "sms/server/codec.h"
 #include "sms/server/configure.h"
 
 class Database::Context {
@@ -207,6 +207,48 @@ void Database::Disconnect()
     _c->_conn = nullptr;
 }
 
+bool Database::Begin()
+{
+    if (Disabled()) {
+        return true;
+    }
+
+    if (!Connect()) {
+        return false;
+    }
+
+    if (mysql_query(_c->_conn, "START TRANSACTION")) {
+        CLOG.Warn("mysql_query() = %d: %s",
+                mysql_errno(_c->_conn), mysql_error(_c->_conn));
+        return false;
+    }
+
+    return true;
+}
+
+bool Database::Commit()
+{
+    if (Disabled()) {
+        return true;
+    }
+
+    if (mysql_commit(_c->_conn)) {
+        CLOG.Warn("mysql_commit() = %d: %s",
+                mysql_errno(_c->_conn), mysql_error(_c->_conn));
+        mysql_rollback(_c->_conn);
+        return false;
+    }
+
+    return true;
+}
+
+void Database::Rollback()
+{
+    if (_c->_conn) {
+        mysql_rollback(_c->_conn);
+    }
+}
+
 bool Database::PrepareCall()
 {
     if (_c->_pscall) {
@@ -295,7 +337,7 @@ int Database::InsertPDU(const db::PDU &pdu)
     if (Disabled()) {
         printf("=== SQL ===\nPDU %d %ld %ld %s %s\n=== SQL ===\n",
                pdu.device, pdu.timestamp, pdu.uploaded, pdu.type.c_str(),
-               flinter::EncodeHex(pdu.pdu).c_str());
+               codec::EncodeHex(pdu.pdu).c_str());
         return 0;
     }
 
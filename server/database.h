@@ -21,6 +21,11 @@ public:
 
     void Disconnect();
 
+    // Group the following inserts into one transaction.
+    bool Begin();
+    bool Commit();
+    void Rollback();
+
     int InsertCall(const db::Call &call);
 
     int InsertPDU(const db::PDU &pdu);
@@ -2,12 +2,14 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 #include <flinter/types/tree.h>
 
 #include <flinter/convert.h>
-#include <flinter/encode.h>
 #include <flinter/utility.h>
 
+#include "sms/server/codec.h"
 #include "sms/server/configure.h"
 #include "sms/server/processor.h"
 
@@ -24,6 +26,9 @@ protected:
     bool ProcessSmsOld(const flinter::Tree &t);
 
     int FindDevice(const std::string &token) const;
+    bool FindDevices(const flinter::Tree &records,
+                     int device,
+                     std::vector<int> *devices) const;
 
 private:
     int _device;
@@ -53,6 +58,25 @@ int Handler::FindDevice(const std::string &token) const
     return -1;
 }
 
+// Records uploaded for several devices at once carry their own tokens, the
+// others are of `device`. False if any token is unknown.
+bool Handler::FindDevices(const flinter::Tree &records,
+                          int device,
+                          std::vector<int> *devices) const
+{
+    for (flinter::Tree::const_iterator p = records.begin(); p != records.end(); ++p) {
+        const flinter::Tree &t = *p;
+        const int d = t.Has("token") ? FindDevice(t["token"]) : device;
+        if (d < 0) {
+            return false;
+        }
+
+        devices->push_back(d);
+    }
+
+    return true;
+}
+
 int Handler::Run(const std::string &payload, std::string *response)
 {
     _uploaded = get_wall_clock_timestamp();
@@ -63,22 +87,34 @@ int Handler::Run(const std::string &payload, std::string *response)
     }
 
     const std::string &token = r["token"];
-    _device = FindDevice(token);
-    if (_device < 0) {
+    const int device = FindDevice(token);
+    if (device < 0) {
         return 403;
     }
 
-    bool good = true;
+    // Before processing anything, so that nothing is processed twice
+    std::vector<int> calls;
+    std::vector<int> pdus;
     const flinter::Tree &call = r["call"];
+    const flinter::Tree &pdu = r["pdu"];
+    if (!FindDevices(call, device, &calls) || !FindDevices(pdu, device, &pdus)) {
+        return 403;
+    }
+
+    bool good = true;
+    size_t i = 0;
     for (flinter::Tree::const_iterator p = call.begin(); p != call.end(); ++p) {
+        _device = calls[i++];
         good &= ProcessCall(*p);
     }
 
-    const flinter::Tree &pdu = r["pdu"];
+    i = 0;
     for (flinter::Tree::const_iterator p = pdu.begin(); p != pdu.end(); ++p) {
+        _device = pdus[i++];
         good &= ProcessPdu(*p);
     }
 
+    _device = device;
     const flinter::Tree &sms = r["sms"];
     for (flinter::Tree::const_iterator p = sms.begin(); p != sms.end(); ++p) {
         good &= ProcessSmsOld(*p);
@@ -230,7 +266,7 @@ bool Handler::ProcessPdu(const flinter::Tree &t)
     }
 
     std::string hex;
-    if (flinter::DecodeHex(pdu, &hex)) {
+    if (!codec::DecodeHex(pdu, &hex)) {
         return false;
     }
 
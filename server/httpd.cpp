@@ -5,8 +5,8 @@
 #include <microhttpd.h>
 
 #include <flinter/types/tree.h>
-#include <flinter/encode.h>
 
+#include "sms/server/codec.h"
 #include "sms/server/configure.h"
 #include "sms/server/handler.h"
 
@@ -66,39 +66,7 @@ static std::string httpd_html_escape(
         bool escape_apos)
 {
     std::string r;
-    const char *p;
-    size_t needed;
-    char *o;
-
-    for (needed = 0, p = s; *p; ++p) {
-        switch (*p) {
-        case '\'' : needed += escape_apos ? 5 : 1; break;
-        case '"'  : needed += 6; break;
-        case '&'  : needed += 5; break;
-        case '<'  : needed += 4; break;
-        case '>'  : needed += 4; break;
-        default   : needed += 1; break;
-        }
-    }
-
-    r.resize(needed);
-    for (o = &r[0]; *s; ++s) {
-        switch (*s) {
-        case '"' : memcpy(o, "&quot;", 6); o += 6; break;
-        case '&' : memcpy(o, "&amp;",  5); o += 5; break;
-        case '<' : memcpy(o, "&lt;",   4); o += 4; break;
-        case '>' : memcpy(o, "&gt;",   4); o += 4; break;
-        case '\'':
-            if (escape_apos) {
-                memcpy(o, "&#39;", 5);
-                o += 5;
-                break;
-            }
-            [[fallthrough]]
-        default  : *o++ = *s; break;
-        };
-    }
-
+    codec::AppendHtml(&r, s, strlen(s), escape_apos);
     return r;
 }
 
@@ -0,0 +1,522 @@
+#include "sms/server/journal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <flinter/logger.h>
+
+class JournalHeader {
+public:
+    uint32_t _length;
+    uint32_t _crc;
+}; // class JournalHeader
+
+class JournalCrcTable {
+public:
+    constexpr JournalCrcTable() : _t()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+            }
+
+            _t[i] = c;
+        }
+    }
+
+    uint32_t _t[256];
+}; // class JournalCrcTable
+
+static constexpr JournalCrcTable kJournalCrcTable;
+
+static uint32_t journal_crc32(const void *buffer, size_t length)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(buffer);
+    uint32_t c = 0xFFFFFFFFU;
+    for (size_t i = 0; i < length; ++i) {
+        c = kJournalCrcTable._t[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    }
+
+    return c ^ 0xFFFFFFFFU;
+}
+
+static bool journal_pread(int fd, void *buffer, size_t length, uint64_t offset)
+{
+    char *p = reinterpret_cast<char *>(buffer);
+    while (length) {
+        const ssize_t ret = pread(fd, p, length, static_cast<off_t>(offset));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+
+        } else if (ret == 0) {
+            return false;
+        }
+
+        length -= static_cast<size_t>(ret);
+        offset += static_cast<uint64_t>(ret);
+        p += ret;
+    }
+
+    return true;
+}
+
+// Read one record at `offset`, returns false if it's torn or corrupted.
+static bool journal_read_record(
+        int fd,
+        uint64_t offset,
+        size_t maximum,
+        std::string *record)
+{
+    JournalHeader h;
+    if (!journal_pread(fd, &h, sizeof(h), offset)) {
+        return false;
+    }
+
+    if (h._length > maximum) {
+        return false;
+    }
+
+    record->resize(h._length);
+    if (h._length && !journal_pread(fd, &(*record)[0], h._length, offset + sizeof(h))) {
+        return false;
+    }
+
+    return journal_crc32(record->data(), record->length()) == h._crc;
+}
+
+static bool journal_sync_directory(const std::string &path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    const int ret = fsync(fd);
+    close(fd);
+    return ret == 0;
+}
+
+Journal::Journal() : _segmentSize(0)
+                   , _checkpoint(0)
+                   , _written(0)
+                   , _synced(0)
+                   , _base(0)
+                   , _syncing(false)
+                   , _fd(-1)
+{
+    // Intended left blank
+}
+
+Journal::~Journal()
+{
+    Close();
+}
+
+std::string Journal::GetSegmentPath(uint64_t base) const
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "/%016" PRIx64 ".log", base);
+    return _path + buffer;
+}
+
+bool Journal::Open(const std::string &path, size_t segment_size)
+{
+    _path = path;
+    _segmentSize = segment_size;
+
+    if (mkdir(path.c_str(), 0755) && errno != EEXIST) {
+        CLOG.Error("Journal: failed to create [%s]: %d: %s",
+                path.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    _checkpoint = 0;
+    FILE *const fp = fopen((path + "/checkpoint").c_str(), "r");
+    if (fp) {
+        if (fscanf(fp, "%" SCNu64, &_checkpoint) != 1) {
+            CLOG.Error("Journal: bad checkpoint in [%s]", path.c_str());
+            fclose(fp);
+            return false;
+        }
+
+        fclose(fp);
+    }
+
+    DIR *const dir = opendir(path.c_str());
+    if (!dir) {
+        return false;
+    }
+
+    _segments.clear();
+    while (struct dirent *e = readdir(dir)) {
+        const size_t length = strlen(e->d_name);
+        if (length != 20 || strcmp(e->d_name + 16, ".log")) {
+            continue;
+        }
+
+        char *end;
+        const uint64_t base = strtoull(e->d_name, &end, 16);
+        if (end != e->d_name + 16) {
+            continue;
+        }
+
+        _segments.insert(base);
+    }
+
+    closedir(dir);
+
+    uint64_t base = _checkpoint;
+    uint64_t written = _checkpoint;
+    if (!_segments.empty()) {
+        base = *_segments.rbegin();
+        if (!Recover(base, &written)) {
+            return false;
+        }
+    }
+
+    const std::string &segment = GetSegmentPath(base);
+    _fd = open(segment.c_str(),
+            O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (_fd < 0) {
+        CLOG.Error("Journal: failed to open [%s]: %d: %s",
+                segment.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    if (_segments.insert(base).second && !journal_sync_directory(_path)) {
+        Close();
+        return false;
+    }
+
+    _base = base;
+    _written = written;
+    _synced = written;
+
+    CLOG.Info("Journal: opened [%s] with %lu segments, "
+            "checkpoint %" PRIu64 ", written %" PRIu64,
+            path.c_str(), _segments.size(), _checkpoint, _written);
+
+    return true;
+}
+
+bool Journal::Recover(uint64_t base, uint64_t *end)
+{
+    const std::string &segment = GetSegmentPath(base);
+    const int fd = open(segment.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return false;
+    }
+
+    std::string record;
+    uint64_t offset = 0;
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    while (offset < size) {
+        if (!journal_read_record(fd, offset, kMaximumRecord, &record)) {
+            break;
+        }
+
+        offset += sizeof(JournalHeader) + record.length();
+    }
+
+    if (offset < size) {
+        CLOG.Warn("Journal: truncating torn tail of [%s] "
+                "from %" PRIu64 " to %" PRIu64 " bytes",
+                segment.c_str(), size, offset);
+
+        if (ftruncate(fd, static_cast<off_t>(offset)) || fdatasync(fd)) {
+            close(fd);
+            return false;
+        }
+    }
+
+    close(fd);
+    *end = base + offset;
+    return true;
+}
+
+void Journal::Close()
+{
+    std::unique_lock<std::mutex> locker(_mutex);
+    while (_syncing) {
+        _cond.wait(locker);
+    }
+
+    if (_fd < 0) {
+        return;
+    }
+
+    fdatasync(_fd);
+    close(_fd);
+    _fd = -1;
+}
+
+bool Journal::Rotate()
+{
+    if (fdatasync(_fd)) {
+        return false;
+    }
+
+    _synced = _written;
+
+    const std::string &segment = GetSegmentPath(_written);
+    const int fd = open(segment.c_str(),
+            O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        CLOG.Error("Journal: failed to open [%s]: %d: %s",
+                segment.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    if (!journal_sync_directory(_path)) {
+        close(fd);
+        unlink(segment.c_str());
+        return false;
+    }
+
+    close(_fd);
+    _fd = fd;
+    _base = _written;
+    _segments.insert(_base);
+    CLOG.Trace("Journal: rotated to [%s]", segment.c_str());
+    return true;
+}
+
+bool Journal::Append(const std::string &record, uint64_t *position)
+{
+    if (record.length() > kMaximumRecord) {
+        return false;
+    }
+
+    JournalHeader h;
+    h._length = static_cast<uint32_t>(record.length());
+    h._crc = journal_crc32(record.data(), record.length());
+
+    struct iovec iov[2];
+    iov[0].iov_base = &h;
+    iov[0].iov_len = sizeof(h);
+    iov[1].iov_base = const_cast<char *>(record.data());
+    iov[1].iov_len = record.length();
+    const size_t total = sizeof(h) + record.length();
+
+    std::unique_lock<std::mutex> locker(_mutex);
+    if (_fd < 0) {
+        return false;
+    }
+
+    // Segments are switched while nobody is syncing the current one
+    while (_syncing && _written - _base >= _segmentSize) {
+        _cond.wait(locker);
+    }
+
+    if (_written - _base >= _segmentSize && !Rotate()) {
+        return false;
+    }
+
+    const ssize_t ret = writev(_fd, iov, 2);
+    if (ret < 0 || static_cast<size_t>(ret) != total) {
+        CLOG.Warn("Journal: writev() = %ld: %d: %s", ret, errno, strerror(errno));
+        if (ret > 0 && ftruncate(_fd, static_cast<off_t>(_written - _base))) {
+            CLOG.Error("Journal: failed to roll back partial record");
+        }
+
+        return false;
+    }
+
+    if (position) {
+        *position = _written;
+    }
+
+    _written += total;
+    const uint64_t end = _written;
+
+    // Group commit: whoever finds nobody syncing syncs for everybody
+    // written so far, the others just wait for it.
+    while (_synced < end) {
+        if (_syncing) {
+            _cond.wait(locker);
+            continue;
+        }
+
+        _syncing = true;
+        const uint64_t target = _written;
+        const int fd = _fd;
+        locker.unlock();
+
+        const int r = fdatasync(fd);
+
+        locker.lock();
+        _syncing = false;
+        _cond.notify_all();
+
+        if (r) {
+            CLOG.Error("Journal: fdatasync() = %d: %s", errno, strerror(errno));
+            return false;
+        }
+
+        _synced = std::max(_synced, target);
+    }
+
+    return true;
+}
+
+uint64_t Journal::synced() const
+{
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _synced;
+}
+
+bool Journal::Read(
+        uint64_t from,
+        size_t max,
+        std::list<std::string> *records,
+        uint64_t *next,
+        std::list<uint64_t> *positions) const
+{
+    std::unique_lock<std::mutex> locker(_mutex);
+    const std::set<uint64_t> segments = _segments;
+    const uint64_t limit = _synced;
+    locker.unlock();
+
+    records->clear();
+    if (positions) {
+        positions->clear();
+    }
+
+    *next = from;
+    if (segments.empty()) {
+        return true;
+    }
+
+    if (from < *segments.begin()) {
+        CLOG.Warn("Journal: records [%" PRIu64 ", %" PRIu64 ") are missing",
+                from, *segments.begin());
+        from = *segments.begin();
+    }
+
+    std::string record;
+    while (records->size() < max && from < limit) {
+        auto p = segments.upper_bound(from);
+        const auto q = p--;
+        const uint64_t base = *p;
+        const uint64_t end = q == segments.end() ? limit : std::min(limit, *q);
+
+        const std::string &segment = GetSegmentPath(base);
+        const int fd = open(segment.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            CLOG.Warn("Journal: failed to open [%s]: %d: %s",
+                    segment.c_str(), errno, strerror(errno));
+            return false;
+        }
+
+        while (records->size() < max && from < end) {
+            if (!journal_read_record(fd, from - base, kMaximumRecord, &record)) {
+                CLOG.Error("Journal: corrupted record at %" PRIu64
+                        ", skipping to %" PRIu64, from, end);
+                from = end;
+                break;
+            }
+
+            if (positions) {
+                positions->push_back(from);
+            }
+
+            from += sizeof(JournalHeader) + record.length();
+            records->push_back(std::move(record));
+        }
+
+        close(fd);
+    }
+
+    *next = from;
+    return true;
+}
+
+bool Journal::SaveCheckpoint(uint64_t position)
+{
+    const std::string &filename = _path + "/checkpoint";
+    const std::string &temporary = filename + ".tmp";
+
+    const int fd = open(temporary.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    char buffer[32];
+    const int length = snprintf(buffer, sizeof(buffer), "%" PRIu64 "\n", position);
+    if (write(fd, buffer, static_cast<size_t>(length)) != length || fdatasync(fd)) {
+        close(fd);
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    close(fd);
+    if (rename(temporary.c_str(), filename.c_str())) {
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool Journal::Release(uint64_t position)
+{
+    if (position <= _checkpoint) {
+        return true;
+    }
+
+    if (!SaveCheckpoint(position)) {
+        CLOG.Warn("Journal: failed to save checkpoint %" PRIu64, position);
+        return false;
+    }
+
+    _checkpoint = position;
+
+    // Drop segments whose successor starts no later than the checkpoint
+    std::list<uint64_t> drop;
+    std::unique_lock<std::mutex> locker(_mutex);
+    for (auto p = _segments.begin(); p != _segments.end();) {
+        const auto q = std::next(p);
+        if (q == _segments.end() || *q > position) {
+            break;
+        }
+
+        drop.push_back(*p);
+        p = _segments.erase(p);
+    }
+    locker.unlock();
+
+    for (auto base : drop) {
+        const std::string &segment = GetSegmentPath(base);
+        if (unlink(segment.c_str())) {
+            CLOG.Warn("Journal: failed to remove [%s]: %d: %s",
+                    segment.c_str(), errno, strerror(errno));
+        } else {
+            CLOG.Trace("Journal: removed [%s]", segment.c_str());
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef SMS_SERVER_JOURNAL_H
+#define SMS_SERVER_JOURNAL_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <set>
+#include <string>
+
+// Append-only write-ahead journal split into segment files.
+//
+// Records are addressed by their global byte position, each segment file is
+// named after the position of its first record, so a segment covers all the
+// bytes up to the first position of the next one. Every record is framed by
+// its length and CRC32, a torn tail is truncated when opening.
+class Journal {
+public:
+    Journal();
+    ~Journal();
+
+    bool Open(const std::string &path, size_t segment_size);
+    void Close();
+
+    // Returns after the record is durable, concurrent appends share fsync.
+    // `position` is where the record starts if not null.
+    bool Append(const std::string &record, uint64_t *position = nullptr);
+
+    // Read at most `max` durable records from `from`, `next` is where the
+    // next read should start. `positions` receives where each record starts
+    // if not null.
+    bool Read(uint64_t from,
+              size_t max,
+              std::list<std::string> *records,
+              uint64_t *next,
+              std::list<uint64_t> *positions = nullptr) const;
+
+    // Everything before `position` is consumed and can be dropped.
+    bool Release(uint64_t position);
+
+    uint64_t checkpoint() const
+    {
+        return _checkpoint;
+    }
+
+    uint64_t synced() const;
+
+protected:
+    bool Recover(uint64_t base, uint64_t *end);
+    bool Rotate();
+    bool SaveCheckpoint(uint64_t position);
+    std::string GetSegmentPath(uint64_t base) const;
+
+private:
+    static constexpr size_t kMaximumRecord = 4194304;
+
+    std::string _path;
+    size_t _segmentSize;
+    uint64_t _checkpoint;
+
+    // Base positions of segments on disk, the last one is being written
+    std::set<uint64_t> _segments;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cond;
+    uint64_t _written;
+    uint64_t _synced;
+    uint64_t _base;
+    bool _syncing;
+    int _fd;
+
+}; // class Journal
+
+#endif // SMS_SERVER_JOURNAL_H
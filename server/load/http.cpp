@@ -0,0 +1,200 @@
+#include "sms/server/load/http.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+namespace {
+
+constexpr int kTimeout = 10; // Seconds
+
+// Value of header `name` within `header`, or nullptr.
+const char *find_header(const std::string &header, const char *name)
+{
+    const size_t length = strlen(name);
+    for (size_t p = header.find("\r\n"); p != std::string::npos;
+         p = header.find("\r\n", p + 2)) {
+
+        const char *line = header.c_str() + p + 2;
+        if (strncasecmp(line, name, length) == 0 && line[length] == ':') {
+            line += length + 1;
+            while (*line == ' ') {
+                ++line;
+            }
+
+            return line;
+        }
+    }
+
+    return nullptr;
+}
+
+} // anonymous namespace
+
+Connection::Connection(
+        const struct sockaddr_in &address,
+        const std::string &host,
+        const std::string &path,
+        bool keepalive)
+        : _address(address)
+        , _host(host)
+        , _path(path)
+        , _keepalive(keepalive)
+        , _fd(-1)
+{
+    // Intended left blank
+}
+
+Connection::~Connection()
+{
+    Close();
+}
+
+bool Connection::Connect()
+{
+    if (_fd >= 0) {
+        return true;
+    }
+
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    const struct timeval timeout = { kTimeout, 0 };
+    const int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) ||
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one))        ||
+        connect(fd, reinterpret_cast<const struct sockaddr *>(&_address),
+                sizeof(_address))                                          ){
+
+        close(fd);
+        return false;
+    }
+
+    _fd = fd;
+    return true;
+}
+
+void Connection::Close()
+{
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+bool Connection::Write(const std::string &request)
+{
+    for (size_t sent = 0; sent < request.length();) {
+        const ssize_t ret = send(_fd, request.data() + sent,
+                                 request.length() - sent, MSG_NOSIGNAL);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        sent += static_cast<size_t>(ret);
+    }
+
+    return true;
+}
+
+int Connection::Read()
+{
+    char buffer[4096];
+    size_t end = std::string::npos;
+
+    _response.clear();
+    for (;;) {
+        if (end == std::string::npos) {
+            end = _response.find("\r\n\r\n");
+        }
+
+        if (end != std::string::npos) {
+            const std::string header = _response.substr(0, end + 2);
+            const char *length = find_header(header, "Content-Length");
+            if (!length) {
+                return -1;
+            }
+
+            if (_response.length() >= end + 4 + strtoul(length, nullptr, 10)) {
+                int major, minor, status;
+                if (sscanf(header.c_str(), "HTTP/%d.%d %d",
+                           &major, &minor, &status) != 3) {
+                    return -1;
+                }
+
+                const char *connection = find_header(header, "Connection");
+                if (!_keepalive ||
+                    (connection && strncasecmp(connection, "close", 5) == 0)) {
+                    Close();
+                }
+
+                return status;
+            }
+        }
+
+        const ssize_t ret = recv(_fd, buffer, sizeof(buffer), 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            return -1;
+        }
+
+        _response.append(buffer, static_cast<size_t>(ret));
+    }
+}
+
+int Connection::Post(const std::string &payload)
+{
+    // A kept alive connection might have been closed by the server in the
+    // meantime, give it another chance over a fresh one.
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        const bool reused = _fd >= 0;
+        if (!Connect()) {
+            return -1;
+        }
+
+        _request.clear();
+        _request.append("POST ").append(_path).append(" HTTP/1.1\r\n");
+        _request.append("Host: ").append(_host).append("\r\n");
+        _request.append("Content-Type: application/json\r\n");
+        _request.append("Content-Length: ")
+                .append(std::to_string(payload.length())).append("\r\n");
+
+        if (!_keepalive) {
+            _request.append("Connection: close\r\n");
+        }
+
+        _request.append("\r\n").append(payload);
+
+        int status = -1;
+        if (Write(_request)) {
+            status = Read();
+        }
+
+        if (status >= 0) {
+            return status;
+        }
+
+        Close();
+        if (!reused) {
+            break;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,41 @@
+#ifndef SMS_SERVER_LOAD_HTTP_H
+#define SMS_SERVER_LOAD_HTTP_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include <netinet/in.h>
+
+// One HTTP/1.1 connection posting JSON, reconnecting as needed. Just what
+// it takes to talk to smsd: responses must carry Content-Length.
+class Connection {
+public:
+    Connection(const struct sockaddr_in &address,
+               const std::string &host,
+               const std::string &path,
+               bool keepalive);
+
+    ~Connection();
+
+    // Returns the status code, or -1 on connection errors and timeouts.
+    int Post(const std::string &payload);
+
+protected:
+    bool Connect();
+    void Close();
+    bool Write(const std::string &request);
+    int Read();
+
+private:
+    const struct sockaddr_in _address;
+    const std::string _host;
+    const std::string _path;
+    const bool _keepalive;
+    std::string _request;
+    std::string _response;
+    int _fd;
+
+}; // class Connection
+
+#endif // SMS_SERVER_LOAD_HTTP_H
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sms/server/load/http.h"
+#include "sms/server/load/traffic.h"
+
+// Drives smsd with uploads like its clients send. With a rate the load is
+// open: uploads are due at Poisson arrivals whether or not earlier ones have
+// completed, and latency counts from when each was due, queueing included.
+// Without a rate every connection posts back to back.
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+class Options {
+public:
+    Options() : port(8080)
+              , path("/")
+              , rate(0)
+              , connections(4)
+              , seconds(10)
+              , duplicates(0)
+              , retries(0)
+              , keepalive(true) {}
+
+    struct sockaddr_in address;
+    std::string host;
+    uint16_t port;
+    std::string path;
+    double rate;        // Uploads per second, 0 for closed loop
+    size_t connections;
+    int seconds;
+    int duplicates;     // Percentage of uploads sent twice
+    int retries;        // Attempts more after failures
+    bool keepalive;
+    Traffic::Options traffic;
+}; // class Options
+
+class Job {
+public:
+    std::string _payload;
+    clock::time_point _due;
+    size_t _pdus;
+    size_t _calls;
+    bool _duplicate;
+}; // class Job
+
+class Stats {
+public:
+    Stats() : _uploads(0), _duplicates(0), _pdus(0), _calls(0), _bytes(0)
+            , _accepted(0), _rejected(0), _errors(0), _failed(0)
+            , _retries(0) {}
+
+    void Merge(const Stats &o)
+    {
+        _uploads    += o._uploads;
+        _duplicates += o._duplicates;
+        _pdus       += o._pdus;
+        _calls      += o._calls;
+        _bytes      += o._bytes;
+        _accepted   += o._accepted;
+        _rejected   += o._rejected;
+        _errors     += o._errors;
+        _failed     += o._failed;
+        _retries    += o._retries;
+        _latencies.insert(_latencies.end(),
+                          o._latencies.begin(), o._latencies.end());
+    }
+
+    size_t _uploads;
+    size_t _duplicates;
+    size_t _pdus;
+    size_t _calls;
+    size_t _bytes;
+    size_t _accepted;  // 2xx
+    size_t _rejected;  // 4xx
+    size_t _errors;    // 5xx and others
+    size_t _failed;    // Connection errors and timeouts
+    size_t _retries;
+    std::vector<int64_t> _latencies; // Microseconds of accepted ones
+}; // class Stats
+
+class Load {
+public:
+    explicit Load(const Options &options)
+            : _options(options)
+            , _traffic(options.traffic)
+            , _random(options.traffic.seed)
+            , _overflow(0)
+            , _quit(false)
+            , _completed(0) {}
+
+    void Run();
+
+private:
+    // Enough for a few seconds of any sane rate, beyond that smsd is so far
+    // behind that more backlog wouldn't tell anything new.
+    static constexpr size_t kMaximumBacklog = 65536;
+
+    void Dispatch(const clock::time_point &deadline);
+    void Enqueue(const clock::time_point &due);
+    void Work(Stats *stats);
+    void Report(const Stats &stats, double seconds) const;
+
+    const Options _options;
+    Traffic _traffic;
+    std::mt19937 _random;
+    size_t _overflow;
+
+    std::mutex _mutex;
+    std::condition_variable _cond;  // Jobs queued or quitting
+    std::condition_variable _space; // Closed loop only
+    std::deque<Job> _jobs;
+    bool _quit;
+
+    std::atomic<size_t> _completed;
+
+}; // class Load
+
+void Load::Enqueue(const clock::time_point &due)
+{
+    Job job;
+    job._payload = _traffic.Next(&job._pdus, &job._calls);
+    job._due = due;
+    job._duplicate = false;
+
+    // As if the response was lost and the client uploaded again.
+    const bool duplicate =
+            static_cast<int>(_random() % 100) < _options.duplicates;
+
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_jobs.size() >= kMaximumBacklog) {
+        ++_overflow;
+        return;
+    }
+
+    _jobs.push_back(job);
+    if (duplicate) {
+        job._duplicate = true;
+        _jobs.push_back(job);
+    }
+
+    _cond.notify_all();
+}
+
+void Load::Dispatch(const clock::time_point &deadline)
+{
+    if (_options.rate <= 0) {
+        while (clock::now() < deadline) {
+            std::unique_lock<std::mutex> locker(_mutex);
+            _space.wait_until(locker, deadline, [this] {
+                return _jobs.size() < _options.connections * 2;
+            });
+
+            locker.unlock();
+            Enqueue(clock::time_point::min()); // Due when taken
+        }
+
+        return;
+    }
+
+    std::exponential_distribution<double> interval(_options.rate);
+    auto due = clock::now();
+    while (due < deadline) {
+        std::this_thread::sleep_until(due);
+        Enqueue(due);
+        due += std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(interval(_random)));
+    }
+}
+
+void Load::Work(Stats *stats)
+{
+    Connection connection(_options.address, _options.host,
+                          _options.path, _options.keepalive);
+
+    for (;;) {
+        std::unique_lock<std::mutex> locker(_mutex);
+        _cond.wait(locker, [this] { return _quit || !_jobs.empty(); });
+        if (_quit) {
+            return;
+        }
+
+        Job job = std::move(_jobs.front());
+        _jobs.pop_front();
+        _space.notify_one();
+        locker.unlock();
+
+        if (job._due == clock::time_point::min()) {
+            job._due = clock::now();
+        }
+
+        int status = connection.Post(job._payload);
+        for (int i = 0; i < _options.retries && (status < 0 || status >= 500); ++i) {
+            ++stats->_retries;
+            status = connection.Post(job._payload);
+        }
+
+        const auto latency = std::chrono::duration_cast<
+                std::chrono::microseconds>(clock::now() - job._due).count();
+
+        ++stats->_uploads;
+        stats->_duplicates += job._duplicate;
+        stats->_pdus += job._pdus;
+        stats->_calls += job._calls;
+        stats->_bytes += job._payload.length();
+
+        if (status < 0) {
+            ++stats->_failed;
+        } else if (status >= 200 && status < 300) {
+            ++stats->_accepted;
+            stats->_latencies.push_back(latency);
+        } else if (status >= 400 && status < 500) {
+            ++stats->_rejected;
+        } else {
+            ++stats->_errors;
+        }
+
+        _completed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Load::Report(const Stats &stats, double seconds) const
+{
+    std::vector<int64_t> l = stats._latencies;
+    std::sort(l.begin(), l.end());
+    auto percentile = [&l](double p) -> double {
+        if (l.empty()) {
+            return 0;
+        }
+
+        const size_t i = std::min(l.size() - 1,
+                                  static_cast<size_t>(p * l.size()));
+        return static_cast<double>(l[i]) / 1000.0;
+    };
+
+    printf("uploads    %zu in %.1fs, %zu duplicates, %zu retries, "
+           "%zu not sent for backlog, %zu still queued\n",
+           stats._uploads, seconds, stats._duplicates, stats._retries,
+           _overflow, _jobs.size());
+
+    printf("responses  %zu 2xx, %zu 4xx, %zu other, %zu failed\n",
+           stats._accepted, stats._rejected, stats._errors, stats._failed);
+
+    printf("throughput %.1f uploads/s, %.1f PDUs/s, %.1f calls/s, %.2f MiB/s\n",
+           static_cast<double>(stats._uploads) / seconds,
+           static_cast<double>(stats._pdus) / seconds,
+           static_cast<double>(stats._calls) / seconds,
+           static_cast<double>(stats._bytes) / seconds / 1048576.0);
+
+    printf("latency    p50 %.3fms p99 %.3fms p999 %.3fms max %.3fms\n",
+           percentile(0.5), percentile(0.99), percentile(0.999),
+           l.empty() ? 0.0 : static_cast<double>(l.back()) / 1000.0);
+}
+
+void Load::Run()
+{
+    const auto start = clock::now();
+    const auto deadline = start + std::chrono::seconds(_options.seconds);
+
+    std::vector<Stats> stats(_options.connections);
+    std::vector<std::thread> workers;
+    for (auto &&s : stats) {
+        workers.emplace_back([this, &s] { Work(&s); });
+    }
+
+    std::thread dispatcher([this, &deadline] { Dispatch(deadline); });
+
+    size_t last = 0;
+    for (auto now = clock::now(); now < deadline; now = clock::now()) {
+        std::this_thread::sleep_until(std::min(
+                deadline, now + std::chrono::seconds(1)));
+
+        const size_t completed = _completed.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> locker(_mutex);
+        fprintf(stderr, "load: %zu uploads/s, %zu queued\n",
+                completed - last, _jobs.size());
+
+        last = completed;
+    }
+
+    dispatcher.join();
+
+    std::unique_lock<std::mutex> locker(_mutex);
+    _quit = true;
+    _cond.notify_all();
+    locker.unlock();
+
+    for (auto &&w : workers) {
+        w.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(
+            clock::now() - start).count();
+
+    Stats total;
+    for (auto &&s : stats) {
+        total.Merge(s);
+    }
+
+    Report(total, seconds);
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <ip>[:port]\n"
+            "\n"
+            "  -p path     URL path to post to, defaults to /\n"
+            "  -t token    tokens are <token>1 to <token>N, defaults to token\n"
+            "  -d devices  number of devices N, defaults to 1\n"
+            "  -r rate     uploads per second, open loop; closed loop if 0 (default)\n"
+            "  -c conns    concurrent connections, defaults to 4\n"
+            "  -T seconds  how long to run, defaults to 10\n"
+            "  -b pdus     PDUs per upload, defaults to 1\n"
+            "  -m percent  concatenated messages, defaults to 20\n"
+            "  -u percent  UCS-2 messages, defaults to 30\n"
+            "  -C percent  uploads with a call, defaults to 5\n"
+            "  -D percent  uploads sent twice, defaults to 0\n"
+            "  -R retries  attempts more after failures and 5xx, defaults to 0\n"
+            "  -K          a new connection for each upload\n"
+            "  -s seed     random seed, defaults to 1\n",
+            argv0);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    options.traffic.token = "token";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:d:r:c:T:b:m:u:C:D:R:Ks:h")) != -1) {
+        switch (opt) {
+        case 'p': options.path = optarg;                              break;
+        case 't': options.traffic.token = optarg;                     break;
+        case 'd': options.traffic.devices = strtoul(optarg, nullptr, 10); break;
+        case 'r': options.rate = atof(optarg);                        break;
+        case 'c': options.connections = strtoul(optarg, nullptr, 10); break;
+        case 'T': options.seconds = atoi(optarg);                     break;
+        case 'b': options.traffic.pdus = strtoul(optarg, nullptr, 10); break;
+        case 'm': options.traffic.multipart = atoi(optarg);           break;
+        case 'u': options.traffic.ucs2 = atoi(optarg);                break;
+        case 'C': options.traffic.calls = atoi(optarg);               break;
+        case 'D': options.duplicates = atoi(optarg);                  break;
+        case 'R': options.retries = atoi(optarg);                     break;
+        case 'K': options.keepalive = false;                          break;
+        case 's': options.traffic.seed = static_cast<unsigned>(atoi(optarg)); break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 1 != argc || !options.traffic.devices ||
+        !options.connections || options.seconds <= 0) {
+
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    options.host = argv[optind];
+    std::string ip = options.host;
+    const size_t colon = ip.find(':');
+    if (colon != std::string::npos) {
+        options.port = static_cast<uint16_t>(atoi(ip.c_str() + colon + 1));
+        ip.resize(colon);
+    }
+
+    memset(&options.address, 0, sizeof(options.address));
+    options.address.sin_family = AF_INET;
+    options.address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, ip.c_str(), &options.address.sin_addr) != 1) {
+        fprintf(stderr, "load: bad address [%s]\n", ip.c_str());
+        return EXIT_FAILURE;
+    }
+
+    Load load(options);
+    load.Run();
+    return EXIT_SUCCESS;
+}
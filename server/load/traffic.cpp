@@ -0,0 +1,252 @@
+#include "sms/server/load/traffic.h"
+
+#include <time.h>
+
+#include "sms/server/codec.h"
+
+namespace {
+
+// Alphanumerics and space are the same in the GSM 7 bit default alphabet.
+const char kAlphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789 ";
+
+// Characters per part, with and without the concatenation header.
+constexpr size_t kGsm7Single = 160;
+constexpr size_t kGsm7Part = 153;
+constexpr size_t kUcs2Single = 70;
+constexpr size_t kUcs2Part = 67;
+
+// Appends bytes and septets LSB first, as TP-UD is packed.
+class Bits {
+public:
+    explicit Bits(std::string *out) : _out(out), _bits(0) {}
+
+    void Put(unsigned value, size_t width)
+    {
+        for (size_t i = 0; i < width; ++i, ++_bits) {
+            if (_bits % 8 == 0) {
+                _out->push_back('\0');
+            }
+
+            if (value & (1u << i)) {
+                _out->back() = static_cast<char>(
+                        _out->back() | (1 << (_bits % 8)));
+            }
+        }
+    }
+
+    // Fill bits up to the next septet boundary.
+    void Align()
+    {
+        while (_bits % 7) {
+            Put(0, 1);
+        }
+    }
+
+private:
+    std::string *_out;
+    size_t _bits;
+
+}; // class Bits
+
+void put_bcd(std::string *out, int a, int b)
+{
+    out->push_back(static_cast<char>(b << 4 | a));
+}
+
+void put_number(std::string *out, const std::string &number)
+{
+    const std::string digits = number.substr(1); // Always international
+    out->push_back(static_cast<char>(digits.length()));
+    out->push_back(static_cast<char>(0x91));
+    for (size_t i = 0; i < digits.length(); i += 2) {
+        put_bcd(out, digits[i] - '0',
+                i + 1 < digits.length() ? digits[i + 1] - '0' : 0xF);
+    }
+}
+
+// TP-SCTS of now in UTC.
+void put_timestamp(std::string *out)
+{
+    const time_t now = time(nullptr);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+
+    const int fields[] = {
+            tm.tm_year % 100, tm.tm_mon + 1, tm.tm_mday,
+            tm.tm_hour, tm.tm_min, tm.tm_sec, 0 };
+
+    for (int f : fields) {
+        put_bcd(out, f / 10, f % 10);
+    }
+}
+
+} // anonymous namespace
+
+Traffic::Traffic(const Options &options)
+        : _options(options)
+        , _devices(options.devices)
+        , _random(options.seed)
+{
+    for (size_t i = 0; i < _devices.size(); ++i) {
+        _devices[i]._token = options.token + std::to_string(i + 1);
+        _devices[i]._reference = static_cast<uint8_t>(_random());
+    }
+}
+
+int Traffic::Percent()
+{
+    return static_cast<int>(_random() % 100);
+}
+
+std::string Traffic::Peer()
+{
+    std::string peer = "+86139";
+    for (int i = 0; i < 8; ++i) {
+        peer.push_back(static_cast<char>('0' + _random() % 10));
+    }
+
+    return peer;
+}
+
+std::string Traffic::Deliver(
+        bool ucs2,
+        const std::string &peer,
+        const std::u16string &text,
+        uint8_t reference,
+        uint8_t maximum,
+        uint8_t sequence)
+{
+    std::string pdu("\x08\x91\x68\x31\x08\x10\x00\x05\xF0", 9);
+    pdu.push_back(static_cast<char>(maximum ? 0x44 : 0x04));
+    put_number(&pdu, peer);
+    pdu.push_back('\0');
+    pdu.push_back(static_cast<char>(ucs2 ? 0x08 : 0x00));
+    put_timestamp(&pdu);
+
+    std::string udh;
+    if (maximum) {
+        const char element[] = {
+                0x05, 0x00, 0x03,
+                static_cast<char>(reference),
+                static_cast<char>(maximum),
+                static_cast<char>(sequence),
+        };
+
+        udh.assign(element, sizeof(element));
+    }
+
+    if (ucs2) {
+        pdu.push_back(static_cast<char>(udh.length() + text.length() * 2));
+        pdu.append(udh);
+        for (char16_t c : text) {
+            pdu.push_back(static_cast<char>(c >> 8));
+            pdu.push_back(static_cast<char>(c));
+        }
+
+    } else {
+        const size_t septets = (udh.length() * 8 + 6) / 7;
+        pdu.push_back(static_cast<char>(septets + text.length()));
+
+        Bits bits(&pdu);
+        for (char c : udh) {
+            bits.Put(static_cast<unsigned char>(c), 8);
+        }
+
+        bits.Align();
+        for (char16_t c : text) {
+            bits.Put(c, 7);
+        }
+    }
+
+    return codec::EncodeHex(pdu);
+}
+
+std::vector<std::string> Traffic::Message(uint8_t *reference)
+{
+    const bool ucs2 = Percent() < _options.ucs2;
+    const bool multipart = Percent() < _options.multipart;
+    const size_t single = ucs2 ? kUcs2Single : kGsm7Single;
+    const size_t part = ucs2 ? kUcs2Part : kGsm7Part;
+
+    size_t length;
+    if (multipart) {
+        length = single + 1 + _random() % (part * 3 - single);
+    } else {
+        length = 1 + _random() % single;
+    }
+
+    std::u16string text(length, u' ');
+    for (auto &&c : text) {
+        c = ucs2 ? static_cast<char16_t>(0x4E00 + _random() % 0x51A6)
+                 : static_cast<char16_t>(
+                         kAlphabet[_random() % (sizeof(kAlphabet) - 1)]);
+    }
+
+    const std::string peer = Peer();
+    if (!multipart) {
+        return { Deliver(ucs2, peer, text, 0, 0, 0) };
+    }
+
+    std::vector<std::string> parts;
+    const uint8_t r = (*reference)++;
+    const size_t maximum = (length + part - 1) / part;
+    for (size_t i = 0; i < maximum; ++i) {
+        parts.push_back(Deliver(
+                ucs2, peer, text.substr(i * part, part), r,
+                static_cast<uint8_t>(maximum), static_cast<uint8_t>(i + 1)));
+    }
+
+    return parts;
+}
+
+void Traffic::Generate(Device *device)
+{
+    for (auto &&pdu : Message(&device->_reference)) {
+        device->_pending.push_back(pdu);
+    }
+}
+
+std::string Traffic::Next(size_t *pdus, size_t *calls)
+{
+    Device &device = _devices[_random() % _devices.size()];
+    while (device._pending.size() < _options.pdus) {
+        Generate(&device);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const std::string timestamp = std::to_string(
+            static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec);
+
+    std::string payload;
+    payload.append("{\"token\":\"").append(device._token).append("\"");
+
+    *pdus = _options.pdus;
+    for (size_t i = 0; i < *pdus; ++i) {
+        payload.append(i ? "," : ",\"pdu\":[");
+        payload.append("{\"timestamp\":\"").append(timestamp)
+               .append("\",\"type\":\"Incoming\",\"pdu\":\"")
+               .append(device._pending.front()).append("\"}");
+
+        device._pending.pop_front();
+    }
+
+    if (*pdus) {
+        payload.append("]");
+    }
+
+    *calls = Percent() < _options.calls ? 1 : 0;
+    if (*calls) {
+        const std::string peer = Peer();
+        payload.append(",\"call\":[{\"timestamp\":\"").append(timestamp)
+               .append("\",\"duration\":\"")
+               .append(std::to_string((_random() % 300 + 1) * 1000000000ULL))
+               .append("\",\"peer\":\"").append(peer)
+               .append("\",\"type\":\"Incoming\",\"raw\":\"+CLIP: \\\"")
+               .append(peer.substr(3)).append("\\\",145,,,,0\"}]");
+    }
+
+    payload.append("}");
+    return payload;
+}
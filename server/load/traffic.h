@@ -0,0 +1,73 @@
+#ifndef SMS_SERVER_LOAD_TRAFFIC_H
+#define SMS_SERVER_LOAD_TRAFFIC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+// Uploads shaped like the client's json_encode(): a token, then "pdu" and
+// "call" arrays whose timestamps and durations are nanoseconds in strings.
+// PDUs are valid SMS-DELIVER with the SMSC address, GSM 7 bit or UCS-2,
+// single or concatenated. Parts of a long message can end up in different
+// uploads, as they do when the modem reports them one by one.
+class Traffic {
+public:
+    class Options {
+    public:
+        Options() : devices(1)
+                  , pdus(1)
+                  , multipart(20)
+                  , ucs2(30)
+                  , calls(5)
+                  , seed(1) {}
+
+        std::string token; // Device i is `token` followed by i, from 1
+        size_t devices;
+        size_t pdus;       // PDUs per upload
+        int multipart;     // Percentage of concatenated messages
+        int ucs2;          // Percentage of UCS-2 messages
+        int calls;         // Percentage of uploads with a call
+        unsigned seed;
+    }; // class Options
+
+    explicit Traffic(const Options &options);
+
+    // Payload of the next upload, `pdus` and `calls` are set to how many of
+    // each there are in it.
+    std::string Next(size_t *pdus, size_t *calls);
+
+    // Hex PDUs of a new message from a random peer, in the order of its
+    // parts. `reference` numbers concatenated ones and is advanced.
+    std::vector<std::string> Message(uint8_t *reference);
+
+private:
+    class Device {
+    public:
+        Device() : _reference(0) {}
+        std::string _token;
+        uint8_t _reference;
+        std::deque<std::string> _pending; // Hex PDUs not uploaded yet
+    }; // class Device
+
+    void Generate(Device *device);
+    std::string Peer();
+    std::string Deliver(bool ucs2,
+                        const std::string &peer,
+                        const std::u16string &text,
+                        uint8_t reference,
+                        uint8_t maximum,
+                        uint8_t sequence);
+
+    int Percent();
+
+    Options _options;
+    std::vector<Device> _devices;
+    std::mt19937 _random;
+
+}; // class Traffic
+
+#endif // SMS_SERVER_LOAD_TRAFFIC_H
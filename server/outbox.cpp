@@ -0,0 +1,262 @@
+#include "sms/server/outbox.h"
+
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include <flinter/logger.h>
+
+#include "sms/server/journal.h"
+#include "sms/server/record.h"
+
+Outbox::Outbox() : _journal(nullptr), _next(1)
+{
+    // Intended left blank
+}
+
+Outbox::~Outbox()
+{
+    Close();
+}
+
+bool Outbox::Open(
+        const std::string &path,
+        size_t segment_size,
+        std::list<Entry> *pending)
+{
+    constexpr size_t kBatch = 1024;
+
+    Close();
+    _journal = new Journal;
+    if (!_journal->Open(path, segment_size)) {
+        Close();
+        return false;
+    }
+
+    std::map<uint64_t, Entry> entries;
+    std::list<std::string> records;
+    std::list<uint64_t> positions;
+    uint64_t position = _journal->checkpoint();
+    while (true) {
+        uint64_t next;
+        if (!_journal->Read(position, kBatch, &records, &next, &positions)) {
+            Close();
+            return false;
+        }
+
+        if (records.empty() && next == position) {
+            break;
+        }
+
+        auto p = positions.begin();
+        for (auto &&record : records) {
+            if (!Apply(*p++, record, &entries)) {
+                CLOG.Error("Outbox: dropping malformed record of %lu bytes",
+                        record.length());
+            }
+        }
+
+        position = next;
+    }
+
+    pending->clear();
+    for (auto &&entry : entries) {
+        pending->push_back(std::move(entry.second));
+    }
+
+    CLOG.Info("Outbox: opened [%s] with %lu pending notifications",
+            path.c_str(), pending->size());
+
+    return true;
+}
+
+void Outbox::Close()
+{
+    if (_journal) {
+        _journal->Close();
+        delete _journal;
+        _journal = nullptr;
+    }
+
+    _pending.clear();
+    _records.clear();
+    _next = 1;
+}
+
+bool Outbox::Apply(
+        uint64_t position,
+        const std::string &record,
+        std::map<uint64_t, Entry> *entries)
+{
+    if (record.empty()) {
+        return false;
+    }
+
+    RecordReader r(record);
+    uint64_t count;
+
+    if (record[0] == 'A') {
+        std::list<Entry> added;
+        if (!r.Get(&count)) {
+            return false;
+        }
+
+        for (uint64_t i = 0; i < count; ++i) {
+            Entry entry;
+            if (!r.Get(&entry._id) || !r.Get(&entry._payload)) {
+                return false;
+            }
+
+            added.push_back(std::move(entry));
+        }
+
+        if (!r.Done()) {
+            return false;
+        }
+
+        for (auto &&entry : added) {
+            _next = std::max(_next, entry._id + 1);
+            _pending[entry._id] = position;
+            ++_records[position];
+            const uint64_t id = entry._id;
+            (*entries)[id] = std::move(entry);
+        }
+
+        return true;
+
+    } else if (record[0] == 'U') {
+        std::list<uint64_t> delivered;
+        std::list<uint64_t> failed;
+        for (auto *ids : { &delivered, &failed }) {
+            if (!r.Get(&count)) {
+                return false;
+            }
+
+            for (uint64_t i = 0; i < count; ++i) {
+                uint64_t id;
+                if (!r.Get(&id)) {
+                    return false;
+                }
+
+                ids->push_back(id);
+            }
+        }
+
+        if (!r.Done()) {
+            return false;
+        }
+
+        // Ids added before the checkpoint are long gone, ignore them
+        for (auto id : delivered) {
+            entries->erase(id);
+            Forget(id);
+        }
+
+        for (auto id : failed) {
+            auto p = entries->find(id);
+            if (p != entries->end()) {
+                ++p->second._attempts;
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Outbox::Add(std::list<Entry> *entries)
+{
+    if (!_journal) {
+        return false;
+    } else if (entries->empty()) {
+        return true;
+    }
+
+    std::string record(1, 'A');
+    record_put(&record, static_cast<int64_t>(entries->size()));
+
+    uint64_t id = _next;
+    for (auto &&entry : *entries) {
+        entry._id = id++;
+        record_put(&record, static_cast<int64_t>(entry._id));
+        record_put(&record, entry._payload);
+    }
+
+    uint64_t position;
+    if (!_journal->Append(record, &position)) {
+        CLOG.Warn("Outbox: failed to add %lu notifications", entries->size());
+        for (auto &&entry : *entries) {
+            entry._id = 0;
+        }
+
+        return false;
+    }
+
+    _next = id;
+    for (auto &&entry : *entries) {
+        _pending[entry._id] = position;
+    }
+
+    _records[position] += entries->size();
+    return true;
+}
+
+bool Outbox::Update(
+        const std::list<uint64_t> &delivered,
+        const std::list<uint64_t> &failed)
+{
+    if (!_journal) {
+        return false;
+    } else if (delivered.empty() && failed.empty()) {
+        return true;
+    }
+
+    std::string record(1, 'U');
+    for (auto *ids : { &delivered, &failed }) {
+        record_put(&record, static_cast<int64_t>(ids->size()));
+        for (auto id : *ids) {
+            record_put(&record, static_cast<int64_t>(id));
+        }
+    }
+
+    if (!_journal->Append(record)) {
+        CLOG.Warn("Outbox: failed to update %lu delivered and %lu failed",
+                delivered.size(), failed.size());
+        return false;
+    }
+
+    for (auto id : delivered) {
+        Forget(id);
+    }
+
+    Release();
+    return true;
+}
+
+void Outbox::Forget(uint64_t id)
+{
+    auto p = _pending.find(id);
+    if (p == _pending.end()) {
+        return;
+    }
+
+    auto q = _records.find(p->second);
+    if (--q->second == 0) {
+        _records.erase(q);
+    }
+
+    _pending.erase(p);
+}
+
+void Outbox::Release()
+{
+    // The only writer, everything written is synced by now
+    const uint64_t position = _records.empty()
+                            ? _journal->synced()
+                            : _records.begin()->first;
+
+    if (!_journal->Release(position)) {
+        CLOG.Warn("Outbox: failed to release up to %" PRIu64, position);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SMS_SERVER_OUTBOX_H
+#define SMS_SERVER_OUTBOX_H
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+class Journal;
+
+// Notifications pending delivery, kept in a journal so that they survive
+// restarts.
+//
+// Every notification gets an id when added, outcomes are recorded in
+// batches. Only the record adding the oldest pending notification and
+// those after it are kept. Not thread safe.
+class Outbox {
+public:
+    class Entry {
+    public:
+        Entry() : _id(0), _attempts(0) {}
+        uint64_t _id;
+        int _attempts;
+        std::string _payload;
+    }; // class Entry
+
+    Outbox();
+    ~Outbox();
+
+    // `pending` receives whatever was not delivered last time.
+    bool Open(const std::string &path,
+              size_t segment_size,
+              std::list<Entry> *pending);
+
+    void Close();
+
+    // Assign ids to `entries` and record all of them at once.
+    bool Add(std::list<Entry> *entries);
+
+    // Delivered ones are forgotten, failed ones have one more attempt.
+    bool Update(const std::list<uint64_t> &delivered,
+                const std::list<uint64_t> &failed);
+
+    size_t size() const
+    {
+        return _pending.size();
+    }
+
+protected:
+    bool Apply(uint64_t position,
+               const std::string &record,
+               std::map<uint64_t, Entry> *entries);
+
+    void Forget(uint64_t id);
+    void Release();
+
+private:
+    Journal *_journal;
+    uint64_t _next;
+
+    // Pending id -> position of the record adding it
+    std::unordered_map<uint64_t, uint64_t> _pending;
+
+    // Record position -> pending entries in it
+    std::map<uint64_t, size_t> _records;
+
+}; // class Outbox
+
+#endif // SMS_SERVER_OUTBOX_H
@@ -1,23 +1,108 @@
 #include "sms/server/processor.h"
 
+#include <string.h>
+
+#include <fstream>
+#include <iterator>
+
 #include <flinter/types/tree.h>
-#include <flinter/encode.h>
 #include <flinter/logger.h>
 
+#include "sms/server/civil.h"
+#include "sms/server/codec.h"
 #include "sms/server/configure.h"
 #include "sms/server/database.h"
+#include "sms/server/journal.h"
+#include "sms/server/outbox.h"
+#include "sms/server/record.h"
 #include "sms/server/smtp.h"
 #include "sms/server/splitter.h"
 
+enum {
+    kMailCalls,
+    kMailSeparator,
+    kMailSMS,
+};
+
+enum {
+    kCallTimestamp,
+    kCallPeer,
+    kCallType,
+    kCallDuration,
+};
+
+enum {
+    kSMSDate,
+    kSMSSent,
+    kSMSReceived,
+    kSMSPeer,
+    kSMSBody,
+};
+
+static const std::vector<std::string> kMailFields = {
+        "calls", "separator", "sms" };
+
+static const std::vector<std::string> kCallFields = {
+        "timestamp", "peer", "type", "duration" };
+
+static const std::vector<std::string> kSMSFields = {
+        "date", "sent", "received", "peer", "body" };
+
+static const char kMailTemplate[] =
+        "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Transitional//EN\" "
+        "\"http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd\">\n"
+        "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
+        "<head>\n"
+        "<style>\n"
+        "table { border: 1px solid black; border_collapse: collapse }\n"
+        "th { border: 1px solid black; border_collapse: collapse }\n"
+        "td { border: 1px solid black; border_collapse: collapse }\n"
+        "</style>\n"
+        "</head>\n"
+        "<body>\n"
+        "<table>\n"
+        "{{calls}}"
+        "{{separator}}"
+        "{{sms}}"
+        "</table>\n"
+        "</body>\n"
+        "</html>\n";
+
+static const char kCallTemplate[] =
+        "<tr>\n"
+        "<td>{{timestamp}}</td>\n"
+        "<td>{{peer}}</td>\n"
+        "<td>{{type}}</td>\n"
+        "<td>{{duration}}</td>\n"
+        "</tr>\n";
+
+static const char kSMSTemplate[] =
+        "<tr>\n"
+        "<td>{{date}}</td>\n"
+        "<td>{{sent}}</td>\n"
+        "<td>{{received}}</td>\n"
+        "<td>{{peer}}</td>\n"
+        "</tr>\n"
+        "<tr>\n"
+        "<th colspan=\"4\">{{body}}</th>\n"
+        "</tr>\n";
+
 Processor::Processor() : _splitter(new Splitter)
-                       , _mailer(nullptr)
+                       , _outbox(nullptr)
+                       , _maximumAttempts(0)
                        , _mailQuit(false)
+                       , _replayer(nullptr)
+                       , _journal(nullptr)
+                       , _replayPending(true)
+                       , _replayQuit(false)
 {
     // Intended left blank
 }
 
 Processor::~Processor()
 {
+    delete _journal;
+    delete _outbox;
     delete _splitter;
 }
 
@@ -27,6 +112,17 @@ bool Processor::Initialize()
     InitializeDevices();
     CLOG.Trace("Processor: loaded %lu devices", _devices.size());
 
+    if (!InitializeTemplates()) {
+        return false;
+    }
+
+    // Probe the zone now rather than in the first mail
+    civil::Zone::Local();
+
+    if (!InitializeOutbox()) {
+        return false;
+    }
+
     Database db;
     std::list<db::PDU> all;
     if (!db.Select(&all)) {
@@ -42,13 +138,41 @@ bool Processor::Initialize()
 
     if (!all.empty()) {
         Split(std::chrono::steady_clock::now());
+        Save();
     }
 
+    const flinter::Tree &j = (*g_configure)["journal"];
+    const std::string &path = j["path"];
+    if (!path.empty()) {
+        _journal = new Journal;
+        if (!_journal->Open(path, j["segment_size"].as<size_t>(67108864))) {
+            CLOG.Error("Processor: failed to open journal [%s]", path.c_str());
+            return false;
+        }
+
+        std::unique_lock<std::mutex> replayLocker(_replayLock);
+        _replayPending = true;
+        _replayQuit = false;
+        replayLocker.unlock();
+
+        _replayer = new std::thread([this]() { Replayer(); });
+    }
+
+    const flinter::Tree &s = (*g_configure)["smtp"];
     std::unique_lock<std::mutex> locker(_mailLock);
+    _retryMinimum = std::chrono::seconds(s["retry_minimum"].as<int>(30));
+    _retryMaximum = std::chrono::seconds(s["retry_maximum"].as<int>(3600));
+    _maximumAttempts = s["max_attempts"].as<int>(10);
+    _mailReport = std::chrono::steady_clock::now();
     _mailQuit = false;
     locker.unlock();
 
-    _mailer = new std::thread([this]() { Mailer(); });
+    const size_t workers = s["workers"].as<size_t>(4);
+    for (size_t i = 0; i < std::max<size_t>(workers, 1); ++i) {
+        _mailers.push_back(new std::thread([this]() { Mailer(); }));
+    }
+
+    CLOG.Trace("Processor: started %lu mailers", _mailers.size());
     CLOG.Trace("Processor: initializing done");
     return true;
 }
@@ -57,17 +181,160 @@ void Processor::InitializeDevices()
 {
     const flinter::Tree &conf = (*g_configure)["device"];
     for (auto &&c : conf) {
-        Device d;
+        const int did = c.key_as<int>();
+        Device &d = _devices[did];
         d._to = c["to"];
         d._receiver = c["receiver"];
         d._flush = std::chrono::steady_clock::time_point::min();
-        const int did = c.key_as<int>();
-        _devices.insert(std::make_pair(did, d));
         CLOG.Trace("Processor: device %d -> %s <%s>",
                 did, d._to.c_str(), d._receiver.c_str());
     }
 }
 
+bool Processor::InitializeTemplates()
+{
+    const flinter::Tree &t = (*g_configure)["template"];
+    const struct {
+        Template *_template;
+        const char *_name;
+        const char *_default;
+        const std::vector<std::string> *_fields;
+    } templates[] = {
+        { &_mailTemplate, "mail", kMailTemplate, &kMailFields },
+        { &_callTemplate, "call", kCallTemplate, &kCallFields },
+        { &_smsTemplate,  "sms",  kSMSTemplate,  &kSMSFields  },
+    };
+
+    for (auto &&c : templates) {
+        std::string text = c._default;
+        const std::string &filename = t[c._name];
+        if (!filename.empty()) {
+            std::ifstream file(filename);
+            if (!file) {
+                CLOG.Error("Processor: failed to open template [%s]",
+                        filename.c_str());
+                return false;
+            }
+
+            text.assign(std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>());
+        }
+
+        if (!c._template->Compile(text, *c._fields)) {
+            CLOG.Error("Processor: failed to compile %s template", c._name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Processor::InitializeOutbox()
+{
+    const flinter::Tree &o = (*g_configure)["outbox"];
+    const std::string &path = o["path"];
+    if (path.empty()) {
+        return true;
+    }
+
+    std::list<Outbox::Entry> pending;
+    _outbox = new Outbox;
+    if (!_outbox->Open(path, o["segment_size"].as<size_t>(16777216), &pending)) {
+        CLOG.Error("Processor: failed to open outbox [%s]", path.c_str());
+        return false;
+    }
+
+    // Pick up where we left off, they'll be flushed on the next cleanup
+    const auto now = std::chrono::steady_clock::now();
+    std::list<uint64_t> dropped;
+    size_t resumed = 0;
+    for (auto &&entry : pending) {
+        Notice notice;
+        if (!Decode(entry._payload, &notice)) {
+            CLOG.Error("Processor: dropping malformed outbox entry %lu",
+                    entry._id);
+            dropped.push_back(entry._id);
+            continue;
+        }
+
+        const int did = notice._call ? notice._call->device
+                                     : notice._sms->device;
+
+        const auto p = _devices.find(did);
+        if (p == _devices.end()) {
+            CLOG.Warn("Processor: dropping outbox entry %lu "
+                    "for unknown device %d", entry._id, did);
+            dropped.push_back(entry._id);
+            continue;
+        }
+
+        notice._id = entry._id;
+        notice._attempts = entry._attempts;
+
+        Device &device = p->second;
+        if (notice._call) {
+            device._call.push_back(std::move(notice));
+        } else {
+            device._sms.push_back(std::move(notice));
+        }
+
+        device._flush = now;
+        ++resumed;
+    }
+
+    _outbox->Update(dropped, std::list<uint64_t>());
+    CLOG.Trace("Processor: resumed %lu notifications", resumed);
+    return true;
+}
+
+void Processor::Save()
+{
+    if (_unsaved.empty()) {
+        return;
+    }
+
+    std::list<Outbox::Entry> entries;
+    for (auto &&notice : _unsaved) {
+        entries.push_back(Outbox::Entry());
+        entries.back()._payload = notice->_call ? Encode(*notice->_call)
+                                                : Encode(*notice->_sms);
+    }
+
+    if (_outbox->Add(&entries)) {
+        auto p = entries.begin();
+        for (auto &&notice : _unsaved) {
+            notice->_id = p++->_id;
+        }
+
+    } else {
+        CLOG.Error("Processor: failed to save %lu notifications to outbox",
+                _unsaved.size());
+    }
+
+    _unsaved.clear();
+}
+
+void Processor::Commit()
+{
+    if (!_outbox) {
+        return;
+    }
+
+    std::list<uint64_t> delivered;
+    std::list<uint64_t> failed;
+    std::unique_lock<std::mutex> locker(_mailLock);
+    delivered.swap(_delivered);
+    failed.swap(_failed);
+    locker.unlock();
+
+    if (!_outbox->Update(delivered, failed)) {
+        // Try again with the next batch
+        locker.lock();
+        _delivered.splice(_delivered.begin(), delivered);
+        _failed.splice(_failed.begin(), failed);
+    }
+}
+
 void Processor::Split(const std::chrono::steady_clock::time_point &when)
 {
     CLOG.Trace("Processor: split");
@@ -94,6 +361,10 @@ void Processor::Split(const std::chrono::steady_clock::time_point &when)
 
 int Processor::Received(std::unique_ptr<db::PDU> r)
 {
+    if (_journal) {
+        return Append(Encode(*r));
+    }
+
     const auto now = std::chrono::steady_clock::now();
 
     Database db;
@@ -118,6 +389,10 @@ int Processor::Received(std::unique_ptr<db::PDU> r)
 
 int Processor::Received(std::unique_ptr<db::SMS> r)
 {
+    if (_journal) {
+        return Append(Encode(*r));
+    }
+
     const auto now = std::chrono::steady_clock::now();
 
     Database db;
@@ -142,6 +417,10 @@ int Processor::Received(std::unique_ptr<db::SMS> r)
 
 int Processor::Received(std::unique_ptr<db::Call> r)
 {
+    if (_journal) {
+        return Append(Encode(*r));
+    }
+
     const auto now = std::chrono::steady_clock::now();
 
     Database db;
@@ -164,8 +443,271 @@ int Processor::Received(std::unique_ptr<db::Call> r)
     return ret;
 }
 
+int Processor::Append(const std::string &record)
+{
+    if (!_journal->Append(record)) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> locker(_replayLock);
+    _replayCond.notify_all();
+    _replayPending = true;
+    return 0;
+}
+
+std::string Processor::Encode(const db::Call &call)
+{
+    std::string r(1, 'C');
+    record_put(&r, call.device);
+    record_put(&r, call.timestamp);
+    record_put(&r, call.uploaded);
+    record_put(&r, call.duration);
+    record_put(&r, call.peer);
+    record_put(&r, call.type);
+    record_put(&r, call.raw);
+    return r;
+}
+
+std::string Processor::Encode(const db::PDU &pdu)
+{
+    std::string r(1, 'P');
+    record_put(&r, pdu.device);
+    record_put(&r, pdu.timestamp);
+    record_put(&r, pdu.uploaded);
+    record_put(&r, pdu.type);
+    record_put(&r, pdu.pdu);
+    return r;
+}
+
+std::string Processor::Encode(const db::SMS &sms)
+{
+    std::string r(1, 'S');
+    record_put(&r, sms.device);
+    record_put(&r, sms.sent);
+    record_put(&r, sms.received);
+    record_put(&r, sms.type);
+    record_put(&r, sms.peer);
+    record_put(&r, sms.subject);
+    record_put(&r, sms.body);
+    return r;
+}
+
+bool Processor::Decode(const std::string &record, Task *task)
+{
+    if (record.empty()) {
+        return false;
+    }
+
+    RecordReader r(record);
+    switch (record[0]) {
+    case 'C':
+        task->_call.reset(new db::Call);
+        return r.Get(&task->_call->device)
+            && r.Get(&task->_call->timestamp)
+            && r.Get(&task->_call->uploaded)
+            && r.Get(&task->_call->duration)
+            && r.Get(&task->_call->peer)
+            && r.Get(&task->_call->type)
+            && r.Get(&task->_call->raw)
+            && r.Done();
+
+    case 'P':
+        task->_pdu.reset(new db::PDU);
+        return r.Get(&task->_pdu->device)
+            && r.Get(&task->_pdu->timestamp)
+            && r.Get(&task->_pdu->uploaded)
+            && r.Get(&task->_pdu->type)
+            && r.Get(&task->_pdu->pdu)
+            && r.Done();
+
+    case 'S':
+        task->_sms.reset(new db::SMS);
+        return r.Get(&task->_sms->device)
+            && r.Get(&task->_sms->sent)
+            && r.Get(&task->_sms->received)
+            && r.Get(&task->_sms->type)
+            && r.Get(&task->_sms->peer)
+            && r.Get(&task->_sms->subject)
+            && r.Get(&task->_sms->body)
+            && r.Done();
+
+    default:
+        return false;
+    }
+}
+
+bool Processor::Decode(const std::string &record, Notice *notice)
+{
+    Task task;
+    if (!Decode(record, &task) || task._pdu) {
+        return false;
+    }
+
+    notice->_call = std::move(task._call);
+    notice->_sms = std::move(task._sms);
+    return true;
+}
+
+bool Processor::Replay(const std::list<std::string> &records)
+{
+    std::list<Task> tasks;
+    for (auto &&record : records) {
+        Task task;
+        if (!Decode(record, &task)) {
+            CLOG.Error("Processor: dropping malformed journal record "
+                    "of %lu bytes", record.length());
+            continue;
+        }
+
+        tasks.push_back(std::move(task));
+    }
+
+    Database db;
+    if (!db.Begin()) {
+        return false;
+    }
+
+    for (auto &&task : tasks) {
+        int ret;
+        if (task._call) {
+            ret = db.InsertCall(*task._call);
+            task._call->id = ret;
+
+        } else if (task._pdu) {
+            ret = db.InsertPDU(*task._pdu);
+            task._pdu->id = ret;
+
+        } else {
+            ret = db.InsertSMS(*task._sms);
+            task._sms->id = ret;
+        }
+
+        if (ret < 0) {
+            db.Rollback();
+            return false;
+        }
+    }
+
+    if (!db.Commit()) {
+        return false;
+    }
+
+    db.Disconnect();
+
+    // Duplicated ones were inserted before, don't process them again
+    const auto now = std::chrono::steady_clock::now();
+    for (auto p = tasks.begin(); p != tasks.end();) {
+        const int id = p->_call ? p->_call->id
+                     : p->_pdu  ? p->_pdu->id
+                     :            p->_sms->id;
+
+        if (id <= 0) {
+            p = tasks.erase(p);
+            continue;
+        }
+
+        p->_when = now;
+        ++p;
+    }
+
+    CLOG.Info("Processor: replayed %lu records, %lu inserted",
+            records.size(), tasks.size());
+
+    std::lock_guard<std::mutex> locker(_mutex);
+    _tasks.splice(_tasks.end(), tasks);
+    return true;
+}
+
+void Processor::Replayer()
+{
+    constexpr std::chrono::seconds kMinimumBackoff(1);
+    constexpr std::chrono::seconds kMaximumBackoff(60);
+
+    const flinter::Tree &j = (*g_configure)["journal"];
+    const size_t kBatch = j["batch"].as<size_t>(256);
+
+    CLOG.Info("Processor: replayer started");
+
+    std::list<std::string> records;
+    uint64_t position = _journal->checkpoint();
+    uint64_t next = position;
+
+    std::chrono::seconds backoff = kMinimumBackoff;
+    auto retry = std::chrono::steady_clock::time_point::min();
+    std::unique_lock<std::mutex> locker(_replayLock);
+    while (!_replayQuit) {
+        if (std::chrono::steady_clock::now() < retry) {
+            _replayCond.wait_until(locker, retry);
+            continue;
+        }
+
+        if (records.empty() && !_replayPending) {
+            _replayCond.wait(locker);
+            continue;
+        }
+
+        _replayPending = false;
+        locker.unlock();
+
+        bool good = true;
+        if (records.empty()) {
+            good = _journal->Read(position, kBatch, &records, &next);
+            if (good && records.empty() && next != position) {
+                // Skipped over corrupted records
+                position = next;
+                _journal->Release(position);
+            }
+        }
+
+        if (good && !records.empty()) {
+            good = Replay(records);
+            if (good) {
+                records.clear();
+                position = next;
+                _journal->Release(position);
+                backoff = kMinimumBackoff;
+
+                locker.lock();
+                _replayPending = true;
+                continue;
+            }
+        }
+
+        if (!good) {
+            CLOG.Warn("Processor: failed to replay %lu records, retry in %lds",
+                    records.size(), static_cast<long>(backoff.count()));
+
+            retry = std::chrono::steady_clock::now() + backoff;
+            backoff = std::min(backoff * 2, kMaximumBackoff);
+
+            locker.lock();
+            _replayPending = true;
+            continue;
+        }
+
+        locker.lock();
+    }
+
+    CLOG.Info("Processor: replayer quit");
+}
+
 bool Processor::Shutdown()
 {
+    std::unique_lock<std::mutex> replayLocker(_replayLock);
+    _replayCond.notify_all();
+    _replayQuit = true;
+    replayLocker.unlock();
+
+    if (_replayer) {
+        _replayer->join();
+        delete _replayer;
+        _replayer = nullptr;
+    }
+
+    if (_journal) {
+        _journal->Close();
+    }
+
     Flush(true);
 
     std::unique_lock<std::mutex> locker(_mailLock);
@@ -173,10 +715,16 @@ bool Processor::Shutdown()
     _mailQuit = true;
     locker.unlock();
 
-    if (_mailer) {
-        _mailer->join();
-        delete _mailer;
-        _mailer = nullptr;
+    for (auto &&mailer : _mailers) {
+        mailer->join();
+        delete mailer;
+    }
+
+    _mailers.clear();
+
+    Commit();
+    if (_outbox) {
+        _outbox->Close();
     }
 
     return true;
@@ -212,186 +760,376 @@ bool Processor::Cleanup()
         Split(now);
     }
 
+    Save();
     Flush(false);
+    Commit();
+    Report(now);
     return true;
 }
 
-std::string Processor::FormatDuration(int64_t t)
+void Processor::AppendDuration(std::string *out, int64_t t)
 {
     const time_t s = t / 1000000000;
     char buffer[64];
+    int length;
 
     if (s < 60) {
-        sprintf(buffer, "%lds", s);
+        length = sprintf(buffer, "%lds", s);
     } else {
-        sprintf(buffer, "%ldm%lds\n", s / 60, s % 60);
+        // The newline is what mails have always had, keep them the same
+        length = sprintf(buffer, "%ldm%lds\n", s / 60, s % 60);
     }
 
-    return buffer;
+    out->append(buffer, static_cast<size_t>(length));
 }
 
-std::string Processor::FormatTime(int64_t t)
+void Processor::Render(const db::SMS &sms, std::string *out) const
 {
-    const time_t s = t / 1000000000;
-    char buffer[64];
-    struct tm tm;
-
-    localtime_r(&s, &tm);
-    sprintf(buffer, "%02d:%02d:%02d", tm.tm_hour, tm.tm_min, tm.tm_sec);
-    return buffer;
+    char sent[civil::kDateTime];
+    char received[civil::kDateTime];
+    civil::format_date_time(civil::to_local(sms.sent / 1000000000), sent);
+    civil::format_date_time(civil::to_local(sms.received / 1000000000),
+                            received);
+
+    _smsTemplate.Render(out, [&](int field, std::string *o) {
+        switch (field) {
+        case kSMSDate:     o->append(sent, 10);             break;
+        case kSMSSent:     o->append(sent + 11, 8);         break;
+        case kSMSReceived: o->append(received + 11, 8);     break;
+        case kSMSPeer:     codec::AppendHtml(o, sms.peer);  break;
+        case kSMSBody:     codec::AppendHtml(o, sms.body);  break;
+        }
+    });
 }
 
-std::string Processor::FormatDate(int64_t t)
+void Processor::Render(const db::Call &call, std::string *out) const
 {
-    const time_t s = t / 1000000000;
-    char buffer[64];
-    struct tm tm;
-
-    localtime_r(&s, &tm);
-    sprintf(buffer, "%04d-%02d-%02d",
-            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
-
-    return buffer;
+    static const std::string kHidden = "<HIDDEN>";
+
+    char timestamp[civil::kDateTime];
+    civil::format_date_time(civil::to_local(call.timestamp / 1000000000),
+                            timestamp);
+
+    _callTemplate.Render(out, [&](int field, std::string *o) {
+        switch (field) {
+        case kCallTimestamp: o->append(timestamp, sizeof(timestamp)); break;
+        case kCallType:      codec::AppendHtml(o, call.type);       break;
+        case kCallDuration:  AppendDuration(o, call.duration);      break;
+        case kCallPeer:
+            codec::AppendHtml(o, call.peer.empty() ? kHidden : call.peer);
+            break;
+        }
+    });
 }
 
-std::string Processor::FormatDateTime(int64_t t)
+void Processor::Render(const Mail &mail, std::string *out) const
 {
-    const time_t s = t / 1000000000;
-    char buffer[64];
-    struct tm tm;
+    // Enough for most mails so that appending rarely reallocates
+    out->clear();
+    out->reserve(_mailTemplate.size()
+            + mail._call.size() * (_callTemplate.size() + 128)
+            + mail._sms.size() * (_smsTemplate.size() + 512));
+
+    _mailTemplate.Render(out, [this, &mail](int field, std::string *o) {
+        switch (field) {
+        case kMailCalls:
+            for (auto &&p : mail._call) {
+                Render(*p._call, o);
+            }
+            break;
 
-    localtime_r(&s, &tm);
-    sprintf(buffer, "%04d-%02d-%02d %02d:%02d:%02d",
-            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
-            tm.tm_hour, tm.tm_min, tm.tm_sec);
+        case kMailSeparator:
+            if (!mail._call.empty() && !mail._sms.empty()) {
+                o->append("<br /> \n");
+            }
+            break;
 
-    return buffer;
+        case kMailSMS:
+            for (auto &&p : mail._sms) {
+                Render(*p._sms, o);
+            }
+            break;
+        }
+    });
 }
 
-std::string Processor::Format(const db::SMS &sms)
+Processor::Mail &Processor::Enqueue(
+        const std::string &to,
+        const std::string &receiver)
 {
-    std::ostringstream s;
-    s << "<tr>\n"
-      << "<td>" << FormatDate(sms.sent)          << "</td>\n"
-      << "<td>" << FormatTime(sms.sent)          << "</td>\n"
-      << "<td>" << FormatTime(sms.received)      << "</td>\n"
-      << "<td>" << flinter::EscapeHtml(sms.peer) << "</td>\n"
-      << "</tr>\n"
-      << "<tr>\n"
-      << "<th colspan=\"4\">" << flinter::EscapeHtml(sms.body) << "</th>\n"
-      << "</tr>\n";
+    auto p = _mailIndex.find(to);
+    if (p == _mailIndex.end()) {
+        _mails.push_back(Mail());
+        Mail &m = _mails.back();
+        m._to = to;
+        m._receiver = receiver;
+        auto last = std::prev(_mails.end());
+        p = _mailIndex.insert(std::make_pair(to, last)).first;
+    }
 
-    return s.str();
+    return *p->second;
 }
 
-std::string Processor::Format(const db::Call &call)
+void Processor::Send(
+        const std::string &to,
+        const std::string &receiver,
+        std::list<Notice> *call,
+        std::list<Notice> *sms)
 {
-    std::ostringstream s;
-    s << "<tr>\n"
-      << "<td>" << FormatDateTime(call.timestamp) << "</td>\n";
-
-    if (call.peer.empty()) {
-        s << "<td>" << flinter::EscapeHtml("<HIDDEN>") << "</td>\n";
-    } else {
-        s << "<td>" << flinter::EscapeHtml(call.peer) << "</td>\n";
-    }
-
-    s << "<td>" << flinter::EscapeHtml(call.type) << "</td>\n"
-      << "<td>" << FormatDuration(call.duration)  << "</td>\n"
-      << "</tr>\n";
+    std::lock_guard<std::mutex> locker(_mailLock);
+    _mailCond.notify_all();
 
-    return s.str();
+    // Merge into whatever is still pending for the same recipient
+    Mail &m = Enqueue(to, receiver);
+    m._call.splice(m._call.end(), *call);
+    m._sms.splice(m._sms.end(), *sms);
 }
 
-std::string Processor::Format(
-        const std::list<db::Call> &call,
-        const std::list<db::SMS> &sms)
+void Processor::Retry(Mail *mail)
 {
-    std::ostringstream m;
-    m << "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Transitional//EN\" "
-         "\"http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd\">\n"
-      << "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
-      << "<head>\n"
-      << "<style>\n"
-      << "table { border: 1px solid black; border_collapse: collapse }\n"
-      << "th { border: 1px solid black; border_collapse: collapse }\n"
-      << "td { border: 1px solid black; border_collapse: collapse }\n"
-      << "</style>\n"
-      << "</head>\n"
-      << "<body>\n"
-      << "<table>\n";
+    int attempts = 0;
+    for (auto *notices : { &mail->_call, &mail->_sms }) {
+        for (auto p = notices->begin(); p != notices->end();) {
+            const bool durable = _outbox && p->_id;
+            if (++p->_attempts >= _maximumAttempts) {
+                CLOG.Error("Processor: giving up notifying %s <%s> "
+                        "after %d attempts", mail->_to.c_str(),
+                        mail->_receiver.c_str(), p->_attempts);
+
+                if (durable) {
+                    _delivered.push_back(p->_id);
+                }
+
+                p = notices->erase(p);
+                continue;
+            }
+
+            if (durable) {
+                _failed.push_back(p->_id);
+            }
 
-    for (auto &&p : call) {
-        m << Format(p);
+            attempts = std::max(attempts, p->_attempts);
+            ++p;
+        }
     }
 
-    if (!call.empty() && !sms.empty()) {
-        m << "<br /> \n";
+    if (mail->_call.empty() && mail->_sms.empty()) {
+        return;
     }
 
-    for (auto &&p : sms) {
-        m << Format(p);
+    std::chrono::seconds backoff = _retryMinimum;
+    for (int i = 1; i < attempts && backoff < _retryMaximum; ++i) {
+        backoff *= 2;
     }
 
-    m << "</table>\n"
-      << "</body>\n"
-      << "</html>\n";
+    // Back in front of whatever came after them
+    Mail &m = Enqueue(mail->_to, mail->_receiver);
+    m._call.splice(m._call.begin(), mail->_call);
+    m._sms.splice(m._sms.begin(), mail->_sms);
+    m._retry = std::chrono::steady_clock::now()
+             + std::min(backoff, _retryMaximum);
 
-    return m.str();
+    CLOG.Warn("Processor: retry %s <%s> in %lds",
+            m._to.c_str(), m._receiver.c_str(),
+            static_cast<long>(std::min(backoff, _retryMaximum).count()));
 }
 
-void Processor::Send(
-        const std::string &to,
-        const std::string &receiver,
-        const std::string &mail,
-        size_t calls,
-        size_t sms)
+void Processor::Take(Mail *pending, Mail *mail)
 {
-    Mail m;
-    m._to = to;
-    m._receiver = receiver;
-    m._mail = mail;
-    m._calls = calls;
-    m._sms = sms;
+    constexpr size_t kMaximumCall = 50;
+    constexpr size_t kMaximumSMS = 50;
 
-    std::lock_guard<std::mutex> locker(_mailLock);
-    _mailCond.notify_all();
-    _mails.push_back(m);
+    mail->_to = pending->_to;
+    mail->_receiver = pending->_receiver;
+
+    if (pending->_call.size() <= kMaximumCall) {
+        mail->_call.splice(mail->_call.end(), pending->_call);
+    } else {
+        auto end = pending->_call.begin();
+        std::advance(end, kMaximumCall);
+        mail->_call.splice(mail->_call.end(), pending->_call,
+                pending->_call.begin(), end);
+    }
+
+    if (pending->_sms.size() <= kMaximumSMS) {
+        mail->_sms.splice(mail->_sms.end(), pending->_sms);
+    } else {
+        auto end = pending->_sms.begin();
+        std::advance(end, kMaximumSMS);
+        mail->_sms.splice(mail->_sms.end(), pending->_sms,
+                pending->_sms.begin(), end);
+    }
 }
 
 void Processor::Mailer()
 {
+    constexpr auto kIdle = std::chrono::seconds(1);
+
     CLOG.Info("Processor: mailer started");
+
+    // One long-lived session per mailer, reused across mails
+    SMTP smtp;
+
+    // Rendered into over and over, keeps the largest capacity so far
+    std::string mail;
+
     std::unique_lock<std::mutex> locker(_mailLock);
     while (!_mailQuit) {
-        if (_mails.empty()) {
-            _mailCond.wait(locker);
+        const auto now = std::chrono::steady_clock::now();
+        auto wake = now + kIdle;
+
+        // Mails to the same recipient go out one at a time and in order
+        auto p = _mails.begin();
+        for (; p != _mails.end(); ++p) {
+            if (_sending.count(p->_to)) {
+                continue;
+            } else if (p->_retry <= now) {
+                break;
+            }
+
+            wake = std::min(wake, p->_retry);
+        }
+
+        if (p == _mails.end()) {
+            if (_mailCond.wait_until(locker, wake) == std::cv_status::timeout) {
+                locker.unlock();
+                smtp.Expire();
+                locker.lock();
+            }
+
             continue;
         }
 
-        Mail m = std::move(_mails.front());
-        _mails.pop_front();
+        Mail m;
+        Take(&*p, &m);
+        if (p->_call.empty() && p->_sms.empty()) {
+            _mailIndex.erase(p->_to);
+            _mails.erase(p);
+        } else {
+            // Let other recipients go before the rest of this one
+            _mails.splice(_mails.end(), _mails, p);
+        }
+
+        _sending.insert(m._to);
         locker.unlock();
 
+        const size_t calls = m._call.size();
+        const size_t sms = m._sms.size();
         CLOG.Trace("Processor: sending to %s <%s> with %lu calls and %lu SMS",
-                m._to.c_str(), m._receiver.c_str(), m._calls, m._sms);
+                m._to.c_str(), m._receiver.c_str(), calls, sms);
+
+        const auto start = std::chrono::steady_clock::now();
+        Render(m, &mail);
+        const bool sent = smtp.Send(m._to, m._receiver, mail,
+                "text/html; charset=UTF-8");
 
-        SMTP smtp;
-        if (smtp.Send(m._to, m._receiver, m._mail, "text/html; charset=UTF-8")) {
+        const auto latency = std::chrono::steady_clock::now() - start;
+
+        if (sent) {
             CLOG.Info("Processor: sent to %s <%s> with %lu calls and %lu SMS",
-                    m._to.c_str(), m._receiver.c_str(), m._calls, m._sms);
+                    m._to.c_str(), m._receiver.c_str(), calls, sms);
         } else {
             CLOG.Warn("Processor: failed to send to %s <%s> "
                     "with %lu calls and %lu SMS",
-                    m._to.c_str(), m._receiver.c_str(),
-                    m._calls, m._sms);
+                    m._to.c_str(), m._receiver.c_str(), calls, sms);
         }
 
         locker.lock();
+        _mailStats.Add(sent, latency);
+        _sending.erase(m._to);
+        _mailCond.notify_all();
+
+        if (!sent) {
+            Retry(&m);
+            continue;
+        }
+
+        for (auto *notices : { &m._call, &m._sms }) {
+            for (auto &&notice : *notices) {
+                if (_outbox && notice._id) {
+                    _delivered.push_back(notice._id);
+                }
+            }
+        }
     }
     CLOG.Info("Processor: mailer quit");
 }
 
+Processor::MailStats::MailStats() : _sent(0)
+                                  , _failed(0)
+                                  , _total(0)
+                                  , _maximum(0)
+                                  , _buckets()
+{
+    // Intended left blank
+}
+
+void Processor::MailStats::Add(
+        bool sent,
+        std::chrono::steady_clock::duration latency)
+{
+    const int64_t ms = std::chrono::duration_cast<
+            std::chrono::milliseconds>(latency).count();
+
+    size_t bucket = 0;
+    while (bucket + 1 < kBuckets && (1LL << bucket) <= ms) {
+        ++bucket;
+    }
+
+    ++(sent ? _sent : _failed);
+    _maximum = std::max(_maximum, ms);
+    ++_buckets[bucket];
+    _total += ms;
+}
+
+int64_t Processor::MailStats::Percentile(double p) const
+{
+    const size_t count = _sent + _failed;
+    const size_t rank = static_cast<size_t>(static_cast<double>(count) * p);
+
+    size_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += _buckets[i];
+        if (seen > rank) {
+            return std::min<int64_t>(1LL << i, _maximum);
+        }
+    }
+
+    return _maximum;
+}
+
+void Processor::Report(const std::chrono::steady_clock::time_point &now)
+{
+    constexpr auto kInterval = std::chrono::seconds(60);
+
+    std::unique_lock<std::mutex> locker(_mailLock);
+    if (now < _mailReport + kInterval) {
+        return;
+    }
+
+    size_t calls = 0;
+    size_t sms = 0;
+    for (auto &&m : _mails) {
+        calls += m._call.size();
+        sms += m._sms.size();
+    }
+
+    const MailStats stats = _mailStats;
+    const size_t recipients = _mails.size();
+    const size_t sending = _sending.size();
+    _mailStats = MailStats();
+    _mailReport = now;
+    locker.unlock();
+
+    const size_t count = stats._sent + stats._failed;
+    CLOG.Info("Processor: mail queue %lu recipients with %lu calls and "
+            "%lu SMS, sending %lu, sent %lu, failed %lu, "
+            "latency avg %ldms p50 %ldms p99 %ldms max %ldms",
+            recipients, calls, sms, sending, stats._sent, stats._failed,
+            count ? stats._total / static_cast<int64_t>(count) : 0,
+            stats.Percentile(0.5), stats.Percentile(0.99), stats._maximum);
+}
+
 void Processor::Finish(
         const std::chrono::steady_clock::time_point &when,
         const db::SMS &sms)
@@ -406,7 +1144,11 @@ void Processor::Finish(
     }
 
     Device &device = p->second;
-    device._sms.push_back(sms);
+    device._sms.push_back(Notice());
+    device._sms.back()._sms.reset(new db::SMS(sms));
+    if (_outbox) {
+        _unsaved.push_back(&device._sms.back());
+    }
 
     if (device._flush == std::chrono::steady_clock::time_point::min()) {
         device._flush = when + kWait;
@@ -427,7 +1169,11 @@ void Processor::Finish(
     }
 
     Device &device = p->second;
-    device._call.push_back(call);
+    device._call.push_back(Notice());
+    device._call.back()._call.reset(new db::Call(call));
+    if (_outbox) {
+        _unsaved.push_back(&device._call.back());
+    }
 
     if (device._flush == std::chrono::steady_clock::time_point::min()) {
         device._flush = when;
@@ -438,9 +1184,6 @@ void Processor::Finish(
 
 void Processor::Flush(bool force)
 {
-    constexpr size_t kMaximumCall = 50;
-    constexpr size_t kMaximumSMS = 50;
-
     const auto now = std::chrono::steady_clock::now();
     for (auto &&p : _devices) {
         Device &device = p.second;
@@ -454,29 +1197,8 @@ void Processor::Flush(bool force)
             }
         }
 
-        std::list<db::Call> call;
-        if (device._call.size() < kMaximumCall) {
-            call.splice(call.end(), device._call);
-        } else {
-            auto end = device._call.begin();
-            std::advance(end, kMaximumCall);
-            call.splice(call.end(), device._call, device._call.begin(), end);
-        }
-
-        std::list<db::SMS> sms;
-        if (device._sms.size() < kMaximumSMS) {
-            sms.splice(sms.end(), device._sms);
-        } else {
-            auto end = device._sms.begin();
-            std::advance(end, kMaximumSMS);
-            sms.splice(sms.end(), device._sms, device._sms.begin(), end);
-        }
-
-        const std::string &mail = Format(call, sms);
-        Send(device._to, device._receiver, mail, call.size(), sms.size());
-
-        if (device._call.empty() && device._sms.empty()) {
-            device._flush = std::chrono::steady_clock::time_point::min();
-        }
+        // Mailers split them into mails and render them later
+        Send(device._to, device._receiver, &device._call, &device._sms);
+        device._flush = std::chrono::steady_clock::time_point::min();
     }
 }
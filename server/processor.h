@@ -8,25 +8,32 @@
 #include <list>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "sms/server/db.h"
+#include "sms/server/template.h"
 
+class Journal;
+class Outbox;
 class Splitter;
 
 class Processor {
 public:
     Processor();
-    ~Processor();
+    virtual ~Processor();
 
     bool Initialize();
     bool Shutdown();
     bool Cleanup();
 
-    int Received(std::unique_ptr<db::Call> r);
-    int Received(std::unique_ptr<db::PDU > r);
-    int Received(std::unique_ptr<db::SMS > r);
+    // Virtual so that benchmarks can feed the handler without a database.
+    virtual int Received(std::unique_ptr<db::Call> r);
+    virtual int Received(std::unique_ptr<db::PDU > r);
+    virtual int Received(std::unique_ptr<db::SMS > r);
 
 protected:
     class Task {
@@ -37,44 +44,80 @@ protected:
         std::unique_ptr<db::SMS>  _sms;
     }; // class Task
 
+    // A call or SMS to be mailed, `_id` is its outbox entry if any
+    class Notice {
+    public:
+        Notice() : _id(0), _attempts(0) {}
+        uint64_t _id;
+        int _attempts;
+        std::unique_ptr<db::Call> _call;
+        std::unique_ptr<db::SMS>  _sms;
+    }; // class Notice
+
     class Device {
     public:
         std::chrono::steady_clock::time_point _flush;
-        std::list<db::Call> _call;
-        std::list<db::SMS> _sms;
+        std::list<Notice> _call;
+        std::list<Notice> _sms;
         std::string _receiver;
         std::string _to;
     }; // class Done
 
+    // Everything pending for one recipient, sent in one or more mails
     class Mail {
     public:
+        std::chrono::steady_clock::time_point _retry;
         std::string _to;
         std::string _receiver;
-        std::string _mail;
-        size_t _calls;
-        size_t _sms;
+        std::list<Notice> _call;
+        std::list<Notice> _sms;
     }; // class Mail
 
-    static std::string FormatTime(int64_t t);
-    static std::string FormatDate(int64_t t);
-    static std::string FormatDateTime(int64_t t);
-    static std::string FormatDuration(int64_t t);
-    static std::string Format(const db::SMS &sms);
-    static std::string Format(const db::Call &call);
-    static std::string Format(
-            const std::list<db::Call> &call,
-            const std::list<db::SMS> &sms);
+    class MailStats {
+    public:
+        MailStats();
+        void Add(bool sent, std::chrono::steady_clock::duration latency);
+        int64_t Percentile(double p) const;
+
+        static constexpr size_t kBuckets = 20;
+
+        size_t _sent;
+        size_t _failed;
+        int64_t _total;   // In milliseconds
+        int64_t _maximum; // In milliseconds
+        size_t _buckets[kBuckets]; // [2^(i-1), 2^i) milliseconds
+    }; // class MailStats
+
+    static std::string Encode(const db::Call &call);
+    static std::string Encode(const db::PDU &pdu);
+    static std::string Encode(const db::SMS &sms);
+    static bool Decode(const std::string &record, Task *task);
+    static bool Decode(const std::string &record, Notice *notice);
+
+    static void AppendDuration(std::string *out, int64_t t);
+    void Render(const db::SMS &sms, std::string *out) const;
+    void Render(const db::Call &call, std::string *out) const;
+    void Render(const Mail &mail, std::string *out) const;
 
     void Send(const std::string &to,
               const std::string &receiver,
-              const std::string &mail,
-              size_t calls,
-              size_t sms);
+              std::list<Notice> *call,
+              std::list<Notice> *sms);
+
+    Mail &Enqueue(const std::string &to, const std::string &receiver);
+    void Retry(Mail *mail);
+
+    static void Take(Mail *pending, Mail *mail);
 
     void Split(const std::chrono::steady_clock::time_point &when);
     void InitializeDevices();
     void Flush(bool force);
 
+    bool InitializeOutbox();
+    bool InitializeTemplates();
+    void Save();
+    void Commit();
+
     void Finish(const std::chrono::steady_clock::time_point &when,
                 const db::SMS &sms);
 
@@ -82,20 +125,49 @@ protected:
                 const db::Call &call);
 
     void Mailer();
+    void Report(const std::chrono::steady_clock::time_point &now);
+
+    int Append(const std::string &record);
+    bool Replay(const std::list<std::string> &records);
+    void Replayer();
 
 private:
+    // Read only once initialized
+    Template _mailTemplate;
+    Template _callTemplate;
+    Template _smsTemplate;
+
     // Only access from cleanup thread, no need to lock
     std::unordered_map<int, Device> _devices;
+    std::list<Notice *> _unsaved; // Finished but not in outbox yet
     Splitter *const _splitter;
+    Outbox *_outbox;
 
-    // Access from both cleanup thread and mailer thread
+    // Access from both cleanup thread and mailer threads
     std::condition_variable _mailCond;
-    std::list<Mail> _mails;
-    std::thread *_mailer;
+    std::list<Mail> _mails; // At most one per recipient
+    std::unordered_map<std::string, std::list<Mail>::iterator> _mailIndex;
+    std::vector<std::thread *> _mailers;
+    std::unordered_set<std::string> _sending; // Recipients being sent to
+    std::chrono::steady_clock::time_point _mailReport;
+    std::list<uint64_t> _delivered; // Outbox entries delivered or given up
+    std::list<uint64_t> _failed;    // Outbox entries to be retried
+    std::chrono::seconds _retryMinimum;
+    std::chrono::seconds _retryMaximum;
+    int _maximumAttempts;
+    MailStats _mailStats;
     std::mutex _mailLock;
     bool _mailQuit;
 
-    // Access from both server thread and cleanup thread
+    // Access from both server thread and replayer thread
+    std::condition_variable _replayCond;
+    std::thread *_replayer;
+    std::mutex _replayLock;
+    Journal *_journal;
+    bool _replayPending;
+    bool _replayQuit;
+
+    // Access from server thread, replayer thread and cleanup thread
     std::list<Task> _tasks;
     std::mutex _mutex;
 
@@ -0,0 +1,90 @@
+#ifndef SMS_SERVER_RECORD_H
+#define SMS_SERVER_RECORD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+// Journal records are a type byte followed by fields in host byte order,
+// strings are prefixed by 32 bits length.
+class RecordReader {
+public:
+    explicit RecordReader(const std::string &record)
+            : _record(record), _offset(1) {}
+
+    bool Get(int64_t *value)
+    {
+        if (_record.length() - _offset < sizeof(*value)) {
+            return false;
+        }
+
+        memcpy(value, _record.data() + _offset, sizeof(*value));
+        _offset += sizeof(*value);
+        return true;
+    }
+
+    bool Get(uint64_t *value)
+    {
+        int64_t v;
+        if (!Get(&v)) {
+            return false;
+        }
+
+        *value = static_cast<uint64_t>(v);
+        return true;
+    }
+
+    bool Get(int *value)
+    {
+        int64_t v;
+        if (!Get(&v)) {
+            return false;
+        }
+
+        *value = static_cast<int>(v);
+        return true;
+    }
+
+    bool Get(std::string *value)
+    {
+        uint32_t length;
+        if (_record.length() - _offset < sizeof(length)) {
+            return false;
+        }
+
+        memcpy(&length, _record.data() + _offset, sizeof(length));
+        _offset += sizeof(length);
+        if (_record.length() - _offset < length) {
+            return false;
+        }
+
+        value->assign(_record, _offset, length);
+        _offset += length;
+        return true;
+    }
+
+    bool Done() const
+    {
+        return _offset == _record.length();
+    }
+
+private:
+    const std::string &_record;
+    size_t _offset;
+
+}; // class RecordReader
+
+inline void record_put(std::string *record, int64_t value)
+{
+    record->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+inline void record_put(std::string *record, const std::string &value)
+{
+    const uint32_t length = static_cast<uint32_t>(value.length());
+    record->append(reinterpret_cast<const char *>(&length), sizeof(length));
+    record->append(value);
+}
+
+#endif // SMS_SERVER_RECORD_H
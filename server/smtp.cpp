@@ -2,21 +2,30 @@
 
 #include <string.h>
 
+#include <algorithm>
+
 #define CURL_STRICTER
 #include <curl/curl.h>
 
 #include <flinter/types/tree.h>
 #include <flinter/types/uuid.h>
-#include <flinter/encode.h>
 #include <flinter/logger.h>
 
+#include "sms/server/civil.h"
+#include "sms/server/codec.h"
 #include "sms/server/configure.h"
 
 SMTP::SMTP() : _curl(nullptr)
              , _tlist(nullptr)
              , _dlist(nullptr)
-             , _email(nullptr)
+             , _body(nullptr)
              , _uploaded(0)
+             , _encoded(0)
+             , _line()
+             , _lineLength(0)
+             , _lineOffset(0)
+             , _idle(0)
+             , _warm(false)
 {
     // Intended left blank
 }
@@ -26,7 +35,7 @@ SMTP::~SMTP()
     Disconnect();
 }
 
-bool SMTP::Connect(const std::string &to)
+bool SMTP::Connect()
 {
     if (_curl) {
         return true;
@@ -41,17 +50,12 @@ bool SMTP::Connect(const std::string &to)
     const std::string &url      = c["url"];
     const long kConnectTimeout  = c["connect_timeout"].as<long>(5);
     const long kTimeout         = c["timeout"].as<long>(5);
-
-    curl_slist *tlist = curl_slist_append(nullptr, to.c_str());
-    if (!tlist) {
-        return false;
-    }
+    const long kIdleTimeout     = c["idle_timeout"].as<long>(60);
 
     curl_slist *dlist = nullptr;
     if (!resolve.empty()) {
         dlist = curl_slist_append(nullptr, resolve.c_str());
         if (!dlist) {
-            curl_slist_free_all(tlist);
             return false;
         }
     }
@@ -59,7 +63,6 @@ bool SMTP::Connect(const std::string &to)
     CURL *curl = curl_easy_init();
     if (!curl) {
         curl_slist_free_all(dlist);
-        curl_slist_free_all(tlist);
         return false;
     }
 
@@ -71,21 +74,21 @@ bool SMTP::Connect(const std::string &to)
         curl_easy_setopt(curl, CURLOPT_READFUNCTION, ReadFunction)      ||
         curl_easy_setopt(curl, CURLOPT_READDATA, this)                  ||
         curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L)                      ||
+#if LIBCURL_VERSION_NUM >= 0x074100
+        curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, kIdleTimeout)       ||
+#endif
 #ifndef NDEBUG
         curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L)                     ||
 #endif
-        curl_easy_setopt(curl, CURLOPT_MAIL_FROM, from.c_str())         ||
-        curl_easy_setopt(curl, CURLOPT_MAIL_RCPT, tlist)                ){
+        curl_easy_setopt(curl, CURLOPT_MAIL_FROM, from.c_str())         ){
 
         curl_slist_free_all(dlist);
-        curl_slist_free_all(tlist);
         curl_easy_cleanup(curl);
         return false;
     }
 
     if (dlist && curl_easy_setopt(curl, CURLOPT_RESOLVE, dlist)) {
         curl_slist_free_all(dlist);
-        curl_slist_free_all(tlist);
         curl_easy_cleanup(curl);
         return false;
     }
@@ -97,15 +100,15 @@ bool SMTP::Connect(const std::string &to)
             curl_easy_setopt(curl, CURLOPT_CAINFO, cainfo.c_str())      ){
 
             curl_slist_free_all(dlist);
-            curl_slist_free_all(tlist);
             curl_easy_cleanup(curl);
             return false;
         }
     }
 
+    _idle = std::chrono::seconds(kIdleTimeout);
     _dlist = dlist;
-    _tlist = tlist;
     _curl = curl;
+    _warm = false;
     return true;
 }
 
@@ -115,17 +118,68 @@ void SMTP::Disconnect()
         return;
     }
 
+    // Sends QUIT over the cached connection if there's one
+    curl_easy_cleanup(_curl);
+    _curl = nullptr;
+
     curl_slist_free_all(_dlist);
     _dlist = nullptr;
 
     curl_slist_free_all(_tlist);
     _tlist = nullptr;
 
-    curl_easy_cleanup(_curl);
-    _curl = nullptr;
+    _warm = false;
 }
 
-std::string SMTP::date(time_t when, long tz)
+void SMTP::Expire()
+{
+    if (!_curl) {
+        return;
+    }
+
+    if (std::chrono::steady_clock::now() - _last >= _idle) {
+        CLOG.Trace("SMTP: closing idle session");
+        Disconnect();
+    }
+}
+
+bool SMTP::Perform(const std::string &to)
+{
+    if (!Connect()) {
+        return false;
+    }
+
+    curl_slist *tlist = curl_slist_append(nullptr, to.c_str());
+    if (!tlist) {
+        return false;
+    }
+
+    if (curl_easy_setopt(_curl, CURLOPT_MAIL_RCPT, tlist)) {
+        curl_slist_free_all(tlist);
+        return false;
+    }
+
+    curl_slist_free_all(_tlist);
+    _tlist = tlist;
+
+    _uploaded = 0;
+    _encoded = 0;
+    _lineLength = 0;
+    _lineOffset = 0;
+    CURLcode ret = curl_easy_perform(_curl);
+
+    _last = std::chrono::steady_clock::now();
+    if (ret) {
+        CLOG.Warn("curl_easy_perform() = %d: %s", ret, curl_easy_strerror(ret));
+        Disconnect();
+        return false;
+    }
+
+    _warm = true;
+    return true;
+}
+
+std::string SMTP::date(time_t when)
 {
     static const char *W[] = {
             "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
@@ -136,20 +190,51 @@ std::string SMTP::date(time_t when, long tz)
     };
 
     char buffer[64];
-    struct tm tm;
-    const time_t t = when - tz;
-    const long atz = tz < 0 ? -tz : tz;
-    gmtime_r(&t, &tm);
-
-    snprintf(buffer, sizeof(buffer), "%s, %d %s %d %02d:%02d:%02d %c%02ld%02ld",
-            W[tm.tm_wday], tm.tm_mday, M[tm.tm_mon], tm.tm_year + 1900,
-            tm.tm_hour, tm.tm_min, tm.tm_sec,
-            tz < 0 ? '+' : '-',
+    const civil::Time t = civil::to_local(when);
+    const long atz = t.offset < 0 ? -t.offset : t.offset;
+
+    snprintf(buffer, sizeof(buffer), "%s, %d %s %ld %02d:%02d:%02d %c%02ld%02ld",
+            W[t.weekday], t.day, M[t.month - 1], static_cast<long>(t.year),
+            t.hour, t.minute, t.second,
+            t.offset < 0 ? '-' : '+',
             atz / 3600, atz % 3600 / 60);
 
     return buffer;
 }
 
+void SMTP::Prepare(
+        const std::string &to,
+        const std::string &receiver,
+        const std::string &body,
+        const std::string &content_type,
+        time_t when)
+{
+    const flinter::Tree &c = (*g_configure)["smtp"];
+    const std::string &from = c["from"];
+    const std::string &domain = from.substr(from.find('@') + 1);
+
+    // Reused across mails, keeps its capacity
+    _header.clear();
+    _header.append("MIME-Version: 1.0\r\n");
+    _header.append("Message-ID: <").append(flinter::Uuid::CreateRandom().str())
+           .append("@").append(domain).append(">\r\n");
+    _header.append("Date: ").append(date(when)).append("\r\n");
+    _header.append("From: ").append(c["sender"].value())
+           .append(" <").append(from).append(">\r\n");
+    _header.append("To: ").append(receiver)
+           .append(" <").append(to).append(">\r\n");
+    _header.append("Subject: ").append(c["subject"].value()).append("\r\n");
+    _header.append("Content-Type: ").append(content_type).append("\r\n");
+    _header.append("Content-Transfer-Encoding: base64\r\n");
+    _header.append("\r\n");
+
+    _body = &body;
+    _uploaded = 0;
+    _encoded = 0;
+    _lineLength = 0;
+    _lineOffset = 0;
+}
+
 bool SMTP::Send(
         const std::string &to,
         const std::string &receiver,
@@ -161,49 +246,35 @@ bool SMTP::Send(
         when = time(nullptr);
     }
 
-    std::string base64;
-    if (flinter::EncodeBase64(body, &base64)) {
-        return false;
-    }
+    Prepare(to, receiver, body, content_type, when);
+    bool result = true;
 
-    const flinter::Tree &c = (*g_configure)["smtp"];
-    const std::string &from = c["from"];
-    const std::string &domain = from.substr(from.find('@') + 1);
+    if ((*g_configure)["smtp"]["disabled"].as<int>()) {
+        std::string email;
+        char buffer[4096];
+        while (size_t length = read(buffer, 1, sizeof(buffer))) {
+            email.append(buffer, length);
+        }
 
-    std::ostringstream s;
-    s << "MIME-Version: 1.0\r\n";
-    s << "Message-ID: <" << flinter::Uuid::CreateRandom().str() << "@" << domain << ">\r\n";
-    s << "Date: " << date(when, timezone) << "\r\n";
-    s << "From: " << c["sender"] << " <" << from << ">\r\n";
-    s << "To: " << receiver << " <" << to << ">\r\n";
-    s << "Subject: " << c["subject"] << "\r\n";
-    s << "Content-Type: " << content_type << "\r\n";
-    s << "Content-Transfer-Encoding: base64\r\n";
-    s << "\r\n";
-    s << base64;
-
-    const std::string &email = s.str();
-
-    if (c["disabled"].as<int>()) {
         printf("=== SMTP ===\n%s\n=== SMTP ===\n", email.c_str());
 
     } else {
-        if (!Connect(to)) {
-            return false;
+        if (_curl && std::chrono::steady_clock::now() - _last >= _idle) {
+            Disconnect();
         }
 
-        _uploaded = 0;
-        _email = &email;
-        CURLcode ret = curl_easy_perform(_curl);
-        _email = nullptr;
-
-        Disconnect();
-        if (ret) {
-            CLOG.Warn("curl_easy_perform() = %d", ret);
+        // A warm session might have been dropped by the server silently,
+        // give it another chance over a fresh connection.
+        const bool warm = _warm;
+        result = Perform(to);
+        if (!result && warm) {
+            CLOG.Trace("SMTP: reconnecting for %s", to.c_str());
+            result = Perform(to);
         }
     }
 
-    return true;
+    _body = nullptr;
+    return result;
 }
 
 size_t SMTP::ReadFunction(
@@ -215,15 +286,45 @@ size_t SMTP::ReadFunction(
 
 size_t SMTP::read(char *buffer, size_t size, size_t nitems)
 {
+    // 76 characters per line
+    constexpr size_t kLine = 57;
+
     const size_t max = size * nitems;
-    const size_t total = _email->length();
-    const size_t remaining = total - _uploaded;
-    const size_t now = std::min(max, remaining);
+    size_t now = 0;
 
-    if (now) {
-        memcpy(buffer, _email->data() + _uploaded, now);
+    if (_uploaded < _header.length()) {
+        now = std::min(max, _header.length() - _uploaded);
+        memcpy(buffer, _header.data() + _uploaded, now);
         _uploaded += now;
     }
 
+    while (now < max) {
+        if (_lineOffset == _lineLength) {
+            const size_t total = _body->length();
+            if (_encoded == total) {
+                break;
+            }
+
+            const size_t length = std::min(kLine, total - _encoded);
+            const unsigned char *in = reinterpret_cast<const unsigned char *>(
+                    _body->data() + _encoded);
+
+            char *out = _line;
+            codec::EncodeBase64(in, length, out);
+            out += codec::base64_length(length);
+            *out++ = '\r';
+            *out++ = '\n';
+
+            _encoded += length;
+            _lineLength = static_cast<size_t>(out - _line);
+            _lineOffset = 0;
+        }
+
+        const size_t n = std::min(max - now, _lineLength - _lineOffset);
+        memcpy(buffer + now, _line + _lineOffset, n);
+        _lineOffset += n;
+        now += n;
+    }
+
     return now;
 }
@@ -1,6 +1,7 @@
 #ifndef SMS_SERVER_SMTP_H
 #define SMS_SERVER_SMTP_H
 
+#include <chrono>
 #include <string>
 
 struct Curl_easy;
@@ -17,11 +18,23 @@ public:
               const std::string &content_type,
               time_t when = -1);
 
+    // Close the session if it has been idle for too long.
+    void Expire();
+
 protected:
     void Disconnect();
-    bool Connect(const std::string &to);
-
-    static std::string date(time_t when, long tz);
+    bool Connect();
+    bool Perform(const std::string &to);
+
+    // Builds the header and points at `body`, read() gives the whole mail
+    // afterwards.
+    void Prepare(const std::string &to,
+                 const std::string &receiver,
+                 const std::string &body,
+                 const std::string &content_type,
+                 time_t when);
+
+    static std::string date(time_t when);
     size_t read(char *buffer, size_t size, size_t nitems);
     static size_t ReadFunction(
             char *buffer, size_t size, size_t nitems, void *userdata);
@@ -31,8 +44,19 @@ private:
     struct curl_slist *_tlist;
     struct curl_slist *_dlist;
 
-    const std::string *_email;
+    // Headers are sent as is, body is base64 encoded line by line as
+    // curl asks for more.
+    std::string _header;
+    const std::string *_body;
     size_t _uploaded;
+    size_t _encoded;
+    char _line[80];
+    size_t _lineLength;
+    size_t _lineOffset;
+
+    std::chrono::steady_clock::time_point _last;
+    std::chrono::seconds _idle;
+    bool _warm;
 
 }; // class SMTP
 
@@ -5,12 +5,6 @@
 
 #include "sms/server/configure.h"
 
-template <class T>
-inline bool is_mms(const T &t)
-{
-    return !!t->TPUserDataHeader.GetApplicationPortAddressingScheme();
-}
-
 bool Splitter::FindDevice(int device, bool *has_smsc)
 {
     const flinter::Tree &c = (*g_configure)["device"];
@@ -35,43 +29,51 @@ bool Splitter::Add(const db::PDU &db)
     }
 
     const bool sending = (db.type == "Outgoing");
-    pdu::PDU pdu(db.pdu, sending, has_smsc);
-    if (pdu.result() != pdu::Result::OK) {
+    pdu_message_t m;
+    if (pdu_decode(db.pdu.data(), db.pdu.length(), sending, has_smsc, &m,
+                   nullptr) != PDU_OK) {
+
         return false;
     }
 
-    if (pdu.type() == pdu::Type::Deliver) {
-        Deliver d;
-        d._pdu = pdu.deliver();
-        if (is_mms(d._pdu)) {
-            return true;
-        }
+    // MMS notifications
+    pdu_application_port_addressing_scheme_t port;
+    if (pdu_get_application_port_addressing_scheme(&m.TPUserDataHeader,
+                                                   &port)) {
+        return true;
+    }
+
+    char text[PDU_MAXIMUM_TEXT];
+    size_t length;
+    if (pdu_decode_text(&m, text, &length) != PDU_OK) {
+        return false;
+    }
 
+    if (m.type == PDU_DELIVER) {
+        Deliver d;
         d._db = db;
-        d._c = d._pdu->TPUserDataHeader.GetConcatenatedShortMessages();
-        if (!(d._c)) {
+        d._peer = m.TPAddress;
+        d._text.assign(text, length);
+        d._sent = m.TPServiceCentreTimeStamp;
+        if (!pdu_get_concatenated_short_messages(&m.TPUserDataHeader, &d._c)) {
             Finish({d}, {});
             return true;
         }
 
-        _delivers[d._c->ReferenceNumber].push_back(d);
+        _delivers[d._c.ReferenceNumber].push_back(d);
         return true;
 
-    } else if (pdu.type() == pdu::Type::Submit) {
+    } else if (m.type == PDU_SUBMIT) {
         Submit s;
-        s._pdu = pdu.submit();
-        if (is_mms(s._pdu)) {
-            return true;
-        }
-
         s._db = db;
-        s._c = s._pdu->TPUserDataHeader.GetConcatenatedShortMessages();
-        if (!s._c) {
+        s._peer = m.TPAddress;
+        s._text.assign(text, length);
+        if (!pdu_get_concatenated_short_messages(&m.TPUserDataHeader, &s._c)) {
             Finish({s}, {});
             return true;
         }
 
-        _submits[s._c->ReferenceNumber].push_back(s);
+        _submits[s._c.ReferenceNumber].push_back(s);
         return true;
     }
 
@@ -97,11 +99,10 @@ void Splitter::Split(std::list<Deliver> *input)
         auto t = p++;
         bool found = false;
         for (auto &&q : output) {
-            const time_t diff = t->_pdu->TPServiceCentreTimeStamp
-                              - q.front()._pdu->TPServiceCentreTimeStamp;
+            const time_t diff = t->_sent - q.front()._sent;
 
-            if (t->_pdu->TPOriginatingAddress == q.front()._pdu->TPOriginatingAddress &&
-                diff >= -kMaximumSending && diff <= kMaximumSending                   ){
+            if (t->_peer == q.front()._peer                         &&
+                diff >= -kMaximumSending && diff <= kMaximumSending ){
 
                 q.splice(q.end(), *input, t);
                 found = true;
@@ -117,8 +118,8 @@ void Splitter::Split(std::list<Deliver> *input)
 
     for (auto &&one : output) {
         one.sort([] (const Deliver &a, const Deliver &b) -> bool {
-            return a._c->Sequence < b._c->Sequence ||
-                   (a._c->Sequence == b._c->Sequence &&
+            return a._c.Sequence < b._c.Sequence ||
+                   (a._c.Sequence == b._c.Sequence &&
                     a._db.timestamp < b._db.timestamp);
         });
 
@@ -128,8 +129,8 @@ void Splitter::Split(std::list<Deliver> *input)
                 break;
             }
 
-            if (q->_c->Sequence == p->_c->Sequence         ||
-                q->_pdu->TPUserData != p->_pdu->TPUserData ){
+            if (q->_c.Sequence == p->_c.Sequence ||
+                q->_text != p->_text             ){
 
                 continue;
             }
@@ -138,7 +139,7 @@ void Splitter::Split(std::list<Deliver> *input)
             p = q;
         }
 
-        if (one.size() != one.front()._c->Maximum) {
+        if (one.size() != one.front()._c.Maximum) {
             input->splice(input->end(), one);
             continue;
         }
@@ -147,7 +148,7 @@ void Splitter::Split(std::list<Deliver> *input)
         for (std::list<Deliver>::const_iterator
              q = one.begin(); q != one.end(); ++q, ++expected) {
 
-            if (q->_c->Sequence != expected) {
+            if (q->_c.Sequence != expected) {
                 input->splice(input->end(), one);
                 break;
             }
@@ -164,19 +165,19 @@ void Splitter::Finish(
     auto p = delivers.begin();
     const int device = p->_db.device;
     const std::string type = p->_db.type;
-    const std::string peer = p->_pdu->TPOriginatingAddress;
+    const std::string peer = p->_peer;
 
     Done done;
     done._pdus.push_back(p->_db);
     int64_t received = p->_db.timestamp;
-    std::string body = p->_pdu->TPUserData;
-    time_t sent = p->_pdu->TPServiceCentreTimeStamp;
+    std::string body = p->_text;
+    time_t sent = p->_sent;
 
     for (++p; p != delivers.end(); ++p) {
         done._pdus.push_back(p->_db);
-        body.append(p->_pdu->TPUserData);
+        body.append(p->_text);
         received = std::max(received, p->_db.timestamp);
-        sent = std::min(sent, p->_pdu->TPServiceCentreTimeStamp);
+        sent = std::min(sent, p->_sent);
     }
 
     for (auto &&d : duplicates) {
@@ -200,16 +201,16 @@ void Splitter::Finish(
     auto p = submits.begin();
     const int device = p->_db.device;
     const std::string type = p->_db.type;
-    const std::string peer = p->_pdu->TPDestinationAddress;
+    const std::string peer = p->_peer;
 
     Done done;
     done._pdus.push_back(p->_db);
     int64_t received = p->_db.timestamp;
-    std::string body = p->_pdu->TPUserData;
+    std::string body = p->_text;
 
     for (++p; p != submits.end(); ++p) {
         done._pdus.push_back(p->_db);
-        body.append(p->_pdu->TPUserData);
+        body.append(p->_text);
         received = std::max(received, p->_db.timestamp);
     }
 
@@ -2,11 +2,11 @@
 #define SMS_SERVER_SPLITTER_H
 
 #include <list>
-#include <memory>
+#include <string>
 #include <unordered_map>
 
+#include "sms/libpdu/pdu.h"
 #include "sms/server/db.h"
-#include "sms/server/pdu.h"
 
 class Splitter {
 public:
@@ -31,15 +31,18 @@ private:
     class Deliver {
     public:
         db::PDU _db;
-        std::shared_ptr<const pdu::Deliver> _pdu;
-        std::shared_ptr<const pdu::ConcatenatedShortMessages> _c;
+        std::string _peer;
+        std::string _text;
+        time_t _sent;
+        pdu_concatenated_short_messages_t _c;
     }; // class Deliver
 
     class Submit {
     public:
         db::PDU _db;
-        std::shared_ptr<const pdu::Submit> _pdu;
-        std::shared_ptr<const pdu::ConcatenatedShortMessages> _c;
+        std::string _peer;
+        std::string _text;
+        pdu_concatenated_short_messages_t _c;
     }; // class Submit
 
     class Done {
@@ -0,0 +1,49 @@
+#include "sms/server/template.h"
+
+#include <algorithm>
+
+#include <flinter/logger.h>
+
+bool Template::Compile(
+        const std::string &text,
+        const std::vector<std::string> &names)
+{
+    _text.clear();
+    _segments.clear();
+
+    size_t from = 0;
+    while (true) {
+        Segment s;
+        s._offset = _text.length();
+        s._field = -1;
+
+        const size_t open = text.find("{{", from);
+        if (open == std::string::npos) {
+            _text.append(text, from, std::string::npos);
+            s._length = _text.length() - s._offset;
+            _segments.push_back(s);
+            break;
+        }
+
+        const size_t close = text.find("}}", open + 2);
+        if (close == std::string::npos) {
+            CLOG.Error("Template: unterminated placeholder at %lu", open);
+            return false;
+        }
+
+        const std::string name = text.substr(open + 2, close - open - 2);
+        const auto p = std::find(names.begin(), names.end(), name);
+        if (p == names.end()) {
+            CLOG.Error("Template: unknown placeholder {{%s}}", name.c_str());
+            return false;
+        }
+
+        _text.append(text, from, open - from);
+        s._length = _text.length() - s._offset;
+        s._field = static_cast<int>(p - names.begin());
+        _segments.push_back(s);
+        from = close + 2;
+    }
+
+    return true;
+}
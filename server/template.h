@@ -0,0 +1,45 @@
+#ifndef SMS_SERVER_TEMPLATE_H
+#define SMS_SERVER_TEMPLATE_H
+
+#include <string>
+#include <vector>
+
+// Text with {{name}} placeholders, compiled once so that rendering is
+// nothing but appending to the output.
+class Template {
+public:
+    // Placeholders must be one of `names`, they're passed by index.
+    bool Compile(const std::string &text, const std::vector<std::string> &names);
+
+    // `f(index, out)` appends the value of the placeholder.
+    template <class F>
+    void Render(std::string *out, F &&f) const
+    {
+        for (auto &&s : _segments) {
+            out->append(_text, s._offset, s._length);
+            if (s._field >= 0) {
+                f(s._field, out);
+            }
+        }
+    }
+
+    // Bytes of literal text, a hint for reserving output.
+    size_t size() const
+    {
+        return _text.length();
+    }
+
+private:
+    class Segment {
+    public:
+        size_t _offset;
+        size_t _length;
+        int _field; // -1 if none after the literal
+    }; // class Segment
+
+    std::string _text;
+    std::vector<Segment> _segments;
+
+}; // class Template
+
+#endif // SMS_SERVER_TEMPLATE_H